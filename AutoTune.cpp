@@ -544,6 +544,13 @@ void ParameterSpace::set_index_parameter (
             return;
         }
     }
+    if (name == "adaptive_nprobe_ratio") {
+        if (DC (IndexIVF)) {
+            ix->adaptive_nprobe = true;
+            ix->adaptive_nprobe_ratio = val;
+            return;
+        }
+    }
 
     if (name == "efSearch") {
         if (DC (IndexHNSW)) {
@@ -167,9 +167,9 @@ size_t DirectMap::remove_ids(const IDSelector& sel, InvertedLists *invlists)
 #pragma omp parallel for
         for (idx_t i = 0; i < nlist; i++) {
             idx_t l0 = invlists->list_size (i), l = l0, j = 0;
-            ScopedIds idsi (invlists, i);
             while (j < l) {
-                if (sel.is_member (idsi[j])) {
+                // get_ids may return a copy that is not updated
+                if (sel.is_member (invlists->get_single_id (i, j))) {
                     l--;
                     invlists->update_entry (
                         i, j,
@@ -14,6 +14,7 @@
 #include <faiss/utils/extra_distances.h>
 #include <faiss/utils/utils.h>
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/hugepages.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/AuxIndexStructures.h>
 
@@ -28,17 +29,44 @@ IndexFlat::IndexFlat (idx_t d, MetricType metric):
 
 
 void IndexFlat::add (idx_t n, const float *x) {
+    hugepage_reserve (xb, (ntotal + n) * d);
     xb.insert(xb.end(), x, x + n * d);
+    if (metric_type == METRIC_L2 && norms.size() == ntotal) {
+        norms.resize (ntotal + n);
+        fvec_norms_L2sqr (norms.data() + ntotal, x, d, n);
+    }
     ntotal += n;
 }
 
 
 void IndexFlat::reset() {
     xb.clear();
+    norms.clear();
     ntotal = 0;
 }
 
 
+void IndexFlat::update_norms ()
+{
+    if (metric_type == METRIC_L2) {
+        norms.resize (ntotal);
+        fvec_norms_L2sqr (norms.data(), xb.data(), d, ntotal);
+    } else {
+        norms.clear();
+    }
+}
+
+const float * IndexFlat::get_norms () const
+{
+    // the norms are out of sync if vectors were added to xb directly.
+    // An in-place overwrite cannot be detected, see update_norms
+    if (metric_type == METRIC_L2 && norms.size() == ntotal) {
+        return norms.data();
+    }
+    return nullptr;
+}
+
+
 void IndexFlat::search (idx_t n, const float *x, idx_t k,
                                float *distances, idx_t *labels) const
 {
@@ -51,7 +79,7 @@ void IndexFlat::search (idx_t n, const float *x, idx_t k,
     } else if (metric_type == METRIC_L2) {
         float_maxheap_array_t res = {
             size_t(n), size_t(k), labels, distances};
-        knn_L2sqr (x, xb.data(), d, n, ntotal, &res);
+        knn_L2sqr (x, xb.data(), d, n, ntotal, &res, get_norms());
     } else {
         float_maxheap_array_t res = {
             size_t(n), size_t(k), labels, distances};
@@ -70,7 +98,8 @@ void IndexFlat::range_search (idx_t n, const float *x, float radius,
                                     radius, result);
         break;
     case METRIC_L2:
-        range_search_L2sqr (x, xb.data(), d, n, ntotal, radius, result);
+        range_search_L2sqr (x, xb.data(), d, n, ntotal, radius, result,
+                            get_norms());
         break;
     default:
         FAISS_THROW_MSG("metric type not supported");
@@ -104,6 +133,7 @@ void IndexFlat::compute_distance_subset (
 
 size_t IndexFlat::remove_ids (const IDSelector & sel)
 {
+    bool has_norms = get_norms() != nullptr;
     idx_t j = 0;
     for (idx_t i = 0; i < ntotal; i++) {
         if (sel.is_member (i)) {
@@ -111,6 +141,9 @@ size_t IndexFlat::remove_ids (const IDSelector & sel)
         } else {
             if (i > j) {
                 memmove (&xb[d * j], &xb[d * i], sizeof(xb[0]) * d);
+                if (has_norms) {
+                    norms[j] = norms[i];
+                }
             }
             j++;
         }
@@ -119,6 +152,9 @@ size_t IndexFlat::remove_ids (const IDSelector & sel)
     if (nremove > 0) {
         ntotal = j;
         xb.resize (ntotal * d);
+        if (has_norms) {
+            norms.resize (ntotal);
+        }
     }
     return nremove;
 }
@@ -130,17 +166,27 @@ size_t IndexFlat::remove_id(idx_t i)
         return 0;
     }
 
+    bool has_norms = get_norms() != nullptr;
     if(i < j) {
         memmove (&xb[d * i], &xb[d * j], sizeof(xb[0]) * d);
+        if (has_norms) {
+            norms[i] = norms[j];
+        }
     }
     ntotal -= 1;
     xb.resize(ntotal * d);
+    if (has_norms) {
+        norms.resize(ntotal);
+    }
     return 1;
 }
 
 void IndexFlat::update(idx_t key, const float *data)
 {
     memcpy (&(xb[key * d]), data, sizeof(*data) * d);
+    if (get_norms()) {
+        norms[key] = fvec_norm_L2sqr (data, d);
+    }
 }
 
 namespace {
@@ -266,7 +312,8 @@ void IndexFlatL2BaseShift::search (
 
     float_maxheap_array_t res = {
         size_t(n), size_t(k), labels, distances};
-    knn_L2sqr_base_shift (x, xb.data(), d, n, ntotal, &res, shift.data());
+    knn_L2sqr_base_shift (x, xb.data(), d, n, ntotal, &res, shift.data(),
+                          get_norms());
 }
 
 
@@ -20,9 +20,21 @@ namespace faiss {
 /** Index that stores the full vectors and performs exhaustive search */
 struct IndexFlat: Index {
 
-    /// database vectors, size ntotal * d
+    /** database vectors, size ntotal * d
+     *
+     * WARNING: with METRIC_L2 the search uses the cached norms below.
+     * They are only detected as stale when the size of xb changes, so
+     * update_norms() must be called after the vectors are overwritten
+     * in place (eg. with copy_array_to_vector from Python), otherwise
+     * the L2 distances are wrong.
+     */
     std::vector<float> xb;
 
+    /// squared L2 norms of the database vectors, size ntotal. Only
+    /// maintained for METRIC_L2, where the search uses them instead of
+    /// recomputing them at each call. Not stored in the index files.
+    std::vector<float> norms;
+
     explicit IndexFlat (idx_t d, MetricType metric = METRIC_L2);
 
     void add(idx_t n, const float* x) override;
@@ -71,6 +83,13 @@ struct IndexFlat: Index {
 
     void update(idx_t i, const float* data) override ;
 
+    /// recompute the norms from xb, to be called after xb was filled
+    /// in or modified directly
+    void update_norms ();
+
+    /// norms to pass to the distance functions, nullptr if not available
+    const float *get_norms () const;
+
     IndexFlat () {}
 
     DistanceComputer * get_distance_computer() const override;
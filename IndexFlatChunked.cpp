@@ -0,0 +1,345 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexFlatChunked.h>
+
+#include <cstring>
+#include <memory>
+
+#include <faiss/utils/distances.h>
+#include <faiss/utils/ChunkArena.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+
+namespace faiss {
+
+IndexFlatChunked::IndexFlatChunked (idx_t d, MetricType metric,
+                                    size_t chunk_size, bool use_hugepages):
+    Index (d, metric), chunk_size (chunk_size),
+    use_hugepages (use_hugepages), arena (nullptr)
+{
+    FAISS_THROW_IF_NOT_MSG (
+        metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT,
+        "metric type not supported");
+    FAISS_THROW_IF_NOT (chunk_size > 0);
+}
+
+IndexFlatChunked::IndexFlatChunked ():
+    chunk_size (32768), use_hugepages (false), arena (nullptr)
+{
+}
+
+
+size_t IndexFlatChunked::chunk_ntotal (size_t c) const
+{
+    return std::min (chunk_size, ntotal - c * chunk_size);
+}
+
+
+void IndexFlatChunked::add (idx_t n, const float *x)
+{
+    if (!arena) {
+        arena = new ChunkArena (
+            chunk_size * (d + 1) * sizeof(float), use_hugepages);
+    }
+    idx_t i = 0;
+    while (i < n) {
+        size_t c = ntotal / chunk_size, j = ntotal % chunk_size;
+        if (c == chunks.size()) {
+            chunks.push_back ((float*)arena->alloc_chunk ());
+        }
+        size_t nc = std::min (chunk_size - j, size_t(n - i));
+        memcpy (chunks[c] + j * d, x + i * d, sizeof(float) * nc * d);
+        if (metric_type == METRIC_L2) {
+            fvec_norms_L2sqr (chunks[c] + chunk_size * d + j,
+                              x + i * d, d, nc);
+        }
+        i += nc;
+        ntotal += nc;
+    }
+}
+
+
+void IndexFlatChunked::reset ()
+{
+    chunks.clear ();
+    // give the memory back to the system
+    delete arena;
+    arena = nullptr;
+    ntotal = 0;
+}
+
+
+namespace {
+
+/* merge the sorted results of a chunk (D1, I1) into the sorted
+ * results (D0, I0), for nx queries */
+template <class C>
+void merge_chunk_results (size_t nx, size_t k,
+                          float *D0, Index::idx_t *I0,
+                          const float *D1, const Index::idx_t *I1,
+                          Index::idx_t translation)
+{
+#pragma omp parallel if (nx > 1)
+    {
+        std::vector<float> tmpD (k);
+        std::vector<Index::idx_t> tmpI (k);
+
+#pragma omp for
+        for (size_t i = 0; i < nx; i++) {
+            float *lD0 = D0 + i * k;
+            Index::idx_t *lI0 = I0 + i * k;
+            const float *lD1 = D1 + i * k;
+            const Index::idx_t *lI1 = I1 + i * k;
+            size_t r0 = 0, r1 = 0;
+            for (size_t j = 0; j < k; j++) {
+                // on ties, the smallest ids come first
+                if (lI1[r1] < 0 ||
+                    (lI0[r0] >= 0 && !C::cmp (lD0[r0], lD1[r1]))) {
+                    tmpD[j] = lD0[r0];
+                    tmpI[j] = lI0[r0];
+                    r0++;
+                } else {
+                    tmpD[j] = lD1[r1];
+                    tmpI[j] = lI1[r1] + translation;
+                    r1++;
+                }
+            }
+            memcpy (lD0, tmpD.data(), sizeof(float) * k);
+            memcpy (lI0, tmpI.data(), sizeof(Index::idx_t) * k);
+        }
+    }
+}
+
+void knn_chunk (const float *x, const float *y, size_t d,
+                size_t nx, size_t ny, float_minheap_array_t *res,
+                const float *)
+{
+    knn_inner_product (x, y, d, nx, ny, res);
+}
+
+void knn_chunk (const float *x, const float *y, size_t d,
+                size_t nx, size_t ny, float_maxheap_array_t *res,
+                const float *y_norms)
+{
+    knn_L2sqr (x, y, d, nx, ny, res, y_norms);
+}
+
+template <class C>
+void search_chunks (const IndexFlatChunked & index, size_t n, const float *x,
+                    size_t k, float *distances, Index::idx_t *labels)
+{
+    HeapArray<C> res = {n, k, labels, distances};
+    if (index.chunks.size() == 0) {
+        res.heapify ();
+        res.reorder ();
+        return;
+    }
+    std::vector<float> D1;
+    std::vector<Index::idx_t> I1;
+    for (size_t c = 0; c < index.chunks.size(); c++) {
+        if (c == 1) {
+            D1.resize (n * k);
+            I1.resize (n * k);
+        }
+        HeapArray<C> resc = {n, k,
+                             c == 0 ? labels : I1.data(),
+                             c == 0 ? distances : D1.data()};
+        knn_chunk (x, index.chunks[c], index.d, n, index.chunk_ntotal (c),
+                   &resc, index.get_chunk_norms (c));
+        if (c > 0) {
+            merge_chunk_results<C> (
+                n, k, distances, labels, D1.data(), I1.data(),
+                c * index.chunk_size);
+        }
+    }
+}
+
+}  // namespace
+
+
+void IndexFlatChunked::search (idx_t n, const float *x, idx_t k,
+                               float *distances, idx_t *labels) const
+{
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        search_chunks<CMin<float, idx_t> > (
+            *this, n, x, k, distances, labels);
+    } else if (metric_type == METRIC_L2) {
+        search_chunks<CMax<float, idx_t> > (
+            *this, n, x, k, distances, labels);
+    } else {
+        FAISS_THROW_MSG ("metric type not supported");
+    }
+}
+
+
+void IndexFlatChunked::range_search (idx_t n, const float *x, float radius,
+                                     RangeSearchResult *result) const
+{
+    FAISS_THROW_IF_NOT_MSG (
+        metric_type == METRIC_L2 || metric_type == METRIC_INNER_PRODUCT,
+        "metric type not supported");
+
+    auto search_chunk = [&] (size_t c, RangeSearchResult *res) {
+        size_t nc = chunk_ntotal (c);
+        if (metric_type == METRIC_INNER_PRODUCT) {
+            range_search_inner_product (x, chunks[c], d, n, nc,
+                                        radius, res);
+        } else {
+            range_search_L2sqr (x, chunks[c], d, n, nc, radius, res,
+                                get_chunk_norms (c));
+        }
+    };
+
+    if (chunks.size() == 1) {
+        search_chunk (0, result);
+        return;
+    }
+
+    // search the chunks separately and concatenate the results
+    std::vector<std::unique_ptr<RangeSearchResult> > chunk_res;
+    for (size_t c = 0; c < chunks.size(); c++) {
+        chunk_res.emplace_back (new RangeSearchResult (n));
+        search_chunk (c, chunk_res.back().get());
+    }
+
+    for (idx_t i = 0; i < n; i++) {
+        result->lims[i] = 0;
+        for (const auto & rc : chunk_res) {
+            result->lims[i] += rc->lims[i + 1] - rc->lims[i];
+        }
+    }
+    result->do_allocation ();
+
+    for (idx_t i = 0; i < n; i++) {
+        size_t ofs = result->lims[i];
+        for (size_t c = 0; c < chunks.size(); c++) {
+            const RangeSearchResult & rc = *chunk_res[c];
+            for (size_t j = rc.lims[i]; j < rc.lims[i + 1]; j++) {
+                result->labels[ofs] = rc.labels[j] + c * chunk_size;
+                result->distances[ofs] = rc.distances[j];
+                ofs++;
+            }
+        }
+    }
+}
+
+
+void IndexFlatChunked::reconstruct (idx_t key, float *recons) const
+{
+    memcpy (recons, get_vector (key), sizeof(*recons) * d);
+}
+
+
+size_t IndexFlatChunked::remove_ids (const IDSelector & sel)
+{
+    idx_t j = 0;
+    for (idx_t i = 0; i < ntotal; i++) {
+        if (sel.is_member (i)) {
+            // should be removed
+        } else {
+            if (i > j) {
+                float *xj = chunks[j / chunk_size] + (j % chunk_size) * d;
+                memmove (xj, get_vector (i), sizeof(float) * d);
+                if (metric_type == METRIC_L2) {
+                    chunks[j / chunk_size][chunk_size * d + j % chunk_size] =
+                        get_chunk_norms (i / chunk_size)[i % chunk_size];
+                }
+            }
+            j++;
+        }
+    }
+    size_t nremove = ntotal - j;
+    if (nremove > 0) {
+        ntotal = j;
+        size_t nchunk = (ntotal + chunk_size - 1) / chunk_size;
+        while (chunks.size() > nchunk) {
+            arena->free_chunk ((uint8_t*)chunks.back ());
+            chunks.pop_back ();
+        }
+    }
+    return nremove;
+}
+
+
+namespace {
+
+template <MetricType metric>
+struct FlatChunkedDis : DistanceComputer {
+    const IndexFlatChunked & storage;
+    size_t d;
+    const float *q;
+    size_t ndis;
+
+    float operator () (idx_t i) override {
+        ndis++;
+        return dis (q, storage.get_vector (i));
+    }
+
+    float symmetric_dis (idx_t i, idx_t j) override {
+        return dis (storage.get_vector (j), storage.get_vector (i));
+    }
+
+    float dis (const float *x, const float *y) const {
+        if (metric == METRIC_INNER_PRODUCT) {
+            return fvec_inner_product (x, y, d);
+        } else {
+            return fvec_L2sqr (x, y, d);
+        }
+    }
+
+    explicit FlatChunkedDis (const IndexFlatChunked & storage):
+        storage (storage), d (storage.d), q (nullptr), ndis (0)
+    {}
+
+    void set_query (const float *x) override {
+        q = x;
+    }
+};
+
+}  // namespace
+
+
+DistanceComputer * IndexFlatChunked::get_distance_computer () const
+{
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        return new FlatChunkedDis<METRIC_INNER_PRODUCT> (*this);
+    }
+    return new FlatChunkedDis<METRIC_L2> (*this);
+}
+
+
+/* The standalone codec interface */
+size_t IndexFlatChunked::sa_code_size () const
+{
+    return sizeof(float) * d;
+}
+
+void IndexFlatChunked::sa_encode (idx_t n, const float *x,
+                                  uint8_t *bytes) const
+{
+    memcpy (bytes, x, sizeof(float) * d * n);
+}
+
+void IndexFlatChunked::sa_decode (idx_t n, const uint8_t *bytes,
+                                  float *x) const
+{
+    memcpy (x, bytes, sizeof(float) * d * n);
+}
+
+
+IndexFlatChunked::~IndexFlatChunked ()
+{
+    delete arena;
+}
+
+
+} // namespace faiss
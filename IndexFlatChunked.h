@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef INDEX_FLAT_CHUNKED_H
+#define INDEX_FLAT_CHUNKED_H
+
+#include <vector>
+
+#include <faiss/Index.h>
+
+
+namespace faiss {
+
+struct ChunkArena;
+
+/** Same search results as an IndexFlat, but the vectors are stored in
+ * fixed-size chunks allocated from a ChunkArena instead of a
+ * contiguous array. Adding vectors never moves the existing ones, so
+ * the index can grow to the size of the RAM without the memory peak
+ * and the copy of the reallocations of IndexFlat::xb.
+ *
+ * The search is performed chunk by chunk. Only METRIC_L2 and
+ * METRIC_INNER_PRODUCT are supported.
+ */
+struct IndexFlatChunked: Index {
+
+    /// nb of vectors per chunk
+    size_t chunk_size;
+
+    /// back the chunks with transparent huge pages, see ChunkArena
+    bool use_hugepages;
+
+    /// each chunk holds chunk_size vectors followed by their squared
+    /// L2 norms (METRIC_L2 only)
+    std::vector<float *> chunks;
+
+    /// allocator of the chunks, owned by the index
+    ChunkArena *arena;
+
+    explicit IndexFlatChunked (idx_t d, MetricType metric = METRIC_L2,
+                               size_t chunk_size = 32768,
+                               bool use_hugepages = false);
+
+    IndexFlatChunked ();
+
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+
+    void search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels) const override;
+
+    void range_search(
+        idx_t n,
+        const float* x,
+        float radius,
+        RangeSearchResult* result) const override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    /** remove some ids. The new ids are shifted, as in
+     * IndexFlat::remove_ids */
+    size_t remove_ids(const IDSelector& sel) override;
+
+    DistanceComputer * get_distance_computer() const override;
+
+    /// nb of vectors in chunk c
+    size_t chunk_ntotal (size_t c) const;
+
+    /// vector i of the index
+    const float *get_vector (idx_t i) const {
+        return chunks[i / chunk_size] + (i % chunk_size) * d;
+    }
+
+    /// squared L2 norms of the vectors of chunk c
+    const float *get_chunk_norms (size_t c) const {
+        return chunks[c] + chunk_size * d;
+    }
+
+    /* The standalone codec interface (just memcopies in this case) */
+    size_t sa_code_size () const override;
+
+    void sa_encode (idx_t n, const float *x,
+                          uint8_t *bytes) const override;
+
+    void sa_decode (idx_t n, const uint8_t *bytes,
+                            float *x) const override;
+
+    ~IndexFlatChunked () override;
+
+    IndexFlatChunked (const IndexFlatChunked &) = delete;
+    void operator = (const IndexFlatChunked &) = delete;
+};
+
+
+}
+
+#endif
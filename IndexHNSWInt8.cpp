@@ -0,0 +1,326 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexHNSWInt8.h>
+
+
+#include <memory>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <omp.h>
+
+#include <faiss/utils/random.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+namespace faiss {
+
+
+/**************************************************************
+ * add / search blocks of descriptors
+ **************************************************************/
+
+namespace {
+
+
+void hnsw_add_vertices(IndexHNSWInt8& index_hnsw,
+                       size_t n0,
+                       size_t n, const int8_t *x,
+                       bool verbose,
+                       bool preset_levels = false) {
+  HNSW& hnsw = index_hnsw.hnsw;
+  size_t ntotal = n0 + n;
+  double t0 = getmillisecs();
+  if (verbose) {
+    printf("hnsw_add_vertices: adding %ld elements on top of %ld "
+           "(preset_levels=%d)\n",
+           n, n0, int(preset_levels));
+  }
+
+  int max_level = hnsw.prepare_level_tab(n, preset_levels);
+
+  if (verbose) {
+    printf("  max_level = %d\n", max_level);
+  }
+
+  std::vector<omp_lock_t> locks(ntotal);
+  for(int i = 0; i < ntotal; i++) {
+    omp_init_lock(&locks[i]);
+  }
+
+  // add vectors from highest to lowest level
+  std::vector<int> hist;
+  std::vector<int> order(n);
+
+  { // make buckets with vectors of the same level
+
+    // build histogram
+    for (int i = 0; i < n; i++) {
+      HNSW::storage_idx_t pt_id = i + n0;
+      int pt_level = hnsw.levels[pt_id] - 1;
+      while (pt_level >= hist.size()) {
+        hist.push_back(0);
+      }
+      hist[pt_level] ++;
+    }
+
+    // accumulate
+    std::vector<int> offsets(hist.size() + 1, 0);
+    for (int i = 0; i < hist.size() - 1; i++) {
+      offsets[i + 1] = offsets[i] + hist[i];
+    }
+
+    // bucket sort
+    for (int i = 0; i < n; i++) {
+      HNSW::storage_idx_t pt_id = i + n0;
+      int pt_level = hnsw.levels[pt_id] - 1;
+      order[offsets[pt_level]++] = pt_id;
+    }
+  }
+
+  { // perform add
+    RandomGenerator rng2(789);
+
+    int i1 = n;
+
+    for (int pt_level = hist.size() - 1; pt_level >= 0; pt_level--) {
+      int i0 = i1 - hist[pt_level];
+
+      if (verbose) {
+        printf("Adding %d elements at level %d\n",
+               i1 - i0, pt_level);
+      }
+
+      // random permutation to get rid of dataset order bias
+      for (int j = i0; j < i1; j++) {
+        std::swap(order[j], order[j + rng2.rand_int(i1 - j)]);
+      }
+
+#pragma omp parallel
+      {
+        VisitedTable vt (ntotal);
+
+        std::unique_ptr<DistanceComputer> dis(
+          index_hnsw.get_distance_computer()
+        );
+        int prev_display = verbose && omp_get_thread_num() == 0 ? 0 : -1;
+
+#pragma omp  for schedule(dynamic)
+        for (int i = i0; i < i1; i++) {
+          HNSW::storage_idx_t pt_id = order[i];
+          dis->set_query((float *)(x + (pt_id - n0) * index_hnsw.d));
+
+          hnsw.add_with_locks(*dis, pt_level, pt_id, locks, vt);
+
+          if (prev_display >= 0 && i - i0 > prev_display + 10000) {
+            prev_display = i - i0;
+            printf("  %d / %d\r", i - i0, i1 - i0);
+            fflush(stdout);
+          }
+        }
+      }
+      i1 = i0;
+    }
+    FAISS_ASSERT(i1 == 0);
+  }
+  if (verbose) {
+    printf("Done in %.3f ms\n", getmillisecs() - t0);
+  }
+
+  for(int i = 0; i < ntotal; i++)
+    omp_destroy_lock(&locks[i]);
+}
+
+
+} // anonymous namespace
+
+
+/**************************************************************
+ * IndexHNSWInt8 implementation
+ **************************************************************/
+
+IndexHNSWInt8::IndexHNSWInt8()
+{
+  is_trained = true;
+}
+
+IndexHNSWInt8::IndexHNSWInt8(int d, int M, MetricType metric)
+    : IndexInt8(d, metric),
+      hnsw(M),
+      own_fields(true),
+      storage(new IndexInt8Flat(d, metric))
+{
+  is_trained = true;
+}
+
+IndexHNSWInt8::IndexHNSWInt8(IndexInt8 *storage, int M)
+    : IndexInt8(storage->d, storage->metric_type),
+      hnsw(M),
+      own_fields(false),
+      storage(storage)
+{
+  is_trained = true;
+}
+
+IndexHNSWInt8::~IndexHNSWInt8() {
+  if (own_fields) {
+    delete storage;
+  }
+}
+
+void IndexHNSWInt8::train(idx_t n, const int8_t *x)
+{
+  // hnsw structure does not require training
+  storage->train(n, x);
+  is_trained = true;
+}
+
+void IndexHNSWInt8::search(idx_t n, const int8_t *x, idx_t k,
+                           int32_t *distances, idx_t *labels) const
+{
+#pragma omp parallel
+  {
+    VisitedTable vt(ntotal);
+    std::unique_ptr<DistanceComputer> dis(get_distance_computer());
+
+#pragma omp for
+    for(idx_t i = 0; i < n; i++) {
+      idx_t *idxi = labels + i * k;
+      float *simi = (float *)(distances + i * k);
+
+      dis->set_query((float *)(x + i * d));
+
+      maxheap_heapify(k, simi, idxi);
+      hnsw.search(*dis, k, idxi, simi, vt);
+      maxheap_reorder(k, simi, idxi);
+    }
+  }
+
+  // the graph is searched with float distances, which are not exact
+  // above 2^24 (eg. L2 with d > 258). The distances of the results are
+  // recomputed with the integer kernels, and the results re-sorted
+  IndexInt8Flat *flat_storage = dynamic_cast<IndexInt8Flat *>(storage);
+  FAISS_ASSERT(flat_storage != nullptr);
+  flat_storage->compute_distance_subset(n, x, k, distances, labels);
+
+  bool is_ip = metric_type == METRIC_INNER_PRODUCT;
+#pragma omp parallel for
+  for (idx_t i = 0; i < n; i++) {
+    int32_t *disi = distances + i * k;
+    idx_t *idxi = labels + i * k;
+    for (idx_t j = 0; j < k; j++) {
+      if (idxi[j] < 0) {
+        disi[j] = is_ip ? CMin<int32_t, idx_t>::neutral() :
+            CMax<int32_t, idx_t>::neutral();
+      }
+    }
+    if (is_ip) {
+      heap_heapify<CMin<int32_t, idx_t> >(k, disi, idxi, disi, idxi, k);
+      heap_reorder<CMin<int32_t, idx_t> >(k, disi, idxi);
+    } else {
+      heap_heapify<CMax<int32_t, idx_t> >(k, disi, idxi, disi, idxi, k);
+      heap_reorder<CMax<int32_t, idx_t> >(k, disi, idxi);
+    }
+  }
+}
+
+
+void IndexHNSWInt8::add(idx_t n, const int8_t *x)
+{
+  FAISS_THROW_IF_NOT(is_trained);
+  int n0 = ntotal;
+  storage->add(n, x);
+  ntotal = storage->ntotal;
+
+  hnsw_add_vertices(*this, n0, n, x, verbose,
+                    hnsw.levels.size() == ntotal);
+}
+
+void IndexHNSWInt8::reset()
+{
+  hnsw.reset();
+  storage->reset();
+  ntotal = 0;
+}
+
+void IndexHNSWInt8::reconstruct(idx_t key, int8_t *recons) const
+{
+  storage->reconstruct(key, recons);
+}
+
+
+namespace {
+
+
+/* HNSW minimizes the distance, so the inner product is negated */
+template<MetricType metric>
+struct FlatInt8Dis : DistanceComputer {
+  const size_t d;
+  const int8_t *b;
+  const int8_t *q;
+  size_t ndis;
+
+  static float dis(const int8_t *x, const int8_t *y, size_t d) {
+    return metric == METRIC_INNER_PRODUCT ?
+        -i8vec_inner_product(x, y, d) : i8vec_L2sqr(x, y, d);
+  }
+
+  float operator () (idx_t i) override {
+    ndis++;
+    return dis(q, b + i * d, d);
+  }
+
+  float symmetric_dis(idx_t i, idx_t j) override {
+    return dis(b + j * d, b + i * d, d);
+  }
+
+
+  explicit FlatInt8Dis(const IndexInt8Flat& storage)
+      : d(storage.d),
+        b(storage.get_xb()),
+        q(nullptr),
+        ndis(0) {}
+
+  // NOTE: Pointers are cast from float in order to reuse the floating-point
+  //   DistanceComputer.
+  void set_query(const float *x) override {
+    q = (const int8_t *)x;
+  }
+
+  ~FlatInt8Dis() override {
+#pragma omp critical
+    {
+      hnsw_stats.ndis += ndis;
+    }
+  }
+};
+
+
+}  // namespace
+
+
+DistanceComputer *IndexHNSWInt8::get_distance_computer() const {
+  IndexInt8Flat *flat_storage = dynamic_cast<IndexInt8Flat *>(storage);
+
+  FAISS_ASSERT(flat_storage != nullptr);
+  if (metric_type == METRIC_INNER_PRODUCT) {
+    return new FlatInt8Dis<METRIC_INNER_PRODUCT>(*flat_storage);
+  } else if (metric_type == METRIC_L2) {
+    return new FlatInt8Dis<METRIC_L2>(*flat_storage);
+  }
+  FAISS_THROW_MSG("metric type not supported");
+}
+
+
+} // namespace faiss
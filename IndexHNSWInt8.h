@@ -0,0 +1,61 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <faiss/impl/HNSW.h>
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/utils/utils.h>
+
+
+namespace faiss {
+
+
+/** The HNSW index over int8 vectors. The storage is an IndexInt8Flat
+ * and the distances are computed with integer inner products on the
+ * int8 queries (no conversion to float). */
+
+struct IndexHNSWInt8 : IndexInt8 {
+  typedef HNSW::storage_idx_t storage_idx_t;
+
+  // the link strcuture
+  HNSW hnsw;
+
+  // the sequential storage
+  bool own_fields;
+  IndexInt8 *storage;
+
+  explicit IndexHNSWInt8();
+  explicit IndexHNSWInt8(int d, int M = 32,
+                         MetricType metric = METRIC_INNER_PRODUCT);
+  explicit IndexHNSWInt8(IndexInt8 *storage, int M = 32);
+
+  ~IndexHNSWInt8() override;
+
+  /** The returned DistanceComputer expects the query as an int8_t
+   * pointer cast to float *. It returns the negated inner product so
+   * that smaller is better, as HNSW expects. */
+  DistanceComputer *get_distance_computer() const;
+
+  void add(idx_t n, const int8_t *x) override;
+
+  /// Trains the storage if needed
+  void train(idx_t n, const int8_t* x) override;
+
+  /// entry point for search
+  void search(idx_t n, const int8_t *x, idx_t k,
+              int32_t *distances, idx_t *labels) const override;
+
+  void reconstruct(idx_t key, int8_t* recons) const override;
+
+  void reset() override;
+};
+
+
+}  // namespace faiss
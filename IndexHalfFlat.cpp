@@ -0,0 +1,216 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexHalfFlat.h>
+
+#include <cstring>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/hugepages.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+
+namespace faiss {
+
+IndexHalfFlat::IndexHalfFlat (idx_t d, HalfType half_type, MetricType metric):
+    Index (d, metric), half_type (half_type)
+{
+    FAISS_THROW_IF_NOT_MSG (
+        metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT,
+        "metric type not supported");
+}
+
+IndexHalfFlat::IndexHalfFlat (): half_type (HALF_FP16)
+{
+}
+
+
+void IndexHalfFlat::add (idx_t n, const float *x)
+{
+    hugepage_reserve (codes, (ntotal + n) * d);
+    codes.resize ((ntotal + n) * d);
+    half_encode (half_type, x, codes.data() + ntotal * d, n * d);
+    if (metric_type == METRIC_L2 && norms.size() == ntotal) {
+        norms.resize (ntotal + n);
+        hvec_norms_L2sqr (half_type, norms.data() + ntotal,
+                          codes.data() + ntotal * d, d, n);
+    }
+    ntotal += n;
+}
+
+
+void IndexHalfFlat::reset ()
+{
+    codes.clear ();
+    norms.clear ();
+    ntotal = 0;
+}
+
+
+void IndexHalfFlat::update_norms ()
+{
+    if (metric_type == METRIC_L2) {
+        norms.resize (ntotal);
+        hvec_norms_L2sqr (half_type, norms.data(), codes.data(), d, ntotal);
+    } else {
+        norms.clear ();
+    }
+}
+
+const float * IndexHalfFlat::get_norms () const
+{
+    if (metric_type == METRIC_L2 && norms.size() == ntotal) {
+        return norms.data();
+    }
+    return nullptr;
+}
+
+
+void IndexHalfFlat::search (idx_t n, const float *x, idx_t k,
+                            float *distances, idx_t *labels) const
+{
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        float_minheap_array_t res = {
+            size_t(n), size_t(k), labels, distances};
+        knn_inner_product (x, codes.data(), half_type, d, n, ntotal, &res);
+    } else if (metric_type == METRIC_L2) {
+        float_maxheap_array_t res = {
+            size_t(n), size_t(k), labels, distances};
+        knn_L2sqr (x, codes.data(), half_type, d, n, ntotal, &res,
+                   get_norms());
+    } else {
+        FAISS_THROW_MSG ("metric type not supported");
+    }
+}
+
+void IndexHalfFlat::range_search (idx_t n, const float *x, float radius,
+                                  RangeSearchResult *result) const
+{
+    switch (metric_type) {
+    case METRIC_INNER_PRODUCT:
+        range_search_inner_product (x, codes.data(), half_type, d, n, ntotal,
+                                    radius, result);
+        break;
+    case METRIC_L2:
+        range_search_L2sqr (x, codes.data(), half_type, d, n, ntotal,
+                            radius, result, get_norms());
+        break;
+    default:
+        FAISS_THROW_MSG ("metric type not supported");
+    }
+}
+
+
+void IndexHalfFlat::reconstruct (idx_t key, float *recons) const
+{
+    half_decode (half_type, codes.data() + key * d, recons, d);
+}
+
+
+size_t IndexHalfFlat::remove_ids (const IDSelector & sel)
+{
+    bool has_norms = get_norms() != nullptr;
+    idx_t j = 0;
+    for (idx_t i = 0; i < ntotal; i++) {
+        if (sel.is_member (i)) {
+            // should be removed
+        } else {
+            if (i > j) {
+                memmove (&codes[d * j], &codes[d * i], sizeof(codes[0]) * d);
+                if (has_norms) {
+                    norms[j] = norms[i];
+                }
+            }
+            j++;
+        }
+    }
+    size_t nremove = ntotal - j;
+    if (nremove > 0) {
+        ntotal = j;
+        codes.resize (ntotal * d);
+        if (has_norms) {
+            norms.resize (ntotal);
+        }
+    }
+    return nremove;
+}
+
+
+namespace {
+
+template <MetricType metric>
+struct HalfFlatDis : DistanceComputer {
+    size_t d;
+    HalfType type;
+    const float *q;
+    const uint16_t *b;
+    size_t ndis;
+    std::vector<float> tmp;
+
+    float operator () (idx_t i) override {
+        ndis++;
+        return dis (q, i);
+    }
+
+    float symmetric_dis (idx_t i, idx_t j) override {
+        half_decode (type, b + i * d, tmp.data(), d);
+        return dis (tmp.data(), j);
+    }
+
+    float dis (const float *x, idx_t i) const {
+        float res;
+        if (metric == METRIC_INNER_PRODUCT) {
+            hvec_inner_products_ny (type, &res, x, b + i * d, d, 1);
+        } else {
+            hvec_L2sqr_ny (type, &res, x, b + i * d, d, 1);
+        }
+        return res;
+    }
+
+    explicit HalfFlatDis (const IndexHalfFlat & storage):
+        d (storage.d), type (storage.half_type), q (nullptr),
+        b (storage.codes.data()), ndis (0), tmp (storage.d)
+    {}
+
+    void set_query (const float *x) override {
+        q = x;
+    }
+};
+
+}  // namespace
+
+
+DistanceComputer * IndexHalfFlat::get_distance_computer () const
+{
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        return new HalfFlatDis<METRIC_INNER_PRODUCT> (*this);
+    }
+    return new HalfFlatDis<METRIC_L2> (*this);
+}
+
+
+/* The standalone codec interface */
+size_t IndexHalfFlat::sa_code_size () const
+{
+    return sizeof(uint16_t) * d;
+}
+
+void IndexHalfFlat::sa_encode (idx_t n, const float *x, uint8_t *bytes) const
+{
+    half_encode (half_type, x, (uint16_t*)bytes, n * d);
+}
+
+void IndexHalfFlat::sa_decode (idx_t n, const uint8_t *bytes, float *x) const
+{
+    half_decode (half_type, (const uint16_t*)bytes, x, n * d);
+}
+
+
+} // namespace faiss
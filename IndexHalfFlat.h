@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef INDEX_HALF_FLAT_H
+#define INDEX_HALF_FLAT_H
+
+#include <vector>
+
+#include <faiss/Index.h>
+#include <faiss/utils/half.h>
+
+
+namespace faiss {
+
+/** Exhaustive search on vectors stored in 16-bit floating point (fp16
+ * or bf16), ie. half the memory and bandwidth of an IndexFlat. The
+ * queries stay in float and the stored components are converted in
+ * the distance kernels, so the results are those of an IndexFlat on
+ * the rounded vectors.
+ *
+ * Only METRIC_L2 and METRIC_INNER_PRODUCT are supported.
+ */
+struct IndexHalfFlat: Index {
+
+    HalfType half_type;
+
+    /// database vectors, size ntotal * d
+    std::vector<uint16_t> codes;
+
+    /// squared L2 norms of the rounded database vectors, size ntotal.
+    /// Only maintained for METRIC_L2, not stored in the index files.
+    std::vector<float> norms;
+
+    explicit IndexHalfFlat (idx_t d, HalfType half_type = HALF_FP16,
+                            MetricType metric = METRIC_L2);
+
+    IndexHalfFlat ();
+
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+
+    void search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels) const override;
+
+    void range_search(
+        idx_t n,
+        const float* x,
+        float radius,
+        RangeSearchResult* result) const override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    /** remove some ids. The new ids are shifted, as in
+     * IndexFlat::remove_ids */
+    size_t remove_ids(const IDSelector& sel) override;
+
+    /// recompute the norms from codes, to be called after codes was
+    /// filled in directly
+    void update_norms ();
+
+    /// norms to pass to the distance functions, nullptr if not available
+    const float *get_norms () const;
+
+    DistanceComputer * get_distance_computer() const override;
+
+    /* The standalone codec interface */
+    size_t sa_code_size () const override;
+
+    void sa_encode (idx_t n, const float *x,
+                          uint8_t *bytes) const override;
+
+    void sa_decode (idx_t n, const uint8_t *bytes,
+                            float *x) const override;
+
+};
+
+
+}
+
+#endif
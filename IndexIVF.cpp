@@ -13,10 +13,17 @@
 #include <omp.h>
 
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
 
 #include <faiss/utils/utils.h>
 #include <faiss/utils/hamming.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/partitioning.h>
+#include <faiss/utils/ThreadPool.h>
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/IndexFlat.h>
@@ -157,6 +164,8 @@ IndexIVF::IndexIVF (Index * quantizer, size_t d,
     code_size (code_size),
     nprobe (1),
     max_codes (0),
+    adaptive_nprobe (false),
+    adaptive_nprobe_ratio (0),
     parallel_mode (0)
 {
     FAISS_THROW_IF_NOT (d == quantizer->d);
@@ -171,7 +180,9 @@ IndexIVF::IndexIVF (Index * quantizer, size_t d,
 IndexIVF::IndexIVF ():
     invlists (nullptr), own_invlists (false),
     code_size (0),
-    nprobe (1), max_codes (0), parallel_mode (0)
+    nprobe (1), max_codes (0),
+    adaptive_nprobe (false), adaptive_nprobe_ratio (0),
+    parallel_mode (0)
 {}
 
 void IndexIVF::add (idx_t n, const float * x)
@@ -180,68 +191,162 @@ void IndexIVF::add (idx_t n, const float * x)
 }
 
 
-void IndexIVF::add_with_ids (idx_t n, const float * x, const idx_t *xids)
+namespace {
+
+/// a block of vectors to add, assigned and encoded
+struct IVFAddBlock {
+    typedef Index::idx_t idx_t;
+    idx_t i0, n;
+    std::vector<idx_t> list_nos;
+    std::vector<uint8_t> codes;
+
+    void prepare (const IndexIVF & ivf, idx_t i0_in, idx_t n_in,
+                  const float *x) {
+        i0 = i0_in;
+        n = n_in;
+        list_nos.resize (n);
+        codes.resize (n * ivf.code_size);
+        ivf.quantizer->assign (n, x + i0 * ivf.d, list_nos.data());
+        ivf.encode_vectors (n, x + i0 * ivf.d, list_nos.data(), codes.data());
+    }
+};
+
+/** Adds a block to the inverted lists: the entries are grouped by list
+ * with a counting sort, then each list is extended once, in parallel
+ * over the lists. The sequential ids start at id0.
+ *
+ * @return nb of vectors added (not assigned to -1)
+ */
+size_t add_block_bucketed (IndexIVF & ivf, Index::idx_t n,
+                           const Index::idx_t *list_nos,
+                           const uint8_t *codes,
+                           const Index::idx_t *xids, Index::idx_t id0)
 {
-    // do some blocking to avoid excessive allocs
-    idx_t bs = 65536;
-    if (n > bs) {
-        for (idx_t i0 = 0; i0 < n; i0 += bs) {
-            idx_t i1 = std::min (n, i0 + bs);
-            if (verbose) {
-                printf("   IndexIVF::add_with_ids %ld:%ld\n", i0, i1);
-            }
-            add_with_ids (i1 - i0, x + i0 * d,
-                          xids ? xids + i0 : nullptr);
+    typedef Index::idx_t idx_t;
+    size_t code_size = ivf.code_size;
+    size_t nlist = ivf.nlist;
+
+    // list_ofs[l] is the offset of list l in the sorted entries
+    std::vector<size_t> list_ofs (nlist + 1);
+    for (idx_t i = 0; i < n; i++) {
+        if (list_nos[i] >= 0) {
+            list_ofs[list_nos[i] + 1]++;
         }
-        return;
     }
+    std::vector<idx_t> lists;
+    for (size_t l = 0; l < nlist; l++) {
+        if (list_ofs[l + 1] > 0) {
+            lists.push_back (l);
+        }
+        list_ofs[l + 1] += list_ofs[l];
+    }
+    size_t nadd = list_ofs[nlist];
 
-    FAISS_THROW_IF_NOT (is_trained);
-    direct_map.check_can_add (xids);
+    // stable, so that the entries of a list are in the order of the input
+    std::vector<idx_t> order (nadd);
+    {
+        std::vector<size_t> next (list_ofs.begin(), list_ofs.end() - 1);
+        for (idx_t i = 0; i < n; i++) {
+            if (list_nos[i] >= 0) {
+                order[next[list_nos[i]]++] = i;
+            }
+        }
+    }
 
-    std::unique_ptr<idx_t []> idx(new idx_t[n]);
-    quantizer->assign (n, x, idx.get());
-    size_t nadd = 0, nminus1 = 0;
+    std::vector<idx_t> sorted_ids (nadd);
+    std::vector<uint8_t> sorted_codes (nadd * code_size);
+    DirectMapAdd dm_adder (ivf.direct_map, n, xids);
+
+    parallel_for (0, lists.size(), [&] (size_t li) {
+        idx_t list_no = lists[li];
+        size_t j0 = list_ofs[list_no], j1 = list_ofs[list_no + 1];
+        for (size_t j = j0; j < j1; j++) {
+            idx_t i = order[j];
+            sorted_ids[j] = xids ? xids[i] : id0 + i;
+            memcpy (sorted_codes.data() + j * code_size,
+                    codes + i * code_size, code_size);
+        }
+        size_t ofs = ivf.invlists->add_entries (
+             list_no, j1 - j0, sorted_ids.data() + j0,
+             sorted_codes.data() + j0 * code_size);
+        for (size_t j = j0; j < j1; j++) {
+            dm_adder.add (order[j], list_no, ofs + j - j0);
+        }
+    });
 
-    for (size_t i = 0; i < n; i++) {
-        if (idx[i] < 0) nminus1++;
+    for (idx_t i = 0; i < n; i++) {
+        if (list_nos[i] < 0) {
+            dm_adder.add (i, -1, 0);
+        }
     }
+    return nadd;
+}
 
-    std::unique_ptr<uint8_t []> flat_codes(new uint8_t [n * code_size]);
-    encode_vectors (n, x, idx.get(), flat_codes.get());
+/// blocks of the add functions, to avoid excessive allocs
+const Index::idx_t add_bs = 65536;
 
-    DirectMapAdd dm_adder(direct_map, n, xids);
+} // anonymous namespace
 
-#pragma omp parallel reduction(+: nadd)
-    {
-        int nt = omp_get_num_threads();
-        int rank = omp_get_thread_num();
 
-        // each thread takes care of a subset of lists
-        for (size_t i = 0; i < n; i++) {
-            idx_t list_no = idx [i];
-            if (list_no >= 0 && list_no % nt == rank) {
-                idx_t id = xids ? xids[i] : ntotal + i;
-                size_t ofs = invlists->add_entry (
-                     list_no, id,
-                     flat_codes.get() + i * code_size
-                );
+void IndexIVF::add_with_ids (idx_t n, const float * x, const idx_t *xids)
+{
+    FAISS_THROW_IF_NOT (is_trained);
+    direct_map.check_can_add (xids);
 
-                dm_adder.add (i, list_no, ofs);
+    // The vectors are added by blocks. The assignment and encoding of a
+    // block is done while the previous one is added to the inverted
+    // lists.
+    idx_t bs = add_bs;
+    idx_t ntotal0 = ntotal;
+    size_t nadd = 0;
 
-                nadd++;
-            } else if (rank == 0 && list_no == -1) {
-                dm_adder.add (i, -1, 0);
-            }
-        }
+    IVFAddBlock cur, next;
+    if (n > 0) {
+        cur.prepare (*this, 0, std::min (n, bs), x);
     }
 
+    for (idx_t i0 = 0; i0 < n; i0 += bs) {
+        idx_t i1 = std::min (n, i0 + bs);
+        if (verbose && n > bs) {
+            printf("   IndexIVF::add_with_ids %ld:%ld\n", i0, i1);
+        }
+
+        // task 0 adds the current block, task 1 prepares the next one
+        WorkRange tasks (0, i1 < n ? 2 : 1);
+        get_thread_pool().parallel (2, [&] (int) {
+            size_t t, te;
+            while (tasks.next (t, te)) {
+                if (t == 0) {
+                    nadd += add_codes_bucketed (
+                         cur.n, cur.list_nos.data(), cur.codes.data(),
+                         xids ? xids + cur.i0 : nullptr);
+                } else {
+                    next.prepare (*this, i1, std::min (n, i1 + bs) - i1, x);
+                }
+            }
+        });
+
+        ntotal = ntotal0 + i1;
+        std::swap (cur, next);
+    }
 
     if (verbose) {
-        printf("    added %ld / %ld vectors (%ld -1s)\n", nadd, n, nminus1);
+        printf("    added %ld / %ld vectors (%ld -1s)\n",
+               nadd, n, n - nadd);
     }
+}
 
-    ntotal += n;
+size_t IndexIVF::add_codes_bucketed (idx_t n, const idx_t *list_nos,
+                                     const uint8_t *codes, const idx_t *xids)
+{
+    size_t nadd = 0;
+    for (idx_t i0 = 0; i0 < n; i0 += add_bs) {
+        idx_t i1 = std::min (n, i0 + add_bs);
+        nadd += add_block_bucketed (
+             *this, i1 - i0, list_nos + i0, codes + i0 * code_size,
+             xids ? xids + i0 : nullptr, ntotal + i0);
+    }
+    return nadd;
 }
 
 void IndexIVF::make_direct_map (bool b)
@@ -279,6 +384,501 @@ void IndexIVF::search (idx_t n, const float *x, idx_t k,
 
 
 
+namespace {
+
+/* List-major search (parallel_mode 3): the (query, list) pairs of a
+ * batch of queries are grouped by list, and each list is scanned once
+ * for all the queries that probe it. The list is scanned by pieces of
+ * list_major_piece_bytes, and each piece is compared with a block of
+ * list_major_query_block queries, whose scanners (with their distance
+ * tables) stay in cache. Each thread collects the results in its own
+ * heaps for the queries of the batch, the heaps of the threads are
+ * merged at the end of the batch. */
+
+const size_t list_major_query_block = 16;
+const size_t list_major_piece_bytes = 64 * 1024;
+
+template <class C>
+void search_preassigned_list_major (
+        const IndexIVF & ivf, Index::idx_t n, const float *x,
+        Index::idx_t k, const Index::idx_t *keys, const float *coarse_dis,
+        float *distances, Index::idx_t *labels, bool store_pairs,
+        size_t nprobe, bool do_heap_init)
+{
+    using idx_t = Index::idx_t;
+    const InvertedLists *invlists = ivf.invlists;
+    size_t nlist = ivf.nlist, code_size = ivf.code_size;
+    size_t qbs = list_major_query_block;
+    size_t piece_size = std::max (
+          list_major_piece_bytes / std::max (code_size, size_t(1)),
+          size_t(1));
+    size_t segment_size = invlists->segment_size ();
+
+    ThreadPool & pool = get_thread_pool ();
+    int nt = std::min (get_parallelism_budget (), pool.nworker () + 1);
+    nt = std::max (nt, 1);
+
+    size_t bs = ivf_list_major_heap_bytes /
+        (nt * std::max (k, idx_t(1)) * (sizeof(float) + sizeof(idx_t)));
+    bs = std::min (std::max (bs, qbs), size_t(n));
+
+    struct RankState {
+        std::vector<std::unique_ptr<InvertedListScanner> > scanners;
+        std::vector<float> dis;
+        std::vector<idx_t> ids;
+        idx_t batch_q0 = -1;   // the heaps are for the batch at batch_q0
+        size_t nlistv = 0, ndis = 0, nheap = 0;
+    };
+    std::vector<RankState> states (nt);
+
+    std::vector<size_t> lims (nlist + 1);
+    std::vector<idx_t> pair_q;
+    std::vector<float> pair_dis;
+    std::vector<idx_t> lists;
+
+    for (idx_t q0 = 0; q0 < n; q0 += bs) {
+        idx_t q1 = std::min (q0 + idx_t(bs), n);
+
+        // group the (query, list) pairs of the batch by list
+        std::fill (lims.begin(), lims.end(), 0);
+        for (size_t i = q0 * nprobe; i < q1 * nprobe; i++) {
+            idx_t key = keys[i];
+            if (key < 0) continue;
+            FAISS_THROW_IF_NOT_FMT (key < (idx_t) nlist,
+                                    "Invalid key=%ld nlist=%ld\n",
+                                    key, nlist);
+            lims[key + 1]++;
+        }
+        for (size_t l = 0; l < nlist; l++) {
+            lims[l + 1] += lims[l];
+        }
+        pair_q.resize (lims[nlist]);
+        pair_dis.resize (lims[nlist]);
+        {
+            std::vector<size_t> ofs (lims.begin(), lims.end() - 1);
+            for (size_t i = q0 * nprobe; i < q1 * nprobe; i++) {
+                idx_t key = keys[i];
+                if (key < 0) continue;
+                size_t o = ofs[key]++;
+                pair_q[o] = i / nprobe;
+                pair_dis[o] = coarse_dis[i];
+            }
+        }
+
+        // the lists with the most work first
+        lists.clear ();
+        for (size_t l = 0; l < nlist; l++) {
+            if (lims[l + 1] > lims[l] && invlists->list_size (l) > 0) {
+                lists.push_back (l);
+            }
+        }
+        std::vector<size_t> work (nlist);
+        for (idx_t l : lists) {
+            work[l] = (lims[l + 1] - lims[l]) * invlists->list_size (l);
+        }
+        std::sort (lists.begin(), lists.end(), [&] (idx_t a, idx_t b) {
+            return work[a] > work[b];
+        });
+
+        WorkRange range (0, lists.size());
+
+        pool.parallel (nt, [&] (int rank) {
+            RankState & st = states[rank];
+            while (st.scanners.size() < qbs) {
+                st.scanners.emplace_back (
+                     ivf.get_InvertedListScanner (store_pairs));
+            }
+            size_t nb = q1 - q0;
+            st.dis.resize (nb * k);
+            st.ids.resize (nb * k);
+            for (size_t i = 0; i < nb; i++) {
+                heap_heapify<C> (k, st.dis.data() + i * k,
+                                 st.ids.data() + i * k);
+            }
+            st.batch_q0 = q0;
+
+            struct Piece {
+                size_t n;
+                const uint8_t *codes;
+                const idx_t *ids;
+            };
+            std::vector<Piece> pieces;
+
+            size_t li, le;
+            while (range.next (li, le)) {
+                idx_t key = lists[li];
+                size_t list_size = invlists->list_size (key);
+
+                // pieces of the list, scanned in place
+                pieces.clear ();
+                std::unique_ptr<ScopedCodes> scodes;
+                std::unique_ptr<ScopedIds> sids;
+                if (segment_size > 0 && !store_pairs) {
+                    for (size_t j0 = 0; j0 < list_size; j0 += segment_size) {
+                        const uint8_t *codes;
+                        const idx_t *ids;
+                        invlists->get_segment (key, j0 / segment_size,
+                                               &codes, &ids);
+                        size_t m = std::min (segment_size, list_size - j0);
+                        for (size_t p0 = 0; p0 < m; p0 += piece_size) {
+                            pieces.push_back (Piece {
+                                std::min (piece_size, m - p0),
+                                codes + p0 * code_size, ids + p0});
+                        }
+                    }
+                } else {
+                    scodes.reset (new ScopedCodes (invlists, key));
+                    if (store_pairs) {
+                        // the offsets are relative to the scanned codes
+                        pieces.push_back (Piece {
+                            list_size, scodes->get(), nullptr});
+                    } else {
+                        sids.reset (new ScopedIds (invlists, key));
+                        for (size_t p0 = 0; p0 < list_size; p0 += piece_size) {
+                            pieces.push_back (Piece {
+                                std::min (piece_size, list_size - p0),
+                                scodes->get() + p0 * code_size,
+                                sids->get() + p0});
+                        }
+                    }
+                }
+
+                const idx_t *qs = pair_q.data() + lims[key];
+                const float *qdis = pair_dis.data() + lims[key];
+                size_t nq = lims[key + 1] - lims[key];
+                st.nlistv += nq;
+                st.ndis += nq * list_size;
+
+                for (size_t j0 = 0; j0 < nq; j0 += qbs) {
+                    size_t j1 = std::min (j0 + qbs, nq);
+                    for (size_t j = j0; j < j1; j++) {
+                        InvertedListScanner *scanner =
+                            st.scanners[j - j0].get();
+                        scanner->set_query (x + qs[j] * ivf.d);
+                        scanner->set_list (key, qdis[j]);
+                    }
+                    for (const Piece & piece : pieces) {
+                        for (size_t j = j0; j < j1; j++) {
+                            size_t qi = qs[j] - q0;
+                            st.nheap += st.scanners[j - j0]->scan_codes (
+                                piece.n, piece.codes, piece.ids,
+                                st.dis.data() + qi * k,
+                                st.ids.data() + qi * k, k);
+                        }
+                    }
+                }
+            }
+        });
+
+        // merge the results of the threads
+        parallel_for (q0, q1, [&] (size_t i) {
+            float *simi = distances + i * k;
+            idx_t *idxi = labels + i * k;
+            if (do_heap_init) {
+                heap_heapify<C> (k, simi, idxi);
+            }
+            for (const RankState & st : states) {
+                if (st.batch_q0 != q0) continue;
+                heap_addn<C> (k, simi, idxi,
+                              st.dis.data() + (i - q0) * k,
+                              st.ids.data() + (i - q0) * k, k);
+            }
+            if (do_heap_init) {
+                heap_reorder<C> (k, simi, idxi);
+            }
+        });
+
+        if (InterruptCallback::is_interrupted ()) {
+            FAISS_THROW_MSG ("computation interrupted");
+        }
+    }
+
+    for (const RankState & st : states) {
+        indexIVF_stats.nlist += st.nlistv;
+        indexIVF_stats.ndis += st.ndis;
+        indexIVF_stats.nheap_updates += st.nheap;
+    }
+    indexIVF_stats.nq += n;
+}
+
+
+/* Work-stealing search (parallel_mode 4): the work is split into
+ * units that each scan a chunk of a list probed by a query, with an
+ * estimated cost of chunk size x code_size. The units are ordered by
+ * query and distributed with WorkStealingRanges, so that a thread
+ * mostly processes the units of a query in a row, and collects their
+ * results in its own heap before merging it into the result of the
+ * query. */
+
+struct IVFWorkUnit {
+    Index::idx_t qno;
+    Index::idx_t list_no;
+    float coarse_dis;
+    size_t j0, j1;      ///< chunk of the list
+};
+
+// the lists are split into chunks of at least this size (in bytes)
+const size_t work_unit_min_bytes = 64 * 1024;
+
+void make_work_units (const IndexIVF & ivf, Index::idx_t n,
+                      const Index::idx_t *keys, const float *coarse_dis,
+                      size_t nprobe, int nt, bool split_lists,
+                      std::vector<IVFWorkUnit> & units,
+                      std::vector<uint64_t> & cum_cost)
+{
+    using idx_t = Index::idx_t;
+    const InvertedLists *invlists = ivf.invlists;
+    size_t code_size = std::max (ivf.code_size, size_t(1));
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < n * nprobe; i++) {
+        idx_t key = keys[i];
+        if (key < 0) continue;
+        FAISS_THROW_IF_NOT_FMT (key < (idx_t) ivf.nlist,
+                                "Invalid key=%ld nlist=%ld\n",
+                                key, ivf.nlist);
+        total += invlists->list_size (key) * code_size;
+    }
+
+    // enough units for the threads to balance the work
+    size_t chunk_bytes = std::max (work_unit_min_bytes,
+                                   size_t(total / (32 * nt)));
+    size_t chunk_size = std::max (chunk_bytes / code_size, size_t(1));
+
+    units.clear ();
+    cum_cost.resize (1);
+    cum_cost[0] = 0;
+    for (size_t i = 0; i < n * nprobe; i++) {
+        idx_t key = keys[i];
+        if (key < 0) continue;
+        size_t list_size = invlists->list_size (key);
+        size_t step = split_lists ? chunk_size : list_size;
+        for (size_t j0 = 0; j0 < list_size; j0 += step) {
+            size_t j1 = std::min (j0 + step, list_size);
+            units.push_back (IVFWorkUnit {
+                idx_t(i / nprobe), key, coarse_dis[i], j0, j1});
+            cum_cost.push_back (cum_cost.back() + (j1 - j0) * code_size);
+        }
+    }
+}
+
+/// calls f(n, codes, ids) on the pieces of the codes of a unit. The
+/// lists are scanned in place, except with store_pairs, where the
+/// units cover whole lists.
+template <class F>
+void scan_work_unit (const InvertedLists *invlists, size_t code_size,
+                     const IVFWorkUnit & u, bool store_pairs, F f)
+{
+    using idx_t = Index::idx_t;
+    size_t segment_size = invlists->segment_size ();
+
+    if (segment_size > 0 && !store_pairs) {
+        for (size_t j = u.j0; j < u.j1; ) {
+            size_t s = j / segment_size;
+            const uint8_t *codes;
+            const idx_t *ids;
+            invlists->get_segment (u.list_no, s, &codes, &ids);
+            size_t je = std::min (u.j1, (s + 1) * segment_size);
+            size_t ofs = j - s * segment_size;
+            f (je - j, codes + ofs * code_size, ids + ofs);
+            j = je;
+        }
+        return;
+    }
+
+    ScopedCodes scodes (invlists, u.list_no);
+    if (store_pairs) {
+        f (u.j1 - u.j0, scodes.get(), nullptr);
+        return;
+    }
+    ScopedIds sids (invlists, u.list_no);
+    f (u.j1 - u.j0, scodes.get() + u.j0 * code_size, sids.get() + u.j0);
+}
+
+int work_stealing_nthread ()
+{
+    return std::max (1, std::min (get_parallelism_budget (),
+                                  get_thread_pool ().nworker () + 1));
+}
+
+template <class C>
+void search_preassigned_work_stealing (
+        const IndexIVF & ivf, Index::idx_t n, const float *x,
+        Index::idx_t k, const Index::idx_t *keys, const float *coarse_dis,
+        float *distances, Index::idx_t *labels, bool store_pairs,
+        size_t nprobe, bool do_heap_init)
+{
+    using idx_t = Index::idx_t;
+    int nt = work_stealing_nthread ();
+
+    std::vector<IVFWorkUnit> units;
+    std::vector<uint64_t> cum_cost;
+    make_work_units (ivf, n, keys, coarse_dis, nprobe, nt, !store_pairs,
+                     units, cum_cost);
+
+    if (do_heap_init) {
+        parallel_for (0, n, [&] (size_t i) {
+            heap_heapify<C> (k, distances + i * k, labels + i * k);
+        });
+    }
+
+    WorkStealingRanges ranges (nt, cum_cost);
+    // protect the result heaps of the queries
+    std::vector<std::mutex> locks (256);
+    std::atomic<bool> interrupted (false);
+    std::atomic<size_t> nlistv (0), ndis (0), nheap (0);
+
+    get_thread_pool ().parallel (nt, [&] (int rank) {
+        std::unique_ptr<InvertedListScanner> scanner (
+            ivf.get_InvertedListScanner (store_pairs));
+        std::vector<float> simi (k);
+        std::vector<idx_t> idxi (k);
+        idx_t qno = -1, list_no = -1;
+        size_t loc_nlistv = 0, loc_ndis = 0, loc_nheap = 0;
+
+        auto flush = [&] () {
+            if (qno < 0) return;
+            std::lock_guard<std::mutex> guard (locks[qno % locks.size()]);
+            heap_addn<C> (k, distances + qno * k, labels + qno * k,
+                          simi.data(), idxi.data(), k);
+            qno = -1;
+        };
+
+        size_t u;
+        while (!interrupted && ranges.next (rank, u)) {
+            const IVFWorkUnit & unit = units[u];
+            if (unit.qno != qno) {
+                flush ();
+                if (InterruptCallback::is_interrupted ()) {
+                    interrupted = true;
+                    break;
+                }
+                qno = unit.qno;
+                list_no = -1;
+                scanner->set_query (x + qno * ivf.d);
+                heap_heapify<C> (k, simi.data(), idxi.data());
+            }
+            if (unit.list_no != list_no) {
+                list_no = unit.list_no;
+                scanner->set_list (list_no, unit.coarse_dis);
+            }
+            if (unit.j0 == 0) {
+                loc_nlistv++;
+            }
+            loc_ndis += unit.j1 - unit.j0;
+            scan_work_unit (
+                ivf.invlists, ivf.code_size, unit, store_pairs,
+                [&] (size_t m, const uint8_t *codes, const idx_t *ids) {
+                    loc_nheap += scanner->scan_codes (
+                        m, codes, ids, simi.data(), idxi.data(), k);
+                });
+        }
+        flush ();
+
+        nlistv += loc_nlistv;
+        ndis += loc_ndis;
+        nheap += loc_nheap;
+    });
+
+    if (interrupted) {
+        FAISS_THROW_MSG ("computation interrupted");
+    }
+
+    if (do_heap_init) {
+        parallel_for (0, n, [&] (size_t i) {
+            heap_reorder<C> (k, distances + i * k, labels + i * k);
+        });
+    }
+
+    indexIVF_stats.nq += n;
+    indexIVF_stats.nlist += nlistv;
+    indexIVF_stats.ndis += ndis;
+    indexIVF_stats.nheap_updates += nheap;
+}
+
+void range_search_preassigned_work_stealing (
+        const IndexIVF & ivf, Index::idx_t nx, const float *x, float radius,
+        const Index::idx_t *keys, const float *coarse_dis,
+        RangeSearchResult *result, size_t nprobe, bool store_pairs)
+{
+    using idx_t = Index::idx_t;
+    int nt = work_stealing_nthread ();
+
+    std::vector<IVFWorkUnit> units;
+    std::vector<uint64_t> cum_cost;
+    make_work_units (ivf, nx, keys, coarse_dis, nprobe, nt, !store_pairs,
+                     units, cum_cost);
+
+    WorkStealingRanges ranges (nt, cum_cost);
+    std::vector<std::unique_ptr<RangeSearchPartialResult> > pres (nt);
+    std::atomic<size_t> nlistv (0), ndis (0);
+
+    get_thread_pool ().parallel (nt, [&] (int rank) {
+        pres[rank].reset (new RangeSearchPartialResult (result));
+        std::unique_ptr<InvertedListScanner> scanner (
+            ivf.get_InvertedListScanner (store_pairs));
+        FAISS_THROW_IF_NOT (scanner.get ());
+        idx_t qno = -1, list_no = -1;
+        RangeQueryResult *qres = nullptr;
+        size_t loc_nlistv = 0, loc_ndis = 0;
+
+        size_t u;
+        while (ranges.next (rank, u)) {
+            const IVFWorkUnit & unit = units[u];
+            if (unit.qno != qno) {
+                qno = unit.qno;
+                list_no = -1;
+                // a query may get several results in a partial
+                // result, the merge adds them up
+                qres = &pres[rank]->new_result (qno);
+                scanner->set_query (x + qno * ivf.d);
+            }
+            if (unit.list_no != list_no) {
+                list_no = unit.list_no;
+                scanner->set_list (list_no, unit.coarse_dis);
+            }
+            if (unit.j0 == 0) {
+                loc_nlistv++;
+            }
+            loc_ndis += unit.j1 - unit.j0;
+            scan_work_unit (
+                ivf.invlists, ivf.code_size, unit, store_pairs,
+                [&] (size_t m, const uint8_t *codes, const idx_t *ids) {
+                    scanner->scan_codes_range (m, codes, ids, radius, *qres);
+                });
+        }
+        nlistv += loc_nlistv;
+        ndis += loc_ndis;
+    });
+
+    std::vector<RangeSearchPartialResult *> all_pres;
+    for (auto & p : pres) {
+        all_pres.push_back (p.get());
+    }
+    RangeSearchPartialResult::merge (all_pres, false);
+
+    indexIVF_stats.nq += nx;
+    indexIVF_stats.nlist += nlistv;
+    indexIVF_stats.ndis += ndis;
+}
+
+/// replaces the (list_no, offset) labels of store_pairs with the ids
+void lookup_ids (const InvertedLists *invlists, size_t n,
+                 Index::idx_t *labels)
+{
+    parallel_for (0, (n + 1023) / 1024, [&] (size_t b) {
+        for (size_t i = b * 1024; i < std::min (n, b * 1024 + 1024); i++) {
+            Index::idx_t lo = labels[i];
+            if (lo >= 0) {
+                labels[i] = invlists->get_single_id (
+                      lo_listno (lo), lo_offset (lo));
+            }
+        }
+    });
+}
+
+} // anonymous namespace
+
 void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
                                    const idx_t *keys,
                                    const float *coarse_dis ,
@@ -299,6 +899,50 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
     int pmode = this->parallel_mode & ~PARALLEL_MODE_NO_HEAP_INIT;
     bool do_heap_init = !(this->parallel_mode & PARALLEL_MODE_NO_HEAP_INIT);
 
+    // per-call output, so that concurrent searches do not share it
+    size_t *nlist_per_query = params ? params->nlist_per_query : nullptr;
+    FAISS_THROW_IF_NOT_MSG (!nlist_per_query || pmode == 0,
+                            "nlist_per_query requires parallel_mode 0");
+
+    // the heaps contain only the results of this search if they are
+    // initialized here
+    if (!store_pairs && do_heap_init && invlists->ids_on_demand ()) {
+        search_preassigned (n, x, k, keys, coarse_dis, distances, labels,
+                            true, params);
+        lookup_ids (invlists, n * k, labels);
+        return;
+    }
+
+    if (pmode == 3) {
+        if (metric_type == METRIC_INNER_PRODUCT) {
+            search_preassigned_list_major<HeapForIP> (
+                *this, n, x, k, keys, coarse_dis, distances, labels,
+                store_pairs, nprobe, do_heap_init);
+        } else {
+            search_preassigned_list_major<HeapForL2> (
+                *this, n, x, k, keys, coarse_dis, distances, labels,
+                store_pairs, nprobe, do_heap_init);
+        }
+        return;
+    }
+
+    if (pmode == 4) {
+        if (metric_type == METRIC_INNER_PRODUCT) {
+            search_preassigned_work_stealing<HeapForIP> (
+                *this, n, x, k, keys, coarse_dis, distances, labels,
+                store_pairs, nprobe, do_heap_init);
+        } else {
+            search_preassigned_work_stealing<HeapForL2> (
+                *this, n, x, k, keys, coarse_dis, distances, labels,
+                store_pairs, nprobe, do_heap_init);
+        }
+        return;
+    }
+
+    bool adaptive = pmode == 0 && adaptive_nprobe;
+    FAISS_THROW_IF_NOT_MSG (!adaptive || metric_type == METRIC_L2,
+                            "adaptive_nprobe requires METRIC_L2");
+
     // don't start parallel section if single query
     bool do_parallel =
         pmode == 0 ? n > 1 :
@@ -310,6 +954,16 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
         InvertedListScanner *scanner = get_InvertedListScanner(store_pairs);
         ScopeDeleter1<InvertedListScanner> del(scanner);
 
+        // for large k, the results of a query are collected in a
+        // reservoir rather than in the heap, if the scanner supports it
+        bool use_reservoir = pmode == 0 && do_heap_init &&
+            k >= distance_compute_min_k_reservoir &&
+            scanner->supports_reservoir ();
+        std::vector<float> rvals (use_reservoir ? 2 * k : 0);
+        std::vector<idx_t> rids (use_reservoir ? 2 * k : 0);
+        std::unique_ptr<ReservoirTopN<HeapForIP> > res_ip;
+        std::unique_ptr<ReservoirTopN<HeapForL2> > res_l2;
+
         /*****************************************************
          * Depending on parallel_mode, there are two possible ways
          * to organize the search. Here we define local functions
@@ -360,6 +1014,36 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
 
             nlistv++;
 
+            auto scan_codes = [&] (size_t n, const uint8_t *codes,
+                                   const idx_t *ids) {
+                if (res_ip) {
+                    nheap += scanner->scan_codes_reservoir (
+                        n, codes, ids, *res_ip);
+                } else if (res_l2) {
+                    nheap += scanner->scan_codes_reservoir (
+                        n, codes, ids, *res_l2);
+                } else {
+                    nheap += scanner->scan_codes (n, codes, ids,
+                                                  simi, idxi, k);
+                }
+            };
+
+            size_t segment_size = invlists->segment_size ();
+
+            if (segment_size > 0 && !store_pairs) {
+                // scan in place, the offsets of store_pairs would be
+                // relative to the segment
+                for (size_t j0 = 0; j0 < list_size; j0 += segment_size) {
+                    const uint8_t *codes;
+                    const idx_t *ids;
+                    invlists->get_segment (key, j0 / segment_size,
+                                           &codes, &ids);
+                    scan_codes (std::min (segment_size, list_size - j0),
+                                codes, ids);
+                }
+                return list_size;
+            }
+
             InvertedLists::ScopedCodes scodes (invlists, key);
 
             std::unique_ptr<InvertedLists::ScopedIds> sids;
@@ -370,12 +1054,73 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
                 ids = sids->get();
             }
 
-            nheap += scanner->scan_codes (list_size, scodes.get(),
-                                          ids, simi, idxi, k);
+            scan_codes (list_size, scodes.get(), ids);
 
             return list_size;
         };
 
+        // adaptive probing of the lists of query i, see adaptive_nprobe
+        std::vector<size_t> probe_order (adaptive ? nprobe : 0);
+        std::vector<float> centroid0 (adaptive ? d : 0);
+        std::vector<float> centroid (adaptive ? d : 0);
+
+        auto scan_lists_adaptive = [&] (size_t i, float *simi, idx_t *idxi) {
+            const idx_t *keysi = keys + i * nprobe;
+            const float *cdis = coarse_dis + i * nprobe;
+            for (size_t ik = 0; ik < nprobe; ik++) {
+                probe_order[ik] = ik;
+            }
+            std::stable_sort (
+                probe_order.begin(), probe_order.end(),
+                [cdis] (size_t a, size_t b) { return cdis[a] < cdis[b]; });
+
+            long nscan = 0;
+            idx_t key0 = -1;
+            float dis0 = 0;
+            bool have_centroid0 = false;
+
+            for (size_t ik : probe_order) {
+                idx_t key = keysi[ik];
+                if (key < 0) {
+                    continue;
+                }
+                if (key0 < 0) {
+                    key0 = key;
+                    dis0 = cdis[ik];
+                } else {
+                    float kth = res_l2 ? res_l2->threshold : simi[0];
+                    if (kth < HeapForL2::neutral()) {
+                        if (adaptive_nprobe_ratio > 0 &&
+                            cdis[ik] > adaptive_nprobe_ratio * kth) {
+                            break;
+                        }
+                        // the vectors of list key are closer to its
+                        // centroid than to centroid key0, so they are
+                        // beyond the bisector of the two centroids
+                        if (!have_centroid0) {
+                            quantizer->reconstruct (key0, centroid0.data());
+                            have_centroid0 = true;
+                        }
+                        quantizer->reconstruct (key, centroid.data());
+                        float cc = fvec_L2sqr (
+                              centroid0.data(), centroid.data(), d);
+                        float delta = cdis[ik] - dis0;
+                        if (cc > 0 && delta > 0 &&
+                            delta * delta >= 4 * cc * kth) {
+                            continue;
+                        }
+                    }
+                }
+
+                nscan += scan_one_list (key, cdis[ik], simi, idxi);
+
+                if (max_codes && nscan >= max_codes) {
+                    break;
+                }
+            }
+            return nscan;
+        };
+
         /****************************************************
          * Actual loops, depending on parallel_mode
          ****************************************************/
@@ -396,23 +1141,46 @@ void IndexIVF::search_preassigned (idx_t n, const float *x, idx_t k,
 
                 init_result (simi, idxi);
 
-                long nscan = 0;
-
-                // loop over probes
-                for (size_t ik = 0; ik < nprobe; ik++) {
-
-                    nscan += scan_one_list (
-                         keys [i * nprobe + ik],
-                         coarse_dis[i * nprobe + ik],
-                         simi, idxi
-                    );
+                if (use_reservoir) {
+                    if (metric_type == METRIC_INNER_PRODUCT) {
+                        res_ip.reset (new ReservoirTopN<HeapForIP> (
+                            k, 2 * k, rvals.data(), rids.data()));
+                    } else {
+                        res_l2.reset (new ReservoirTopN<HeapForL2> (
+                            k, 2 * k, rvals.data(), rids.data()));
+                    }
+                }
 
-                    if (max_codes && nscan >= max_codes) {
-                        break;
+                long nscan = 0;
+                size_t nlistv0 = nlistv;
+
+                if (adaptive) {
+                    nscan = scan_lists_adaptive (i, simi, idxi);
+                } else {
+                    // loop over probes
+                    for (size_t ik = 0; ik < nprobe; ik++) {
+
+                        nscan += scan_one_list (
+                             keys [i * nprobe + ik],
+                             coarse_dis[i * nprobe + ik],
+                             simi, idxi
+                        );
+
+                        if (max_codes && nscan >= max_codes) {
+                            break;
+                        }
                     }
                 }
 
+                if (nlist_per_query) {
+                    nlist_per_query[i] = nlistv - nlistv0;
+                }
                 ndis += nscan;
+                if (res_ip) {
+                    res_ip->to_heap (simi, idxi);
+                } else if (res_l2) {
+                    res_l2->to_heap (simi, idxi);
+                }
                 reorder_result (simi, idxi);
 
                 if (InterruptCallback::is_interrupted ()) {
@@ -506,8 +1274,20 @@ void IndexIVF::range_search_preassigned (
          RangeSearchResult *result) const
 {
 
+    // with store_pairs, the ids of the results are looked up at the end
+    bool store_pairs = invlists->ids_on_demand ();
+
+    if (parallel_mode == 4) {
+        range_search_preassigned_work_stealing (
+            *this, nx, x, radius, keys, coarse_dis, result, nprobe,
+            store_pairs);
+        if (store_pairs) {
+            lookup_ids (invlists, result->lims[nx], result->labels);
+        }
+        return;
+    }
+
     size_t nlistv = 0, ndis = 0;
-    bool store_pairs = false;
 
     std::vector<RangeSearchPartialResult *> all_pres (omp_get_max_threads());
 
@@ -533,12 +1313,35 @@ void IndexIVF::range_search_preassigned (
 
             if (list_size == 0) return;
 
-            InvertedLists::ScopedCodes scodes (invlists, key);
-            InvertedLists::ScopedIds ids (invlists, key);
-
             scanner->set_list (key, coarse_dis[i * nprobe + ik]);
             nlistv++;
             ndis += list_size;
+
+            size_t segment_size = invlists->segment_size ();
+
+            if (segment_size > 0 && !store_pairs) {
+                for (size_t j0 = 0; j0 < list_size; j0 += segment_size) {
+                    const uint8_t *codes;
+                    const idx_t *ids;
+                    invlists->get_segment (key, j0 / segment_size,
+                                           &codes, &ids);
+                    scanner->scan_codes_range (
+                        std::min (segment_size, list_size - j0),
+                        codes, ids, radius, qres);
+                }
+                return;
+            }
+
+            InvertedLists::ScopedCodes scodes (invlists, key);
+
+            if (store_pairs) {
+                scanner->scan_codes_range (list_size, scodes.get(),
+                                           nullptr, radius, qres);
+                return;
+            }
+
+            InvertedLists::ScopedIds ids (invlists, key);
+
             scanner->scan_codes_range (list_size, scodes.get(),
                                        ids.get(), radius, qres);
         };
@@ -597,6 +1400,9 @@ void IndexIVF::range_search_preassigned (
 
         }
     }
+    if (store_pairs) {
+        lookup_ids (invlists, result->lims[nx], result->labels);
+    }
     indexIVF_stats.nq += nx;
     indexIVF_stats.nlist += nlistv;
     indexIVF_stats.ndis += ndis;
@@ -891,6 +1697,8 @@ void IndexIVFStats::reset()
 
 IndexIVFStats indexIVF_stats;
 
+size_t ivf_list_major_heap_bytes = size_t(128) << 20;
+
 void InvertedListScanner::scan_codes_range (size_t ,
                        const uint8_t *,
                        const idx_t *,
@@ -900,6 +1708,20 @@ void InvertedListScanner::scan_codes_range (size_t ,
     FAISS_THROW_MSG ("scan_codes_range not implemented");
 }
 
+size_t InvertedListScanner::scan_codes_reservoir (
+        size_t, const uint8_t *, const idx_t *,
+        ReservoirTopN<CMax<float, idx_t> > &) const
+{
+    FAISS_THROW_MSG ("scan_codes_reservoir not implemented");
+}
+
+size_t InvertedListScanner::scan_codes_reservoir (
+        size_t, const uint8_t *, const idx_t *,
+        ReservoirTopN<CMin<float, idx_t> > &) const
+{
+    FAISS_THROW_MSG ("scan_codes_reservoir not implemented");
+}
+
 
 
 } // namespace faiss
@@ -20,6 +20,7 @@
 #include <faiss/DirectMap.h>
 #include <faiss/Clustering.h>
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/partitioning.h>
 
 
 namespace faiss {
@@ -68,6 +69,14 @@ struct Level1Quantizer {
 struct IVFSearchParameters {
     size_t nprobe;            ///< number of probes at query time
     size_t max_codes;         ///< max nb of codes to visit to do a query
+
+    /// if not null, IndexIVF::search_preassigned stores the nb of
+    /// inverted lists scanned for each query in it (size n). Only with
+    /// parallel_mode 0
+    size_t *nlist_per_query;
+
+    IVFSearchParameters (): nprobe (1), max_codes (0),
+                            nlist_per_query (nullptr) {}
     virtual ~IVFSearchParameters () {}
 };
 
@@ -105,11 +114,37 @@ struct IndexIVF: Index, Level1Quantizer {
     size_t nprobe;            ///< number of probes at query time
     size_t max_codes;         ///< max nb of codes to visit to do a query
 
+    /** Adaptive probing, for METRIC_L2 with parallel_mode 0. The
+     * probed lists of a query are visited by increasing centroid
+     * distance, and a list is skipped when the distance from the query
+     * to the Voronoi cell of its centroid (a lower bound of the
+     * distances to its vectors) is not below the current k-th result
+     * distance. The results do not change if the vectors are assigned
+     * to their nearest centroid with exact distances, as with a flat
+     * quantizer. The quantizer must implement reconstruct. nprobe
+     * remains the max nb of lists to probe.
+     */
+    bool adaptive_nprobe;
+
+    /// with adaptive_nprobe, stop probing once the centroid distance
+    /// exceeds this factor times the current k-th result distance
+    /// (0 = disabled). Approximate, to be tuned like nprobe.
+    float adaptive_nprobe_ratio;
+
     /** Parallel mode determines how queries are parallelized with OpenMP
      *
      * 0 (default): parallelize over queries
      * 1: parallelize over inverted lists
      * 2: parallelize over both
+     * 3: list-major, for large batches of queries: the queries are
+     *    grouped by the lists they probe and each list is scanned
+     *    once for all of them, by pieces that stay in cache. This pays
+     *    off when the lists do not fit in cache, since the query
+     *    setup is redone for every probed list. max_codes is not
+     *    supported.
+     * 4: work stealing over units of (query, list chunk), balanced
+     *    by the size of the chunks, for skewed list sizes. Also
+     *    supported by range_search. max_codes is not supported.
      *
      * PARALLEL_MODE_NO_HEAP_INIT: binary or with the previous to
      * prevent the heap to be initialized and finalized
@@ -141,6 +176,18 @@ struct IndexIVF: Index, Level1Quantizer {
     /// default implementation that calls encode_vectors
     void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
 
+    /** Adds entries whose list numbers and codes are already computed.
+     * The entries are grouped by list, and each list is extended once,
+     * in parallel over the lists. The ids are xids, or ntotal + i if
+     * xids is null. Updates the direct map, but not ntotal.
+     *
+     * @param list_nos   inverted list ids (size n), -1s are ignored
+     * @param codes      codes of the entries, size n * code_size
+     * @return           nb of entries added (list_nos[i] >= 0)
+     */
+    size_t add_codes_bucketed (idx_t n, const idx_t *list_nos,
+                               const uint8_t *codes, const idx_t *xids);
+
     /** Encodes a set of vectors as they would appear in the inverted lists
      *
      * @param list_nos   inverted list ids as returned by the
@@ -335,6 +382,26 @@ struct InvertedListScanner {
                                float *distances, idx_t *labels,
                                size_t k) const = 0;
 
+    /// whether scan_codes_reservoir is implemented
+    virtual bool supports_reservoir () const { return false; }
+
+    /** scan a set of codes, compute distances to current query and
+     * add them to a reservoir of results. For large k, search_preassigned
+     * calls this instead of scan_codes if supports_reservoir () is true.
+     * The reservoir is a CMax for METRIC_L2 and a CMin for inner product.
+     *
+     * (default implementation fails)
+     *
+     * @return number of results added to the reservoir
+     */
+    virtual size_t scan_codes_reservoir (
+        size_t n, const uint8_t *codes, const idx_t *ids,
+        ReservoirTopN<CMax<float, idx_t> > &res) const;
+
+    virtual size_t scan_codes_reservoir (
+        size_t n, const uint8_t *codes, const idx_t *ids,
+        ReservoirTopN<CMin<float, idx_t> > &res) const;
+
     /** scan a set of codes, compute distances to current query and
      * update results if distances are below radius
      *
@@ -365,6 +432,10 @@ struct IndexIVFStats {
 // global var that collects them all
 extern IndexIVFStats indexIVF_stats;
 
+/// parallel_mode 3: the queries are processed by batches such that the
+/// result heaps of all the threads for a batch fit in this size (bytes)
+extern size_t ivf_list_major_heap_bytes;
+
 
 } // namespace faiss
 
@@ -36,7 +36,9 @@ IndexIVFFlat::IndexIVFFlat (Index * quantizer,
 
 void IndexIVFFlat::add_with_ids (idx_t n, const float * x, const idx_t *xids)
 {
-    add_core (n, x, xids, nullptr);
+    // the codes of encode_vectors are the vectors, so the pipelined add
+    // of IndexIVF applies as is
+    IndexIVF::add_with_ids (n, x, xids);
 }
 
 void IndexIVFFlat::add_core (idx_t n, const float * x, const int64_t *xids,
@@ -57,22 +59,8 @@ void IndexIVFFlat::add_core (idx_t n, const float * x, const int64_t *xids,
         quantizer->assign (n, x, idx0);
         idx = idx0;
     }
-    int64_t n_add = 0;
-    for (size_t i = 0; i < n; i++) {
-        idx_t id = xids ? xids[i] : ntotal + i;
-        idx_t list_no = idx [i];
-        size_t offset;
-
-        if (list_no >= 0) {
-            const float *xi = x + i * d;
-            offset = invlists->add_entry (
-                     list_no, id, (const uint8_t*) xi);
-            n_add++;
-        } else {
-            offset = 0;
-        }
-        direct_map.add_single_id (id, list_no, offset);
-    }
+    // the codes are the vectors
+    int64_t n_add = add_codes_bucketed (n, idx, (const uint8_t*) x, xids);
 
     if (verbose) {
         printf("IndexIVFFlat::add_core: added %ld / %ld vectors\n",
@@ -145,6 +133,17 @@ struct IVFFlatScanner: InvertedListScanner {
         return dis;
     }
 
+    /// the distances are computed by blocks with the one-to-many kernels
+    static const size_t block_size = 256;
+
+    void compute_block (float *dis, const float *y, size_t n) const {
+        if (metric == METRIC_INNER_PRODUCT) {
+            fvec_inner_products_ny (dis, xi, y, d, n);
+        } else {
+            fvec_L2sqr_ny (dis, xi, y, d, n);
+        }
+    }
+
     size_t scan_codes (size_t list_size,
                        const uint8_t *codes,
                        const idx_t *ids,
@@ -153,20 +152,61 @@ struct IVFFlatScanner: InvertedListScanner {
     {
         const float *list_vecs = (const float*)codes;
         size_t nup = 0;
-        for (size_t j = 0; j < list_size; j++) {
-            const float * yj = list_vecs + d * j;
-            float dis = metric == METRIC_INNER_PRODUCT ?
-                fvec_inner_product (xi, yj, d) : fvec_L2sqr (xi, yj, d);
-            if (C::cmp (simi[0], dis)) {
-                heap_pop<C> (k, simi, idxi);
+        float dis_block[block_size];
+        for (size_t j0 = 0; j0 < list_size; j0 += block_size) {
+            size_t j1 = std::min (j0 + block_size, list_size);
+            compute_block (dis_block, list_vecs + d * j0, j1 - j0);
+            for (size_t j = j0; j < j1; j++) {
+                float dis = dis_block[j - j0];
+                if (C::cmp (simi[0], dis)) {
+                    heap_pop<C> (k, simi, idxi);
+                    int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
+                    heap_push<C> (k, simi, idxi, dis, id);
+                    nup++;
+                }
+            }
+        }
+        return nup;
+    }
+
+    bool supports_reservoir () const override {
+        return true;
+    }
+
+    template <class CR>
+    size_t scan_codes_to_reservoir (size_t list_size,
+                                    const uint8_t *codes,
+                                    const idx_t *ids,
+                                    ReservoirTopN<CR> & res) const
+    {
+        const float *list_vecs = (const float*)codes;
+        size_t nup = 0;
+        float dis_block[block_size];
+        for (size_t j0 = 0; j0 < list_size; j0 += block_size) {
+            size_t j1 = std::min (j0 + block_size, list_size);
+            compute_block (dis_block, list_vecs + d * j0, j1 - j0);
+            for (size_t j = j0; j < j1; j++) {
                 int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
-                heap_push<C> (k, simi, idxi, dis, id);
-                nup++;
+                nup += res.add (dis_block[j - j0], id);
             }
         }
         return nup;
     }
 
+    size_t scan_codes_reservoir (
+            size_t list_size, const uint8_t *codes, const idx_t *ids,
+            ReservoirTopN<CMax<float, idx_t> > & res) const override
+    {
+        return scan_codes_to_reservoir (list_size, codes, ids, res);
+    }
+
+    size_t scan_codes_reservoir (
+            size_t list_size, const uint8_t *codes, const idx_t *ids,
+            ReservoirTopN<CMin<float, idx_t> > & res) const override
+    {
+        return scan_codes_to_reservoir (list_size, codes, ids, res);
+    }
+
     void scan_codes_range (size_t list_size,
                            const uint8_t *codes,
                            const idx_t *ids,
@@ -174,13 +214,16 @@ struct IVFFlatScanner: InvertedListScanner {
                            RangeQueryResult & res) const override
     {
         const float *list_vecs = (const float*)codes;
-        for (size_t j = 0; j < list_size; j++) {
-            const float * yj = list_vecs + d * j;
-            float dis = metric == METRIC_INNER_PRODUCT ?
-                fvec_inner_product (xi, yj, d) : fvec_L2sqr (xi, yj, d);
-            if (C::cmp (radius, dis)) {
-                int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
-                res.add (dis, id);
+        float dis_block[block_size];
+        for (size_t j0 = 0; j0 < list_size; j0 += block_size) {
+            size_t j1 = std::min (j0 + block_size, list_size);
+            compute_block (dis_block, list_vecs + d * j0, j1 - j0);
+            for (size_t j = j0; j < j1; j++) {
+                float dis = dis_block[j - j0];
+                if (C::cmp (radius, dis)) {
+                    int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
+                    res.add (dis, id);
+                }
             }
         }
     }
@@ -0,0 +1,633 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexIVFInt8.h>
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <omp.h>
+
+#include <memory>
+
+
+#include <faiss/utils/distances.h>
+#include <faiss/utils/utils.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/IndexFlat.h>
+
+
+namespace faiss {
+
+namespace {
+
+void int8_to_float (size_t n, const int8_t *x, float *xf)
+{
+    for (size_t i = 0; i < n; i++) {
+        xf[i] = x[i];
+    }
+}
+
+} // namespace
+
+
+IndexIVFInt8::IndexIVFInt8(Index *quantizer, size_t d, size_t nlist,
+                           MetricType metric)
+    : IndexInt8(d, metric),
+      invlists(new ArrayInvertedLists(nlist, d)),
+      own_invlists(true),
+      code_size(d),
+      nprobe(1),
+      max_codes(0),
+      quantizer(quantizer),
+      quantizer_int8(nullptr),
+      nlist(nlist),
+      own_fields(false),
+      clustering_index(nullptr)
+{
+  FAISS_THROW_IF_NOT (d == quantizer->d);
+  is_trained = quantizer->is_trained && (quantizer->ntotal == nlist);
+
+  cp.niter = 10;
+}
+
+IndexIVFInt8::IndexIVFInt8(IndexInt8 *quantizer, size_t d, size_t nlist,
+                           MetricType metric)
+    : IndexInt8(d, metric),
+      invlists(new ArrayInvertedLists(nlist, d)),
+      own_invlists(true),
+      code_size(d),
+      nprobe(1),
+      max_codes(0),
+      quantizer(nullptr),
+      quantizer_int8(quantizer),
+      nlist(nlist),
+      own_fields(false),
+      clustering_index(nullptr)
+{
+  FAISS_THROW_IF_NOT (d == quantizer->d);
+  is_trained = quantizer->is_trained && (quantizer->ntotal == nlist);
+
+  cp.niter = 10;
+}
+
+IndexIVFInt8::IndexIVFInt8()
+    : invlists(nullptr),
+      own_invlists(false),
+      code_size(0),
+      nprobe(1),
+      max_codes(0),
+      quantizer(nullptr),
+      quantizer_int8(nullptr),
+      nlist(0),
+      own_fields(false),
+      clustering_index(nullptr)
+{}
+
+void IndexIVFInt8::add(idx_t n, const int8_t *x) {
+  add_with_ids(n, x, nullptr);
+}
+
+void IndexIVFInt8::add_with_ids(idx_t n, const int8_t *x, const idx_t *xids) {
+  add_core(n, x, xids, nullptr);
+}
+
+void IndexIVFInt8::quantizer_search(idx_t n, const int8_t *x, idx_t k,
+                                    int32_t *coarse_dis, idx_t *idx) const {
+  if (quantizer_int8) {
+    quantizer_int8->search(n, x, k, coarse_dis, idx);
+    return;
+  }
+  FAISS_THROW_IF_NOT_MSG(quantizer, "no coarse quantizer");
+
+  std::unique_ptr<float[]> xf(new float[n * d]);
+  int8_to_float(n * d, x, xf.get());
+  std::unique_ptr<float[]> dis(new float[n * k]);
+  quantizer->search(n, xf.get(), k, dis.get(), idx);
+
+  // the inputs are integer so the distances are integer as well
+  for (size_t i = 0; i < n * k; i++) {
+    coarse_dis[i] = lrintf(dis[i]);
+  }
+}
+
+void IndexIVFInt8::add_core(idx_t n, const int8_t *x, const idx_t *xids,
+                            const idx_t *precomputed_idx) {
+  FAISS_THROW_IF_NOT(is_trained);
+  assert(invlists);
+  direct_map.check_can_add (xids);
+
+  const idx_t * idx;
+
+  std::unique_ptr<idx_t[]> scoped_idx;
+
+  if (precomputed_idx) {
+    idx = precomputed_idx;
+  } else {
+    scoped_idx.reset(new idx_t[n]);
+    std::unique_ptr<int32_t[]> coarse_dis(new int32_t[n]);
+    quantizer_search(n, x, 1, coarse_dis.get(), scoped_idx.get());
+    idx = scoped_idx.get();
+  }
+
+  long n_add = 0;
+  for (size_t i = 0; i < n; i++) {
+    idx_t id = xids ? xids[i] : ntotal + i;
+    idx_t list_no = idx[i];
+
+    if (list_no < 0) {
+        direct_map.add_single_id (id, -1, 0);
+    } else {
+        const uint8_t *xi = (const uint8_t*)(x + i * code_size);
+        size_t offset = invlists->add_entry(list_no, id, xi);
+
+        direct_map.add_single_id (id, list_no, offset);
+    }
+
+    n_add++;
+  }
+  if (verbose) {
+    printf("IndexIVFInt8::add_with_ids: added %ld / %ld vectors\n",
+           n_add, n);
+  }
+  ntotal += n_add;
+}
+
+void IndexIVFInt8::make_direct_map (bool b)
+{
+    if (b) {
+        direct_map.set_type (DirectMap::Array, invlists, ntotal);
+    } else {
+        direct_map.set_type (DirectMap::NoMap, invlists, ntotal);
+    }
+}
+
+void IndexIVFInt8::set_direct_map_type (DirectMap::Type type)
+{
+    direct_map.set_type (type, invlists, ntotal);
+}
+
+
+void IndexIVFInt8::search(idx_t n, const int8_t *x, idx_t k,
+                          int32_t *distances, idx_t *labels) const {
+  std::unique_ptr<idx_t[]> idx(new idx_t[n * nprobe]);
+  std::unique_ptr<int32_t[]> coarse_dis(new int32_t[n * nprobe]);
+
+  double t0 = getmillisecs();
+  quantizer_search(n, x, nprobe, coarse_dis.get(), idx.get());
+  indexIVF_stats.quantization_time += getmillisecs() - t0;
+
+  t0 = getmillisecs();
+  invlists->prefetch_lists(idx.get(), n * nprobe);
+
+  search_preassigned(n, x, k, idx.get(), coarse_dis.get(),
+                     distances, labels, false);
+  indexIVF_stats.search_time += getmillisecs() - t0;
+}
+
+void IndexIVFInt8::reconstruct(idx_t key, int8_t *recons) const {
+    idx_t lo = direct_map.get (key);
+    reconstruct_from_offset (lo_listno(lo), lo_offset(lo), recons);
+}
+
+void IndexIVFInt8::reconstruct_n(idx_t i0, idx_t ni, int8_t *recons) const {
+  FAISS_THROW_IF_NOT(ni == 0 || (i0 >= 0 && i0 + ni <= ntotal));
+
+  for (idx_t list_no = 0; list_no < nlist; list_no++) {
+    size_t list_size = invlists->list_size(list_no);
+    InvertedLists::ScopedIds idlist (invlists, list_no);
+
+    for (idx_t offset = 0; offset < list_size; offset++) {
+      idx_t id = idlist[offset];
+      if (!(id >= i0 && id < i0 + ni)) {
+        continue;
+      }
+
+      int8_t *reconstructed = recons + (id - i0) * d;
+      reconstruct_from_offset(list_no, offset, reconstructed);
+    }
+  }
+}
+
+void IndexIVFInt8::reconstruct_from_offset(idx_t list_no, idx_t offset,
+                                           int8_t *recons) const {
+  InvertedLists::ScopedCodes code (invlists, list_no, offset);
+  memcpy(recons, code.get(), code_size);
+}
+
+void IndexIVFInt8::reset() {
+  direct_map.clear();
+  invlists->reset();
+  ntotal = 0;
+}
+
+size_t IndexIVFInt8::remove_ids(const IDSelector& sel) {
+    size_t nremove = direct_map.remove_ids (sel, invlists);
+    ntotal -= nremove;
+    return nremove;
+}
+
+void IndexIVFInt8::train(idx_t n, const int8_t *x) {
+  if (verbose) {
+    printf("Training quantizer\n");
+  }
+
+  bool quantizer_trained = quantizer ?
+      quantizer->is_trained && quantizer->ntotal == nlist :
+      quantizer_int8->is_trained && quantizer_int8->ntotal == nlist;
+
+  if (quantizer_trained) {
+    if (verbose) {
+      printf("IVF quantizer does not need training.\n");
+    }
+  } else {
+    if (verbose) {
+      printf("Training quantizer on %ld vectors in %dD\n", n, d);
+    }
+
+    // the clustering is done in float
+    std::unique_ptr<float[]> xf(new float[n * d]);
+    int8_to_float(n * d, x, xf.get());
+
+    Clustering clus(d, nlist, cp);
+
+    if (clustering_index && verbose) {
+      printf("using clustering_index of dimension %d to do the clustering\n",
+             clustering_index->d);
+    }
+
+    if (quantizer) {
+      quantizer->reset();
+      if (clustering_index) {
+        clus.train(n, xf.get(), *clustering_index);
+        quantizer->add(nlist, clus.centroids.data());
+      } else {
+        clus.train(n, xf.get(), *quantizer);
+      }
+      quantizer->is_trained = true;
+    } else {
+      IndexFlat index_tmp(d, metric_type);
+      clus.train(n, xf.get(),
+                 clustering_index ? *clustering_index : index_tmp);
+
+      // round the centroids to int8
+      std::unique_ptr<int8_t[]> x_i8(new int8_t[clus.k * d]);
+      for (size_t i = 0; i < clus.k * d; i++) {
+        float v = roundf(clus.centroids[i]);
+        x_i8[i] = v < -128 ? -128 : v > 127 ? 127 : int8_t(v);
+      }
+
+      quantizer_int8->reset();
+      quantizer_int8->add(clus.k, x_i8.get());
+      quantizer_int8->is_trained = true;
+    }
+  }
+
+  is_trained = true;
+}
+
+void IndexIVFInt8::merge_from(IndexIVFInt8 &other, idx_t add_id) {
+  // minimal sanity checks
+  FAISS_THROW_IF_NOT(other.d == d);
+  FAISS_THROW_IF_NOT(other.nlist == nlist);
+  FAISS_THROW_IF_NOT(other.code_size == code_size);
+  FAISS_THROW_IF_NOT_MSG(direct_map.no() && other.direct_map.no(),
+                         "direct map copy not implemented");
+  FAISS_THROW_IF_NOT_MSG(typeid (*this) == typeid (other),
+                         "can only merge indexes of the same type");
+
+  invlists->merge_from (other.invlists, add_id);
+
+  ntotal += other.ntotal;
+  other.ntotal = 0;
+}
+
+void IndexIVFInt8::replace_invlists(InvertedLists *il, bool own) {
+  FAISS_THROW_IF_NOT(il->nlist == nlist &&
+                     il->code_size == code_size);
+  if (own_invlists) {
+    delete invlists;
+  }
+  invlists = il;
+  own_invlists = own;
+}
+
+
+namespace {
+
+using idx_t = Index::idx_t;
+
+
+template<MetricType metric, class C>
+struct IVFInt8Scanner: Int8InvertedListScanner {
+
+    const int8_t *q;
+    size_t d;
+    bool store_pairs;
+
+    IVFInt8Scanner (size_t d, bool store_pairs):
+        q (nullptr), d (d), store_pairs(store_pairs)
+    {}
+
+    void set_query (const int8_t *query_vector) override {
+        q = query_vector;
+    }
+
+    idx_t list_no;
+    void set_list (idx_t list_no, int32_t /* coarse_dis */) override {
+        this->list_no = list_no;
+    }
+
+    int32_t distance_to_code (const uint8_t *code) const override {
+        return metric == METRIC_INNER_PRODUCT ?
+            i8vec_inner_product (q, (const int8_t*)code, d) :
+            i8vec_L2sqr (q, (const int8_t*)code, d);
+    }
+
+    size_t scan_codes (size_t n,
+                       const uint8_t *codes,
+                       const idx_t *ids,
+                       int32_t *simi, idx_t *idxi,
+                       size_t k) const override
+    {
+        size_t nup = 0;
+        for (size_t j = 0; j < n; j++) {
+            int32_t dis = distance_to_code (codes);
+            if (C::cmp (simi[0], dis)) {
+                heap_pop<C> (k, simi, idxi);
+                idx_t id = store_pairs ? lo_build(list_no, j) : ids[j];
+                heap_push<C> (k, simi, idxi, dis, id);
+                nup++;
+            }
+            codes += d;
+        }
+        return nup;
+    }
+
+    void scan_codes_range (size_t n,
+                           const uint8_t *codes,
+                           const idx_t *ids,
+                           int radius,
+                           RangeQueryResult &result) const override
+    {
+        for (size_t j = 0; j < n; j++) {
+            int32_t dis = distance_to_code (codes);
+            if (C::cmp (radius, dis)) {
+                int64_t id = store_pairs ? lo_build (list_no, j) : ids[j];
+                result.add (dis, id);
+            }
+            codes += d;
+        }
+    }
+
+};
+
+
+void search_knn_int8_heap(const IndexIVFInt8& ivf,
+                          size_t n,
+                          const int8_t *x,
+                          idx_t k,
+                          const idx_t *keys,
+                          const int32_t * coarse_dis,
+                          int32_t *distances, idx_t *labels,
+                          bool store_pairs,
+                          const IVFSearchParameters *params)
+{
+    long nprobe = params ? params->nprobe : ivf.nprobe;
+    long max_codes = params ? params->max_codes : ivf.max_codes;
+    MetricType metric_type = ivf.metric_type;
+
+    // almost verbatim copy from IndexIVF::search_preassigned
+
+    size_t nlistv = 0, ndis = 0, nheap = 0;
+    using HeapForIP = CMin<int32_t, idx_t>;
+    using HeapForL2 = CMax<int32_t, idx_t>;
+
+#pragma omp parallel if(n > 1) reduction(+: nlistv, ndis, nheap)
+    {
+        std::unique_ptr<Int8InvertedListScanner> scanner
+            (ivf.get_InvertedListScanner (store_pairs));
+
+#pragma omp for
+        for (size_t i = 0; i < n; i++) {
+            const int8_t *xi = x + i * ivf.code_size;
+            scanner->set_query(xi);
+
+            const idx_t * keysi = keys + i * nprobe;
+            int32_t * simi = distances + k * i;
+            idx_t * idxi = labels + k * i;
+
+            if (metric_type == METRIC_INNER_PRODUCT) {
+                heap_heapify<HeapForIP> (k, simi, idxi);
+            } else {
+                heap_heapify<HeapForL2> (k, simi, idxi);
+            }
+
+            size_t nscan = 0;
+
+            for (size_t ik = 0; ik < nprobe; ik++) {
+                idx_t key = keysi[ik];  /* select the list  */
+                if (key < 0) {
+                    // not enough centroids for multiprobe
+                    continue;
+                }
+                FAISS_THROW_IF_NOT_FMT
+                    (key < (idx_t) ivf.nlist,
+                     "Invalid key=%ld  at ik=%ld nlist=%ld\n",
+                     key, ik, ivf.nlist);
+
+                scanner->set_list (key, coarse_dis[i * nprobe + ik]);
+
+                nlistv++;
+
+                size_t list_size = ivf.invlists->list_size(key);
+                size_t segment_size = ivf.invlists->segment_size ();
+
+                if (segment_size > 0 && !store_pairs) {
+                    for (size_t j0 = 0; j0 < list_size; j0 += segment_size) {
+                        const uint8_t *codes;
+                        const idx_t *ids;
+                        ivf.invlists->get_segment (key, j0 / segment_size,
+                                                   &codes, &ids);
+                        nheap += scanner->scan_codes (
+                                std::min (segment_size, list_size - j0),
+                                codes, ids, simi, idxi, k
+                        );
+                    }
+                } else {
+                    InvertedLists::ScopedCodes scodes (ivf.invlists, key);
+                    std::unique_ptr<InvertedLists::ScopedIds> sids;
+                    const Index::idx_t * ids = nullptr;
+
+                    if (!store_pairs) {
+                        sids.reset (new InvertedLists::ScopedIds (
+                                ivf.invlists, key));
+                        ids = sids->get();
+                    }
+
+                    nheap += scanner->scan_codes (
+                            list_size, scodes.get(),
+                            ids, simi, idxi, k
+                    );
+                }
+
+                nscan += list_size;
+                if (max_codes && nscan >= max_codes)
+                    break;
+            }
+
+            ndis += nscan;
+            if (metric_type == METRIC_INNER_PRODUCT) {
+                heap_reorder<HeapForIP> (k, simi, idxi);
+            } else {
+                heap_reorder<HeapForL2> (k, simi, idxi);
+            }
+
+        } // parallel for
+    } // parallel
+
+    indexIVF_stats.nq += n;
+    indexIVF_stats.nlist += nlistv;
+    indexIVF_stats.ndis += ndis;
+    indexIVF_stats.nheap_updates += nheap;
+
+}
+
+}  // namespace
+
+Int8InvertedListScanner *IndexIVFInt8::get_InvertedListScanner
+      (bool store_pairs) const
+{
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        return new IVFInt8Scanner<
+            METRIC_INNER_PRODUCT, CMin<int32_t, idx_t> >(code_size, store_pairs);
+    } else if (metric_type == METRIC_L2) {
+        return new IVFInt8Scanner<
+            METRIC_L2, CMax<int32_t, idx_t> >(code_size, store_pairs);
+    } else {
+        FAISS_THROW_MSG("metric type not supported");
+    }
+}
+
+void IndexIVFInt8::search_preassigned(idx_t n, const int8_t *x, idx_t k,
+                                      const idx_t *idx,
+                                      const int32_t * coarse_dis,
+                                      int32_t *distances, idx_t *labels,
+                                      bool store_pairs,
+                                      const IVFSearchParameters *params
+                                      ) const {
+    search_knn_int8_heap (*this, n, x, k, idx, coarse_dis,
+                          distances, labels, store_pairs,
+                          params);
+}
+
+
+void IndexIVFInt8::range_search(
+        idx_t n, const int8_t *x, int radius,
+        RangeSearchResult *res) const
+{
+
+    std::unique_ptr<idx_t[]> idx(new idx_t[n * nprobe]);
+    std::unique_ptr<int32_t[]> coarse_dis(new int32_t[n * nprobe]);
+
+    double t0 = getmillisecs();
+    quantizer_search(n, x, nprobe, coarse_dis.get(), idx.get());
+    indexIVF_stats.quantization_time += getmillisecs() - t0;
+
+    t0 = getmillisecs();
+    invlists->prefetch_lists(idx.get(), n * nprobe);
+
+    bool store_pairs = false;
+    size_t nlistv = 0, ndis = 0;
+
+#pragma omp parallel reduction(+: nlistv, ndis)
+    {
+        RangeSearchPartialResult pres(res);
+        std::unique_ptr<Int8InvertedListScanner> scanner
+            (get_InvertedListScanner(store_pairs));
+        FAISS_THROW_IF_NOT (scanner.get ());
+
+        auto scan_list_func = [&](size_t i, size_t ik, RangeQueryResult &qres)
+        {
+
+            idx_t key = idx[i * nprobe + ik];  /* select the list  */
+            if (key < 0) return;
+            FAISS_THROW_IF_NOT_FMT (
+                    key < (idx_t) nlist,
+                    "Invalid key=%ld  at ik=%ld nlist=%ld\n",
+                    key, ik, nlist);
+            const size_t list_size = invlists->list_size(key);
+
+            if (list_size == 0) return;
+
+            scanner->set_list (key, coarse_dis[i * nprobe + ik]);
+            nlistv++;
+            ndis += list_size;
+
+            size_t segment_size = invlists->segment_size ();
+
+            if (segment_size > 0) {
+                for (size_t j0 = 0; j0 < list_size; j0 += segment_size) {
+                    const uint8_t *codes;
+                    const idx_t *ids;
+                    invlists->get_segment (key, j0 / segment_size,
+                                           &codes, &ids);
+                    scanner->scan_codes_range (
+                        std::min (segment_size, list_size - j0),
+                        codes, ids, radius, qres);
+                }
+                return;
+            }
+
+            InvertedLists::ScopedCodes scodes (invlists, key);
+            InvertedLists::ScopedIds ids (invlists, key);
+
+            scanner->scan_codes_range (list_size, scodes.get(),
+                                       ids.get(), radius, qres);
+        };
+
+#pragma omp for
+        for (size_t i = 0; i < n; i++) {
+            scanner->set_query (x + i * code_size);
+
+            RangeQueryResult & qres = pres.new_result (i);
+
+            for (size_t ik = 0; ik < nprobe; ik++) {
+                scan_list_func (i, ik, qres);
+            }
+
+        }
+
+        pres.finalize();
+
+    }
+    indexIVF_stats.nq += n;
+    indexIVF_stats.nlist += nlistv;
+    indexIVF_stats.ndis += ndis;
+    indexIVF_stats.search_time += getmillisecs() - t0;
+
+}
+
+
+
+
+IndexIVFInt8::~IndexIVFInt8() {
+  if (own_invlists) {
+    delete invlists;
+  }
+
+  if (own_fields) {
+    delete quantizer;
+    delete quantizer_int8;
+  }
+}
+
+
+}  // namespace faiss
@@ -182,7 +182,9 @@ void IndexIVFPQ::decode_multiple (size_t n, const idx_t *keys,
 
 void IndexIVFPQ::add_with_ids (idx_t n, const float * x, const idx_t *xids)
 {
-    add_core_o (n, x, xids, nullptr);
+    // encode_vectors computes the same codes as add_core_o, so the
+    // pipelined add of IndexIVF applies as is
+    IndexIVF::add_with_ids (n, x, xids);
 }
 
 
@@ -310,31 +312,20 @@ void IndexIVFPQ::add_core_o (idx_t n, const float * x, const idx_t *xids,
     pq.compute_codes (to_encode, xcodes, n);
 
     double t2 = getmillisecs ();
-    // TODO: parallelize?
-    size_t n_ignore = 0;
-    for (size_t i = 0; i < n; i++) {
-        idx_t key = idx[i];
-        idx_t id = xids ? xids[i] : ntotal + i;
-        if (key < 0) {
-            direct_map.add_single_id (id, -1, 0);
-            n_ignore ++;
-            if (residuals_2)
-                memset (residuals_2, 0, sizeof(*residuals_2) * d);
-            continue;
-        }
+    size_t n_ignore = n - add_codes_bucketed (n, idx, xcodes, xids);
 
-        uint8_t *code = xcodes + i * code_size;
-        size_t offset = invlists->add_entry (key, id, code);
-
-        if (residuals_2) {
+    if (residuals_2) {
+        for (size_t i = 0; i < n; i++) {
             float *res2 = residuals_2 + i * d;
+            if (idx[i] < 0) {
+                memset (res2, 0, sizeof(*res2) * d);
+                continue;
+            }
             const float *xi = to_encode + i * d;
-            pq.decode (code, res2);
+            pq.decode (xcodes + i * code_size, res2);
             for (int j = 0; j < d; j++)
                 res2[j] = xi[j] - res2[j];
         }
-
-        direct_map.add_single_id (id, key, offset);
     }
 
     double t3 = getmillisecs ();
@@ -811,6 +802,21 @@ struct KnnSearchResults {
 
 };
 
+template<class C>
+struct ReservoirSearchResults {
+    idx_t key;
+    const idx_t *ids;
+
+    ReservoirTopN<C> & res;
+
+    size_t nup;
+
+    inline void add (idx_t j, float dis) {
+        idx_t id = ids ? ids[j] : lo_build (key, j);
+        nup += res.add (dis, id);
+    }
+};
+
 template<class C>
 struct RangeSearchResults {
     idx_t key;
@@ -1063,6 +1069,25 @@ struct IVFPQScanner:
         return dis;
     }
 
+    /// scan with the method selected by polysemous_ht and precompute_mode
+    template <class SearchResultType>
+    void scan_list (size_t ncode, const uint8_t *codes,
+                    SearchResultType & res) const
+    {
+        if (this->polysemous_ht > 0) {
+            assert(precompute_mode == 2);
+            this->scan_list_polysemous (ncode, codes, res);
+        } else if (precompute_mode == 2) {
+            this->scan_list_with_table (ncode, codes, res);
+        } else if (precompute_mode == 1) {
+            this->scan_list_with_pointer (ncode, codes, res);
+        } else if (precompute_mode == 0) {
+            this->scan_on_the_fly_dist (ncode, codes, res);
+        } else {
+            FAISS_THROW_MSG("bad precomp mode");
+        }
+    }
+
     size_t scan_codes (size_t ncode,
                        const uint8_t *codes,
                        const idx_t *ids,
@@ -1077,22 +1102,44 @@ struct IVFPQScanner:
             /* heap_ids */ heap_ids,
             /* nup */      0
         };
+        scan_list (ncode, codes, res);
+        return res.nup;
+    }
 
-        if (this->polysemous_ht > 0) {
-            assert(precompute_mode == 2);
-            this->scan_list_polysemous (ncode, codes, res);
-        } else if (precompute_mode == 2) {
-            this->scan_list_with_table (ncode, codes, res);
-        } else if (precompute_mode == 1) {
-            this->scan_list_with_pointer (ncode, codes, res);
-        } else if (precompute_mode == 0) {
-            this->scan_on_the_fly_dist (ncode, codes, res);
-        } else {
-            FAISS_THROW_MSG("bad precomp mode");
-        }
+    bool supports_reservoir () const override {
+        return true;
+    }
+
+    template <class CR>
+    size_t scan_codes_to_reservoir (size_t ncode,
+                                    const uint8_t *codes,
+                                    const idx_t *ids,
+                                    ReservoirTopN<CR> & rres) const
+    {
+        ReservoirSearchResults<CR> res = {
+            /* key */      this->key,
+            /* ids */      this->store_pairs ? nullptr : ids,
+            /* res */      rres,
+            /* nup */      0
+        };
+        scan_list (ncode, codes, res);
         return res.nup;
     }
 
+    size_t scan_codes_reservoir (
+            size_t ncode, const uint8_t *codes, const idx_t *ids,
+            ReservoirTopN<CMax<float, idx_t> > & res) const override
+    {
+        return scan_codes_to_reservoir (ncode, codes, ids, res);
+    }
+
+    size_t scan_codes_reservoir (
+            size_t ncode, const uint8_t *codes, const idx_t *ids,
+            ReservoirTopN<CMin<float, idx_t> > & res) const override
+    {
+        return scan_codes_to_reservoir (ncode, codes, ids, res);
+    }
+
     void scan_codes_range (size_t ncode,
                            const uint8_t *codes,
                            const idx_t *ids,
@@ -1105,20 +1152,7 @@ struct IVFPQScanner:
             /* radius */   radius,
             /* rres */     rres
         };
-
-        if (this->polysemous_ht > 0) {
-            assert(precompute_mode == 2);
-            this->scan_list_polysemous (ncode, codes, res);
-        } else if (precompute_mode == 2) {
-            this->scan_list_with_table (ncode, codes, res);
-        } else if (precompute_mode == 1) {
-            this->scan_list_with_pointer (ncode, codes, res);
-        } else if (precompute_mode == 0) {
-            this->scan_on_the_fly_dist (ncode, codes, res);
-        } else {
-            FAISS_THROW_MSG("bad precomp mode");
-        }
-
+        scan_list (ncode, codes, res);
     }
 };
 
@@ -16,7 +16,7 @@ namespace faiss {
 
 struct IndexInt8 {
     using idx_t = Index::idx_t;    ///< all indices are this type
-    using component_t = uint8_t;
+    using component_t = int8_t;
     using distance_t = int32_t;
 
     int d;                 ///< vector dimension
@@ -82,7 +82,8 @@ struct IndexInt8 {
      * RangeSearchResult structure, but they are integer. By convention,
      * only distances < radius (strict comparison) are returned,
      * ie. radius = 0 does not return any result and 1 returns only
-     * exact same vectors.
+     * exact same vectors. For the inner product, the vectors with
+     * ip > radius are returned.
      *
      * @param x           input vectors to search, size n * d
      * @param radius      search radius
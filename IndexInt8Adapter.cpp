@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexInt8Adapter.h>
+
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <algorithm>
+
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/utils.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace faiss {
+
+namespace {
+
+inline int8_t clamp_int8 (float v) {
+    v = roundf (v);
+    return v < -128 ? -128 : v > 127 ? 127 : int8_t(v);
+}
+
+} // namespace
+
+
+IndexInt8Adapter::IndexInt8Adapter (IndexInt8 *index, bool per_dimension):
+    Index (index->d, index->metric_type),
+    index (index), own_fields (false),
+    rangestat (ScalarQuantizer::RS_minmax), rangestat_arg (0),
+    per_dimension (per_dimension)
+{
+    FAISS_THROW_IF_NOT_MSG (
+        metric_type == METRIC_INNER_PRODUCT || metric_type == METRIC_L2,
+        "metric type not supported");
+    FAISS_THROW_IF_NOT_MSG (index->ntotal == 0,
+                            "int8 index should be empty in the beginning");
+    is_trained = false;
+}
+
+IndexInt8Adapter::IndexInt8Adapter ():
+    index (nullptr), own_fields (false),
+    rangestat (ScalarQuantizer::RS_minmax), rangestat_arg (0),
+    per_dimension (true)
+{}
+
+IndexInt8Adapter::~IndexInt8Adapter ()
+{
+    if (own_fields) delete index;
+}
+
+
+void IndexInt8Adapter::train (idx_t n, const float *x)
+{
+    // the ranges are estimated by the ScalarQuantizer, with
+    // trained = [vmin, vdiff], per dimension or for all dimensions
+    ScalarQuantizer sq (d, per_dimension ? ScalarQuantizer::QT_8bit :
+                        ScalarQuantizer::QT_8bit_uniform);
+    sq.rangestat = rangestat;
+    sq.rangestat_arg = rangestat_arg;
+    sq.train (n, x);
+
+    center.resize (d);
+    scale.resize (d);
+    float max_scale = 0;
+    for (int j = 0; j < d; j++) {
+        float vmin = per_dimension ? sq.trained[j] : sq.trained[0];
+        float vdiff = per_dimension ? sq.trained[d + j] : sq.trained[1];
+        center[j] = vmin + vdiff / 2;
+        scale[j] = vdiff / 255;
+        // constant dimensions
+        if (!(scale[j] > 0)) scale[j] = 1;
+        max_scale = std::max (max_scale, scale[j]);
+    }
+    if (metric_type == METRIC_L2) {
+        std::fill (scale.begin(), scale.end(), max_scale);
+    }
+
+    if (!index->is_trained) {
+        std::unique_ptr<int8_t[]> codes (new int8_t[n * d]);
+        encode (n, x, codes.get());
+        index->train (n, codes.get());
+    }
+    is_trained = true;
+}
+
+void IndexInt8Adapter::encode (idx_t n, const float *x, int8_t *codes) const
+{
+    FAISS_THROW_IF_NOT (is_trained);
+#pragma omp parallel for if(n > 1000)
+    for (idx_t i = 0; i < n; i++) {
+        const float *xi = x + i * d;
+        int8_t *ci = codes + i * d;
+        for (int j = 0; j < d; j++) {
+            ci[j] = clamp_int8 ((xi[j] - center[j]) / scale[j]);
+        }
+    }
+}
+
+void IndexInt8Adapter::decode (idx_t n, const int8_t *codes, float *x) const
+{
+#pragma omp parallel for if(n > 1000)
+    for (idx_t i = 0; i < n; i++) {
+        const int8_t *ci = codes + i * d;
+        float *xi = x + i * d;
+        for (int j = 0; j < d; j++) {
+            xi[j] = center[j] + scale[j] * ci[j];
+        }
+    }
+}
+
+void IndexInt8Adapter::encode_queries (
+        idx_t n, const float *x, int8_t *codes,
+        float *qscale, float *qoffset) const
+{
+    FAISS_THROW_IF_NOT (is_trained);
+    if (metric_type == METRIC_L2) {
+        encode (n, x, codes);
+        for (idx_t i = 0; i < n; i++) {
+            qscale[i] = scale[0] * scale[0];
+            qoffset[i] = 0;
+        }
+        return;
+    }
+
+#pragma omp parallel for if(n > 1000)
+    for (idx_t i = 0; i < n; i++) {
+        const float *xi = x + i * d;
+        int8_t *ci = codes + i * d;
+        float zmax = 0, offset = 0;
+        for (int j = 0; j < d; j++) {
+            zmax = std::max (zmax, std::abs (xi[j] * scale[j]));
+            offset += center[j] * xi[j];
+        }
+        float t = zmax > 0 ? zmax / 127 : 1;
+        for (int j = 0; j < d; j++) {
+            ci[j] = clamp_int8 (xi[j] * scale[j] / t);
+        }
+        qscale[i] = t;
+        qoffset[i] = offset;
+    }
+}
+
+void IndexInt8Adapter::add (idx_t n, const float *x)
+{
+    FAISS_THROW_IF_NOT (is_trained);
+    constexpr idx_t bs = 32768;
+    std::unique_ptr<int8_t[]> codes (new int8_t[std::min(bs, n) * d]);
+
+    for (idx_t b = 0; b < n; b += bs) {
+        idx_t bn = std::min (bs, n - b);
+        encode (bn, x + b * d, codes.get());
+        index->add (bn, codes.get());
+    }
+    ntotal = index->ntotal;
+}
+
+void IndexInt8Adapter::reset ()
+{
+    index->reset ();
+    ntotal = 0;
+}
+
+void IndexInt8Adapter::search (
+        idx_t n, const float *x, idx_t k,
+        float *distances, idx_t *labels) const
+{
+    FAISS_THROW_IF_NOT (is_trained);
+    constexpr idx_t bs = 32768;
+    idx_t bs1 = std::min (bs, n);
+    std::unique_ptr<int8_t[]> codes (new int8_t[bs1 * d]);
+    std::unique_ptr<float[]> qscale (new float[bs1]), qoffset (new float[bs1]);
+    std::unique_ptr<int32_t[]> idis (new int32_t[bs1 * k]);
+
+    float neutral = metric_type == METRIC_L2 ?
+        CMax<float, idx_t>::neutral () : CMin<float, idx_t>::neutral ();
+
+    for (idx_t b = 0; b < n; b += bs) {
+        idx_t bn = std::min (bs, n - b);
+        encode_queries (bn, x + b * d, codes.get(),
+                        qscale.get(), qoffset.get());
+        index->search (bn, codes.get(), k, idis.get(), labels + b * k);
+
+        for (idx_t i = 0; i < bn; i++) {
+            for (idx_t j = 0; j < k; j++) {
+                idx_t ij = i * k + j;
+                distances[b * k + ij] = labels[b * k + ij] < 0 ? neutral :
+                    qscale[i] * idis[ij] + qoffset[i];
+            }
+        }
+    }
+}
+
+void IndexInt8Adapter::range_search (
+        idx_t n, const float *x, float radius,
+        RangeSearchResult *result) const
+{
+    FAISS_THROW_IF_NOT_MSG (metric_type == METRIC_L2,
+                            "range search only supported for L2");
+    FAISS_THROW_IF_NOT (is_trained);
+
+    std::unique_ptr<int8_t[]> codes (new int8_t[n * d]);
+    std::unique_ptr<float[]> qscale (new float[n]), qoffset (new float[n]);
+    encode_queries (n, x, codes.get(), qscale.get(), qoffset.get());
+
+    // integer distance < ceil(radius / s) <=> s * distance < radius
+    float s = scale[0] * scale[0];
+    double iradius = std::ceil (radius / s);
+    iradius = std::min (iradius, double(std::numeric_limits<int>::max()));
+    index->range_search (n, codes.get(), int(iradius), result);
+
+    for (size_t i = 0; i < result->lims[n]; i++) {
+        result->distances[i] *= s;
+    }
+}
+
+size_t IndexInt8Adapter::remove_ids (const IDSelector &sel)
+{
+    size_t nremove = index->remove_ids (sel);
+    ntotal = index->ntotal;
+    return nremove;
+}
+
+void IndexInt8Adapter::reconstruct (idx_t key, float *recons) const
+{
+    std::vector<int8_t> code (d);
+    index->reconstruct (key, code.data());
+    decode (1, code.data(), recons);
+}
+
+size_t IndexInt8Adapter::sa_code_size () const
+{
+    return d;
+}
+
+void IndexInt8Adapter::sa_encode (idx_t n, const float *x,
+                                  uint8_t *bytes) const
+{
+    encode (n, x, (int8_t*)bytes);
+}
+
+void IndexInt8Adapter::sa_decode (idx_t n, const uint8_t *bytes,
+                                  float *x) const
+{
+    decode (n, (const int8_t*)bytes, x);
+}
+
+
+} // namespace faiss
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_INDEX_INT8_ADAPTER_H
+#define FAISS_INDEX_INT8_ADAPTER_H
+
+#include <vector>
+
+#include <faiss/Index.h>
+#include <faiss/IndexInt8.h>
+#include <faiss/impl/ScalarQuantizer.h>
+
+
+namespace faiss {
+
+
+/** Index with float inputs backed by an IndexInt8. The float vectors
+ * are quantized to int8 with ranges learned in train(), so that the
+ * int8 index searches them with the integer kernels, and the integer
+ * distances are rescaled to float.
+ *
+ * A database vector is stored as x_j ~= center_j + scale_j * q_j with
+ * q_j in [-128, 127]. The queries are encoded so that the integer
+ * distances are an affine function of the float ones:
+ *
+ *  - inner product: the query y is encoded as round(y_j * scale_j / t),
+ *    where the query scale t maps the largest component to 127. Then
+ *    <x, y> ~= t * <q, yq> + <center, y>. Scales and centers can be
+ *    per-dimension.
+ *
+ *  - L2: the query is encoded like the database vectors and
+ *    |x - y|^2 ~= scale^2 * |q - yq|^2. This requires the same scale
+ *    for all dimensions (the largest range is used), but the centers
+ *    can still be per-dimension.
+ */
+struct IndexInt8Adapter: Index {
+    /// the int8 index, of the same metric
+    IndexInt8 *index;
+    bool own_fields;  ///< whether the int8 index should be deallocated
+
+    /// how the range of the values is estimated
+    ScalarQuantizer::RangeStat rangestat;
+    float rangestat_arg;
+
+    /// learn one range per dimension (otherwise one for all dimensions)
+    bool per_dimension;
+
+    /// trained encoding, size d each
+    std::vector<float> center, scale;
+
+    explicit IndexInt8Adapter (IndexInt8 *index, bool per_dimension = true);
+
+    IndexInt8Adapter ();
+
+    /// encode database vectors to int8
+    void encode (idx_t n, const float *x, int8_t *codes) const;
+
+    /// decode int8 database vectors
+    void decode (idx_t n, const int8_t *codes, float *x) const;
+
+    /** encode queries to int8
+     *
+     * @param qscale   size n, multiplier of the integer distances
+     * @param qoffset  size n, added to the rescaled distances
+     */
+    void encode_queries (idx_t n, const float *x, int8_t *codes,
+                         float *qscale, float *qoffset) const;
+
+    void train(idx_t n, const float* x) override;
+
+    void add(idx_t n, const float* x) override;
+
+    void reset() override;
+
+    void search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels) const override;
+
+    /// only for METRIC_L2, where the radius does not depend on the query
+    void range_search(
+        idx_t n,
+        const float* x,
+        float radius,
+        RangeSearchResult* result) const override;
+
+    size_t remove_ids(const IDSelector& sel) override;
+
+    void reconstruct(idx_t key, float* recons) const override;
+
+    size_t sa_code_size () const override;
+
+    void sa_encode (idx_t n, const float *x,
+                    uint8_t *bytes) const override;
+
+    void sa_decode (idx_t n, const uint8_t *bytes,
+                    float *x) const override;
+
+    ~IndexInt8Adapter() override;
+};
+
+
+} // namespace faiss
+
+#endif
@@ -9,17 +9,31 @@
 #include <faiss/utils/extra_distances.h>
 #include <faiss/utils/utils.h>
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/hugepages.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/io.h>
 
 
 namespace faiss {
 
 IndexInt8Flat::IndexInt8Flat(idx_t d, MetricType metric) :
-        IndexInt8(d, metric) { }
+        IndexInt8(d, metric), xb_mmap(nullptr) { }
+
+IndexInt8Flat::IndexInt8Flat() : xb_mmap(nullptr) { }
+
+void
+IndexInt8Flat::unmap() {
+    if (!xb_mmap) return;
+    xb.assign(xb_mmap, xb_mmap + ntotal * d);
+    xb_mmap = nullptr;
+    mmap_file.reset();
+}
 
 void
 IndexInt8Flat::add(idx_t n, const int8_t *x) {
+    unmap();
+    hugepage_reserve (xb, (ntotal + n) * d);
     xb.insert(xb.end(), x, x + n * d);
     ntotal += n;
 }
@@ -27,39 +41,72 @@ IndexInt8Flat::add(idx_t n, const int8_t *x) {
 void
 IndexInt8Flat::reset() {
     xb.clear();
+    xb_mmap = nullptr;
+    mmap_file.reset();
     ntotal = 0;
 }
 
 void
 IndexInt8Flat::search(idx_t n, const int8_t *x, idx_t k, int *distances,
                       idx_t *labels) const {
-    FAISS_ASSERT(metric_type == METRIC_INNER_PRODUCT);
-
-    int_minheap_array_t res = {
-            size_t(n), size_t(k), labels, distances};
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        int_minheap_array_t res = {
+                size_t(n), size_t(k), labels, distances};
+        knn_inner_product(x, get_xb(), d, n, ntotal, &res);
+    } else if (metric_type == METRIC_L2) {
+        int_maxheap_array_t res = {
+                size_t(n), size_t(k), labels, distances};
+        knn_L2sqr(x, get_xb(), d, n, ntotal, &res);
+    } else {
+        FAISS_THROW_MSG("metric type not supported");
+    }
+}
 
-    knn_inner_product(x, xb.data(), d, n, ntotal, &res);
+void IndexInt8Flat::range_search(idx_t n, const int8_t *x, int radius,
+                                 RangeSearchResult *result) const {
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        range_search_inner_product(x, get_xb(), d, n, ntotal, radius, result);
+    } else if (metric_type == METRIC_L2) {
+        range_search_L2sqr(x, get_xb(), d, n, ntotal, radius, result);
+    } else {
+        FAISS_THROW_MSG("metric type not supported");
+    }
 }
 
 void IndexInt8Flat::reconstruct(IndexInt8::idx_t i, int8_t *recons) const {
-    IndexInt8::reconstruct(i, recons);
+    std::memcpy(recons, get_xb() + i * d, d);
 }
 
 void IndexInt8Flat::compute_distance_subset(IndexInt8::idx_t n,
                                             const int8_t *x, IndexInt8::idx_t k, int *distances,
                                             const IndexInt8::idx_t *labels) const {
-
+    switch (metric_type) {
+        case METRIC_INNER_PRODUCT:
+            i8vec_inner_products_by_idx(
+                distances, x, get_xb(), labels, d, n, k);
+            break;
+        case METRIC_L2:
+            i8vec_L2sqr_by_idx(
+                distances, x, get_xb(), labels, d, n, k);
+            break;
+        default:
+            FAISS_THROW_MSG("metric type not supported");
+    }
 }
 
 size_t IndexInt8Flat::remove_id(IndexInt8::idx_t i) {
     FAISS_THROW_IF_NOT(i >= 0 && i < ntotal);
+    unmap();
 
     std::memcpy(&xb[i * d], &xb[(ntotal-1) * d], d);
     ntotal -= 1;
+    xb.resize(ntotal * d);
+    return 1;
 }
 
 void IndexInt8Flat::update(IndexInt8::idx_t i, const int8_t *x) {
     FAISS_THROW_IF_NOT(i >= 0 && i < ntotal);
+    unmap();
 
     std::memcpy(&xb[i * d], x, d);
 }
@@ -6,18 +6,39 @@
 #define FAISS_INDEXINT8FLAT_H
 
 #include <vector>
+#include <memory>
 
 #include <faiss/IndexInt8.h>
 
 
 namespace faiss {
 
+struct MmappedFile;
+
 struct IndexInt8Flat : public IndexInt8 {
     /// database vectors, size ntotal * d
     std::vector<int8_t> xb;
 
+    /** When the index is read with IO_FLAG_MMAP, the database vectors
+     * are not copied to xb but point into a mapping of the file. Before
+     * any modification of the index, they are copied to xb and the
+     * mapping is released.
+     */
+    std::shared_ptr<MmappedFile> mmap_file;
+    const int8_t *xb_mmap;
+
     explicit IndexInt8Flat (idx_t d, MetricType metric = METRIC_INNER_PRODUCT);
 
+    IndexInt8Flat ();
+
+    /// database vectors, whether they are in xb or memory-mapped
+    const int8_t *get_xb () const {
+        return xb_mmap ? xb_mmap : xb.data();
+    }
+
+    /// copy memory-mapped vectors to xb (no-op if not mapped)
+    void unmap ();
+
     void add(idx_t n, const int8_t* x) override;
 
     void reset() override;
@@ -29,6 +50,12 @@ struct IndexInt8Flat : public IndexInt8 {
             int* distances,
             idx_t* labels) const override;
 
+    void range_search(
+            idx_t n,
+            const int8_t* x,
+            int radius,
+            RangeSearchResult* result) const override;
+
     void reconstruct(idx_t i, int8_t* recons) const override;
 
     /** compute distance with a subset of vectors
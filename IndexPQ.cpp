@@ -20,6 +20,7 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/utils/hamming.h>
+#include <faiss/utils/hugepages.h>
 
 namespace faiss {
 
@@ -76,6 +77,7 @@ void IndexPQ::train (idx_t n, const float *x)
 void IndexPQ::add (idx_t n, const float *x)
 {
     FAISS_THROW_IF_NOT (is_trained);
+    hugepage_reserve (codes, (n + ntotal) * pq.code_size);
     codes.resize ((n + ntotal) * pq.code_size);
     pq.compute_codes (x, &codes[ntotal * pq.code_size], n);
     ntotal += n;
@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexRefineInt8.h>
+
+#include <memory>
+
+#include <faiss/utils/Heap.h>
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace faiss {
+
+namespace {
+
+typedef Index::idx_t idx_t;
+
+void int8_to_float (size_t n, const int8_t *x, float *xf)
+{
+    for (size_t i = 0; i < n; i++) {
+        xf[i] = x[i];
+    }
+}
+
+template<class C>
+void reorder_2_heaps (
+      idx_t n,
+      idx_t k, idx_t *labels, int32_t *distances,
+      idx_t k_base, const idx_t *base_labels, const int32_t *base_distances)
+{
+#pragma omp parallel for
+    for (idx_t i = 0; i < n; i++) {
+        idx_t *idxo = labels + i * k;
+        int32_t *diso = distances + i * k;
+        const idx_t *idxi = base_labels + i * k_base;
+        const int32_t *disi = base_distances + i * k_base;
+
+        heap_heapify<C> (k, diso, idxo, disi, idxi, k);
+        if (k_base != k) { // add remaining elements
+            heap_addn<C> (k, diso, idxo, disi + k, idxi + k, k_base - k);
+        }
+        heap_reorder<C> (k, diso, idxo);
+    }
+}
+
+} // namespace
+
+
+IndexRefineInt8::IndexRefineInt8 (Index *base_index):
+    IndexInt8 (base_index->d, base_index->metric_type),
+    refine_index (base_index->d, base_index->metric_type),
+    base_index (base_index), own_fields (false),
+    k_factor (1)
+{
+    is_trained = base_index->is_trained;
+    FAISS_THROW_IF_NOT_MSG (base_index->ntotal == 0,
+                      "base_index should be empty in the beginning");
+}
+
+IndexRefineInt8::IndexRefineInt8 () {
+    base_index = nullptr;
+    own_fields = false;
+    k_factor = 1;
+}
+
+
+void IndexRefineInt8::train (idx_t n, const int8_t *x)
+{
+    std::unique_ptr<float[]> xf (new float[n * d]);
+    int8_to_float (n * d, x, xf.get());
+    base_index->train (n, xf.get());
+    is_trained = true;
+}
+
+void IndexRefineInt8::add (idx_t n, const int8_t *x) {
+    FAISS_THROW_IF_NOT (is_trained);
+    std::unique_ptr<float[]> xf (new float[n * d]);
+    int8_to_float (n * d, x, xf.get());
+    base_index->add (n, xf.get());
+    refine_index.add (n, x);
+    ntotal = refine_index.ntotal;
+}
+
+void IndexRefineInt8::reset ()
+{
+    base_index->reset ();
+    refine_index.reset ();
+    ntotal = 0;
+}
+
+void IndexRefineInt8::search (
+              idx_t n, const int8_t *x, idx_t k,
+              int32_t *distances, idx_t *labels) const
+{
+    FAISS_THROW_IF_NOT (is_trained);
+    idx_t k_base = idx_t (k * k_factor);
+    FAISS_THROW_IF_NOT (k_base >= k);
+
+    std::unique_ptr<idx_t[]> base_labels (new idx_t [n * k_base]);
+    std::unique_ptr<int32_t[]> base_distances (new int32_t [n * k_base]);
+
+    {
+        std::unique_ptr<float[]> xf (new float[n * d]);
+        int8_to_float (n * d, x, xf.get());
+        std::unique_ptr<float[]> base_dis (new float [n * k_base]);
+        base_index->search (n, xf.get(), k_base, base_dis.get(),
+                            base_labels.get());
+    }
+
+    for (idx_t i = 0; i < n * k_base; i++) {
+        FAISS_ASSERT (base_labels[i] >= -1 && base_labels[i] < ntotal);
+    }
+
+    // compute the exact distances. The entries with label -1 are not
+    // computed, they get the neutral value of the heap
+    bool is_ip = metric_type == METRIC_INNER_PRODUCT;
+    int32_t neutral = is_ip ? CMin<int32_t, idx_t>::neutral() :
+        CMax<int32_t, idx_t>::neutral();
+    for (idx_t i = 0; i < n * k_base; i++) {
+        base_distances[i] = neutral;
+    }
+    refine_index.compute_distance_subset (
+        n, x, k_base, base_distances.get(), base_labels.get());
+
+    // sort and store result
+    if (metric_type == METRIC_L2) {
+        typedef CMax <int32_t, idx_t> C;
+        reorder_2_heaps<C> (
+            n, k, labels, distances,
+            k_base, base_labels.get(), base_distances.get());
+    } else if (metric_type == METRIC_INNER_PRODUCT) {
+        typedef CMin <int32_t, idx_t> C;
+        reorder_2_heaps<C> (
+            n, k, labels, distances,
+            k_base, base_labels.get(), base_distances.get());
+    } else {
+        FAISS_THROW_MSG("Metric type not supported");
+    }
+}
+
+void IndexRefineInt8::reconstruct (idx_t key, int8_t *recons) const
+{
+    refine_index.reconstruct (key, recons);
+}
+
+
+IndexRefineInt8::~IndexRefineInt8 ()
+{
+    if (own_fields) delete base_index;
+}
+
+
+} // namespace faiss
@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_INDEX_REFINE_INT8_H
+#define FAISS_INDEX_REFINE_INT8_H
+
+#include <faiss/Index.h>
+#include <faiss/IndexInt8Flat.h>
+
+
+namespace faiss {
+
+
+/** Same as IndexRefineFlat, for int8 vectors. The base index is any
+ * float index that is fed with the int8 vectors converted to float. The
+ * results of the base index are re-ranked with the exact int8
+ * distances, computed from the original vectors stored in an
+ * IndexInt8Flat (4x less memory than the IndexFlat of IndexRefineFlat).
+ */
+struct IndexRefineInt8: IndexInt8 {
+
+    /// storage for full vectors
+    IndexInt8Flat refine_index;
+
+    /// faster index to pre-select the vectors that should be filtered
+    Index *base_index;
+    bool own_fields;  ///< should the base index be deallocated?
+
+    /// factor between k requested in search and the k requested from
+    /// the base_index (should be >= 1)
+    float k_factor;
+
+    explicit IndexRefineInt8 (Index *base_index);
+
+    IndexRefineInt8 ();
+
+    void train(idx_t n, const int8_t* x) override;
+
+    void add(idx_t n, const int8_t* x) override;
+
+    void reset() override;
+
+    void search(
+        idx_t n,
+        const int8_t* x,
+        idx_t k,
+        int32_t* distances,
+        idx_t* labels) const override;
+
+    void reconstruct(idx_t key, int8_t* recons) const override;
+
+    ~IndexRefineInt8() override;
+};
+
+
+} // namespace faiss
+
+#endif
@@ -87,9 +87,7 @@ IndexReplicasTemplate<IndexT>::search(idx_t n,
     return;
   }
 
-  auto dim = this->d;
-  size_t componentsPerVec =
-    sizeof(component_t) == 1 ? (dim + 7) / 8 : dim;
+  size_t componentsPerVec = components_per_vector<IndexT>(this);
 
   // Partition the query by the number of indices we have
   faiss::Index::idx_t queriesPerIndex =
@@ -119,5 +117,6 @@ IndexReplicasTemplate<IndexT>::search(idx_t n,
 // explicit instantiations
 template struct IndexReplicasTemplate<Index>;
 template struct IndexReplicasTemplate<IndexBinary>;
+template struct IndexReplicasTemplate<IndexInt8>;
 
 } // namespace
@@ -9,6 +9,7 @@
 
 #include <faiss/Index.h>
 #include <faiss/IndexBinary.h>
+#include <faiss/IndexInt8.h>
 #include <faiss/impl/ThreadedIndex.h>
 
 namespace faiss {
@@ -72,5 +73,6 @@ class IndexReplicasTemplate : public ThreadedIndex<IndexT> {
 
 using IndexReplicas = IndexReplicasTemplate<Index>;
 using IndexBinaryReplicas = IndexReplicasTemplate<IndexBinary>;
+using IndexInt8Replicas = IndexReplicasTemplate<IndexInt8>;
 
 } // namespace
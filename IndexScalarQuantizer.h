@@ -105,8 +105,6 @@ struct IndexIVFScalarQuantizer: IndexIVF {
                         uint8_t * codes,
                         bool include_listnos=false) const override;
 
-    void add_with_ids(idx_t n, const float* x, const idx_t* xids) override;
-
     InvertedListScanner *get_InvertedListScanner (bool store_pairs)
         const override;
 
@@ -10,11 +10,16 @@
 #include <faiss/IndexShards.h>
 
 #include <cstdio>
+#include <algorithm>
 #include <functional>
 
+#include <faiss/index_io.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/ThreadPool.h>
 #include <faiss/utils/WorkerThread.h>
+#include <faiss/utils/numa.h>
 
 namespace faiss {
 
@@ -55,53 +60,83 @@ merge_tables(long n, long k, long nshard,
   using distance_t = typename IndexClass::distance_t;
 
   long stride = n * k;
-#pragma omp parallel
-  {
+  WorkRange range(0, n, 64);
+  get_thread_pool().parallel(0, [&](int) {
     std::vector<int> buf (2 * nshard);
     int * pointer = buf.data();
     int * shard_ids = pointer + nshard;
     std::vector<distance_t> buf2 (nshard);
     distance_t * heap_vals = buf2.data();
-#pragma omp for
-    for (long i = 0; i < n; i++) {
-      // the heap maps values to the shard where they are
-      // produced.
-      const distance_t *D_in = all_distances.data() + i * k;
-      const idx_t *I_in = all_labels.data() + i * k;
-      int heap_size = 0;
-
-      for (long s = 0; s < nshard; s++) {
-        pointer[s] = 0;
-        if (I_in[stride * s] >= 0) {
-          heap_push<C> (++heap_size, heap_vals, shard_ids,
-                        D_in[stride * s], s);
+    size_t i0, i1;
+    while (range.next(i0, i1)) {
+      for (size_t i = i0; i < i1; i++) {
+        // the heap maps values to the shard where they are
+        // produced.
+        const distance_t *D_in = all_distances.data() + i * k;
+        const idx_t *I_in = all_labels.data() + i * k;
+        int heap_size = 0;
+
+        for (long s = 0; s < nshard; s++) {
+          pointer[s] = 0;
+          if (I_in[stride * s] >= 0) {
+            heap_push<C> (++heap_size, heap_vals, shard_ids,
+                          D_in[stride * s], s);
+          }
         }
-      }
 
-      distance_t *D = distances + i * k;
-      idx_t *I = labels + i * k;
-
-      for (int j = 0; j < k; j++) {
-        if (heap_size == 0) {
-          I[j] = -1;
-          D[j] = C::neutral();
-        } else {
-          // pop best element
-          int s = shard_ids[0];
-          int & p = pointer[s];
-          D[j] = heap_vals[0];
-          I[j] = I_in[stride * s + p] + translations[s];
-
-          heap_pop<C> (heap_size--, heap_vals, shard_ids);
-          p++;
-          if (p < k && I_in[stride * s + p] >= 0) {
-            heap_push<C> (++heap_size, heap_vals, shard_ids,
-                          D_in[stride * s + p], s);
+        distance_t *D = distances + i * k;
+        idx_t *I = labels + i * k;
+
+        for (int j = 0; j < k; j++) {
+          if (heap_size == 0) {
+            I[j] = -1;
+            D[j] = C::neutral();
+          } else {
+            // pop best element
+            int s = shard_ids[0];
+            int & p = pointer[s];
+            D[j] = heap_vals[0];
+            I[j] = I_in[stride * s + p] + translations[s];
+
+            heap_pop<C> (heap_size--, heap_vals, shard_ids);
+            p++;
+            if (p < k && I_in[stride * s + p] >= 0) {
+              heap_push<C> (++heap_size, heap_vals, shard_ids,
+                            D_in[stride * s + p], s);
+            }
           }
         }
       }
     }
-  }
+  });
+}
+
+
+/* copies of an index through serialization, used to allocate a copy
+ * of the index from the thread that will use it. */
+
+Index *copy_index_via_io(const Index *index) {
+  VectorIOWriter writer;
+  write_index(index, &writer);
+  VectorIOReader reader;
+  reader.data.swap(writer.data);
+  return read_index(&reader);
+}
+
+IndexBinary *copy_index_via_io(const IndexBinary *index) {
+  VectorIOWriter writer;
+  write_index_binary(index, &writer);
+  VectorIOReader reader;
+  reader.data.swap(writer.data);
+  return read_index_binary(&reader);
+}
+
+IndexInt8 *copy_index_via_io(const IndexInt8 *index) {
+  VectorIOWriter writer;
+  write_index_int8(index, &writer);
+  VectorIOReader reader;
+  reader.data.swap(writer.data);
+  return read_index_int8(&reader);
 }
 
 } // anonymous namespace
@@ -137,10 +172,98 @@ IndexShardsTemplate<IndexT>::onAfterAddIndex(IndexT* index /* unused */) {
 
 template <typename IndexT>
 void
-IndexShardsTemplate<IndexT>::onAfterRemoveIndex(IndexT* index /* unused */) {
+IndexShardsTemplate<IndexT>::onAfterRemoveIndex(IndexT* index) {
+  shardNumaNodes_.erase(index);
   sync_with_shard_indexes();
 }
 
+template <typename IndexT>
+void
+IndexShardsTemplate<IndexT>::set_shard_numa_node(int i, int node,
+                                                 bool relocate) {
+  FAISS_THROW_IF_NOT_MSG(this->isThreaded_,
+                         "NUMA placement requires a threaded IndexShards");
+  FAISS_THROW_IF_NOT_FMT(i >= 0 && i < this->count(),
+                         "invalid shard %d", i);
+  FAISS_THROW_IF_NOT_MSG(!relocate || this->own_fields,
+                         "relocating the shards requires own_fields");
+  std::vector<int> nodes = numa_get_nodes();
+  FAISS_THROW_IF_NOT_FMT(
+     std::find(nodes.begin(), nodes.end(), node) != nodes.end(),
+     "no CPU available on NUMA node %d", node);
+
+  auto& p = this->indices_[i];
+  IndexT *index = p.first;
+  IndexT *new_index = nullptr;
+
+  // the binding and the copy are done by the worker thread itself, so
+  // that the copy is allocated on the node
+  auto fut = p.second->add([index, node, relocate, &new_index]() {
+      numa_bind_thread_and_team(node);
+      if (relocate && index->ntotal > 0) {
+        new_index = copy_index_via_io(index);
+      }
+    });
+  fut.get();
+
+  shardNumaNodes_.erase(index);
+  if (new_index) {
+    p.first = new_index;
+    delete index;
+    index = new_index;
+  }
+  shardNumaNodes_[index] = node;
+}
+
+template <typename IndexT>
+void
+IndexShardsTemplate<IndexT>::place_shards_on_numa_nodes(bool relocate) {
+  std::vector<int> nodes = numa_get_nodes();
+  int nnode = nodes.size();
+  std::vector<double> ncpu(nnode);
+  for (int j = 0; j < nnode; j++) {
+    ncpu[j] = std::max(numa_node_cpus(nodes[j]).size(), size_t(1));
+  }
+
+  // largest shards first, each to the node that is the least loaded
+  // once it gets it
+  int nshard = this->count();
+  std::vector<int> order(nshard);
+  for (int i = 0; i < nshard; i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+      return this->at(a)->ntotal > this->at(b)->ntotal;
+    });
+
+  std::vector<double> load(nnode);
+  std::vector<int> nshard_per_node(nnode);
+  for (int i : order) {
+    double size = this->at(i)->ntotal;
+    int best = 0;
+    for (int j = 1; j < nnode; j++) {
+      double lj = (load[j] + size) / ncpu[j];
+      double lbest = (load[best] + size) / ncpu[best];
+      if (lj < lbest || (lj == lbest &&
+          nshard_per_node[j] / ncpu[j] < nshard_per_node[best] / ncpu[best])) {
+        best = j;
+      }
+    }
+    load[best] += size;
+    nshard_per_node[best]++;
+    set_shard_numa_node(i, nodes[best], relocate);
+  }
+}
+
+template <typename IndexT>
+int
+IndexShardsTemplate<IndexT>::get_shard_numa_node(int i) const {
+  FAISS_THROW_IF_NOT_FMT(i >= 0 && i < this->count(),
+                         "invalid shard %d", i);
+  auto it = shardNumaNodes_.find(this->at(i));
+  return it == shardNumaNodes_.end() ? -1 : it->second;
+}
+
 template <typename IndexT>
 void
 IndexShardsTemplate<IndexT>::sync_with_shard_indexes() {
@@ -227,8 +350,7 @@ IndexShardsTemplate<IndexT>::add_with_ids(idx_t n,
     ids = aids.data();
   }
 
-  size_t components_per_vec =
-    sizeof(component_t) == 1 ? (this->d + 7) / 8 : this->d;
+  size_t components_per_vec = components_per_vector<IndexT>(this);
 
   auto fn =
     [n, ids, x, nshard, components_per_vec](int no, IndexT *index) {
@@ -313,5 +435,6 @@ IndexShardsTemplate<IndexT>::search(idx_t n,
 // explicit instanciations
 template struct IndexShardsTemplate<Index>;
 template struct IndexShardsTemplate<IndexBinary>;
+template struct IndexShardsTemplate<IndexInt8>;
 
 } // namespace faiss
@@ -9,8 +9,11 @@
 
 #include <faiss/Index.h>
 #include <faiss/IndexBinary.h>
+#include <faiss/IndexInt8.h>
 #include <faiss/impl/ThreadedIndex.h>
 
+#include <unordered_map>
+
 namespace faiss {
 
 /**
@@ -85,16 +88,40 @@ struct IndexShardsTemplate : public ThreadedIndex<IndexT> {
 
   bool successive_ids;
 
+  /**
+   * NUMA placement, in threaded mode only. A shard placed on a node
+   * is served by a worker thread that runs on the CPUs of the node,
+   * with OpenMP teams of the size of the node, and the memory it
+   * allocates (in add, train) comes preferably from the node.
+   *
+   * @param relocate  also move the data the shard already holds to the
+   *                  node. The shard is replaced with a copy made
+   *                  on the node (via serialization), so this requires
+   *                  own_fields and invalidates the pointer to the shard.
+   */
+  void set_shard_numa_node(int i, int node, bool relocate = true);
+
+  /// place all the shards on the NUMA nodes, balancing the nb of
+  /// vectors per CPU of each node. Empty shards are spread round-robin.
+  void place_shards_on_numa_nodes(bool relocate = true);
+
+  /// node shard i is placed on, -1 if it was not placed
+  int get_shard_numa_node(int i) const;
+
  protected:
   /// Called just after an index is added
   void onAfterAddIndex(IndexT* index) override;
 
   /// Called just after an index is removed
   void onAfterRemoveIndex(IndexT* index) override;
+
+  /// NUMA node of the placed shards
+  std::unordered_map<const IndexT*, int> shardNumaNodes_;
 };
 
 using IndexShards = IndexShardsTemplate<Index>;
 using IndexBinaryShards = IndexShardsTemplate<IndexBinary>;
+using IndexInt8Shards = IndexShardsTemplate<IndexInt8>;
 
 
 } // namespace faiss
@@ -10,8 +10,12 @@
 #include <faiss/InvertedLists.h>
 
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 
 #include <faiss/utils/utils.h>
+#include <faiss/utils/ChunkArena.h>
+#include <faiss/utils/hugepages.h>
 #include <faiss/impl/FaissAssert.h>
 
 namespace faiss {
@@ -47,6 +51,22 @@ void InvertedLists::release_ids (size_t, const idx_t *) const
 void InvertedLists::prefetch_lists (const idx_t *, int) const
 {}
 
+size_t InvertedLists::segment_size () const
+{
+    return 0;
+}
+
+bool InvertedLists::ids_on_demand () const
+{
+    return false;
+}
+
+void InvertedLists::get_segment (size_t, size_t,
+                                 const uint8_t **, const idx_t **) const
+{
+    FAISS_THROW_MSG ("not implemented");
+}
+
 const uint8_t * InvertedLists::get_single_code (
                    size_t list_no, size_t offset) const
 {
@@ -147,6 +167,8 @@ size_t ArrayInvertedLists::add_entries (
     if (n_entry == 0) return 0;
     assert (list_no < nlist);
     size_t o = ids [list_no].size();
+    hugepage_reserve (ids[list_no], o + n_entry);
+    hugepage_reserve (codes[list_no], (o + n_entry) * code_size);
     ids [list_no].resize (o + n_entry);
     memcpy (&ids[list_no][o], ids_in, sizeof (ids_in[0]) * n_entry);
     codes [list_no].resize ((o + n_entry) * code_size);
@@ -193,6 +215,431 @@ void ArrayInvertedLists::update_entries (
 ArrayInvertedLists::~ArrayInvertedLists ()
 {}
 
+/*****************************************
+ * ChunkedInvertedLists implementation
+ ******************************************/
+
+ChunkedInvertedLists::ChunkedInvertedLists (
+      size_t nlist, size_t code_size, size_t chunk_size,
+      bool use_hugepages):
+    InvertedLists (nlist, code_size), chunk_size (chunk_size),
+    arena (nullptr), sizes (nlist), chunks (nlist)
+{
+    FAISS_THROW_IF_NOT (chunk_size > 0);
+    arena = new ChunkArena (
+        chunk_size * (sizeof(idx_t) + code_size), use_hugepages);
+}
+
+size_t ChunkedInvertedLists::list_size (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return sizes[list_no];
+}
+
+const uint8_t * ChunkedInvertedLists::get_codes (size_t list_no) const
+{
+    assert (list_no < nlist);
+    const std::vector<uint8_t *> & cl = chunks[list_no];
+    if (cl.size() == 0) {
+        return nullptr;
+    } else if (cl.size() == 1) {
+        return chunk_codes (cl[0]);
+    }
+    size_t n = sizes[list_no];
+    uint8_t *codes = new uint8_t [n * code_size];
+    for (size_t c = 0; c < cl.size(); c++) {
+        size_t j0 = c * chunk_size;
+        size_t nc = std::min (chunk_size, n - j0);
+        memcpy (codes + j0 * code_size, chunk_codes (cl[c]), nc * code_size);
+    }
+    return codes;
+}
+
+const InvertedLists::idx_t * ChunkedInvertedLists::get_ids (
+      size_t list_no) const
+{
+    assert (list_no < nlist);
+    const std::vector<uint8_t *> & cl = chunks[list_no];
+    if (cl.size() == 0) {
+        return nullptr;
+    } else if (cl.size() == 1) {
+        return chunk_ids (cl[0]);
+    }
+    size_t n = sizes[list_no];
+    idx_t *ids = new idx_t [n];
+    for (size_t c = 0; c < cl.size(); c++) {
+        size_t j0 = c * chunk_size;
+        size_t nc = std::min (chunk_size, n - j0);
+        memcpy (ids + j0, chunk_ids (cl[c]), nc * sizeof(idx_t));
+    }
+    return ids;
+}
+
+bool ChunkedInvertedLists::in_chunks (size_t list_no, const void *ptr) const
+{
+    const uint8_t *p = (const uint8_t*)ptr;
+    for (const uint8_t *chunk : chunks[list_no]) {
+        if (p >= chunk && p < chunk + arena->chunk_bytes) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChunkedInvertedLists::release_codes (
+      size_t list_no, const uint8_t *codes) const
+{
+    // get_single_code returns pointers into the chunks
+    if (codes && !in_chunks (list_no, codes)) {
+        delete [] codes;
+    }
+}
+
+void ChunkedInvertedLists::release_ids (
+      size_t list_no, const idx_t *ids) const
+{
+    if (ids && !in_chunks (list_no, ids)) {
+        delete [] ids;
+    }
+}
+
+InvertedLists::idx_t ChunkedInvertedLists::get_single_id (
+      size_t list_no, size_t offset) const
+{
+    assert (offset < sizes[list_no]);
+    return chunk_ids (chunks[list_no][offset / chunk_size])
+        [offset % chunk_size];
+}
+
+const uint8_t * ChunkedInvertedLists::get_single_code (
+      size_t list_no, size_t offset) const
+{
+    assert (offset < sizes[list_no]);
+    return chunk_codes (chunks[list_no][offset / chunk_size]) +
+        (offset % chunk_size) * code_size;
+}
+
+size_t ChunkedInvertedLists::segment_size () const
+{
+    return chunk_size;
+}
+
+void ChunkedInvertedLists::get_segment (
+      size_t list_no, size_t s,
+      const uint8_t **codes, const idx_t **ids) const
+{
+    assert (s < chunks[list_no].size());
+    uint8_t *chunk = chunks[list_no][s];
+    *codes = chunk_codes (chunk);
+    *ids = chunk_ids (chunk);
+}
+
+size_t ChunkedInvertedLists::add_entries (
+      size_t list_no, size_t n_entry,
+      const idx_t* ids_in, const uint8_t *code)
+{
+    if (n_entry == 0) return 0;
+    assert (list_no < nlist);
+    size_t o = sizes[list_no];
+    resize (list_no, o + n_entry);
+    update_entries (list_no, o, n_entry, ids_in, code);
+    return o;
+}
+
+void ChunkedInvertedLists::update_entries (
+      size_t list_no, size_t offset, size_t n_entry,
+      const idx_t *ids_in, const uint8_t *codes_in)
+{
+    assert (list_no < nlist);
+    assert (n_entry + offset <= sizes[list_no]);
+    const std::vector<uint8_t *> & cl = chunks[list_no];
+    size_t j = offset, j1 = offset + n_entry;
+    while (j < j1) {
+        uint8_t *chunk = cl[j / chunk_size];
+        size_t jc = j % chunk_size;
+        size_t nc = std::min (chunk_size - jc, j1 - j);
+        memcpy (chunk_ids (chunk) + jc, ids_in + (j - offset),
+                nc * sizeof(idx_t));
+        memcpy (chunk_codes (chunk) + jc * code_size,
+                codes_in + (j - offset) * code_size, nc * code_size);
+        j += nc;
+    }
+}
+
+void ChunkedInvertedLists::resize (size_t list_no, size_t new_size)
+{
+    std::vector<uint8_t *> & cl = chunks[list_no];
+    size_t nchunk = (new_size + chunk_size - 1) / chunk_size;
+    while (cl.size() > nchunk) {
+        arena->free_chunk (cl.back());
+        cl.pop_back ();
+    }
+    while (cl.size() < nchunk) {
+        cl.push_back (arena->alloc_chunk());
+    }
+    sizes[list_no] = new_size;
+}
+
+void ChunkedInvertedLists::reset ()
+{
+    for (size_t i = 0; i < nlist; i++) {
+        chunks[i].clear ();
+        sizes[i] = 0;
+    }
+    ChunkArena *new_arena = new ChunkArena (
+        arena->chunk_bytes, arena->use_hugepages);
+    delete arena;
+    arena = new_arena;
+}
+
+ChunkedInvertedLists::~ChunkedInvertedLists ()
+{
+    delete arena;
+}
+
+/*****************************************
+ * CompressedIdsInvertedLists implementation
+ ******************************************/
+
+namespace {
+
+int nbits_for (uint64_t x)
+{
+    int nbits = 0;
+    while (nbits < 64 && (x >> nbits) != 0) {
+        nbits++;
+    }
+    return nbits;
+}
+
+void write_bits (uint64_t *bits, size_t pos, int nbits, uint64_t x)
+{
+    if (nbits == 0) return;
+    size_t i = pos >> 6;
+    int shift = pos & 63;
+    bits[i] |= x << shift;
+    if (shift + nbits > 64) {
+        bits[i + 1] |= x >> (64 - shift);
+    }
+}
+
+uint64_t read_bits (const uint64_t *bits, size_t pos, int nbits)
+{
+    if (nbits == 0) return 0;
+    size_t i = pos >> 6;
+    int shift = pos & 63;
+    uint64_t x = bits[i] >> shift;
+    if (shift + nbits > 64) {
+        x |= bits[i + 1] << (64 - shift);
+    }
+    return nbits == 64 ? x : x & ((uint64_t(1) << nbits) - 1);
+}
+
+} // anonymous namespace
+
+
+CompressedIdsInvertedLists::CompressedIdsInvertedLists (
+      size_t nlist, size_t code_size, size_t block_size):
+    InvertedLists (nlist, code_size),
+    block_size (block_size)
+{
+    FAISS_THROW_IF_NOT (block_size > 0);
+    codes.resize (nlist);
+    ids.resize (nlist);
+}
+
+CompressedIdsInvertedLists::CompressedIdsInvertedLists (
+      const InvertedLists & il, size_t block_size):
+    CompressedIdsInvertedLists (il.nlist, il.code_size, block_size)
+{
+#pragma omp parallel for
+    for (idx_t i = 0; i < nlist; i++) {
+        size_t n = il.list_size (i);
+        if (n > 0) {
+            add_entries (i, n, ScopedIds (&il, i).get (),
+                         ScopedCodes (&il, i).get ());
+        }
+    }
+}
+
+size_t CompressedIdsInvertedLists::list_size (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return ids[list_no].size;
+}
+
+const uint8_t * CompressedIdsInvertedLists::get_codes (size_t list_no) const
+{
+    assert (list_no < nlist);
+    return codes[list_no].data();
+}
+
+const InvertedLists::idx_t * CompressedIdsInvertedLists::get_ids (
+      size_t list_no) const
+{
+    size_t n = list_size (list_no);
+    if (n == 0) {
+        return nullptr;
+    }
+    idx_t *out = new idx_t [n];
+    decode_ids (list_no, 0, n, out);
+    return out;
+}
+
+void CompressedIdsInvertedLists::release_ids (
+      size_t, const idx_t *ids) const
+{
+    delete [] ids;
+}
+
+InvertedLists::idx_t CompressedIdsInvertedLists::get_single_id (
+      size_t list_no, size_t offset) const
+{
+    const IdList & il = ids[list_no];
+    assert (offset < il.size);
+    size_t b = offset / block_size;
+    int nbits = il.nbits[b];
+    return il.bases[b] + (idx_t)read_bits (
+        il.bits.data(), il.bit_ofs[b] + (offset % block_size) * nbits, nbits);
+}
+
+bool CompressedIdsInvertedLists::ids_on_demand () const
+{
+    return true;
+}
+
+void CompressedIdsInvertedLists::decode_ids (
+      size_t list_no, size_t j0, size_t j1, idx_t *out) const
+{
+    const IdList & il = ids[list_no];
+    assert (j1 <= il.size);
+    for (size_t j = j0; j < j1; ) {
+        size_t b = j / block_size;
+        size_t je = std::min (j1, (b + 1) * block_size);
+        int nbits = il.nbits[b];
+        size_t pos = il.bit_ofs[b] + (j - b * block_size) * nbits;
+        for (; j < je; j++) {
+            *out++ = il.bases[b] + (idx_t)read_bits (
+                il.bits.data(), pos, nbits);
+            pos += nbits;
+        }
+    }
+}
+
+size_t CompressedIdsInvertedLists::pop_tail (
+      size_t list_no, size_t j0, std::vector<idx_t> & tail)
+{
+    IdList & il = ids[list_no];
+    size_t b = j0 / block_size;
+    size_t jb = b * block_size;
+    tail.resize (il.size - jb);
+    decode_ids (list_no, jb, il.size, tail.data());
+
+    if (b < il.bases.size()) {
+        il.bits.resize ((il.bit_ofs[b] + 63) / 64);
+        // the first block kept may share its last word with block b
+        if (il.bit_ofs[b] % 64 != 0) {
+            il.bits.back() &= (uint64_t(1) << (il.bit_ofs[b] % 64)) - 1;
+        }
+        il.bases.resize (b);
+        il.nbits.resize (b);
+        il.bit_ofs.resize (b);
+    }
+    il.size = jb;
+    return jb;
+}
+
+void CompressedIdsInvertedLists::push_blocks (
+      size_t list_no, size_t n, const idx_t *ids_in)
+{
+    IdList & il = ids[list_no];
+    assert (il.size % block_size == 0);
+    size_t pos = il.bit_ofs.empty() ? 0 :
+        il.bit_ofs.back() + block_size * il.nbits.back();
+
+    for (size_t j0 = 0; j0 < n; j0 += block_size) {
+        size_t nb = std::min (block_size, n - j0);
+        const idx_t *block = ids_in + j0;
+        idx_t lo = *std::min_element (block, block + nb);
+        idx_t hi = *std::max_element (block, block + nb);
+        int nbits = nbits_for ((uint64_t)hi - (uint64_t)lo);
+
+        il.bases.push_back (lo);
+        il.nbits.push_back (nbits);
+        il.bit_ofs.push_back (pos);
+        // one spare word, so that write_bits can always spill over
+        il.bits.resize ((pos + nb * nbits + 63) / 64 + 1);
+        for (size_t j = 0; j < nb; j++) {
+            write_bits (il.bits.data(), pos, nbits,
+                        (uint64_t)block[j] - (uint64_t)lo);
+            pos += nbits;
+        }
+        il.bits.resize ((pos + 63) / 64);
+    }
+    il.size += n;
+}
+
+size_t CompressedIdsInvertedLists::add_entries (
+      size_t list_no, size_t n_entry,
+      const idx_t* ids_in, const uint8_t *code)
+{
+    if (n_entry == 0) return 0;
+    assert (list_no < nlist);
+    size_t o = ids[list_no].size;
+
+    // the last block is re-encoded with the new ids
+    std::vector<idx_t> tail;
+    pop_tail (list_no, o, tail);
+    tail.insert (tail.end(), ids_in, ids_in + n_entry);
+    push_blocks (list_no, tail.size(), tail.data());
+
+    codes[list_no].resize ((o + n_entry) * code_size);
+    memcpy (&codes[list_no][o * code_size], code, code_size * n_entry);
+    return o;
+}
+
+void CompressedIdsInvertedLists::update_entries (
+      size_t list_no, size_t offset, size_t n_entry,
+      const idx_t *ids_in, const uint8_t *codes_in)
+{
+    assert (list_no < nlist);
+    assert (n_entry + offset <= ids[list_no].size);
+    if (n_entry == 0) return;
+
+    // the blocks after the updated ones are re-encoded as well, since
+    // their positions in the bits may change
+    std::vector<idx_t> tail;
+    size_t jb = pop_tail (list_no, offset, tail);
+    memcpy (tail.data() + offset - jb, ids_in, sizeof(ids_in[0]) * n_entry);
+    push_blocks (list_no, tail.size(), tail.data());
+
+    memcpy (&codes[list_no][offset * code_size], codes_in,
+            code_size * n_entry);
+}
+
+void CompressedIdsInvertedLists::resize (size_t list_no, size_t new_size)
+{
+    size_t n = ids[list_no].size;
+    std::vector<idx_t> tail;
+    size_t jb = pop_tail (list_no, std::min (n, new_size), tail);
+    // the new entries are not initialized
+    tail.resize (new_size - jb);
+    push_blocks (list_no, tail.size(), tail.data());
+    codes[list_no].resize (new_size * code_size);
+}
+
+size_t CompressedIdsInvertedLists::ids_bytes () const
+{
+    size_t nbytes = 0;
+    for (const IdList & il : ids) {
+        nbytes += il.bases.size() * sizeof(il.bases[0]) +
+            il.nbits.size() * sizeof(il.nbits[0]) +
+            il.bit_ofs.size() * sizeof(il.bit_ofs[0]) +
+            il.bits.size() * sizeof(il.bits[0]);
+    }
+    return nbytes;
+}
+
 /*****************************************************************
  * Meta-inverted list implementations
  *****************************************************************/
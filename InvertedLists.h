@@ -74,6 +74,30 @@ struct InvertedLists {
     /// a list can be -1 hence the signed long
     virtual void prefetch_lists (const idx_t *list_nos, int nlist) const;
 
+    /** Lists that are not stored contiguously can be scanned in place,
+     * segment by segment, instead of through the copies returned by
+     * get_codes and get_ids.
+     *
+     * @return max nb of entries per segment, 0 if the lists should be
+     *         accessed with get_codes and get_ids (default)
+     */
+    virtual size_t segment_size () const;
+
+    /** get the entries s * segment_size to
+     * min((s + 1) * segment_size, list_size) of a list. The pointers
+     * are not released, they are valid until the list is modified.
+     */
+    virtual void get_segment (size_t list_no, size_t s,
+                              const uint8_t **codes,
+                              const idx_t **ids) const;
+
+    /** whether the ids are costly to get as a whole list (eg. they are
+     * compressed). The IVF search then scans the lists without their
+     * ids and looks up the ids of the results only, with
+     * get_single_id. Default false.
+     */
+    virtual bool ids_on_demand () const;
+
     /*************************
      * writing functions     */
 
@@ -201,6 +225,153 @@ struct ArrayInvertedLists: InvertedLists {
     virtual ~ArrayInvertedLists ();
 };
 
+
+struct ChunkArena;
+
+/** Inverted lists stored as sequences of fixed-size chunks, allocated
+ * from a ChunkArena. Contrary to ArrayInvertedLists, appending to a
+ * list never moves the existing entries, so adding to a large index
+ * does not have the memory peaks and the copies of the reallocations.
+ *
+ * A chunk holds the ids of chunk_size entries followed by their
+ * codes. The last chunk of each list is partially filled, so
+ * chunk_size should be small wrt. the typical list size.
+ *
+ * The search scans the lists segment by segment. get_codes and get_ids
+ * return a copy of the lists that span several chunks.
+ */
+struct ChunkedInvertedLists: InvertedLists {
+    size_t chunk_size;            ///< nb of entries per chunk
+    ChunkArena *arena;            ///< owned by the inverted lists
+
+    std::vector<size_t> sizes;    ///< list sizes, size nlist
+    std::vector<std::vector<uint8_t *> > chunks;  ///< size nlist
+
+    ChunkedInvertedLists (size_t nlist, size_t code_size,
+                          size_t chunk_size = 256,
+                          bool use_hugepages = false);
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t * get_codes (size_t list_no) const override;
+    const idx_t * get_ids (size_t list_no) const override;
+
+    void release_codes (size_t list_no, const uint8_t *codes) const override;
+    void release_ids (size_t list_no, const idx_t *ids) const override;
+
+    idx_t get_single_id (size_t list_no, size_t offset) const override;
+
+    const uint8_t * get_single_code (
+           size_t list_no, size_t offset) const override;
+
+    size_t segment_size () const override;
+
+    void get_segment (size_t list_no, size_t s,
+                      const uint8_t **codes,
+                      const idx_t **ids) const override;
+
+    size_t add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids, const uint8_t *code) override;
+
+    void update_entries (size_t list_no, size_t offset, size_t n_entry,
+                         const idx_t *ids, const uint8_t *code) override;
+
+    /// when shrinking, the chunks that are not used anymore are given
+    /// back to the arena. The new entries are not initialized.
+    void resize (size_t list_no, size_t new_size) override;
+
+    /// empties the lists and releases the memory of the arena
+    void reset () override;
+
+    idx_t *chunk_ids (uint8_t *chunk) const {
+        return (idx_t*)chunk;
+    }
+
+    uint8_t *chunk_codes (uint8_t *chunk) const {
+        return chunk + chunk_size * sizeof(idx_t);
+    }
+
+    /// is ptr within one of the chunks of the list?
+    bool in_chunks (size_t list_no, const void *ptr) const;
+
+    ~ChunkedInvertedLists () override;
+
+    ChunkedInvertedLists (const ChunkedInvertedLists &) = delete;
+    void operator = (const ChunkedInvertedLists &) = delete;
+};
+
+/** Inverted lists that store the ids compressed, by blocks of
+ * block_size entries. The ids of a block are stored as the offsets from
+ * the smallest id of the block, bit-packed with as many bits as the
+ * largest offset needs. This is compact when the ids of a list are
+ * close to each other in each block, as when consecutive ids are
+ * added together. The order of the entries is kept, so the offsets in
+ * the lists (used by store_pairs and the DirectMap) do not change.
+ *
+ * get_single_id decodes a single id, get_ids returns a decoded copy of
+ * the list. The codes are stored as in ArrayInvertedLists.
+ */
+struct CompressedIdsInvertedLists: InvertedLists {
+    size_t block_size;            ///< nb of ids per block
+
+    /// compressed ids of a list
+    struct IdList {
+        size_t size;                  ///< nb of ids
+        std::vector<idx_t> bases;     ///< smallest id of each block
+        std::vector<uint8_t> nbits;   ///< bits per id of each block
+        std::vector<size_t> bit_ofs;  ///< where each block starts in bits
+        std::vector<uint64_t> bits;   ///< the packed offsets
+
+        IdList (): size (0) {}
+    };
+
+    std::vector<std::vector<uint8_t> > codes;  ///< size nlist
+    std::vector<IdList> ids;                   ///< size nlist
+
+    CompressedIdsInvertedLists (size_t nlist, size_t code_size,
+                                size_t block_size = 128);
+
+    /// copy of the entries of another InvertedLists, eg. to compress
+    /// the ids of a filled IndexIVF with replace_invlists
+    explicit CompressedIdsInvertedLists (const InvertedLists & il,
+                                         size_t block_size = 128);
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t * get_codes (size_t list_no) const override;
+    const idx_t * get_ids (size_t list_no) const override;
+
+    void release_ids (size_t list_no, const idx_t *ids) const override;
+
+    idx_t get_single_id (size_t list_no, size_t offset) const override;
+
+    bool ids_on_demand () const override;
+
+    size_t add_entries (
+           size_t list_no, size_t n_entry,
+           const idx_t* ids, const uint8_t *code) override;
+
+    void update_entries (size_t list_no, size_t offset, size_t n_entry,
+                         const idx_t *ids, const uint8_t *code) override;
+
+    void resize (size_t list_no, size_t new_size) override;
+
+    /// decode the ids [j0, j1) of a list
+    void decode_ids (size_t list_no, size_t j0, size_t j1,
+                     idx_t *out) const;
+
+    /// memory used by the compressed ids, in bytes
+    size_t ids_bytes () const;
+
+    /// decodes the ids from the block of offset j0 to the end of the
+    /// list, removes them and returns them in tail, along with the
+    /// offset of the block
+    size_t pop_tail (size_t list_no, size_t j0, std::vector<idx_t> & tail);
+
+    /// appends ids at the end of a list whose size is a multiple of
+    /// block_size
+    void push_blocks (size_t list_no, size_t n, const idx_t *ids_in);
+};
+
 /*****************************************************************
  * Meta-inverted lists
  *
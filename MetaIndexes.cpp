@@ -208,8 +208,10 @@ void IndexIDMap2Template<IndexT>::reconstruct
 
 template struct IndexIDMapTemplate<Index>;
 template struct IndexIDMapTemplate<IndexBinary>;
+template struct IndexIDMapTemplate<IndexInt8>;
 template struct IndexIDMap2Template<Index>;
 template struct IndexIDMap2Template<IndexBinary>;
+template struct IndexIDMap2Template<IndexInt8>;
 
 
 /*****************************************************
@@ -58,6 +58,7 @@ struct IndexIDMapTemplate : IndexT {
 
 using IndexIDMap = IndexIDMapTemplate<Index>;
 using IndexBinaryIDMap = IndexIDMapTemplate<IndexBinary>;
+using IndexInt8IDMap = IndexIDMapTemplate<IndexInt8>;
 
 
 /** same as IndexIDMap but also provides an efficient reconstruction
@@ -87,6 +88,7 @@ struct IndexIDMap2Template : IndexIDMapTemplate<IndexT> {
 
 using IndexIDMap2 = IndexIDMap2Template<Index>;
 using IndexBinaryIDMap2 = IndexIDMap2Template<IndexBinary>;
+using IndexInt8IDMap2 = IndexIDMap2Template<IndexInt8>;
 
 
 /** splits input vectors in segments and assigns each segment to a sub-index
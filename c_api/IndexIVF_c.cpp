@@ -15,7 +15,6 @@
 #include "macros_impl.h"
 
 using faiss::IndexIVF;
-using faiss::IndexIVFStats;
 
 DEFINE_DESTRUCTOR(IndexIVF)
 DEFINE_INDEX_DOWNCAST(IndexIVF)
@@ -95,5 +94,6 @@ void faiss_IndexIVF_invlists_get_ids (const FaissIndexIVF* index, size_t list_no
 }
 
 void faiss_IndexIVFStats_reset(FaissIndexIVFStats* stats) {
-    reinterpret_cast<IndexIVFStats*>(stats)->reset();    
+    // only the first fields of IndexIVFStats are mirrored in C
+    memset(stats, 0, sizeof(*stats));
 }
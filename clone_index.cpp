@@ -15,6 +15,7 @@
 #include <faiss/impl/FaissAssert.h>
 
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHalfFlat.h>
 #include <faiss/VectorTransform.h>
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexLSH.h>
@@ -86,6 +87,7 @@ Index *Cloner::clone_Index (const Index *index)
     TRYCLONE (IndexFlatL2, index)
     TRYCLONE (IndexFlatIP, index)
     TRYCLONE (IndexFlat, index)
+    TRYCLONE (IndexHalfFlat, index)
     TRYCLONE (IndexLattice, index)
     TRYCLONE (IndexScalarQuantizer, index)
     TRYCLONE (MultiIndexQuantizer, index)
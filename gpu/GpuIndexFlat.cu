@@ -106,7 +106,10 @@ GpuIndexFlat::copyTo(faiss::IndexFlat* index) const {
     } else {
       fromDevice(data_->getVectorsFloat32Ref(), index->xb.data(), stream);
     }
+    // the norms are computed on the CPU side
+    CUDA_VERIFY(cudaStreamSynchronize(stream));
   }
+  index->update_norms();
 }
 
 size_t
@@ -19,6 +19,8 @@
 #endif
 
 #include <faiss/utils/utils.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/half.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/AuxIndexStructures.h>
 
@@ -39,14 +41,23 @@ namespace faiss {
  * that hides the template mess.
  ********************************************************************/
 
-#ifdef __AVX__
-#define USE_AVX
-#endif
-
 #ifdef __F16C__
 #define USE_F16C
 #endif
 
+/* The 8-wide code needs AVX2 and F16C. With gcc and clang on x86, it
+ * is compiled with target attributes and used when get_simd_level() is
+ * at least SIMD_AVX2. Otherwise it is compiled only if the build flags
+ * enable these instruction sets. */
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define USE_SIMD8
+#define SIMD8_DISPATCH
+#define SIMD8_TARGET __attribute__((target("avx2,fma,f16c")))
+#elif defined(__AVX2__) && defined(__F16C__)
+#define USE_SIMD8
+#define SIMD8_TARGET
+#endif
+
 
 namespace {
 
@@ -72,7 +83,8 @@ struct Codec8bit {
         return (code[i] + 0.5f) / 255.0f;
     }
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
+    SIMD8_TARGET
     static __m256 decode_8_components (const uint8_t *code, int i) {
         uint64_t c8 = *(uint64_t*)(code + i);
         __m128i c4lo = _mm_cvtepu8_epi32 (_mm_set1_epi32(c8));
@@ -101,7 +113,8 @@ struct Codec4bit {
     }
 
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
+    SIMD8_TARGET
     static __m256 decode_8_components (const uint8_t *code, int i) {
         uint32_t c4 = *(uint32_t*)(code + (i >> 1));
         uint32_t mask = 0x0f0f0f0f;
@@ -169,7 +182,8 @@ struct Codec6bit {
         return (bits + 0.5f) / 63.0f;
     }
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
+    SIMD8_TARGET
     static __m256 decode_8_components (const uint8_t *code, int i) {
         return _mm256_set_ps
             (decode_component(code, i + 7),
@@ -188,6 +202,7 @@ struct Codec6bit {
 
 #ifdef USE_F16C
 
+// these hide the portable versions of utils/half.h
 
 uint16_t encode_fp16 (float x) {
     __m128 xf = _mm_set1_ps (x);
@@ -203,100 +218,6 @@ float decode_fp16 (uint16_t x) {
     return _mm_cvtss_f32 (xf);
 }
 
-#else
-
-// non-intrinsic FP16 <-> FP32 code adapted from
-// https://github.com/ispc/ispc/blob/master/stdlib.ispc
-
-float floatbits (uint32_t x) {
-    void *xptr = &x;
-    return *(float*)xptr;
-}
-
-uint32_t intbits (float f) {
-    void *fptr = &f;
-    return *(uint32_t*)fptr;
-}
-
-
-uint16_t encode_fp16 (float f) {
-
-    // via Fabian "ryg" Giesen.
-    // https://gist.github.com/2156668
-    uint32_t sign_mask = 0x80000000u;
-    int32_t o;
-
-    uint32_t fint = intbits(f);
-    uint32_t sign = fint & sign_mask;
-    fint ^= sign;
-
-    // NOTE all the integer compares in this function can be safely
-    // compiled into signed compares since all operands are below
-    // 0x80000000. Important if you want fast straight SSE2 code (since
-    // there's no unsigned PCMPGTD).
-
-    // Inf or NaN (all exponent bits set)
-    // NaN->qNaN and Inf->Inf
-    // unconditional assignment here, will override with right value for
-    // the regular case below.
-    uint32_t f32infty = 255u << 23;
-    o = (fint > f32infty) ? 0x7e00u : 0x7c00u;
-
-    // (De)normalized number or zero
-    // update fint unconditionally to save the blending; we don't need it
-    // anymore for the Inf/NaN case anyway.
-
-    const uint32_t round_mask = ~0xfffu;
-    const uint32_t magic = 15u << 23;
-
-    // Shift exponent down, denormalize if necessary.
-    // NOTE This represents half-float denormals using single
-    // precision denormals.  The main reason to do this is that
-    // there's no shift with per-lane variable shifts in SSE*, which
-    // we'd otherwise need. It has some funky side effects though:
-    // - This conversion will actually respect the FTZ (Flush To Zero)
-    //   flag in MXCSR - if it's set, no half-float denormals will be
-    //   generated. I'm honestly not sure whether this is good or
-    //   bad. It's definitely interesting.
-    // - If the underlying HW doesn't support denormals (not an issue
-    //   with Intel CPUs, but might be a problem on GPUs or PS3 SPUs),
-    //   you will always get flush-to-zero behavior. This is bad,
-    //   unless you're on a CPU where you don't care.
-    // - Denormals tend to be slow. FP32 denormals are rare in
-    //   practice outside of things like recursive filters in DSP -
-    //   not a typical half-float application. Whether FP16 denormals
-    //   are rare in practice, I don't know. Whatever slow path your
-    //   HW may or may not have for denormals, this may well hit it.
-    float fscale = floatbits(fint & round_mask) * floatbits(magic);
-    fscale = std::min(fscale, floatbits((31u << 23) - 0x1000u));
-    int32_t fint2 = intbits(fscale) - round_mask;
-
-    if (fint < f32infty)
-        o = fint2 >> 13; // Take the bits!
-
-    return (o | (sign >> 16));
-}
-
-float decode_fp16 (uint16_t h) {
-
-    // https://gist.github.com/2144712
-    // Fabian "ryg" Giesen.
-
-    const uint32_t shifted_exp = 0x7c00u << 13; // exponent mask after shift
-
-    int32_t o = ((int32_t)(h & 0x7fffu)) << 13;     // exponent/mantissa bits
-    int32_t exp = shifted_exp & o;   // just the exponent
-    o += (int32_t)(127 - 15) << 23;        // exponent adjust
-
-    int32_t infnan_val = o + ((int32_t)(128 - 16) << 23);
-    int32_t zerodenorm_val = intbits(
-                 floatbits(o + (1u<<23)) - floatbits(113u << 23));
-    int32_t reg_val = (exp == 0) ? zerodenorm_val : o;
-
-    int32_t sign_bit = ((int32_t)(h & 0x8000u)) << 16;
-    return floatbits(((exp == shifted_exp) ? infnan_val : reg_val) | sign_bit);
-}
-
 #endif
 
 
@@ -354,7 +275,7 @@ struct QuantizerTemplate<Codec, true, 1>: ScalarQuantizer::Quantizer {
 
 
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
 
 template<class Codec>
 struct QuantizerTemplate<Codec, true, 8>: QuantizerTemplate<Codec, true, 1> {
@@ -362,6 +283,7 @@ struct QuantizerTemplate<Codec, true, 8>: QuantizerTemplate<Codec, true, 1> {
     QuantizerTemplate (size_t d, const std::vector<float> &trained):
         QuantizerTemplate<Codec, true, 1> (d, trained) {}
 
+    SIMD8_TARGET
     __m256 reconstruct_8_components (const uint8_t * code, int i) const
     {
         __m256 xi = Codec::decode_8_components (code, i);
@@ -409,7 +331,7 @@ struct QuantizerTemplate<Codec, false, 1>: ScalarQuantizer::Quantizer {
 };
 
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
 
 template<class Codec>
 struct QuantizerTemplate<Codec, false, 8>: QuantizerTemplate<Codec, false, 1> {
@@ -417,6 +339,7 @@ struct QuantizerTemplate<Codec, false, 8>: QuantizerTemplate<Codec, false, 1> {
     QuantizerTemplate (size_t d, const std::vector<float> &trained):
         QuantizerTemplate<Codec, false, 1> (d, trained) {}
 
+    SIMD8_TARGET
     __m256 reconstruct_8_components (const uint8_t * code, int i) const
     {
         __m256 xi = Codec::decode_8_components (code, i);
@@ -461,7 +384,7 @@ struct QuantizerFP16<1>: ScalarQuantizer::Quantizer {
 
 };
 
-#ifdef USE_F16C
+#ifdef USE_SIMD8
 
 template<>
 struct QuantizerFP16<8>: QuantizerFP16<1> {
@@ -469,6 +392,7 @@ struct QuantizerFP16<8>: QuantizerFP16<1> {
     QuantizerFP16 (size_t d, const std::vector<float> &trained):
         QuantizerFP16<1> (d, trained) {}
 
+    SIMD8_TARGET
     __m256 reconstruct_8_components (const uint8_t * code, int i) const
     {
         __m128i codei = _mm_loadu_si128 ((const __m128i*)(code + 2 * i));
@@ -513,7 +437,7 @@ struct Quantizer8bitDirect<1>: ScalarQuantizer::Quantizer {
 
 };
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
 
 template<>
 struct Quantizer8bitDirect<8>: Quantizer8bitDirect<1> {
@@ -521,6 +445,7 @@ struct Quantizer8bitDirect<8>: Quantizer8bitDirect<1> {
     Quantizer8bitDirect (size_t d, const std::vector<float> &trained):
         Quantizer8bitDirect<1> (d, trained) {}
 
+    SIMD8_TARGET
     __m256 reconstruct_8_components (const uint8_t * code, int i) const
     {
         __m128i x8 = _mm_loadl_epi64((__m128i*)(code + i)); // 8 * int8
@@ -696,15 +621,15 @@ void train_NonUniform(RangeStat rs, float rs_arg,
     } else {
         // transpose
         std::vector<float> xt(n * d);
-        for (size_t i = 1; i < n; i++) {
+        for (size_t i = 0; i < n; i++) {
             const float *xi = x + i * d;
             for (size_t j = 0; j < d; j++) {
                 xt[j * n + i] = xi[j];
             }
         }
-        std::vector<float> trained_d(2);
 #pragma omp parallel for
         for (size_t j = 0; j < d; j++) {
+            std::vector<float> trained_d(2);
             train_Uniform(rs, rs_arg,
                           n, k, xt.data() + j * n,
                           trained_d);
@@ -760,7 +685,7 @@ struct SimilarityL2<1> {
 };
 
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
 template<>
 struct SimilarityL2<8> {
     static constexpr int simdwidth = 8;
@@ -771,11 +696,13 @@ struct SimilarityL2<8> {
     explicit SimilarityL2 (const float * y): y(y) {}
     __m256 accu8;
 
+    SIMD8_TARGET
     void begin_8 () {
         accu8 = _mm256_setzero_ps();
         yi = y;
     }
 
+    SIMD8_TARGET
     void add_8_components (__m256 x) {
         __m256 yiv = _mm256_loadu_ps (yi);
         yi += 8;
@@ -783,11 +710,13 @@ struct SimilarityL2<8> {
         accu8 += tmp * tmp;
     }
 
+    SIMD8_TARGET
     void add_8_components_2 (__m256 x, __m256 y) {
         __m256 tmp = y - x;
         accu8 += tmp * tmp;
     }
 
+    SIMD8_TARGET
     float result_8 () {
         __m256 sum = _mm256_hadd_ps(accu8, accu8);
         __m256 sum2 = _mm256_hadd_ps(sum, sum);
@@ -835,7 +764,7 @@ struct SimilarityIP<1> {
     }
 };
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
 
 template<>
 struct SimilarityIP<8> {
@@ -851,21 +780,25 @@ struct SimilarityIP<8> {
 
     __m256 accu8;
 
+    SIMD8_TARGET
     void begin_8 () {
         accu8 = _mm256_setzero_ps();
         yi = y;
     }
 
+    SIMD8_TARGET
     void add_8_components (__m256 x) {
         __m256 yiv = _mm256_loadu_ps (yi);
         yi += 8;
         accu8 += yiv * x;
     }
 
+    SIMD8_TARGET
     void add_8_components_2 (__m256 x1, __m256 x2) {
         accu8 += x1 * x2;
     }
 
+    SIMD8_TARGET
     float result_8 () {
         __m256 sum = _mm256_hadd_ps(accu8, accu8);
         __m256 sum2 = _mm256_hadd_ps(sum, sum);
@@ -940,7 +873,7 @@ struct DCTemplate<Quantizer, Similarity, 1> : SQDistanceComputer
 
 };
 
-#ifdef USE_F16C
+#ifdef USE_SIMD8
 
 template<class Quantizer, class Similarity>
 struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer
@@ -953,6 +886,7 @@ struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer
         quant(d, trained)
     {}
 
+    SIMD8_TARGET
     float compute_distance(const float* x, const uint8_t* code) const {
 
         Similarity sim(x);
@@ -964,6 +898,7 @@ struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer
         return sim.result_8();
     }
 
+    SIMD8_TARGET
     float compute_code_distance(const uint8_t* code1, const uint8_t* code2)
         const {
         Similarity sim(nullptr);
@@ -981,15 +916,18 @@ struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer
     }
 
     /// compute distance of vector i to current query
+    SIMD8_TARGET
     float operator () (idx_t i) final {
         return compute_distance (q, codes + i * code_size);
     }
 
+    SIMD8_TARGET
     float symmetric_dis (idx_t i, idx_t j) override {
         return compute_code_distance (codes + i * code_size,
                                       codes + j * code_size);
     }
 
+    SIMD8_TARGET
     float query_to_code (const uint8_t * code) const {
         return compute_distance (q, code);
     }
@@ -1058,7 +996,7 @@ struct DistanceComputerByte<Similarity, 1> : SQDistanceComputer {
 
 };
 
-#ifdef USE_AVX
+#ifdef USE_SIMD8
 
 
 template<class Similarity>
@@ -1071,6 +1009,7 @@ struct DistanceComputerByte<Similarity, 8> : SQDistanceComputer {
     DistanceComputerByte(int d, const std::vector<float> &): d(d), tmp(d) {
     }
 
+    SIMD8_TARGET
     int compute_code_distance(const uint8_t* code1, const uint8_t* code2)
         const {
         // __m256i accu = _mm256_setzero_ps ();
@@ -1109,21 +1048,25 @@ struct DistanceComputerByte<Similarity, 8> : SQDistanceComputer {
         }
     }
 
+    SIMD8_TARGET
     int compute_distance(const float* x, const uint8_t* code) {
         set_query(x);
         return compute_code_distance(tmp.data(), code);
     }
 
     /// compute distance of vector i to current query
+    SIMD8_TARGET
     float operator () (idx_t i) final {
         return compute_distance (q, codes + i * code_size);
     }
 
+    SIMD8_TARGET
     float symmetric_dis (idx_t i, idx_t j) override {
         return compute_code_distance (codes + i * code_size,
                                       codes + j * code_size);
     }
 
+    SIMD8_TARGET
     float query_to_code (const uint8_t * code) const {
         return compute_code_distance (tmp.data(), code);
     }
@@ -1139,6 +1082,21 @@ struct DistanceComputerByte<Similarity, 8> : SQDistanceComputer {
  *******************************************************************/
 
 
+#ifdef USE_SIMD8
+
+// whether the 8-wide code is used for dimension d
+bool use_simd8 (size_t d)
+{
+#ifdef SIMD8_DISPATCH
+    return d % 8 == 0 && get_simd_level () >= SIMD_AVX2;
+#else
+    return d % 8 == 0;
+#endif
+}
+
+#endif
+
+
 template<class Sim>
 SQDistanceComputer *select_distance_computer (
           QuantizerType qtype,
@@ -1279,8 +1237,8 @@ void ScalarQuantizer::train_residual(size_t n,
 
 ScalarQuantizer::Quantizer *ScalarQuantizer::select_quantizer () const
 {
-#ifdef USE_F16C
-    if (d % 8 == 0) {
+#ifdef USE_SIMD8
+    if (use_simd8 (d)) {
         return select_quantizer_1<8> (qtype, d, trained);
     } else
 #endif
@@ -1316,8 +1274,8 @@ SQDistanceComputer *
 ScalarQuantizer::get_distance_computer (MetricType metric) const
 {
     FAISS_THROW_IF_NOT(metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT);
-#ifdef USE_F16C
-    if (d % 8 == 0) {
+#ifdef USE_SIMD8
+    if (use_simd8 (d)) {
         if (metric == METRIC_L2) {
             return select_distance_computer<SimilarityL2<8> >
                 (qtype, d, trained);
@@ -1609,8 +1567,8 @@ InvertedListScanner* ScalarQuantizer::select_InvertedListScanner
         (MetricType mt, const Index *quantizer,
          bool store_pairs, bool by_residual) const
 {
-#ifdef USE_F16C
-    if (d % 8 == 0) {
+#ifdef USE_SIMD8
+    if (use_simd8 (d)) {
         return sel0_InvertedListScanner<8>
             (mt, this, quantizer, store_pairs, by_residual);
     } else
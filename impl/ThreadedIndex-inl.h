@@ -6,6 +6,7 @@
  */
 
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/ThreadPool.h>
 #include <exception>
 #include <iostream>
 
@@ -120,10 +121,18 @@ void ThreadedIndex<IndexT>::runOnIndex(std::function<void(int, IndexT*)> f) {
   if (isThreaded_) {
     std::vector<std::future<bool>> v;
 
+    // The sub-indices share the parallelism budget of the caller, so
+    // that their own parallel work does not oversubscribe the cores
+    int budget = std::max(
+      1, get_parallelism_budget() / std::max(1, (int) this->indices_.size()));
+
     for (int i = 0; i < this->indices_.size(); ++i) {
       auto& p = this->indices_[i];
       auto indexPtr = p.first;
-      v.emplace_back(p.second->add([f, i, indexPtr](){ f(i, indexPtr); }));
+      v.emplace_back(p.second->add([f, i, indexPtr, budget](){
+            ParallelismBudget pb(budget);
+            f(i, indexPtr);
+          }));
     }
 
     waitAndHandleFutures(v);
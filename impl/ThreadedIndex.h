@@ -75,6 +75,17 @@ protected:
   bool isThreaded_;
 };
 
+/// nb of component_t's per vector, binary vectors are packed 8 bits per byte
+template <typename IndexT>
+inline size_t components_per_vector(const IndexT* index) {
+  return index->d;
+}
+
+template <>
+inline size_t components_per_vector(const IndexBinary* index) {
+  return (index->d + 7) / 8;
+}
+
 } // namespace
 
 #include <faiss/impl/ThreadedIndex-inl.h>
@@ -20,8 +20,11 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/io.h>
 #include <faiss/utils/hamming.h>
+#include <faiss/utils/hugepages.h>
 
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHalfFlat.h>
+#include <faiss/IndexFlatChunked.h>
 #include <faiss/VectorTransform.h>
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexLSH.h>
@@ -43,6 +46,11 @@
 #include <faiss/IndexBinaryHNSW.h>
 #include <faiss/IndexBinaryIVF.h>
 #include <faiss/IndexBinaryHash.h>
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/IndexIVFInt8.h>
+#include <faiss/IndexHNSWInt8.h>
+#include <faiss/IndexRefineInt8.h>
+#include <faiss/IndexInt8Adapter.h>
 
 
 
@@ -71,6 +79,7 @@ namespace faiss {
         long size;                            \
         READANDCHECK (&size, 1);                \
         FAISS_THROW_IF_NOT (size >= 0 && size < (1L << 40));  \
+        hugepage_reserve (vec, size);           \
         (vec).resize (size);                    \
         READANDCHECK ((vec).data (), size);     \
     }
@@ -211,6 +220,8 @@ InvertedLists *read_InvertedLists (IOReader *f, int io_flags) {
         std::vector<size_t> sizes (ails->nlist);
         read_ArrayInvertedLists_sizes (f, sizes);
         for (size_t i = 0; i < ails->nlist; i++) {
+            hugepage_reserve (ails->ids[i], sizes[i]);
+            hugepage_reserve (ails->codes[i], sizes[i] * ails->code_size);
             ails->ids[i].resize (sizes[i]);
             ails->codes[i].resize (sizes[i] * ails->code_size);
         }
@@ -249,6 +260,7 @@ InvertedLists *read_InvertedLists (IOReader *f, int io_flags) {
             FAISS_THROW_IF_NOT_FMT (ails->ptr != MAP_FAILED,
                             "could not mmap: %s",
                             strerror(errno));
+            hugepage_advise_mapping (ails->ptr, ails->totsize, fileno(fdesc));
         }
 
         for (size_t i = 0; i < ails->nlist; i++) {
@@ -262,6 +274,60 @@ InvertedLists *read_InvertedLists (IOReader *f, int io_flags) {
         // resume normal reading of file
         fseek (fdesc, o, SEEK_SET);
         return ails;
+    } else if (h == fourcc ("ilch")) {
+        size_t nlist, code_size, chunk_size;
+        READ1 (nlist);
+        READ1 (code_size);
+        READ1 (chunk_size);
+        auto cils = new ChunkedInvertedLists (nlist, code_size, chunk_size);
+        std::vector<size_t> sizes;
+        READVECTOR (sizes);
+        FAISS_THROW_IF_NOT (sizes.size() == nlist);
+        for (size_t i = 0; i < nlist; i++) {
+            cils->resize (i, sizes[i]);
+            const std::vector<uint8_t *> & cl = cils->chunks[i];
+            for (size_t c = 0; c < cl.size(); c++) {
+                size_t nc = std::min (chunk_size, sizes[i] - c * chunk_size);
+                READANDCHECK (cils->chunk_codes (cl[c]), nc * code_size);
+            }
+            for (size_t c = 0; c < cl.size(); c++) {
+                size_t nc = std::min (chunk_size, sizes[i] - c * chunk_size);
+                READANDCHECK (cils->chunk_ids (cl[c]), nc);
+            }
+        }
+        return cils;
+    } else if (h == fourcc ("ilci")) {
+        size_t nlist, code_size, block_size;
+        READ1 (nlist);
+        READ1 (code_size);
+        READ1 (block_size);
+        auto ccils = new CompressedIdsInvertedLists (
+              nlist, code_size, block_size);
+        std::vector<size_t> sizes;
+        READVECTOR (sizes);
+        FAISS_THROW_IF_NOT (sizes.size() == nlist);
+        for (size_t i = 0; i < nlist; i++) {
+            CompressedIdsInvertedLists::IdList & il = ccils->ids[i];
+            il.size = sizes[i];
+            ccils->codes[i].resize (sizes[i] * code_size);
+            READANDCHECK (ccils->codes[i].data(), sizes[i] * code_size);
+            READVECTOR (il.bases);
+            READVECTOR (il.nbits);
+            READVECTOR (il.bit_ofs);
+            READVECTOR (il.bits);
+            size_t nblock = (sizes[i] + block_size - 1) / block_size;
+            FAISS_THROW_IF_NOT (il.bases.size() == nblock &&
+                                il.nbits.size() == nblock &&
+                                il.bit_ofs.size() == nblock);
+            if (nblock > 0) {
+                size_t nlast = sizes[i] - (nblock - 1) * block_size;
+                FAISS_THROW_IF_NOT (il.nbits.back() <= 64 &&
+                                    il.bit_ofs.back() +
+                                    nlast * il.nbits.back() <=
+                                    il.bits.size() * 64);
+            }
+        }
+        return ccils;
     } else if (h == fourcc ("ilod")) {
         OnDiskInvertedLists *od = new OnDiskInvertedLists();
         od->read_only = io_flags & IO_FLAG_READ_ONLY;
@@ -469,6 +535,7 @@ Index *read_index (IOReader *f, int io_flags) {
         read_index_header (idxf, f);
         READVECTOR (idxf->xb);
         FAISS_THROW_IF_NOT (idxf->xb.size() == idxf->ntotal * idxf->d);
+        idxf->update_norms ();
         // leak!
         idx = idxf;
     } else if (h == fourcc("IxHE") || h == fourcc("IxHe")) {
@@ -568,6 +635,35 @@ Index *read_index (IOReader *f, int io_flags) {
         READVECTOR (idxs->codes);
         idxs->code_size = idxs->sq.code_size;
         idx = idxs;
+    } else if (h == fourcc ("IxFh")) {
+        IndexHalfFlat * idxh = new IndexHalfFlat ();
+        read_index_header (idxh, f);
+        int half_type;
+        READ1 (half_type);
+        FAISS_THROW_IF_NOT (half_type == HALF_FP16 || half_type == HALF_BF16);
+        idxh->half_type = HalfType (half_type);
+        READVECTOR (idxh->codes);
+        FAISS_THROW_IF_NOT (idxh->codes.size() == idxh->ntotal * idxh->d);
+        idxh->update_norms ();
+        idx = idxh;
+    } else if (h == fourcc ("IxFc")) {
+        IndexFlatChunked * idxc = new IndexFlatChunked ();
+        read_index_header (idxc, f);
+        READ1 (idxc->chunk_size);
+        size_t size;
+        READ1 (size);
+        FAISS_THROW_IF_NOT (size == idxc->ntotal * idxc->d);
+        // fill the chunks with add, that computes the norms
+        Index::idx_t ntotal = idxc->ntotal;
+        idxc->ntotal = 0;
+        std::vector<float> buf (idxc->chunk_size * idxc->d);
+        for (Index::idx_t i0 = 0; i0 < ntotal; i0 += idxc->chunk_size) {
+            Index::idx_t n = std::min (Index::idx_t (idxc->chunk_size),
+                                       ntotal - i0);
+            READANDCHECK (buf.data(), n * idxc->d);
+            idxc->add (n, buf.data());
+        }
+        idx = idxc;
     } else if (h == fourcc ("IxLa")) {
         int d, nsq, scale_nbit, r2;
         READ1 (d);
@@ -648,6 +744,17 @@ Index *read_index (IOReader *f, int io_flags) {
         delete rf;
         READ1 (idxrf->k_factor);
         idx = idxrf;
+    } else if(h == fourcc ("IxI8")) {
+        IndexInt8Adapter *idxa = new IndexInt8Adapter ();
+        read_index_header (idxa, f);
+        READ1 (idxa->rangestat);
+        READ1 (idxa->rangestat_arg);
+        READ1 (idxa->per_dimension);
+        READVECTOR (idxa->center);
+        READVECTOR (idxa->scale);
+        idxa->index = read_index_int8 (f, io_flags);
+        idxa->own_fields = true;
+        idx = idxa;
     } else if(h == fourcc ("IxMp") || h == fourcc ("IxM2")) {
         bool is_map2 = h == fourcc ("IxM2");
         IndexIDMap * idxmap = is_map2 ? new IndexIDMap2 () : new IndexIDMap ();
@@ -886,4 +993,124 @@ IndexBinary *read_index_binary (const char *fname, int io_flags) {
 }
 
 
+
+/*************************************************************
+ * Read int8 indexes
+ **************************************************************/
+
+static void read_index_int8_header (IndexInt8 *idx, IOReader *f) {
+    READ1 (idx->d);
+    READ1 (idx->ntotal);
+    READ1 (idx->is_trained);
+    READ1 (idx->metric_type);
+    idx->verbose = false;
+}
+
+static void read_int8_ivf_header (IndexIVFInt8 *ivf, IOReader *f) {
+    read_index_int8_header (ivf, f);
+    ivf->code_size = ivf->d;
+    READ1 (ivf->nlist);
+    READ1 (ivf->nprobe);
+    uint8_t int8_quantizer;
+    READ1 (int8_quantizer);
+    if (int8_quantizer) {
+        ivf->quantizer_int8 = read_index_int8 (f);
+    } else {
+        ivf->quantizer = read_index (f);
+    }
+    ivf->own_fields = true;
+    read_direct_map (&ivf->direct_map, f);
+}
+
+/// map the vectors of an IndexInt8Flat from the file instead of copying them
+static void mmap_int8_vectors (IndexInt8Flat *idxf, IOReader *f, size_t size) {
+    FileIOReader *reader = dynamic_cast<FileIOReader*>(f);
+    FAISS_THROW_IF_NOT_MSG(reader, "mmap only supported for File objects");
+    FILE *fdesc = reader->f;
+
+    size_t o = ftell(fdesc);
+    idxf->mmap_file = std::make_shared<MmappedFile> (fdesc, reader->name);
+    FAISS_THROW_IF_NOT(o + size <= idxf->mmap_file->size);
+    idxf->xb_mmap = (const int8_t*)(idxf->mmap_file->ptr + o);
+
+    // resume normal reading of file
+    fseek (fdesc, o + size, SEEK_SET);
+}
+
+IndexInt8 *read_index_int8 (IOReader *f, int io_flags) {
+    IndexInt8 * idx = nullptr;
+    uint32_t h;
+    READ1 (h);
+    if (h == fourcc ("IIxF")) {
+        IndexInt8Flat *idxf = new IndexInt8Flat ();
+        read_index_int8_header (idxf, f);
+        if (io_flags & IO_FLAG_MMAP) {
+            size_t size;
+            READ1 (size);
+            FAISS_THROW_IF_NOT (size == idxf->ntotal * idxf->d);
+            mmap_int8_vectors (idxf, f, size);
+        } else {
+            READVECTOR (idxf->xb);
+            FAISS_THROW_IF_NOT (idxf->xb.size() == idxf->ntotal * idxf->d);
+        }
+        idx = idxf;
+    } else if (h == fourcc ("IIwF")) {
+        IndexIVFInt8 *ivf = new IndexIVFInt8 ();
+        read_int8_ivf_header (ivf, f);
+        InvertedLists *ils = read_InvertedLists (f, io_flags);
+        FAISS_THROW_IF_NOT (!ils || (ils->nlist == ivf->nlist &&
+                                     ils->code_size == ivf->code_size));
+        ivf->invlists = ils;
+        ivf->own_invlists = true;
+        idx = ivf;
+    } else if (h == fourcc ("IIHf")) {
+        IndexHNSWInt8 *idxhnsw = new IndexHNSWInt8 ();
+        read_index_int8_header (idxhnsw, f);
+        read_HNSW (&idxhnsw->hnsw, f);
+        idxhnsw->storage = read_index_int8 (f, io_flags);
+        idxhnsw->own_fields = true;
+        idx = idxhnsw;
+    } else if (h == fourcc ("IIRF")) {
+        IndexRefineInt8 *idxrf = new IndexRefineInt8 ();
+        read_index_int8_header (idxrf, f);
+        idxrf->base_index = read_index (f, io_flags);
+        idxrf->own_fields = true;
+        IndexInt8Flat *rf = dynamic_cast<IndexInt8Flat*> (
+            read_index_int8 (f, io_flags));
+        FAISS_THROW_IF_NOT (rf);
+        std::swap (*rf, idxrf->refine_index);
+        delete rf;
+        READ1 (idxrf->k_factor);
+        idx = idxrf;
+    } else if (h == fourcc ("IIMp") || h == fourcc ("IIM2")) {
+        bool is_map2 = h == fourcc ("IIM2");
+        IndexInt8IDMap * idxmap = is_map2 ?
+            new IndexInt8IDMap2 () : new IndexInt8IDMap ();
+        read_index_int8_header (idxmap, f);
+        idxmap->index = read_index_int8 (f, io_flags);
+        idxmap->own_fields = true;
+        READVECTOR (idxmap->id_map);
+        if (is_map2) {
+            static_cast<IndexInt8IDMap2*>(idxmap)->construct_rev_map ();
+        }
+        idx = idxmap;
+    } else {
+        FAISS_THROW_FMT("Index type 0x%08x not supported\n", h);
+        idx = nullptr;
+    }
+    return idx;
+}
+
+IndexInt8 *read_index_int8 (FILE * f, int io_flags) {
+    FileIOReader reader(f);
+    return read_index_int8(&reader, io_flags);
+}
+
+IndexInt8 *read_index_int8 (const char *fname, int io_flags) {
+    FileIOReader reader(fname);
+    IndexInt8 *idx = read_index_int8 (&reader, io_flags);
+    return idx;
+}
+
+
 } // namespace faiss
@@ -22,6 +22,8 @@
 #include <faiss/utils/hamming.h>
 
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHalfFlat.h>
+#include <faiss/IndexFlatChunked.h>
 #include <faiss/VectorTransform.h>
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexLSH.h>
@@ -43,6 +45,11 @@
 #include <faiss/IndexBinaryHNSW.h>
 #include <faiss/IndexBinaryIVF.h>
 #include <faiss/IndexBinaryHash.h>
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/IndexIVFInt8.h>
+#include <faiss/IndexHNSWInt8.h>
+#include <faiss/IndexRefineInt8.h>
+#include <faiss/IndexInt8Adapter.h>
 
 
 
@@ -239,6 +246,48 @@ void write_InvertedLists (const InvertedLists *ils, IOWriter *f) {
                 WRITEANDCHECK (ails->ids[i].data(), n);
             }
         }
+    } else if (const auto & cils =
+               dynamic_cast<const ChunkedInvertedLists *>(ils)) {
+        uint32_t h = fourcc ("ilch");
+        WRITE1 (h);
+        WRITE1 (cils->nlist);
+        WRITE1 (cils->code_size);
+        WRITE1 (cils->chunk_size);
+        WRITEVECTOR (cils->sizes);
+        // the codes then the ids of each list, as for ilar
+        for (size_t i = 0; i < cils->nlist; i++) {
+            size_t n = cils->sizes[i];
+            const std::vector<uint8_t *> & cl = cils->chunks[i];
+            for (size_t c = 0; c < cl.size(); c++) {
+                size_t nc = std::min (cils->chunk_size, n - c * cils->chunk_size);
+                WRITEANDCHECK (cils->chunk_codes (cl[c]), nc * cils->code_size);
+            }
+            for (size_t c = 0; c < cl.size(); c++) {
+                size_t nc = std::min (cils->chunk_size, n - c * cils->chunk_size);
+                WRITEANDCHECK (cils->chunk_ids (cl[c]), nc);
+            }
+        }
+    } else if (const auto & ccils =
+               dynamic_cast<const CompressedIdsInvertedLists *>(ils)) {
+        uint32_t h = fourcc ("ilci");
+        WRITE1 (h);
+        WRITE1 (ccils->nlist);
+        WRITE1 (ccils->code_size);
+        WRITE1 (ccils->block_size);
+        std::vector<size_t> sizes;
+        for (size_t i = 0; i < ccils->nlist; i++) {
+            sizes.push_back (ccils->ids[i].size);
+        }
+        WRITEVECTOR (sizes);
+        // the codes then the compressed ids of each list
+        for (size_t i = 0; i < ccils->nlist; i++) {
+            const CompressedIdsInvertedLists::IdList & il = ccils->ids[i];
+            WRITEANDCHECK (ccils->codes[i].data(), il.size * ccils->code_size);
+            WRITEVECTOR (il.bases);
+            WRITEVECTOR (il.nbits);
+            WRITEVECTOR (il.bit_ofs);
+            WRITEVECTOR (il.bits);
+        }
     } else if (const auto & od =
                dynamic_cast<const OnDiskInvertedLists *>(ils)) {
         uint32_t h = fourcc ("ilod");
@@ -359,6 +408,26 @@ void write_index (const Index *idx, IOWriter *f) {
         write_index_header (idx, f);
         write_ScalarQuantizer (&idxs->sq, f);
         WRITEVECTOR (idxs->codes);
+    } else if(const IndexHalfFlat * idxh =
+              dynamic_cast<const IndexHalfFlat *> (idx)) {
+        uint32_t h = fourcc ("IxFh");
+        WRITE1 (h);
+        write_index_header (idx, f);
+        int half_type = idxh->half_type;
+        WRITE1 (half_type);
+        WRITEVECTOR (idxh->codes);
+    } else if(const IndexFlatChunked * idxc =
+              dynamic_cast<const IndexFlatChunked *> (idx)) {
+        uint32_t h = fourcc ("IxFc");
+        WRITE1 (h);
+        write_index_header (idx, f);
+        WRITE1 (idxc->chunk_size);
+        // same layout as a WRITEVECTOR of the vectors
+        size_t size = idxc->ntotal * idxc->d;
+        WRITE1 (size);
+        for (size_t c = 0; c < idxc->chunks.size(); c++) {
+            WRITEANDCHECK (idxc->chunks[c], idxc->chunk_ntotal (c) * idxc->d);
+        }
     } else if(const IndexLattice * idxl =
               dynamic_cast<const IndexLattice *> (idx)) {
         uint32_t h = fourcc ("IxLa");
@@ -452,6 +521,17 @@ void write_index (const Index *idx, IOWriter *f) {
         write_index (idxrf->base_index, f);
         write_index (&idxrf->refine_index, f);
         WRITE1 (idxrf->k_factor);
+    } else if(const IndexInt8Adapter * idxa =
+              dynamic_cast<const IndexInt8Adapter *> (idx)) {
+        uint32_t h = fourcc ("IxI8");
+        WRITE1 (h);
+        write_index_header (idxa, f);
+        WRITE1 (idxa->rangestat);
+        WRITE1 (idxa->rangestat_arg);
+        WRITE1 (idxa->per_dimension);
+        WRITEVECTOR (idxa->center);
+        WRITEVECTOR (idxa->scale);
+        write_index_int8 (idxa->index, f);
     } else if(const IndexIDMap * idxmap =
               dynamic_cast<const IndexIDMap *> (idx)) {
         uint32_t h =
@@ -651,4 +731,87 @@ void write_index_binary (const IndexBinary *idx, const char *fname) {
 }
 
 
+/*************************************************************
+ * Write int8 indexes
+ **************************************************************/
+
+static void write_index_int8_header (const IndexInt8 *idx, IOWriter *f) {
+    WRITE1 (idx->d);
+    WRITE1 (idx->ntotal);
+    WRITE1 (idx->is_trained);
+    WRITE1 (idx->metric_type);
+}
+
+static void write_int8_ivf_header (const IndexIVFInt8 *ivf, IOWriter *f) {
+    write_index_int8_header (ivf, f);
+    WRITE1 (ivf->nlist);
+    WRITE1 (ivf->nprobe);
+    // the quantizer is either a float or an int8 index
+    uint8_t int8_quantizer = ivf->quantizer_int8 != nullptr;
+    WRITE1 (int8_quantizer);
+    if (int8_quantizer) {
+        write_index_int8 (ivf->quantizer_int8, f);
+    } else {
+        write_index (ivf->quantizer, f);
+    }
+    write_direct_map (&ivf->direct_map, f);
+}
+
+void write_index_int8 (const IndexInt8 *idx, IOWriter *f) {
+    if (const IndexInt8Flat *idxf =
+        dynamic_cast<const IndexInt8Flat *> (idx)) {
+        uint32_t h = fourcc ("IIxF");
+        WRITE1 (h);
+        write_index_int8_header (idx, f);
+        // same layout as WRITEVECTOR, the vectors may be memory-mapped
+        size_t size = idxf->ntotal * idxf->d;
+        WRITE1 (size);
+        WRITEANDCHECK (idxf->get_xb(), size);
+    } else if (const IndexIVFInt8 *ivf =
+               dynamic_cast<const IndexIVFInt8 *> (idx)) {
+        uint32_t h = fourcc ("IIwF");
+        WRITE1 (h);
+        write_int8_ivf_header (ivf, f);
+        write_InvertedLists (ivf->invlists, f);
+    } else if (const IndexHNSWInt8 *idxhnsw =
+               dynamic_cast<const IndexHNSWInt8 *> (idx)) {
+        uint32_t h = fourcc ("IIHf");
+        WRITE1 (h);
+        write_index_int8_header (idxhnsw, f);
+        write_HNSW (&idxhnsw->hnsw, f);
+        write_index_int8 (idxhnsw->storage, f);
+    } else if (const IndexRefineInt8 *idxrf =
+               dynamic_cast<const IndexRefineInt8 *> (idx)) {
+        uint32_t h = fourcc ("IIRF");
+        WRITE1 (h);
+        write_index_int8_header (idxrf, f);
+        write_index (idxrf->base_index, f);
+        write_index_int8 (&idxrf->refine_index, f);
+        WRITE1 (idxrf->k_factor);
+    } else if (const IndexInt8IDMap *idxmap =
+               dynamic_cast<const IndexInt8IDMap *> (idx)) {
+        uint32_t h =
+            dynamic_cast<const IndexInt8IDMap2 *> (idx) ? fourcc ("IIM2") :
+            fourcc ("IIMp");
+        // no need to store additional info for IndexIDMap2
+        WRITE1 (h);
+        write_index_int8_header (idxmap, f);
+        write_index_int8 (idxmap->index, f);
+        WRITEVECTOR (idxmap->id_map);
+    } else {
+        FAISS_THROW_MSG ("don't know how to serialize this type of index");
+    }
+}
+
+void write_index_int8 (const IndexInt8 *idx, FILE *f) {
+    FileIOWriter writer(f);
+    write_index_int8(idx, &writer);
+}
+
+void write_index_int8 (const IndexInt8 *idx, const char *fname) {
+    FileIOWriter writer(fname);
+    write_index_int8 (idx, &writer);
+}
+
+
 } // namespace faiss
@@ -10,8 +10,13 @@
 #include <cstring>
 #include <cassert>
 
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #include <faiss/impl/io.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/hugepages.h>
 
 
 namespace faiss {
@@ -131,6 +136,33 @@ int FileIOWriter::fileno()  {
     return ::fileno (f);
 }
 
+/***********************************************************************
+ * Memory-mapped file
+ ***********************************************************************/
+
+MmappedFile::MmappedFile (FILE *f, const std::string & name):
+    name (name), ptr (nullptr), size (0)
+{
+    struct stat buf;
+    int ret = fstat (::fileno(f), &buf);
+    FAISS_THROW_IF_NOT_FMT (ret == 0, "fstat failed: %s", strerror(errno));
+    size = buf.st_size;
+    if (size == 0) return;
+    void *p = mmap (nullptr, size, PROT_READ, MAP_SHARED, ::fileno(f), 0);
+    FAISS_THROW_IF_NOT_FMT (p != MAP_FAILED,
+                            "could not mmap %s: %s",
+                            name.c_str(), strerror(errno));
+    ptr = (uint8_t*)p;
+    hugepage_advise_mapping (ptr, size, ::fileno(f));
+}
+
+MmappedFile::~MmappedFile ()
+{
+    if (ptr) {
+        munmap (ptr, size);
+    }
+}
+
 /***********************************************************************
  * IO buffer
  ***********************************************************************/
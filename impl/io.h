@@ -95,6 +95,20 @@ struct FileIOWriter: IOWriter {
     int fileno() override;
 };
 
+/** read-only, shared memory mapping of a whole file. Indexes that are
+ * read with IO_FLAG_MMAP keep a reference to it and point into it. The
+ * mapping is released when the last reference disappears. It is
+ * advised for huge pages if hugepage_mode is set. */
+struct MmappedFile {
+    std::string name;
+    uint8_t *ptr;
+    size_t size;
+
+    explicit MmappedFile (FILE *f, const std::string & name = "");
+
+    ~MmappedFile ();
+};
+
 /*******************************************************
  * Buffered reader + writer
  *******************************************************/
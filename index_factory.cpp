@@ -21,6 +21,7 @@
 #include <faiss/utils/random.h>
 
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexHalfFlat.h>
 #include <faiss/VectorTransform.h>
 #include <faiss/IndexPreTransform.h>
 #include <faiss/IndexLSH.h>
@@ -191,6 +192,10 @@ Index *index_factory (int d, const char *description_in, MetricType metric)
                                         "dedup supported only for IVFFlat");
                 index_1 = new IndexFlat (d, metric);
             }
+        } else if (!index && !coarse_quantizer &&
+                   (stok == "FlatFP16" || stok == "FlatBF16")) {
+            index_1 = new IndexHalfFlat (
+                d, stok == "FlatFP16" ? HALF_FP16 : HALF_BF16, metric);
         } else if (!index && (stok == "SQ8" || stok == "SQ4" || stok == "SQ6" ||
                               stok == "SQfp16")) {
             ScalarQuantizer::QuantizerType qt =
@@ -27,6 +27,7 @@ namespace faiss {
 
 struct Index;
 struct IndexBinary;
+struct IndexInt8;
 struct VectorTransform;
 struct ProductQuantizer;
 struct IOReader;
@@ -41,6 +42,10 @@ void write_index_binary (const IndexBinary *idx, const char *fname);
 void write_index_binary (const IndexBinary *idx, FILE *f);
 void write_index_binary (const IndexBinary *idx, IOWriter *writer);
 
+void write_index_int8 (const IndexInt8 *idx, const char *fname);
+void write_index_int8 (const IndexInt8 *idx, FILE *f);
+void write_index_int8 (const IndexInt8 *idx, IOWriter *writer);
+
 // The read_index flags are implemented only for a subset of index types.
 const int IO_FLAG_MMAP = 1; // try to memmap if possible
 const int IO_FLAG_READ_ONLY = 2;
@@ -56,6 +61,11 @@ IndexBinary *read_index_binary (const char *fname, int io_flags = 0);
 IndexBinary *read_index_binary (FILE * f, int io_flags = 0);
 IndexBinary *read_index_binary (IOReader *reader, int io_flags = 0);
 
+/// with IO_FLAG_MMAP, the IndexInt8Flat vectors are mapped from the file
+IndexInt8 *read_index_int8 (const char *fname, int io_flags = 0);
+IndexInt8 *read_index_int8 (FILE * f, int io_flags = 0);
+IndexInt8 *read_index_int8 (IOReader *reader, int io_flags = 0);
+
 void write_VectorTransform (const VectorTransform *vt, const char *fname);
 VectorTransform *read_VectorTransform (const char *fname);
 
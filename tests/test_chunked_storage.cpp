@@ -0,0 +1,266 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexFlatChunked.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/io.h>
+#include <faiss/utils/ChunkArena.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48();
+    }
+    return x;
+}
+
+/// sorted results of each query, to be robust to the order of ties
+std::vector<std::set<idx_t> > range_results(const faiss::RangeSearchResult &res) {
+    std::vector<std::set<idx_t> > r(res.nq);
+    for (size_t i = 0; i < res.nq; i++) {
+        r[i].insert(res.labels + res.lims[i], res.labels + res.lims[i + 1]);
+    }
+    return r;
+}
+
+} // namespace
+
+
+TEST(ChunkedStorage, arena) {
+    for (bool use_hugepages : {false, true}) {
+        faiss::ChunkArena arena(1000, use_hugepages);
+        EXPECT_EQ(1024, arena.chunk_bytes);
+
+        std::vector<uint8_t *> chunks;
+        for (int i = 0; i < 5000; i++) {
+            uint8_t *c = arena.alloc_chunk();
+            EXPECT_EQ(0, (uintptr_t)c % 64);
+            memset(c, i, arena.chunk_bytes);
+            chunks.push_back(c);
+        }
+        EXPECT_EQ(5000, arena.nb_chunks_in_use());
+        size_t reserved = arena.nb_bytes_reserved();
+        EXPECT_GE(reserved, 5000 * 1024);
+
+        // the chunks do not overlap
+        for (int i = 0; i < 5000; i++) {
+            EXPECT_EQ(uint8_t(i), chunks[i][arena.chunk_bytes - 1]);
+        }
+
+        // freed chunks are reused
+        for (int i = 0; i < 100; i++) {
+            arena.free_chunk(chunks[i]);
+        }
+        for (int i = 0; i < 100; i++) {
+            arena.alloc_chunk();
+        }
+        EXPECT_EQ(reserved, arena.nb_bytes_reserved());
+    }
+}
+
+
+TEST(ChunkedStorage, invlists) {
+    size_t d = 16, nlist = 20, nb = 5000, nq = 30;
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat ref(&quantizer, d, nlist);
+    ref.train(nb, xb.data());
+    ref.nprobe = 4;
+
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.is_trained = true;
+    index.nprobe = 4;
+    // small chunks to have lists of many chunks
+    auto *cils = new faiss::ChunkedInvertedLists(nlist, index.code_size, 30);
+    index.replace_invlists(cils, true);
+
+    // several adds to have partially filled chunks in between
+    for (size_t i0 = 0; i0 < nb; i0 += 1234) {
+        size_t n = std::min(nb - i0, size_t(1234));
+        ref.add(n, xb.data() + i0 * d);
+        index.add(n, xb.data() + i0 * d);
+    }
+    for (size_t l = 0; l < nlist; l++) {
+        size_t n = cils->list_size(l);
+        EXPECT_EQ(ref.invlists->list_size(l), n);
+        EXPECT_EQ((n + 29) / 30, cils->chunks[l].size());
+
+        faiss::InvertedLists::ScopedIds ids(cils, l);
+        faiss::InvertedLists::ScopedIds ref_ids(ref.invlists, l);
+        for (size_t j = 0; j < n; j++) {
+            EXPECT_EQ(ref_ids[j], ids[j]);
+            EXPECT_EQ(ref_ids[j], cils->get_single_id(l, j));
+        }
+    }
+
+    auto check_search = [&] (const faiss::Index &index2) {
+        // the reservoir is used for large k
+        for (idx_t k : {10, 200}) {
+            std::vector<float> D(nq * k), Dref(nq * k);
+            std::vector<idx_t> I(nq * k), Iref(nq * k);
+            index2.search(nq, xq.data(), k, D.data(), I.data());
+            ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+            EXPECT_EQ(Iref, I);
+            EXPECT_EQ(Dref, D);
+        }
+
+        // store_pairs goes through the copies of the lists
+        idx_t k = 5;
+        std::vector<float> D(nq * k), Dref(nq * k);
+        std::vector<idx_t> I(nq * k), Iref(nq * k);
+        std::vector<float> R(nq * k * d), Rref(nq * k * d);
+        index2.search_and_reconstruct(
+            nq, xq.data(), k, D.data(), I.data(), R.data());
+        ref.search_and_reconstruct(
+            nq, xq.data(), k, Dref.data(), Iref.data(), Rref.data());
+        EXPECT_EQ(Iref, I);
+        EXPECT_EQ(Rref, R);
+
+        faiss::RangeSearchResult res(nq), res_ref(nq);
+        index2.range_search(nq, xq.data(), 0.8, &res);
+        ref.range_search(nq, xq.data(), 0.8, &res_ref);
+        EXPECT_EQ(range_results(res_ref), range_results(res));
+    };
+
+    check_search(index);
+
+    faiss::VectorIOWriter w;
+    faiss::write_index(&index, &w);
+    faiss::VectorIOReader r;
+    r.data = w.data;
+    std::unique_ptr<faiss::IndexIVFFlat> index2(
+        dynamic_cast<faiss::IndexIVFFlat*>(faiss::read_index(&r)));
+    ASSERT_TRUE(index2 != nullptr);
+    ASSERT_TRUE(dynamic_cast<faiss::ChunkedInvertedLists*>(index2->invlists));
+    check_search(*index2);
+
+    // remove_ids moves the entries within the lists and shrinks them
+    faiss::IDSelectorRange sel(1000, 4000);
+    EXPECT_EQ(3000, ref.remove_ids(sel));
+    EXPECT_EQ(3000, index.remove_ids(sel));
+    check_search(index);
+
+    size_t nchunk = 0;
+    for (size_t l = 0; l < nlist; l++) {
+        nchunk += cils->chunks[l].size();
+    }
+    EXPECT_EQ(nchunk, cils->arena->nb_chunks_in_use());
+
+    index.reset();
+    EXPECT_EQ(0, cils->compute_ntotal());
+    EXPECT_EQ(0, cils->arena->nb_bytes_reserved());
+}
+
+
+TEST(ChunkedStorage, flat) {
+    size_t d = 24, nb = 3000;
+    std::vector<float> xb = make_data(nb * d);
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexFlat ref(d, metric);
+        ref.add(nb, xb.data());
+
+        faiss::IndexFlatChunked index(d, metric, 700);
+        for (size_t i0 = 0; i0 < nb; i0 += 1000) {
+            index.add(1000, xb.data() + i0 * d);
+        }
+        EXPECT_EQ(5, index.chunks.size());
+
+        std::vector<float> y(d);
+        index.reconstruct(1234, y.data());
+        EXPECT_EQ(0, memcmp(y.data(), xb.data() + 1234 * d, d * 4));
+
+        // one-to-many, fused and BLAS search paths
+        for (size_t nq : {5, 100, 600}) {
+            idx_t k = 10;
+            std::vector<float> xq = make_data(nq * d);
+            std::vector<float> D(nq * k), Dref(nq * k);
+            std::vector<idx_t> I(nq * k), Iref(nq * k);
+            index.search(nq, xq.data(), k, D.data(), I.data());
+            ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+            size_t nsame = 0;
+            for (size_t i = 0; i < nq * k; i++) {
+                EXPECT_NEAR(Dref[i], D[i], 1e-4);
+                nsame += I[i] == Iref[i];
+            }
+            // only ties may be ordered differently
+            EXPECT_GE(nsame, nq * k * 99 / 100);
+
+            float radius = metric == faiss::METRIC_L2 ? 2.0 : 7.0;
+            faiss::RangeSearchResult res(nq), res_ref(nq);
+            index.range_search(nq, xq.data(), radius, &res);
+            ref.range_search(nq, xq.data(), radius, &res_ref);
+            EXPECT_NEAR(res_ref.lims[nq], res.lims[nq], nq);
+        }
+
+        std::unique_ptr<faiss::DistanceComputer> dis(
+            index.get_distance_computer());
+        std::unique_ptr<faiss::DistanceComputer> dis_ref(
+            ref.get_distance_computer());
+        dis->set_query(xb.data());
+        dis_ref->set_query(xb.data());
+        EXPECT_EQ((*dis_ref)(2500), (*dis)(2500));
+        EXPECT_EQ(dis_ref->symmetric_dis(10, 2900),
+                  dis->symmetric_dis(10, 2900));
+    }
+}
+
+
+TEST(ChunkedStorage, flat_remove_and_io) {
+    size_t d = 8, nb = 1000, nq = 20, k = 5;
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+
+    faiss::IndexFlat ref(d);
+    ref.add(nb, xb.data());
+    faiss::IndexFlatChunked index(d, faiss::METRIC_L2, 128);
+    index.add(nb, xb.data());
+
+    faiss::IDSelectorRange sel(100, 800);
+    EXPECT_EQ(700, ref.remove_ids(sel));
+    EXPECT_EQ(700, index.remove_ids(sel));
+    EXPECT_EQ(3, index.chunks.size());
+
+    faiss::VectorIOWriter w;
+    faiss::write_index(&index, &w);
+    faiss::VectorIOReader r;
+    r.data = w.data;
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(&r));
+    auto *ic2 = dynamic_cast<faiss::IndexFlatChunked*>(index2.get());
+    ASSERT_TRUE(ic2 != nullptr);
+    EXPECT_EQ(128, ic2->chunk_size);
+
+    std::vector<float> D(nq * k), D2(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), I2(nq * k), Iref(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(I, I2);
+    EXPECT_EQ(D, D2);
+
+    index.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(-1, I[0]);
+}
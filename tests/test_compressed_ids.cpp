@@ -0,0 +1,183 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/InvertedLists.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/io.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+/// the lists should hold the same entries
+void check_same_lists(const faiss::InvertedLists &ref,
+                      const faiss::InvertedLists &il) {
+    ASSERT_EQ(ref.nlist, il.nlist);
+    for (size_t l = 0; l < ref.nlist; l++) {
+        size_t n = ref.list_size(l);
+        ASSERT_EQ(n, il.list_size(l));
+        if (n == 0) {
+            continue;
+        }
+        faiss::InvertedLists::ScopedIds ids_ref(&ref, l), ids(&il, l);
+        faiss::InvertedLists::ScopedCodes codes_ref(&ref, l), codes(&il, l);
+        for (size_t j = 0; j < n; j++) {
+            ASSERT_EQ(ids_ref[j], ids[j]);
+            ASSERT_EQ(ids_ref[j], il.get_single_id(l, j));
+        }
+        ASSERT_EQ(0, memcmp(codes_ref.get(), codes.get(), n * ref.code_size));
+    }
+}
+
+std::vector<float> make_data(size_t n, int d) {
+    std::vector<float> x(n * d);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48();
+    }
+    return x;
+}
+
+std::vector<std::set<idx_t> > range_results(const faiss::RangeSearchResult &res) {
+    std::vector<std::set<idx_t> > r(res.nq);
+    for (size_t i = 0; i < res.nq; i++) {
+        r[i].insert(res.labels + res.lims[i], res.labels + res.lims[i + 1]);
+    }
+    return r;
+}
+
+} // namespace
+
+
+TEST(CompressedIds, updates) {
+    size_t nlist = 3, code_size = 4;
+    faiss::ArrayInvertedLists ref(nlist, code_size);
+    faiss::CompressedIdsInvertedLists il(nlist, code_size, 16);
+
+    std::vector<uint8_t> codes(1000 * code_size);
+    for (size_t i = 0; i < codes.size(); i++) {
+        codes[i] = lrand48();
+    }
+    std::vector<idx_t> ids(1000);
+
+    for (int rep = 0; rep < 20; rep++) {
+        size_t l = rep % nlist;
+        size_t n = lrand48() % 100;
+        for (size_t i = 0; i < n; i++) {
+            switch (rep % 4) {
+            case 0: ids[i] = 1000 * rep + i; break;
+            case 1: ids[i] = lrand48(); break;
+            case 2: ids[i] = (idx_t(lrand48()) << 31) ^ lrand48(); break;
+            case 3: ids[i] = 123; break;
+            }
+        }
+        EXPECT_EQ(ref.add_entries(l, n, ids.data(), codes.data()),
+                  il.add_entries(l, n, ids.data(), codes.data()));
+    }
+    check_same_lists(ref, il);
+
+    for (size_t l = 0; l < nlist; l++) {
+        size_t n = ref.list_size(l);
+        size_t ofs = n / 3, nu = n / 4;
+        for (size_t i = 0; i < nu; i++) {
+            ids[i] = lrand48() % 100;
+        }
+        ref.update_entries(l, ofs, nu, ids.data(), codes.data());
+        il.update_entries(l, ofs, nu, ids.data(), codes.data());
+    }
+    check_same_lists(ref, il);
+
+    // shrink, and grow by overwriting the new entries
+    for (size_t l = 0; l < nlist; l++) {
+        size_t n = ref.list_size(l) / 2;
+        ref.resize(l, n);
+        il.resize(l, n);
+        ref.resize(l, n + 30);
+        il.resize(l, n + 30);
+        for (size_t i = 0; i < 30; i++) {
+            ids[i] = 5 * i;
+        }
+        ref.update_entries(l, n, 30, ids.data(), codes.data());
+        il.update_entries(l, n, 30, ids.data(), codes.data());
+    }
+    check_same_lists(ref, il);
+
+    il.reset();
+    EXPECT_EQ(0, il.compute_ntotal());
+    EXPECT_EQ(0, il.ids_bytes());
+}
+
+
+TEST(CompressedIds, IVF_search_and_io) {
+    int d = 32;
+    size_t nb = 20000, nq = 100, nlist = 32;
+    std::vector<float> xb = make_data(nb, d), xq = make_data(nq, d);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQ index(&quantizer, d, nlist, 8, 8);
+    index.do_polysemous_training = false;
+    index.train(5000, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 4;
+
+    // same index with the ids compressed
+    faiss::IndexIVFPQ index2(index);
+    index2.own_invlists = false;
+    index2.replace_invlists(
+        new faiss::CompressedIdsInvertedLists(*index.invlists), true);
+    check_same_lists(*index.invlists, *index2.invlists);
+
+    // the ids of a list are increasing by small steps
+    auto *il = dynamic_cast<faiss::CompressedIdsInvertedLists*>(
+        index2.invlists);
+    EXPECT_LT(il->ids_bytes(), nb * sizeof(idx_t) / 3);
+
+    idx_t k = 10;
+    float radius = 3.0;
+    std::vector<float> Dref(nq * k);
+    std::vector<idx_t> Iref(nq * k);
+    index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    faiss::RangeSearchResult rref(nq);
+    index.range_search(nq, xq.data(), radius, &rref);
+    EXPECT_GT(rref.lims[nq], 0);
+
+    faiss::VectorIOWriter w;
+    faiss::write_index(&index2, &w);
+    faiss::VectorIOReader r;
+    r.data = w.data;
+    std::unique_ptr<faiss::IndexIVFPQ> index3(
+        dynamic_cast<faiss::IndexIVFPQ*>(faiss::read_index(&r)));
+    ASSERT_TRUE(index3.get() != nullptr);
+    ASSERT_TRUE(dynamic_cast<faiss::CompressedIdsInvertedLists*>(
+        index3->invlists) != nullptr);
+    check_same_lists(*index.invlists, *index3->invlists);
+
+    for (faiss::IndexIVFPQ *ivf : {&index2, index3.get()}) {
+        for (int pmode : {0, 4}) {
+            ivf->parallel_mode = pmode;
+            std::vector<float> D(nq * k);
+            std::vector<idx_t> I(nq * k);
+            ivf->search(nq, xq.data(), k, D.data(), I.data());
+            EXPECT_EQ(Iref, I);
+            EXPECT_EQ(Dref, D);
+
+            faiss::RangeSearchResult res(nq);
+            ivf->range_search(nq, xq.data(), radius, &res);
+            EXPECT_EQ(range_results(rref), range_results(res));
+        }
+    }
+}
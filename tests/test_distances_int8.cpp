@@ -0,0 +1,187 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/utils/distances.h>
+#include <faiss/impl/AuxIndexStructures.h>
+
+namespace {
+
+std::vector<int8_t> make_data(size_t n, unsigned seed) {
+    std::vector<int8_t> x(n);
+    srand(seed);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = rand() % 256 - 128;
+    }
+    return x;
+}
+
+int ref_inner_product(const int8_t *a, const int8_t *b, size_t d) {
+    int res = 0;
+    for (size_t i = 0; i < d; i++) {
+        res += int(a[i]) * b[i];
+    }
+    return res;
+}
+
+int ref_L2sqr(const int8_t *a, const int8_t *b, size_t d) {
+    int res = 0;
+    for (size_t i = 0; i < d; i++) {
+        int tmp = int(a[i]) - b[i];
+        res += tmp * tmp;
+    }
+    return res;
+}
+
+} // namespace
+
+
+TEST(Int8Distances, inner_products_block) {
+    faiss::SIMDLevel prev = faiss::get_simd_level();
+    // the kernels of each level, with d not a multiple of the SIMD width
+    for (int l = 0; l <= faiss::simd_level_supported(); l++) {
+        faiss::set_simd_level(faiss::SIMDLevel(l));
+        for (size_t d : {1, 7, 15, 16, 31, 33, 40, 64, 100, 129}) {
+            size_t nx = 7, ny = 13;
+            std::vector<int8_t> x = make_data(nx * d, 1);
+            std::vector<int8_t> y = make_data(ny * d, 2);
+            std::vector<int32_t> ip(nx * ny);
+
+            faiss::i8vec_inner_products_block(
+                ip.data(), x.data(), y.data(), d, nx, ny);
+
+            for (size_t i = 0; i < nx; i++) {
+                for (size_t j = 0; j < ny; j++) {
+                    int ref = ref_inner_product(
+                        x.data() + i * d, y.data() + j * d, d);
+                    EXPECT_EQ(ref, ip[i * ny + j])
+                        << "level " << l << " d " << d;
+                    EXPECT_EQ(ref, faiss::i8vec_inner_product(
+                                  x.data() + i * d, y.data() + j * d, d));
+                }
+            }
+        }
+    }
+    faiss::set_simd_level(prev);
+}
+
+TEST(Int8Distances, knn_inner_product) {
+    size_t d = 40, nx = 100, ny = 3000, k = 5;
+    std::vector<int8_t> x = make_data(nx * d, 3);
+    std::vector<int8_t> y = make_data(ny * d, 4);
+
+    // nx is above distance_compute_blas_threshold: blocked path
+    std::vector<int> D(nx * k);
+    std::vector<int64_t> I(nx * k);
+    faiss::int_minheap_array_t res = {nx, k, I.data(), D.data()};
+    faiss::knn_inner_product(x.data(), y.data(), d, nx, ny, &res);
+
+    for (size_t i = 0; i < nx; i++) {
+        std::vector<int> ips(ny);
+        for (size_t j = 0; j < ny; j++) {
+            ips[j] = ref_inner_product(x.data() + i * d, y.data() + j * d, d);
+        }
+        std::sort(ips.begin(), ips.end(), std::greater<int>());
+        for (size_t j = 0; j < k; j++) {
+            EXPECT_EQ(ips[j], D[i * k + j]);
+            EXPECT_EQ(ips[j], ref_inner_product(
+                          x.data() + i * d, y.data() + I[i * k + j] * d, d));
+        }
+    }
+}
+
+TEST(Int8Distances, L2sqr) {
+    for (size_t d : {1, 15, 16, 31, 33, 64, 100, 129}) {
+        std::vector<int8_t> x = make_data(d, 5);
+        std::vector<int8_t> y = make_data(d, 6);
+        EXPECT_EQ(ref_L2sqr(x.data(), y.data(), d),
+                  faiss::i8vec_L2sqr(x.data(), y.data(), d));
+    }
+    // extreme values
+    std::vector<int8_t> x(100, -128), y(100, 127);
+    EXPECT_EQ(100 * 255 * 255, faiss::i8vec_L2sqr(x.data(), y.data(), 100));
+}
+
+TEST(Int8Distances, knn_L2sqr) {
+    size_t d = 40, ny = 3000, k = 5;
+    std::vector<int8_t> y = make_data(ny * d, 4);
+
+    // below and above distance_compute_blas_threshold
+    for (size_t nx : {5, 100}) {
+        std::vector<int8_t> x = make_data(nx * d, 3);
+        std::vector<int> D(nx * k);
+        std::vector<int64_t> I(nx * k);
+        faiss::int_maxheap_array_t res = {nx, k, I.data(), D.data()};
+        faiss::knn_L2sqr(x.data(), y.data(), d, nx, ny, &res);
+
+        for (size_t i = 0; i < nx; i++) {
+            std::vector<int> dis(ny);
+            for (size_t j = 0; j < ny; j++) {
+                dis[j] = ref_L2sqr(x.data() + i * d, y.data() + j * d, d);
+            }
+            std::sort(dis.begin(), dis.end());
+            for (size_t j = 0; j < k; j++) {
+                EXPECT_EQ(dis[j], D[i * k + j]);
+                EXPECT_EQ(dis[j], ref_L2sqr(
+                              x.data() + i * d, y.data() + I[i * k + j] * d, d));
+            }
+        }
+    }
+}
+
+TEST(Int8Distances, range_search) {
+    size_t d = 24, ny = 2000;
+    std::vector<int8_t> y = make_data(ny * d, 4);
+
+    // below and above distance_compute_blas_threshold
+    for (size_t nx : {5, 100}) {
+        std::vector<int8_t> x = make_data(nx * d, 3);
+        for (int is_l2 = 0; is_l2 < 2; is_l2++) {
+            // about 2 standard deviations from the mean distance
+            int radius = is_l2 ? 7000 * d : 2000 * d;
+            faiss::RangeSearchResult res(nx);
+            if (is_l2) {
+                faiss::range_search_L2sqr(
+                    x.data(), y.data(), d, nx, ny, radius, &res);
+            } else {
+                faiss::range_search_inner_product(
+                    x.data(), y.data(), d, nx, ny, radius, &res);
+            }
+
+            size_t nres = 0;
+            for (size_t i = 0; i < nx; i++) {
+                std::vector<int64_t> ref;
+                for (size_t j = 0; j < ny; j++) {
+                    const int8_t *xi = x.data() + i * d, *yj = y.data() + j * d;
+                    if (is_l2 ? ref_L2sqr(xi, yj, d) < radius :
+                                ref_inner_product(xi, yj, d) > radius) {
+                        ref.push_back(j);
+                    }
+                }
+                std::vector<int64_t> found(
+                    res.labels + res.lims[i], res.labels + res.lims[i + 1]);
+                std::sort(found.begin(), found.end());
+                EXPECT_EQ(ref, found);
+                for (size_t l = res.lims[i]; l < res.lims[i + 1]; l++) {
+                    const int8_t *yj = y.data() + res.labels[l] * d;
+                    int dis = is_l2 ? ref_L2sqr(x.data() + i * d, yj, d) :
+                        ref_inner_product(x.data() + i * d, yj, d);
+                    EXPECT_EQ(dis, res.distances[l]);
+                }
+                nres += ref.size();
+            }
+            EXPECT_GT(nres, 0);
+        }
+    }
+}
@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/utils/distances.h>
+#include <faiss/index_io.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 24;
+size_t nb = 1000;
+// above distance_compute_blas_threshold, so that the norms are used
+size_t nq = 50;
+int k = 10;
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n * d);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48();
+    }
+    return x;
+}
+
+/// the cached norms must match the stored vectors
+void check_norms(const faiss::IndexFlat &index) {
+    ASSERT_EQ(index.norms.size(), index.ntotal);
+    std::vector<float> ref(index.ntotal);
+    faiss::fvec_norms_L2sqr(ref.data(), index.xb.data(), d, index.ntotal);
+    for (size_t i = 0; i < index.ntotal; i++) {
+        EXPECT_FLOAT_EQ(ref[i], index.norms[i]);
+    }
+}
+
+/// the results with cached norms must match the ones computed from
+/// scratch
+void check_search(const faiss::IndexFlat &index) {
+    std::vector<float> xq = make_data(nq);
+
+    faiss::IndexFlatL2 ref(d);
+    ref.add(index.ntotal, index.xb.data());
+    ref.norms.clear();
+
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    EXPECT_EQ(I, Iref);
+    EXPECT_EQ(D, Dref);
+
+    float radius = 1.5;
+    faiss::RangeSearchResult res(nq), resref(nq);
+    index.range_search(nq, xq.data(), radius, &res);
+    ref.range_search(nq, xq.data(), radius, &resref);
+    for (size_t i = 0; i <= nq; i++) {
+        EXPECT_EQ(res.lims[i], resref.lims[i]);
+    }
+}
+
+} // namespace
+
+
+TEST(FlatNorms, maintained) {
+    std::vector<float> xb = make_data(nb);
+    faiss::IndexFlatL2 index(d);
+
+    index.add(nb / 2, xb.data());
+    index.add(nb - nb / 2, xb.data() + nb / 2 * d);
+    check_norms(index);
+    check_search(index);
+
+    faiss::IDSelectorRange sel(100, 200);
+    EXPECT_EQ(index.remove_ids(sel), 100);
+    check_norms(index);
+    check_search(index);
+
+    index.remove_id(3);
+    check_norms(index);
+
+    std::vector<float> x = make_data(1);
+    index.update(7, x.data());
+    check_norms(index);
+    check_search(index);
+
+    index.reset();
+    EXPECT_TRUE(index.norms.empty());
+    index.add(nb, xb.data());
+    check_norms(index);
+}
+
+TEST(FlatNorms, inner_product) {
+    std::vector<float> xb = make_data(nb);
+    faiss::IndexFlatIP index(d);
+    index.add(nb, xb.data());
+    EXPECT_TRUE(index.norms.empty());
+}
+
+TEST(FlatNorms, out_of_sync) {
+    std::vector<float> xb = make_data(nb);
+    faiss::IndexFlatL2 index(d);
+
+    // vectors filled in directly: the norms are ignored until recomputed
+    index.xb = xb;
+    index.ntotal = nb;
+    check_search(index);
+    index.add(10, xb.data());
+    EXPECT_TRUE(index.norms.empty());
+
+    index.update_norms();
+    check_norms(index);
+    check_search(index);
+}
+
+TEST(FlatNorms, overwritten_in_place) {
+    std::vector<float> xb = make_data(nb);
+    faiss::IndexFlatL2 index(d);
+    index.add(nb, xb.data());
+
+    // same size: the cached norms are still used, so they must be
+    // recomputed explicitly
+    std::vector<float> xb2 = make_data(nb);
+    memcpy(index.xb.data(), xb2.data(), sizeof(float) * nb * d);
+    ASSERT_EQ(index.norms.size(), index.ntotal);
+    index.update_norms();
+    check_norms(index);
+    check_search(index);
+}
+
+TEST(FlatNorms, io) {
+    std::vector<float> xb = make_data(nb);
+    faiss::IndexFlatL2 index(d);
+    index.add(nb, xb.data());
+
+    char *fname = tempnam(nullptr, "flatn");
+    faiss::write_index(&index, fname);
+    std::unique_ptr<faiss::IndexFlat> index2(
+        dynamic_cast<faiss::IndexFlat*>(faiss::read_index(fname)));
+    unlink(fname);
+    free(fname);
+
+    ASSERT_TRUE(index2);
+    check_norms(*index2);
+    check_search(*index2);
+}
@@ -0,0 +1,202 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHalfFlat.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/io.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/half.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+/// restores the initial SIMD level at the end of the scope
+struct SIMDLevelGuard {
+    faiss::SIMDLevel prev;
+    SIMDLevelGuard (): prev (faiss::get_simd_level ()) {}
+    ~SIMDLevelGuard () {
+        faiss::set_simd_level (prev);
+    }
+};
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48() * 2 - 1;
+    }
+    return x;
+}
+
+} // namespace
+
+
+TEST(HalfFlat, conversions) {
+    // exactly representable values
+    for (float f : {0.0f, 1.0f, -2.5f, 0.375f, 1024.0f}) {
+        EXPECT_EQ(f, faiss::decode_fp16(faiss::encode_fp16(f)));
+        EXPECT_EQ(f, faiss::decode_bf16(faiss::encode_bf16(f)));
+    }
+    EXPECT_EQ(-65504.0f, faiss::decode_fp16(faiss::encode_fp16(-65504.0f)));
+    // bf16 has the range of float
+    EXPECT_NEAR(1e30f, faiss::decode_bf16(faiss::encode_bf16(1e30f)), 1e28f);
+    // bf16 rounds to nearest even
+    EXPECT_EQ(1.0f, faiss::decode_bf16(faiss::encode_bf16(1.0f + 1.0f / 256)));
+    EXPECT_EQ(1.0f + 1.0f / 64,
+              faiss::decode_bf16(faiss::encode_bf16(1.0f + 3.0f / 256)));
+    EXPECT_TRUE(std::isnan(faiss::decode_bf16(faiss::encode_bf16(NAN))));
+
+    std::vector<float> x = make_data(1000);
+    for (auto type : {faiss::HALF_FP16, faiss::HALF_BF16}) {
+        float eps = type == faiss::HALF_FP16 ? 1.0 / 2048 : 1.0 / 256;
+        std::vector<uint16_t> h(x.size());
+        faiss::half_encode(type, x.data(), h.data(), x.size());
+        for (size_t i = 0; i < x.size(); i++) {
+            EXPECT_NEAR(x[i], faiss::decode_half(type, h[i]), eps);
+        }
+    }
+}
+
+/// all levels give the same conversions and close distances
+TEST(HalfFlat, kernels) {
+    SIMDLevelGuard guard;
+    for (auto type : {faiss::HALF_FP16, faiss::HALF_BF16}) {
+        for (int l = 0; l <= faiss::simd_level_supported (); l++) {
+            faiss::set_simd_level (faiss::SIMDLevel (l));
+            for (size_t d = 1; d < 70; d += d < 20 ? 1 : 7) {
+                size_t ny = 19;
+                std::vector<float> x = make_data(d), y = make_data(ny * d);
+                std::vector<uint16_t> yh(ny * d);
+                faiss::half_encode(type, y.data(), yh.data(), ny * d);
+
+                std::vector<float> yd(ny * d);
+                faiss::half_decode(type, yh.data(), yd.data(), ny * d);
+                for (size_t i = 0; i < ny * d; i++) {
+                    EXPECT_EQ(faiss::decode_half(type, yh[i]), yd[i]);
+                }
+
+                std::vector<float> dis(ny), ips(ny);
+                faiss::hvec_L2sqr_ny(
+                    type, dis.data(), x.data(), yh.data(), d, ny);
+                faiss::hvec_inner_products_ny(
+                    type, ips.data(), x.data(), yh.data(), d, ny);
+                for (size_t j = 0; j < ny; j++) {
+                    const float *yj = yd.data() + j * d;
+                    EXPECT_NEAR(faiss::fvec_L2sqr(x.data(), yj, d),
+                                dis[j], 1e-4);
+                    EXPECT_NEAR(faiss::fvec_inner_product(x.data(), yj, d),
+                                ips[j], 1e-4);
+                }
+            }
+        }
+    }
+}
+
+/// same results as an IndexFlat on the rounded vectors, for the
+/// one-to-many, fused and BLAS paths
+TEST(HalfFlat, search) {
+    size_t d = 40, nb = 3000, k = 10;
+    std::vector<float> xb = make_data(nb * d);
+
+    for (auto type : {faiss::HALF_FP16, faiss::HALF_BF16}) {
+        for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+            faiss::IndexHalfFlat index(d, type, metric);
+            index.add(nb / 2, xb.data());
+            index.add(nb - nb / 2, xb.data() + nb / 2 * d);
+            EXPECT_EQ(nb * d, index.codes.size());
+
+            std::vector<float> xb_rounded(nb * d);
+            index.reconstruct_n(0, nb, xb_rounded.data());
+            faiss::IndexFlat ref(d, metric);
+            ref.add(nb, xb_rounded.data());
+
+            for (size_t nq : {5, 100, 600}) {
+                std::vector<float> xq = make_data(nq * d);
+                std::vector<float> D(nq * k), Dref(nq * k);
+                std::vector<idx_t> I(nq * k), Iref(nq * k);
+                index.search(nq, xq.data(), k, D.data(), I.data());
+                ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+                size_t nsame = 0;
+                for (size_t i = 0; i < nq * k; i++) {
+                    EXPECT_NEAR(Dref[i], D[i], 1e-4);
+                    nsame += I[i] == Iref[i];
+                }
+                // only ties may be ordered differently
+                EXPECT_GE(nsame, nq * k * 99 / 100);
+            }
+        }
+    }
+}
+
+TEST(HalfFlat, range_search) {
+    size_t d = 24, nb = 1000;
+    std::vector<float> xb = make_data(nb * d);
+    for (size_t nq : {3, 50}) {
+        std::vector<float> xq = make_data(nq * d);
+        faiss::IndexHalfFlat index(d, faiss::HALF_BF16);
+        index.add(nb, xb.data());
+        float radius = 5.0;
+        faiss::RangeSearchResult res(nq);
+        index.range_search(nq, xq.data(), radius, &res);
+
+        std::vector<float> y(d);
+        size_t nres = 0;
+        for (size_t i = 0; i < nq; i++) {
+            for (size_t j = 0; j < nb; j++) {
+                index.reconstruct(j, y.data());
+                float dis = faiss::fvec_L2sqr(xq.data() + i * d, y.data(), d);
+                // margin for the roundoff of the BLAS path
+                if (fabs(dis - radius) > 1e-4) {
+                    nres += dis < radius;
+                }
+            }
+        }
+        EXPECT_NEAR(nres, res.lims[nq], nq);
+    }
+}
+
+TEST(HalfFlat, io_and_factory) {
+    size_t d = 16, nb = 500, nq = 10, k = 5;
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+
+    std::unique_ptr<faiss::Index> index(
+        faiss::index_factory(d, "FlatBF16", faiss::METRIC_INNER_PRODUCT));
+    auto *ih = dynamic_cast<faiss::IndexHalfFlat*>(index.get());
+    ASSERT_TRUE(ih != nullptr);
+    EXPECT_EQ(faiss::HALF_BF16, ih->half_type);
+    index->add(nb, xb.data());
+
+    faiss::VectorIOWriter w;
+    faiss::write_index(index.get(), &w);
+    faiss::VectorIOReader r;
+    r.data = w.data;
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(&r));
+    auto *ih2 = dynamic_cast<faiss::IndexHalfFlat*>(index2.get());
+    ASSERT_TRUE(ih2 != nullptr);
+    EXPECT_EQ(ih->codes, ih2->codes);
+    EXPECT_EQ(faiss::METRIC_INNER_PRODUCT, ih2->metric_type);
+
+    std::vector<float> D(nq * k), D2(nq * k);
+    std::vector<idx_t> I(nq * k), I2(nq * k);
+    index->search(nq, xq.data(), k, D.data(), I.data());
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(D, D2);
+    EXPECT_EQ(I, I2);
+}
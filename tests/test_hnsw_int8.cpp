@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/IndexHNSWInt8.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+void test_recall(faiss::MetricType metric) {
+    int d = 32;
+    size_t nb = 2000, nq = 100;
+
+    srand(1234);
+    std::vector<int8_t> xb(nb * d), xq(nq * d);
+    for (size_t i = 0; i < xb.size(); i++) {
+        xb[i] = rand() % 256 - 128;
+    }
+    for (size_t i = 0; i < xq.size(); i++) {
+        xq[i] = rand() % 256 - 128;
+    }
+
+    faiss::IndexInt8Flat ref(d, metric);
+    ref.add(nb, xb.data());
+
+    faiss::IndexHNSWInt8 index(d, 16, metric);
+    index.hnsw.efSearch = 64;
+    index.add(nb, xb.data());
+    EXPECT_EQ(index.ntotal, nb);
+
+    std::vector<int> D(nq), Dref(nq);
+    std::vector<idx_t> I(nq), Iref(nq);
+    ref.search(nq, xq.data(), 1, Dref.data(), Iref.data());
+    index.search(nq, xq.data(), 1, D.data(), I.data());
+
+    int n_ok = 0;
+    for (size_t i = 0; i < nq; i++) {
+        // the returned distance is the distance to the result
+        std::vector<int8_t> v(d);
+        index.reconstruct(I[i], v.data());
+        int dis = 0;
+        for (int j = 0; j < d; j++) {
+            int a = xq[i * d + j], b = v[j];
+            dis += metric == faiss::METRIC_INNER_PRODUCT ? a * b :
+                (a - b) * (a - b);
+        }
+        EXPECT_EQ(dis, D[i]);
+        if (D[i] == Dref[i]) {
+            n_ok++;
+        }
+    }
+    EXPECT_GE(n_ok, nq * 9 / 10);
+}
+
+} // namespace
+
+
+TEST(HNSWInt8, recall) {
+    test_recall(faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(HNSWInt8, recall_L2) {
+    test_recall(faiss::METRIC_L2);
+}
+
+/// the distances above 2^24 are returned exactly, in order
+TEST(HNSWInt8, exact_distances) {
+    int d = 768, k = 10;
+    size_t nb = 300, nq = 10;
+
+    srand(1234);
+    // components of +-127, so that the L2 distances are ~2.5e7
+    std::vector<int8_t> xb(nb * d), xq(nq * d);
+    for (size_t i = 0; i < xb.size(); i++) {
+        xb[i] = rand() % 2 ? 127 : -128;
+    }
+    for (size_t i = 0; i < xq.size(); i++) {
+        xq[i] = rand() % 2 ? 127 : -128;
+    }
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexHNSWInt8 index(d, 16, metric);
+        index.add(nb, xb.data());
+
+        std::vector<int> D(nq * k);
+        std::vector<idx_t> I(nq * k);
+        index.search(nq, xq.data(), k, D.data(), I.data());
+
+        for (size_t i = 0; i < nq; i++) {
+            for (int j = 0; j < k; j++) {
+                ASSERT_GE(I[i * k + j], 0);
+                const int8_t *v = xb.data() + I[i * k + j] * d;
+                int dis = 0;
+                for (int l = 0; l < d; l++) {
+                    int a = xq[i * d + l], b = v[l];
+                    dis += metric == faiss::METRIC_INNER_PRODUCT ? a * b :
+                        (a - b) * (a - b);
+                }
+                EXPECT_EQ(dis, D[i * k + j]);
+                if (j > 0) {
+                    if (metric == faiss::METRIC_L2) {
+                        EXPECT_LE(D[i * k + j - 1], D[i * k + j]);
+                    } else {
+                        EXPECT_GE(D[i * k + j - 1], D[i * k + j]);
+                    }
+                }
+            }
+        }
+    }
+}
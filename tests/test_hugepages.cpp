@@ -0,0 +1,176 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/ChunkArena.h>
+#include <faiss/utils/hugepages.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+/// restores the global settings at the end of the scope
+struct HugePageModeGuard {
+    faiss::HugePageMode mode;
+    size_t min_bytes;
+    HugePageModeGuard ():
+        mode (faiss::hugepage_mode), min_bytes (faiss::hugepage_min_bytes) {}
+    ~HugePageModeGuard () {
+        faiss::hugepage_mode = mode;
+        faiss::hugepage_min_bytes = min_bytes;
+    }
+};
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48();
+    }
+    return x;
+}
+
+} // namespace
+
+
+TEST(HugePages, alloc) {
+    size_t size = (5 << 20) + 123;
+    for (auto mode : {faiss::HUGEPAGES_NONE, faiss::HUGEPAGES_THP,
+                      faiss::HUGEPAGES_2MB, faiss::HUGEPAGES_1GB}) {
+        faiss::hugepage_stats.reset();
+        uint8_t *p = (uint8_t*)faiss::hugepage_alloc(size, mode);
+        ASSERT_TRUE(p != nullptr);
+        memset(p, 1, size);
+        EXPECT_EQ(1, p[size - 1]);
+        if (mode != faiss::HUGEPAGES_NONE) {
+            EXPECT_EQ(0, (uintptr_t)p % (2 << 20));
+        }
+        if (mode >= faiss::HUGEPAGES_2MB) {
+            // either from the hugetlbfs pool or the fallback
+            EXPECT_GT(faiss::hugepage_stats.nb_hugetlb +
+                      faiss::hugepage_stats.nb_fallback, 0);
+        }
+        faiss::hugepage_free(p);
+    }
+}
+
+
+TEST(HugePages, reserve) {
+    HugePageModeGuard guard;
+    faiss::hugepage_mode = faiss::HUGEPAGES_THP;
+    faiss::hugepage_min_bytes = 1 << 20;
+    faiss::hugepage_stats.reset();
+
+    std::vector<float> v(1000);
+    for (size_t i = 0; i < v.size(); i++) {
+        v[i] = i;
+    }
+    // too small
+    faiss::hugepage_reserve(v, 2000);
+    EXPECT_EQ(0, faiss::hugepage_stats.nb_advised);
+
+    faiss::hugepage_reserve(v, 3 << 20);
+    EXPECT_GE(v.capacity(), 3 << 20);
+    EXPECT_EQ(1000, v.size());
+    for (size_t i = 0; i < v.size(); i++) {
+        EXPECT_EQ(i, v[i]);
+    }
+    // the advised range is within the buffer (0 if THP is disabled)
+    EXPECT_LE(faiss::hugepage_stats.nb_advised,
+              v.capacity() * sizeof(float));
+
+    // no reallocation when the capacity is sufficient
+    const float *p = v.data();
+    faiss::hugepage_reserve(v, 2 << 20);
+    EXPECT_EQ(p, v.data());
+}
+
+
+TEST(HugePages, indexes) {
+    HugePageModeGuard guard;
+    size_t d = 32, nb = 20000, nq = 10, k = 5;
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+
+    std::vector<float> Dref(nq * k);
+    std::vector<idx_t> Iref(nq * k);
+    faiss::IndexFlatL2 ref(d);
+    ref.add(nb, xb.data());
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    faiss::hugepage_mode = faiss::HUGEPAGES_THP;
+    faiss::hugepage_min_bytes = 1 << 20;
+    faiss::hugepage_stats.reset();
+
+    faiss::IndexFlatL2 index(d);
+    for (size_t i0 = 0; i0 < nb; i0 += 1000) {
+        index.add(1000, xb.data() + i0 * d);
+    }
+    EXPECT_EQ(ref.xb, index.xb);
+
+    std::vector<float> D(nq * k);
+    std::vector<idx_t> I(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+
+    // THP may be disabled in the kernel
+    printf("advised %zd bytes, %zd bytes on huge pages\n",
+           faiss::hugepage_stats.nb_advised,
+           faiss::get_hugepage_resident_bytes());
+
+    // chunk arenas use hugepage_alloc
+    faiss::ChunkArena arena(1000);
+    uint8_t *chunk = arena.alloc_chunk();
+    EXPECT_EQ(0, (uintptr_t)chunk % (2 << 20));
+}
+
+
+TEST(HugePages, io) {
+    HugePageModeGuard guard;
+    size_t d = 16, nb = 1000, nq = 10, k = 5;
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 10);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    char fname[256];
+    snprintf(fname, sizeof(fname), "/tmp/faiss_test_hugepages_%d.index",
+             (int)getpid());
+    faiss::write_index(&index, fname);
+
+    std::vector<float> D(nq * k), D2(nq * k);
+    std::vector<idx_t> I(nq * k), I2(nq * k);
+    index.nprobe = 3;
+    index.search(nq, xq.data(), k, D.data(), I.data());
+
+    faiss::hugepage_mode = faiss::HUGEPAGES_2MB;
+    faiss::hugepage_min_bytes = 0;
+    for (int io_flags : {0, faiss::IO_FLAG_MMAP}) {
+        std::unique_ptr<faiss::IndexIVFFlat> index2(
+            dynamic_cast<faiss::IndexIVFFlat*>(
+                faiss::read_index(fname, io_flags)));
+        ASSERT_TRUE(index2 != nullptr);
+        index2->nprobe = 3;
+        index2->search(nq, xq.data(), k, D2.data(), I2.data());
+        EXPECT_EQ(I, I2);
+        EXPECT_EQ(D, D2);
+    }
+    unlink(fname);
+}
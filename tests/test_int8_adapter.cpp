@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/IndexInt8Adapter.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 5000, nq = 100;
+int k = 10;
+
+/// components of different ranges and offsets
+std::vector<float> make_data(size_t n, int64_t seed) {
+    std::vector<float> x(n * d);
+    faiss::float_randn(x.data(), x.size(), seed);
+    for (size_t i = 0; i < n; i++) {
+        for (int j = 0; j < d; j++) {
+            x[i * d + j] = x[i * d + j] * (1 + j % 4) + 0.5 * j;
+        }
+    }
+    return x;
+}
+
+void test_adapter(faiss::MetricType metric, bool per_dimension) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    faiss::IndexInt8Adapter index(
+        new faiss::IndexInt8Flat(d, metric), per_dimension);
+    index.own_fields = true;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    EXPECT_EQ(index.ntotal, nb);
+
+    faiss::IndexFlat ref(d, metric);
+    ref.add(nb, xb.data());
+
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    int n_ok = 0;
+    for (size_t i = 0; i < nq; i++) {
+        for (int j = 0; j < k; j++) {
+            if (I[i * k + j] == Iref[i * k]) n_ok++;
+        }
+        // the rescaled distances approximate the float distances
+        const float *xi = xq.data() + i * d;
+        const float *yi = xb.data() + I[i * k] * d;
+        float dis = metric == faiss::METRIC_L2 ?
+            faiss::fvec_L2sqr(xi, yi, d) : faiss::fvec_inner_product(xi, yi, d);
+        float spread = std::abs(Dref[i * k] - Dref[i * k + k - 1]) + 1;
+        EXPECT_NEAR(dis, D[i * k], spread);
+    }
+    EXPECT_GE(n_ok, nq * 9 / 10);
+}
+
+} // namespace
+
+
+TEST(Int8Adapter, IP) {
+    test_adapter(faiss::METRIC_INNER_PRODUCT, true);
+}
+
+TEST(Int8Adapter, IP_uniform) {
+    test_adapter(faiss::METRIC_INNER_PRODUCT, false);
+}
+
+TEST(Int8Adapter, L2) {
+    test_adapter(faiss::METRIC_L2, true);
+}
+
+TEST(Int8Adapter, L2_uniform) {
+    test_adapter(faiss::METRIC_L2, false);
+}
+
+TEST(Int8Adapter, range_search) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    faiss::IndexInt8Adapter index(new faiss::IndexInt8Flat(d, faiss::METRIC_L2));
+    index.own_fields = true;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    std::vector<float> D(nq * k);
+    std::vector<idx_t> I(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+
+    // the radius between the 5th and 6th neighbor gives 5 results
+    faiss::RangeSearchResult res(nq);
+    float radius = (D[4] + D[5]) / 2;
+    index.range_search(1, xq.data(), radius, &res);
+    if (D[4] < D[5]) {
+        EXPECT_EQ(res.lims[1], 5);
+    }
+    for (size_t l = 0; l < res.lims[1]; l++) {
+        EXPECT_LT(res.distances[l], radius);
+    }
+}
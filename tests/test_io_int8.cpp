@@ -0,0 +1,194 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/IndexIVFInt8.h>
+#include <faiss/IndexHNSWInt8.h>
+#include <faiss/IndexRefineInt8.h>
+#include <faiss/IndexInt8Adapter.h>
+#include <faiss/MetaIndexes.h>
+#include <faiss/index_io.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+struct Tempfilename {
+    std::string filename;
+
+    Tempfilename () {
+        char *cfname = tempnam (nullptr, "i8io");
+        filename = cfname;
+        free(cfname);
+    }
+
+    ~Tempfilename () {
+        if (access (filename.c_str(), F_OK) == 0) {
+            unlink (filename.c_str());
+        }
+    }
+
+    const char *c_str() {
+        return filename.c_str();
+    }
+};
+
+int d = 32;
+size_t nb = 1000, nq = 20;
+int k = 5;
+
+std::vector<int8_t> make_data(size_t n, unsigned seed) {
+    std::vector<int8_t> x(n * d);
+    srand(seed);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = rand() % 256 - 128;
+    }
+    return x;
+}
+
+/// write the index, read it back with the io_flags and compare results
+void test_roundtrip(const faiss::IndexInt8 &index, int io_flags) {
+    std::vector<int8_t> xq = make_data(nq, 456);
+    Tempfilename fname;
+
+    faiss::write_index_int8(&index, fname.c_str());
+    std::unique_ptr<faiss::IndexInt8> index2(
+        faiss::read_index_int8(fname.c_str(), io_flags));
+
+    EXPECT_EQ(index.d, index2->d);
+    EXPECT_EQ(index.ntotal, index2->ntotal);
+
+    std::vector<int> D(nq * k), D2(nq * k);
+    std::vector<idx_t> I(nq * k), I2(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(D, D2);
+    EXPECT_EQ(I, I2);
+}
+
+} // namespace
+
+
+TEST(IOInt8, flat) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    faiss::IndexInt8Flat index(d);
+    index.add(nb, xb.data());
+
+    test_roundtrip(index, 0);
+    test_roundtrip(index, faiss::IO_FLAG_MMAP);
+}
+
+TEST(IOInt8, flat_mmap_then_add) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    faiss::IndexInt8Flat index(d);
+    index.add(nb, xb.data());
+
+    Tempfilename fname;
+    faiss::write_index_int8(&index, fname.c_str());
+    std::unique_ptr<faiss::IndexInt8Flat> index2(
+        dynamic_cast<faiss::IndexInt8Flat*>(faiss::read_index_int8(
+            fname.c_str(), faiss::IO_FLAG_MMAP)));
+    ASSERT_TRUE(index2);
+    EXPECT_TRUE(index2->xb.empty());
+
+    // modifications copy the mapped vectors first
+    index2->add(10, xb.data());
+    EXPECT_EQ(index2->ntotal, nb + 10);
+    EXPECT_EQ(index2->xb.size(), (nb + 10) * d);
+    std::vector<int8_t> v(d);
+    index2->reconstruct(nb - 1, v.data());
+    for (int j = 0; j < d; j++) {
+        EXPECT_EQ(v[j], xb[(nb - 1) * d + j]);
+    }
+}
+
+TEST(IOInt8, ivf) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    for (int int8_quantizer = 0; int8_quantizer < 2; int8_quantizer++) {
+        faiss::IndexFlatIP quantizer(d);
+        faiss::IndexInt8Flat quantizer_int8(d);
+        std::unique_ptr<faiss::IndexIVFInt8> index(int8_quantizer ?
+            new faiss::IndexIVFInt8(&quantizer_int8, d, 10) :
+            new faiss::IndexIVFInt8(&quantizer, d, 10));
+        index->train(nb, xb.data());
+        index->add(nb, xb.data());
+        index->nprobe = 3;
+
+        test_roundtrip(*index, 0);
+        test_roundtrip(*index, faiss::IO_FLAG_MMAP);
+    }
+}
+
+TEST(IOInt8, hnsw) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    faiss::IndexHNSWInt8 index(d, 16);
+    index.add(nb, xb.data());
+
+    test_roundtrip(index, 0);
+    test_roundtrip(index, faiss::IO_FLAG_MMAP);
+}
+
+TEST(IOInt8, refine) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    faiss::IndexRefineInt8 index(new faiss::IndexFlatL2(d));
+    index.own_fields = true;
+    index.k_factor = 2;
+    index.add(nb, xb.data());
+
+    test_roundtrip(index, 0);
+    test_roundtrip(index, faiss::IO_FLAG_MMAP);
+}
+
+TEST(IOInt8, adapter) {
+    std::vector<float> xb(nb * d), xq(nq * d);
+    for (size_t i = 0; i < xb.size(); i++) {
+        xb[i] = drand48() * 10 - 3;
+    }
+    for (size_t i = 0; i < xq.size(); i++) {
+        xq[i] = drand48() * 10 - 3;
+    }
+    faiss::IndexInt8Adapter index(new faiss::IndexInt8Flat(d));
+    index.own_fields = true;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+
+    Tempfilename fname;
+    faiss::write_index(&index, fname.c_str());
+    std::unique_ptr<faiss::Index> index2(faiss::read_index(fname.c_str()));
+
+    std::vector<float> D(nq * k), D2(nq * k);
+    std::vector<idx_t> I(nq * k), I2(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    index2->search(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(D, D2);
+    EXPECT_EQ(I, I2);
+}
+
+TEST(IOInt8, idmap) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    std::vector<idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 2 * i + 1;
+    }
+    faiss::IndexInt8IDMap2 index(new faiss::IndexInt8Flat(d));
+    index.own_fields = true;
+    index.add_with_ids(nb, xb.data(), ids.data());
+
+    test_roundtrip(index, 0);
+    test_roundtrip(index, faiss::IO_FLAG_MMAP);
+}
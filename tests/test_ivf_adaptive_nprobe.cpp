@@ -0,0 +1,143 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IVFlib.h>
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 16;
+size_t nb = 20000, nq = 100;
+size_t nlist = 64;
+
+/// points around a few centers, so that few lists matter per query
+std::vector<float> make_data(size_t n) {
+    std::vector<float> centers(20 * d);
+    srand48(123);
+    for (size_t i = 0; i < centers.size(); i++) {
+        centers[i] = 10 * drand48();
+    }
+    std::vector<float> x(n * d);
+    srand48(n);
+    for (size_t i = 0; i < n; i++) {
+        const float *c = centers.data() + (lrand48() % 20) * d;
+        for (int j = 0; j < d; j++) {
+            x[i * d + j] = c[j] + drand48();
+        }
+    }
+    return x;
+}
+
+} // namespace
+
+
+TEST(IVFAdaptiveNprobe, same_results_fewer_codes) {
+    std::vector<float> xb = make_data(nb), xq = make_data(nq);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 32;
+
+    for (idx_t k : {1, 10, 200}) {
+        std::vector<float> D(nq * k), Dref(nq * k);
+        std::vector<idx_t> I(nq * k), Iref(nq * k);
+
+        faiss::indexIVF_stats.reset();
+        index.adaptive_nprobe = false;
+        index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+        size_t ndis_ref = faiss::indexIVF_stats.ndis;
+
+        faiss::indexIVF_stats.reset();
+        index.adaptive_nprobe = true;
+        std::vector<size_t> npq(nq);
+        faiss::IVFSearchParameters params;
+        params.nprobe = index.nprobe;
+        params.nlist_per_query = npq.data();
+        faiss::ivflib::search_with_parameters(
+            &index, nq, xq.data(), k, D.data(), I.data(), &params);
+        size_t ndis = faiss::indexIVF_stats.ndis;
+
+        // the skipped lists cannot contain results
+        for (size_t i = 0; i < nq * k; i++) {
+            EXPECT_FLOAT_EQ(Dref[i], D[i]);
+        }
+        EXPECT_LT(ndis, ndis_ref);
+
+        size_t tot = 0;
+        for (size_t nl : npq) {
+            EXPECT_GE(nl, 1);
+            EXPECT_LE(nl, index.nprobe);
+            tot += nl;
+        }
+        EXPECT_EQ(faiss::indexIVF_stats.nlist, tot);
+    }
+
+    // the counts are only available per query in parallel_mode 0
+    idx_t k = 10;
+    std::vector<float> D(nq * k);
+    std::vector<idx_t> I(nq * k);
+    std::vector<size_t> npq(nq);
+    faiss::IVFSearchParameters params;
+    params.nprobe = index.nprobe;
+    params.nlist_per_query = npq.data();
+    index.parallel_mode = 1;
+    EXPECT_THROW(
+        faiss::ivflib::search_with_parameters(
+            &index, nq, xq.data(), k, D.data(), I.data(), &params),
+        faiss::FaissException);
+}
+
+
+TEST(IVFAdaptiveNprobe, ratio) {
+    std::vector<float> xb = make_data(nb), xq = make_data(nq);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 32;
+    index.adaptive_nprobe = true;
+
+    idx_t k = 10;
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+
+    faiss::indexIVF_stats.reset();
+    index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    size_t nlist_ref = faiss::indexIVF_stats.nlist;
+
+    faiss::indexIVF_stats.reset();
+    index.adaptive_nprobe_ratio = 1.5;
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_LE(faiss::indexIVF_stats.nlist, nlist_ref);
+
+    // the first result is found in the nearest list
+    size_t nsame = 0;
+    for (size_t i = 0; i < nq; i++) {
+        nsame += I[i * k] == Iref[i * k];
+    }
+    EXPECT_GE(nsame, nq * 9 / 10);
+
+    faiss::IndexFlatIP quantizer_ip(d);
+    faiss::IndexIVFFlat index_ip(
+        &quantizer_ip, d, nlist, faiss::METRIC_INNER_PRODUCT);
+    index_ip.train(nb, xb.data());
+    index_ip.adaptive_nprobe = true;
+    EXPECT_THROW(
+        index_ip.search(nq, xq.data(), k, D.data(), I.data()),
+        faiss::FaissException);
+}
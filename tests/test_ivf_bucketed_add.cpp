@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexIVFPQR.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/InvertedLists.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 8;
+size_t nlist = 64;
+// more than one block of 65536
+size_t nb = 150000;
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n * d);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48();
+    }
+    return x;
+}
+
+/// the lists should contain the entries in the order they were added
+void check_lists(const faiss::IndexIVF &index, const float *x,
+                 size_t n, const idx_t *ids) {
+    std::vector<idx_t> list_nos(n);
+    index.quantizer->assign(n, x, list_nos.data());
+    std::vector<uint8_t> codes(n * index.code_size);
+    index.encode_vectors(n, x, list_nos.data(), codes.data());
+
+    std::vector<size_t> ofs(nlist);
+    for (size_t i = 0; i < n; i++) {
+        idx_t l = list_nos[i];
+        ASSERT_LT(ofs[l], index.invlists->list_size(l));
+        idx_t id = index.invlists->get_single_id(l, ofs[l]);
+        ASSERT_EQ(ids ? ids[i] : idx_t(i), id);
+        faiss::InvertedLists::ScopedCodes code(index.invlists, l, ofs[l]);
+        ASSERT_EQ(0, memcmp(code.get(), codes.data() + i * index.code_size,
+                            index.code_size));
+        ofs[l]++;
+    }
+    for (size_t l = 0; l < nlist; l++) {
+        EXPECT_EQ(ofs[l], index.invlists->list_size(l));
+    }
+}
+
+} // namespace
+
+
+TEST(IVFBucketedAdd, order_and_direct_map) {
+    std::vector<float> xb = make_data(nb);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFScalarQuantizer index(
+        &quantizer, d, nlist, faiss::ScalarQuantizer::QT_8bit);
+    index.train(20000, xb.data());
+    index.make_direct_map(true);
+
+    // two calls, the first one ending within a block
+    size_t n1 = 70000;
+    index.add(n1, xb.data());
+    index.add(nb - n1, xb.data() + n1 * d);
+    EXPECT_EQ(nb, index.ntotal);
+    EXPECT_EQ(nb, index.invlists->compute_ntotal());
+    check_lists(index, xb.data(), nb, nullptr);
+
+    std::vector<float> recons(d);
+    for (idx_t i : {idx_t(0), idx_t(n1 - 1), idx_t(n1), idx_t(nb - 1)}) {
+        index.reconstruct(i, recons.data());
+        for (int j = 0; j < d; j++) {
+            EXPECT_NEAR(xb[i * d + j], recons[j], 0.01);
+        }
+    }
+}
+
+
+TEST(IVFBucketedAdd, ids_and_chunked_lists) {
+    std::vector<float> xb = make_data(nb);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFScalarQuantizer index(
+        &quantizer, d, nlist, faiss::ScalarQuantizer::QT_8bit);
+    index.train(20000, xb.data());
+    index.replace_invlists(
+        new faiss::ChunkedInvertedLists(nlist, index.code_size, 100), true);
+    index.set_direct_map_type(faiss::DirectMap::Hashtable);
+
+    std::vector<idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 3 * i + 1;
+    }
+    index.add_with_ids(nb, xb.data(), ids.data());
+    check_lists(index, xb.data(), nb, ids.data());
+
+    std::vector<float> recons(d);
+    index.reconstruct(ids[nb - 1], recons.data());
+    for (int j = 0; j < d; j++) {
+        EXPECT_NEAR(xb[(nb - 1) * d + j], recons[j], 0.01);
+    }
+}
+
+
+TEST(IVFBucketedAdd, ivf_flat) {
+    std::vector<float> xb = make_data(nb);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    index.train(20000, xb.data());
+    index.make_direct_map(true);
+
+    // the first vectors with precomputed list numbers
+    size_t n1 = 1000;
+    std::vector<idx_t> list_nos(n1);
+    quantizer.assign(n1, xb.data(), list_nos.data());
+    index.add_core(n1, xb.data(), nullptr, list_nos.data());
+    index.add(nb - n1, xb.data() + n1 * d);
+    EXPECT_EQ(nb, index.ntotal);
+    check_lists(index, xb.data(), nb, nullptr);
+
+    std::vector<float> recons(d);
+    index.reconstruct(nb - 1, recons.data());
+    for (int j = 0; j < d; j++) {
+        EXPECT_EQ(xb[(nb - 1) * d + j], recons[j]);
+    }
+}
+
+
+TEST(IVFBucketedAdd, ivf_pq) {
+    size_t n = 20000, nt = 10000;
+    std::vector<float> xb = make_data(n);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFPQ index(&quantizer, d, nlist, 4, 8);
+    index.train(nt, xb.data());
+    index.set_direct_map_type(faiss::DirectMap::Hashtable);
+
+    std::vector<idx_t> ids(n);
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = 2 * i + 5;
+    }
+    index.add_with_ids(n, xb.data(), ids.data());
+    check_lists(index, xb.data(), n, ids.data());
+
+    // IndexIVFPQR goes through add_core_o, that also returns the
+    // residuals for the refinement codes
+    faiss::IndexFlatL2 quantizer2(d);
+    faiss::IndexIVFPQR index2(&quantizer2, d, nlist, 4, 8, 4, 8);
+    index2.train(nt, xb.data());
+    index2.add(n, xb.data());
+    check_lists(index2, xb.data(), n, nullptr);
+    EXPECT_EQ(n * index2.refine_pq.code_size, index2.refine_codes.size());
+
+    // the refinement codes are those of the residuals of the PQ codes
+    size_t nq = 100, k = 1;
+    std::vector<float> D(nq * k);
+    std::vector<idx_t> I(nq * k);
+    index2.nprobe = 8;
+    index2.search(nq, xb.data(), k, D.data(), I.data());
+    size_t nfound = 0;
+    for (size_t i = 0; i < nq; i++) {
+        nfound += I[i] == idx_t(i);
+    }
+    EXPECT_GE(nfound, nq * 9 / 10);
+}
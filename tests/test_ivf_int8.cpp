@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/IndexIVFInt8.h>
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 2000;
+size_t nq = 50;
+int nlist = 16;
+int k = 10;
+
+std::vector<int8_t> make_data(size_t n, unsigned seed) {
+    std::vector<int8_t> x(n * d);
+    srand(seed);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = rand() % 256 - 128;
+    }
+    return x;
+}
+
+/// with nprobe = nlist, the IVF search is exhaustive so the
+/// distances must match the flat index exactly
+void test_exhaustive(faiss::IndexIVFInt8 &index) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    std::vector<int8_t> xq = make_data(nq, 456);
+
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    EXPECT_EQ(index.ntotal, nb);
+
+    faiss::IndexInt8Flat ref(d, index.metric_type);
+    ref.add(nb, xb.data());
+
+    std::vector<int> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+
+    index.nprobe = nlist;
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_EQ(D[i], Dref[i]);
+    }
+
+    // reconstructed vectors give the returned distances
+    index.make_direct_map();
+    std::vector<int8_t> recons(d);
+    index.reconstruct(I[0], recons.data());
+    for (int j = 0; j < d; j++) {
+        EXPECT_EQ(recons[j], xb[I[0] * d + j]);
+    }
+
+    // with a single probe fewer codes are visited
+    index.nprobe = 1;
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    for (size_t i = 0; i < nq; i++) {
+        if (index.metric_type == faiss::METRIC_INNER_PRODUCT) {
+            EXPECT_LE(D[i * k], Dref[i * k]);
+        } else {
+            EXPECT_GE(D[i * k], Dref[i * k]);
+        }
+    }
+}
+
+} // namespace
+
+
+TEST(IVFInt8, float_quantizer) {
+    faiss::IndexFlatIP quantizer(d);
+    faiss::IndexIVFInt8 index(&quantizer, d, nlist);
+    test_exhaustive(index);
+}
+
+TEST(IVFInt8, int8_quantizer) {
+    faiss::IndexInt8Flat quantizer(d);
+    faiss::IndexIVFInt8 index(&quantizer, d, nlist);
+    test_exhaustive(index);
+}
+
+TEST(IVFInt8, L2) {
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFInt8 index(&quantizer, d, nlist, faiss::METRIC_L2);
+    test_exhaustive(index);
+}
+
+TEST(IVFInt8, int8_quantizer_L2) {
+    faiss::IndexInt8Flat quantizer(d, faiss::METRIC_L2);
+    faiss::IndexIVFInt8 index(&quantizer, d, nlist, faiss::METRIC_L2);
+    test_exhaustive(index);
+}
@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/index_factory.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 5000, nq = 300;
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48();
+    }
+    return x;
+}
+
+/// restores the batch size at the end of the scope
+struct HeapBytesGuard {
+    size_t prev;
+    HeapBytesGuard(): prev(faiss::ivf_list_major_heap_bytes) {}
+    ~HeapBytesGuard() {
+        faiss::ivf_list_major_heap_bytes = prev;
+    }
+};
+
+/// parallel_mode 3 should give the same results as parallel_mode 0
+void test_same_results(const char *factory, faiss::MetricType metric) {
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+    std::unique_ptr<faiss::Index> index(
+        faiss::index_factory(d, factory, metric));
+    index->train(nb, xb.data());
+    index->add(nb, xb.data());
+    auto *ivf = dynamic_cast<faiss::IndexIVF*>(index.get());
+    ASSERT_TRUE(ivf != nullptr);
+    ivf->nprobe = 8;
+
+    HeapBytesGuard guard;
+    for (idx_t k : {1, 10, 150}) {
+        std::vector<float> D(nq * k), Dref(nq * k);
+        std::vector<idx_t> I(nq * k), Iref(nq * k);
+        ivf->parallel_mode = 0;
+        ivf->search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+        // single batch, then small batches
+        for (size_t heap_bytes : {size_t(1) << 30, size_t(20000)}) {
+            faiss::ivf_list_major_heap_bytes = heap_bytes;
+            ivf->parallel_mode = 3;
+            ivf->search(nq, xq.data(), k, D.data(), I.data());
+
+            size_t nsame = 0;
+            for (size_t i = 0; i < nq * k; i++) {
+                EXPECT_NEAR(Dref[i], D[i], 1e-5);
+                nsame += I[i] == Iref[i];
+            }
+            // only ties may be ordered differently
+            EXPECT_GE(nsame, nq * k * 99 / 100);
+        }
+    }
+}
+
+} // namespace
+
+
+TEST(IVFListMajor, IVFFlat) {
+    test_same_results("IVF32,Flat", faiss::METRIC_L2);
+    test_same_results("IVF32,Flat", faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(IVFListMajor, IVFPQ) {
+    test_same_results("IVF32,PQ8np", faiss::METRIC_L2);
+    test_same_results("IVF32,PQ8np", faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(IVFListMajor, IVFSQ) {
+    test_same_results("IVF32,SQ8", faiss::METRIC_L2);
+}
+
+
+TEST(IVFListMajor, store_pairs_and_chunked_lists) {
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 20);
+    index.train(nb, xb.data());
+    index.nprobe = 5;
+
+    faiss::IndexIVFFlat chunked(&quantizer, d, 20);
+    chunked.is_trained = true;
+    chunked.nprobe = 5;
+    chunked.replace_invlists(
+        new faiss::ChunkedInvertedLists(20, chunked.code_size, 64), true);
+
+    index.add(nb, xb.data());
+    chunked.add(nb, xb.data());
+
+    idx_t k = 10;
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    std::vector<float> R(nq * k * d), Rref(nq * k * d);
+    index.search_and_reconstruct(
+        nq, xq.data(), k, Dref.data(), Iref.data(), Rref.data());
+
+    for (faiss::IndexIVFFlat *ivf : {&index, &chunked}) {
+        ivf->parallel_mode = 3;
+        ivf->search_and_reconstruct(
+            nq, xq.data(), k, D.data(), I.data(), R.data());
+        EXPECT_EQ(Dref, D);
+        EXPECT_EQ(Rref, R);
+        ivf->search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(Dref, D);
+    }
+}
@@ -0,0 +1,161 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdlib>
+#include <set>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/utils/ThreadPool.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 16;
+size_t nb = 6000, nq = 200;
+
+/// clustered data, so that the list sizes are skewed
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n * d);
+    for (size_t i = 0; i < n; i++) {
+        float center = (i % 7 == 0) ? drand48() : 0.5;
+        for (int j = 0; j < d; j++) {
+            x[i * d + j] = center + 0.1 * drand48();
+        }
+    }
+    return x;
+}
+
+std::vector<std::set<idx_t> > range_results(const faiss::RangeSearchResult &res) {
+    std::vector<std::set<idx_t> > r(res.nq);
+    for (size_t i = 0; i < res.nq; i++) {
+        r[i].insert(res.labels + res.lims[i], res.labels + res.lims[i + 1]);
+    }
+    return r;
+}
+
+} // namespace
+
+
+TEST(IVFWorkStealing, ranges) {
+    // cost of item i is i
+    size_t n = 1000;
+    std::vector<uint64_t> cum(n + 1);
+    for (size_t i = 0; i < n; i++) {
+        cum[i + 1] = cum[i] + i;
+    }
+    faiss::WorkStealingRanges ranges(4, cum);
+
+    // rank 3 alone takes everything: its own range, then steals
+    std::vector<int> seen(n);
+    size_t i;
+    ASSERT_TRUE(ranges.next(3, i));
+    // the last range is small since the costly items are at the end
+    EXPECT_GT(i, n / 2);
+    seen[i]++;
+    for (int rep = 0; rep < 100; rep++) {
+        ASSERT_TRUE(ranges.next(3, i));
+        seen[i]++;
+    }
+    // the other ranks get what is left
+    int rank = 0;
+    while (ranges.next(rank, i)) {
+        seen[i]++;
+        rank = (rank + 1) % 3;
+    }
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(1, seen[i]);
+    }
+}
+
+
+TEST(IVFWorkStealing, search) {
+    std::vector<float> xb = make_data(nb), xq = make_data(nq);
+
+    for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+        faiss::IndexFlat quantizer(d, metric);
+        faiss::IndexIVFFlat index(&quantizer, d, 32, metric);
+        index.train(nb, xb.data());
+        index.add(nb, xb.data());
+        index.nprobe = 6;
+
+        for (idx_t k : {1, 20}) {
+            std::vector<float> D(nq * k), Dref(nq * k);
+            std::vector<idx_t> I(nq * k), Iref(nq * k);
+            index.parallel_mode = 0;
+            index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+            index.parallel_mode = 4;
+            index.search(nq, xq.data(), k, D.data(), I.data());
+
+            size_t nsame = 0;
+            for (size_t i = 0; i < nq * k; i++) {
+                EXPECT_NEAR(Dref[i], D[i], 1e-5);
+                nsame += I[i] == Iref[i];
+            }
+            EXPECT_GE(nsame, nq * k * 99 / 100);
+        }
+
+        // store_pairs goes through whole lists
+        idx_t k = 5;
+        std::vector<float> D(nq * k), Dref(nq * k);
+        std::vector<idx_t> I(nq * k), Iref(nq * k);
+        std::vector<float> R(nq * k * d), Rref(nq * k * d);
+        index.parallel_mode = 0;
+        index.search_and_reconstruct(
+            nq, xq.data(), k, Dref.data(), Iref.data(), Rref.data());
+        index.parallel_mode = 4;
+        index.search_and_reconstruct(
+            nq, xq.data(), k, D.data(), I.data(), R.data());
+        EXPECT_EQ(Dref, D);
+        EXPECT_EQ(Rref, R);
+    }
+}
+
+
+TEST(IVFWorkStealing, range_search_and_chunked_lists) {
+    std::vector<float> xb = make_data(nb), xq = make_data(nq);
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index(&quantizer, d, 32);
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    index.nprobe = 6;
+
+    // chunks smaller than the work units, and lists of many chunks
+    faiss::IndexIVFFlat chunked(&quantizer, d, 32);
+    chunked.is_trained = true;
+    chunked.nprobe = 6;
+    chunked.replace_invlists(
+        new faiss::ChunkedInvertedLists(32, chunked.code_size, 100), true);
+    chunked.add(nb, xb.data());
+
+    float radius = 0.05;
+    faiss::RangeSearchResult ref(nq);
+    index.range_search(nq, xq.data(), radius, &ref);
+    EXPECT_GT(ref.lims[nq], 0);
+
+    for (faiss::IndexIVFFlat *ivf : {&index, &chunked}) {
+        ivf->parallel_mode = 4;
+        faiss::RangeSearchResult res(nq);
+        ivf->range_search(nq, xq.data(), radius, &res);
+        EXPECT_EQ(range_results(ref), range_results(res));
+
+        idx_t k = 10;
+        std::vector<float> D(nq * k), Dref(nq * k);
+        std::vector<idx_t> I(nq * k), Iref(nq * k);
+        index.parallel_mode = 0;
+        index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+        ivf->parallel_mode = 4;
+        ivf->search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(Dref, D);
+    }
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/Heap.h>
+
+
+namespace {
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48();
+    }
+    return x;
+}
+
+float ref_distance(const float *x, const float *y, size_t d, bool is_l2) {
+    return is_l2 ? faiss::fvec_L2sqr(x, y, d) :
+        faiss::fvec_inner_product(x, y, d);
+}
+
+} // namespace
+
+
+TEST(KnnFused, inner_products_block) {
+    for (size_t d : {1, 7, 8, 17, 64, 100}) {
+        size_t nx = 9, ny = 14;
+        std::vector<float> x = make_data(nx * d);
+        std::vector<float> y = make_data(ny * d);
+        std::vector<float> ip(nx * ny);
+
+        faiss::fvec_inner_products_block(
+            ip.data(), x.data(), y.data(), d, nx, ny);
+
+        for (size_t i = 0; i < nx; i++) {
+            for (size_t j = 0; j < ny; j++) {
+                float ref = faiss::fvec_inner_product(
+                    x.data() + i * d, y.data() + j * d, d);
+                EXPECT_NEAR(ref, ip[i * ny + j], 1e-5 * d);
+            }
+        }
+    }
+}
+
+/// the fused and BLAS paths return the same neighbors up to roundoff
+TEST(KnnFused, same_as_blas) {
+    size_t ny = 3000, k = 10;
+    int fused_threshold = faiss::distance_compute_fused_threshold;
+
+    for (size_t d : {3, 32, 100}) {
+        std::vector<float> y = make_data(ny * d);
+        for (size_t nx : {5, 50, 1000}) {
+            std::vector<float> x = make_data(nx * d);
+            for (int is_l2 = 0; is_l2 < 2; is_l2++) {
+                std::vector<float> D[2];
+                std::vector<int64_t> I[2];
+                for (int fused = 0; fused < 2; fused++) {
+                    faiss::distance_compute_fused_threshold =
+                        fused ? 1000 : 0;
+                    D[fused].resize(nx * k);
+                    I[fused].resize(nx * k);
+                    if (is_l2) {
+                        faiss::float_maxheap_array_t res = {
+                            nx, k, I[fused].data(), D[fused].data()};
+                        faiss::knn_L2sqr(x.data(), y.data(), d, nx, ny, &res);
+                    } else {
+                        faiss::float_minheap_array_t res = {
+                            nx, k, I[fused].data(), D[fused].data()};
+                        faiss::knn_inner_product(
+                            x.data(), y.data(), d, nx, ny, &res);
+                    }
+                }
+
+                for (size_t i = 0; i < nx; i++) {
+                    for (size_t j = 0; j < k; j++) {
+                        size_t l = i * k + j;
+                        EXPECT_NEAR(D[0][l], D[1][l], 1e-4 * d);
+                        float dis = ref_distance(
+                            x.data() + i * d, y.data() + I[1][l] * d,
+                            d, is_l2);
+                        EXPECT_NEAR(dis, D[1][l], 1e-4 * d);
+                    }
+                }
+            }
+        }
+    }
+    faiss::distance_compute_fused_threshold = fused_threshold;
+}
+
+/// k = 0 returns without results on all paths
+TEST(KnnFused, k_zero) {
+    size_t d = 16, ny = 500;
+    std::vector<float> y = make_data(ny * d);
+    for (size_t nx : {5, 50, 1000}) {
+        std::vector<float> x = make_data(nx * d);
+        faiss::float_maxheap_array_t res_l2 = {nx, 0, nullptr, nullptr};
+        faiss::knn_L2sqr(x.data(), y.data(), d, nx, ny, &res_l2);
+        faiss::float_minheap_array_t res_ip = {nx, 0, nullptr, nullptr};
+        faiss::knn_inner_product(x.data(), y.data(), d, nx, ny, &res_ip);
+    }
+
+    faiss::IndexFlatL2 index(d);
+    index.add(ny, y.data());
+    std::vector<float> x = make_data(50 * d);
+    index.search(50, x.data(), 0, nullptr, nullptr);
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/MetaIndexes.h>
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 1000, nq = 30;
+int k = 10;
+
+std::vector<int8_t> make_data(size_t n, unsigned seed) {
+    std::vector<int8_t> x(n * d);
+    srand(seed);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = rand() % 256 - 128;
+    }
+    return x;
+}
+
+/// checks that index returns the same results as a flat index
+void test_same_results(faiss::IndexInt8 &index, faiss::MetricType metric) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    std::vector<int8_t> xq = make_data(nq, 456);
+
+    faiss::IndexInt8Flat ref(d, metric);
+    ref.add(nb, xb.data());
+    index.add(nb, xb.data());
+    EXPECT_EQ(index.ntotal, nb);
+
+    std::vector<int> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    EXPECT_EQ(D, Dref);
+
+    // labels may differ for ties, check they give the distances
+    std::vector<int> D2(nq * k);
+    ref.compute_distance_subset(nq, xq.data(), k, D2.data(), I.data());
+    EXPECT_EQ(D, D2);
+}
+
+} // namespace
+
+
+TEST(MetaInt8, shards) {
+    for (auto metric : {faiss::METRIC_INNER_PRODUCT, faiss::METRIC_L2}) {
+        faiss::IndexInt8Shards index(d, true, true);
+        index.own_fields = true;
+        for (int i = 0; i < 3; i++) {
+            index.addIndex(new faiss::IndexInt8Flat(d, metric));
+        }
+        EXPECT_EQ(index.metric_type, metric);
+        test_same_results(index, metric);
+    }
+}
+
+TEST(MetaInt8, replicas) {
+    faiss::IndexInt8Replicas index(d, true);
+    index.own_fields = true;
+    for (int i = 0; i < 3; i++) {
+        index.addIndex(new faiss::IndexInt8Flat(d));
+    }
+    test_same_results(index, faiss::METRIC_INNER_PRODUCT);
+}
+
+TEST(MetaInt8, IDMap2) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    std::vector<idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 1000 + 7 * i;
+    }
+
+    faiss::IndexInt8IDMap2 index(new faiss::IndexInt8Flat(d));
+    index.own_fields = true;
+    index.add_with_ids(nb, xb.data(), ids.data());
+
+    std::vector<int> D(k);
+    std::vector<idx_t> I(k);
+    index.search(1, xb.data() + 5 * d, k, D.data(), I.data());
+    for (int j = 0; j < k; j++) {
+        EXPECT_EQ((I[j] - 1000) % 7, 0);
+    }
+
+    std::vector<int8_t> v(d);
+    index.reconstruct(ids[5], v.data());
+    for (int j = 0; j < d; j++) {
+        EXPECT_EQ(v[j], xb[5 * d + j]);
+    }
+}
@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdlib>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <omp.h>
+#include <sched.h>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/IndexShards.h>
+#include <faiss/utils/ThreadPool.h>
+#include <faiss/utils/numa.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48();
+    }
+    return x;
+}
+
+} // namespace
+
+
+TEST(NumaShards, topology) {
+    std::vector<int> nodes = faiss::numa_get_nodes();
+    ASSERT_FALSE(nodes.empty());
+    size_t ncpu = 0;
+    for (int node : nodes) {
+        std::vector<int> cpus = faiss::numa_node_cpus(node);
+        EXPECT_FALSE(cpus.empty());
+        ncpu += cpus.size();
+    }
+    EXPECT_GE(ncpu, 1);
+}
+
+
+/// the parallel work of a bound thread stays on the CPUs of its node
+TEST(NumaShards, bound_parallel_for) {
+    int node = faiss::numa_get_nodes().back();
+    std::vector<int> node_cpus = faiss::numa_node_cpus(node);
+    std::mutex mutex;
+    std::vector<int> cpus;
+    bool bound = false;
+
+    std::thread t([&] () {
+        bound = faiss::numa_bind_thread_and_team(node);
+        // more items than threads, each long enough to be shared
+        faiss::parallel_for(0, 64, [&] (size_t) {
+            volatile double s = 0;
+            for (int i = 0; i < 100000; i++) {
+                s = s + i;
+            }
+            // the CPU we run on and the ones we may run on
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            sched_getaffinity(0, sizeof(set), &set);
+            std::lock_guard<std::mutex> guard(mutex);
+            cpus.push_back(sched_getcpu());
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        });
+    });
+    t.join();
+
+    if (!bound) {
+        return; // not supported
+    }
+    EXPECT_FALSE(faiss::is_thread_bound());
+    ASSERT_FALSE(cpus.empty());
+    for (int cpu : cpus) {
+        EXPECT_NE(node_cpus.end(),
+                  std::find(node_cpus.begin(), node_cpus.end(), cpu))
+            << "cpu " << cpu << " is not on node " << node;
+    }
+}
+
+
+TEST(NumaShards, search) {
+    int d = 16;
+    size_t nb = 6000, nq = 50, nshard = 3;
+    idx_t k = 10;
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+
+    faiss::IndexShards ref(d, true);
+    ref.own_fields = true;
+    faiss::IndexShards index(d, true);
+    index.own_fields = true;
+    for (size_t i = 0; i < nshard; i++) {
+        ref.add_shard(new faiss::IndexFlatL2(d));
+        index.add_shard(new faiss::IndexFlatL2(d));
+    }
+
+    // placed before the add: the vectors are allocated on the nodes
+    index.place_shards_on_numa_nodes();
+    std::vector<int> nodes = faiss::numa_get_nodes();
+    for (size_t i = 0; i < nshard; i++) {
+        // empty shards are spread round-robin
+        EXPECT_EQ(nodes[i % nodes.size()], index.get_shard_numa_node(i));
+    }
+
+    ref.add(nb, xb.data());
+    index.add(nb, xb.data());
+
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(Dref, D);
+
+    // relocating the filled shards replaces them with copies
+    const faiss::Index *shard0 = index.at(0);
+    index.place_shards_on_numa_nodes();
+    EXPECT_NE(shard0, index.at(0));
+    EXPECT_EQ(nb, index.ntotal);
+    for (size_t i = 0; i < nshard; i++) {
+        EXPECT_GE(index.get_shard_numa_node(i), 0);
+    }
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(Dref, D);
+
+    index.remove_shard(index.at(2));
+    EXPECT_EQ(nb / 3 * 2, index.ntotal);
+}
+
+
+TEST(NumaShards, relocate_ivf_and_int8) {
+    int d = 16;
+    size_t nb = 2000, nq = 20;
+    idx_t k = 5;
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat ref(&quantizer, d, 16);
+    ref.train(nb, xb.data());
+    ref.add(nb, xb.data());
+    ref.nprobe = 4;
+
+    faiss::IndexShards index(d, true, false);
+    index.own_fields = true;
+    auto *ivf = new faiss::IndexIVFFlat(&quantizer, d, 16);
+    ivf->is_trained = true;
+    ivf->nprobe = 4;
+    index.add_shard(ivf);
+    index.add(nb, xb.data());
+    index.set_shard_numa_node(0, faiss::numa_get_nodes()[0]);
+
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_EQ(Iref, I);
+
+    // int8 shards
+    std::vector<int8_t> xb8(nb * d);
+    for (size_t i = 0; i < xb8.size(); i++) {
+        xb8[i] = lrand48() % 256 - 128;
+    }
+    faiss::IndexInt8Shards index8(d, true);
+    index8.own_fields = true;
+    index8.add_shard(new faiss::IndexInt8Flat(d));
+    index8.add_shard(new faiss::IndexInt8Flat(d));
+    index8.add(nb, xb8.data());
+    std::vector<int> D8(k), D8ref(k);
+    std::vector<idx_t> I8(k), I8ref(k);
+    index8.search(1, xb8.data(), k, D8ref.data(), I8ref.data());
+    index8.place_shards_on_numa_nodes();
+    index8.search(1, xb8.data(), k, D8.data(), I8.data());
+    EXPECT_EQ(I8ref, I8);
+    EXPECT_EQ(D8ref, D8);
+
+    // not supported without worker threads
+    faiss::IndexShards sequential(d, false);
+    sequential.add_shard(new faiss::IndexFlatL2(d));
+    sequential.own_fields = true;
+    EXPECT_THROW(sequential.place_shards_on_numa_nodes(),
+                 faiss::FaissException);
+}
@@ -0,0 +1,277 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/hamming.h>
+#include <faiss/utils/partitioning.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+/// sets distance_compute_min_k_reservoir for the scope
+struct MinKReservoir {
+    int prev;
+    explicit MinKReservoir (int min_k):
+        prev (faiss::distance_compute_min_k_reservoir) {
+        faiss::distance_compute_min_k_reservoir = min_k;
+    }
+    ~MinKReservoir () {
+        faiss::distance_compute_min_k_reservoir = prev;
+    }
+};
+
+template <class C>
+void test_partition (std::vector<typename C::T> vals,
+                     size_t q_min, size_t q_max) {
+    typedef typename C::T T;
+    size_t n = vals.size();
+    std::vector<int64_t> ids(n);
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = i;
+    }
+    std::vector<T> sorted = vals;
+    std::sort(sorted.begin(), sorted.end(),
+              [](T a, T b) { return C::cmp(b, a); });
+    std::vector<T> orig = vals;
+
+    size_t q;
+    T thresh = faiss::partition_fuzzy<C>(
+        vals.data(), ids.data(), n, q_min, q_max, &q);
+    ASSERT_GE(q, q_min);
+    ASSERT_LE(q, q_max);
+
+    // the kept values are the q best ones, with their ids
+    std::vector<T> kept(vals.begin(), vals.begin() + q);
+    std::sort(kept.begin(), kept.end(),
+              [](T a, T b) { return C::cmp(b, a); });
+    for (size_t i = 0; i < q; i++) {
+        EXPECT_EQ(sorted[i], kept[i]);
+        EXPECT_EQ(orig[ids[i]], vals[i]);
+        EXPECT_FALSE(C::cmp(vals[i], thresh));
+    }
+}
+
+} // namespace
+
+
+TEST(Partitioning, fuzzy) {
+    srand(123);
+    for (size_t n : {1, 7, 100, 1000, 5000}) {
+        std::vector<float> vals(n);
+        std::vector<int> ivals(n);
+        for (size_t i = 0; i < n; i++) {
+            vals[i] = drand48();
+            ivals[i] = rand() % 20;   // many ties
+        }
+        for (size_t q : {size_t(1), n / 3, n / 2}) {
+            if (q == 0) continue;
+            size_t q_max = std::min(n, q + q / 2);
+            test_partition<faiss::CMax<float, int64_t> >(vals, q, q);
+            test_partition<faiss::CMin<float, int64_t> >(vals, q, q_max);
+            test_partition<faiss::CMax<int, int64_t> >(ivals, q, q_max);
+            test_partition<faiss::CMin<int, int64_t> >(ivals, q, q);
+        }
+    }
+    // all equal
+    test_partition<faiss::CMax<float, int64_t> >(
+        std::vector<float>(100, 1.5f), 10, 10);
+}
+
+TEST(Partitioning, reservoir) {
+    typedef faiss::CMax<float, int64_t> C;
+    size_t n = 10000, k = 100;
+    std::vector<float> dis(n);
+    for (size_t i = 0; i < n; i++) {
+        dis[i] = drand48();
+    }
+
+    std::vector<float> rvals(2 * k), D(k);
+    std::vector<int64_t> rids(2 * k), I(k);
+    faiss::ReservoirTopN<C> res(k, 2 * k, rvals.data(), rids.data());
+    for (size_t i = 0; i < n; i++) {
+        res.add(dis[i], i);
+    }
+    res.to_heap(D.data(), I.data());
+    faiss::heap_reorder<C>(k, D.data(), I.data());
+
+    std::vector<float> sorted = dis;
+    std::sort(sorted.begin(), sorted.end());
+    for (size_t i = 0; i < k; i++) {
+        EXPECT_EQ(sorted[i], D[i]);
+        EXPECT_EQ(dis[I[i]], D[i]);
+    }
+}
+
+/// the knn functions return the same results with and without reservoirs
+TEST(Partitioning, knn) {
+    size_t d = 16, nb = 5000, k = 150;
+    std::vector<float> xb(nb * d);
+    for (size_t i = 0; i < xb.size(); i++) {
+        xb[i] = drand48();
+    }
+
+    // sse, fused and blas paths
+    int fused_threshold = faiss::distance_compute_fused_threshold;
+    for (int path = 0; path < 3; path++) {
+        size_t nq = path == 0 ? 5 : 40;
+        faiss::distance_compute_fused_threshold = path == 1 ? 512 : 0;
+        std::vector<float> xq(nq * d);
+        for (size_t i = 0; i < xq.size(); i++) {
+            xq[i] = drand48();
+        }
+        for (int is_l2 = 0; is_l2 < 2; is_l2++) {
+            std::vector<float> D[2];
+            std::vector<idx_t> I[2];
+            for (int with_reservoir = 0; with_reservoir < 2; with_reservoir++) {
+                MinKReservoir mk (with_reservoir ? 10 : 100000);
+                D[with_reservoir].resize(nq * k);
+                I[with_reservoir].resize(nq * k);
+                faiss::IndexFlat index(d, is_l2 ? faiss::METRIC_L2 :
+                                       faiss::METRIC_INNER_PRODUCT);
+                index.add(nb, xb.data());
+                index.search(nq, xq.data(), k, D[with_reservoir].data(),
+                             I[with_reservoir].data());
+            }
+            EXPECT_EQ(D[0], D[1]);
+            EXPECT_EQ(I[0], I[1]);
+        }
+    }
+    faiss::distance_compute_fused_threshold = fused_threshold;
+}
+
+TEST(Partitioning, ivf) {
+    size_t d = 16, nb = 5000, nq = 20, k = 200;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    for (size_t i = 0; i < xb.size(); i++) {
+        xb[i] = drand48();
+    }
+    for (size_t i = 0; i < xq.size(); i++) {
+        xq[i] = drand48();
+    }
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexIVFFlat index_flat(&quantizer, d, 16);
+    faiss::IndexIVFPQ index_pq(&quantizer, d, 16, 4, 8);
+    for (faiss::IndexIVF *index :
+             std::vector<faiss::IndexIVF*>{&index_flat, &index_pq}) {
+        index->train(nb, xb.data());
+        index->add(nb, xb.data());
+        index->nprobe = 4;
+
+        std::vector<float> D[2];
+        std::vector<idx_t> I[2];
+        for (int with_reservoir = 0; with_reservoir < 2; with_reservoir++) {
+            MinKReservoir mk (with_reservoir ? 10 : 100000);
+            D[with_reservoir].resize(nq * k);
+            I[with_reservoir].resize(nq * k);
+            index->search(nq, xq.data(), k, D[with_reservoir].data(),
+                          I[with_reservoir].data());
+        }
+        // ties may be ordered differently
+        for (size_t i = 0; i < nq * k; i++) {
+            EXPECT_NEAR(D[0][i], D[1][i], 1e-5);
+        }
+    }
+}
+
+/// the scanners collect in the reservoir what they put in the heap,
+/// here with a polysemous filter and with inner products
+TEST(Partitioning, ivf_scanners) {
+    size_t d = 16, nb = 5000, nq = 20, k = 200;
+    std::vector<float> xb(nb * d), xq(nq * d);
+    for (size_t i = 0; i < xb.size(); i++) {
+        xb[i] = (i * 7919) % 1000 / 1000.0;
+    }
+    for (size_t i = 0; i < xq.size(); i++) {
+        xq[i] = (i * 104729) % 1000 / 1000.0;
+    }
+
+    faiss::IndexFlatL2 quantizer(d);
+    faiss::IndexFlatIP quantizer_ip(d);
+    faiss::IndexIVFPQ index_pq(&quantizer, d, 16, 4, 8);
+    faiss::IndexIVFFlat index_ip(&quantizer_ip, d, 16,
+                                 faiss::METRIC_INNER_PRODUCT);
+    for (faiss::IndexIVF *index :
+             std::vector<faiss::IndexIVF*>{&index_pq, &index_ip}) {
+        index->train(nb, xb.data());
+        index->add(nb, xb.data());
+        index->nprobe = 4;
+    }
+    index_pq.polysemous_ht = 12;
+
+    for (faiss::IndexIVF *index :
+             std::vector<faiss::IndexIVF*>{&index_pq, &index_ip}) {
+        std::vector<float> D[2];
+        std::vector<idx_t> I[2];
+        for (int with_reservoir = 0; with_reservoir < 2; with_reservoir++) {
+            MinKReservoir mk (with_reservoir ? 10 : 100000);
+            D[with_reservoir].resize(nq * k);
+            I[with_reservoir].resize(nq * k);
+            index->search(nq, xq.data(), k, D[with_reservoir].data(),
+                          I[with_reservoir].data());
+        }
+        size_t nmissing = 0;
+        for (size_t i = 0; i < nq * k; i++) {
+            EXPECT_NEAR(D[0][i], D[1][i], 1e-5);
+            EXPECT_EQ(I[0][i] < 0, I[1][i] < 0);
+            nmissing += I[0][i] < 0;
+        }
+        if (index == &index_pq) {
+            // the filter dropped some of the results
+            EXPECT_GT(nmissing, 0);
+        }
+    }
+}
+
+TEST(Partitioning, hamming) {
+    size_t nb = 3000, nq = 10, k = 120;
+    for (size_t code_size : {8, 16}) {
+        std::vector<uint8_t> xb(nb * code_size), xq(nq * code_size);
+        for (size_t i = 0; i < xb.size(); i++) {
+            xb[i] = rand();
+        }
+        for (size_t i = 0; i < xq.size(); i++) {
+            xq[i] = rand();
+        }
+        std::vector<int> D[2];
+        std::vector<int64_t> I[2];
+        for (int with_reservoir = 0; with_reservoir < 2; with_reservoir++) {
+            MinKReservoir mk (with_reservoir ? 10 : 100000);
+            D[with_reservoir].resize(nq * k);
+            I[with_reservoir].resize(nq * k);
+            faiss::int_maxheap_array_t res = {
+                nq, k, I[with_reservoir].data(), D[with_reservoir].data()};
+            faiss::hammings_knn_hc(&res, xq.data(), xb.data(),
+                                   nb, code_size, true);
+        }
+        EXPECT_EQ(D[0], D[1]);
+        for (size_t i = 0; i < nq; i++) {
+            for (size_t j = 0; j < k; j++) {
+                const uint8_t *a = xq.data() + i * code_size;
+                const uint8_t *b = xb.data() + I[1][i * k + j] * code_size;
+                int dis = 0;
+                for (size_t l = 0; l < code_size; l++) {
+                    dis += __builtin_popcount(a[l] ^ b[l]);
+                }
+                EXPECT_EQ(dis, D[1][i * k + j]);
+            }
+        }
+    }
+}
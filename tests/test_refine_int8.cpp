@@ -0,0 +1,89 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexInt8Flat.h>
+#include <faiss/IndexRefineInt8.h>
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+int d = 32;
+size_t nb = 2000, nq = 50;
+int k = 10;
+
+std::vector<int8_t> make_data(size_t n, unsigned seed) {
+    std::vector<int8_t> x(n * d);
+    srand(seed);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = rand() % 256 - 128;
+    }
+    return x;
+}
+
+/// returns the number of results that are the same as the exact search
+size_t test_refine(faiss::MetricType metric, float k_factor) {
+    std::vector<int8_t> xb = make_data(nb, 123);
+    std::vector<int8_t> xq = make_data(nq, 456);
+
+    faiss::IndexPQ base(d, 4, 8, metric);
+    faiss::IndexRefineInt8 index(&base);
+    index.k_factor = k_factor;
+    index.train(nb, xb.data());
+    index.add(nb, xb.data());
+    EXPECT_EQ(index.ntotal, nb);
+
+    faiss::IndexInt8Flat ref(d, metric);
+    ref.add(nb, xb.data());
+
+    std::vector<int> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    size_t n_ok = 0;
+    for (size_t i = 0; i < nq; i++) {
+        // the distances are the exact int8 ones
+        std::vector<int> Dsub(k);
+        ref.compute_distance_subset(
+            1, xq.data() + i * d, k, Dsub.data(), I.data() + i * k);
+        for (int j = 0; j < k; j++) {
+            EXPECT_EQ(Dsub[j], D[i * k + j]);
+        }
+        // the first result can only be worse than the exact one
+        if (metric == faiss::METRIC_INNER_PRODUCT) {
+            EXPECT_LE(D[i * k], Dref[i * k]);
+        } else {
+            EXPECT_GE(D[i * k], Dref[i * k]);
+        }
+        n_ok += D[i * k] == Dref[i * k];
+    }
+    return n_ok;
+}
+
+} // namespace
+
+
+TEST(RefineInt8, IP) {
+    size_t n1 = test_refine(faiss::METRIC_INNER_PRODUCT, 1);
+    size_t n8 = test_refine(faiss::METRIC_INNER_PRODUCT, 8);
+    EXPECT_GT(n8, n1);
+}
+
+TEST(RefineInt8, L2) {
+    size_t n1 = test_refine(faiss::METRIC_L2, 1);
+    size_t n8 = test_refine(faiss::METRIC_L2, 8);
+    EXPECT_GT(n8, n1);
+}
@@ -0,0 +1,199 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/utils.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+/// restores the initial SIMD level at the end of the scope
+struct SIMDLevelGuard {
+    faiss::SIMDLevel prev;
+    SIMDLevelGuard (): prev (faiss::get_simd_level ()) {}
+    ~SIMDLevelGuard () {
+        faiss::set_simd_level (prev);
+    }
+};
+
+std::vector<float> make_data(size_t n) {
+    std::vector<float> x(n);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = drand48() * 2 - 1;
+    }
+    return x;
+}
+
+} // namespace
+
+
+TEST(SIMDLevels, supported) {
+    SIMDLevelGuard guard;
+    faiss::SIMDLevel supported = faiss::simd_level_supported ();
+    EXPECT_LE(faiss::get_simd_level (), supported);
+    if (supported < faiss::SIMD_AVX512) {
+        EXPECT_THROW(faiss::set_simd_level (faiss::SIMD_AVX512),
+                     faiss::FaissException);
+    }
+    faiss::set_simd_level (faiss::SIMD_GENERIC);
+    EXPECT_EQ(faiss::SIMD_GENERIC, faiss::get_simd_level ());
+}
+
+/// all levels give the same results as the scalar code
+TEST(SIMDLevels, kernels) {
+    SIMDLevelGuard guard;
+    for (int l = 0; l <= faiss::simd_level_supported (); l++) {
+        faiss::set_simd_level (faiss::SIMDLevel (l));
+        for (size_t d = 1; d < 70; d += d < 20 ? 1 : 7) {
+            size_t ny = 19;
+            std::vector<float> x = make_data(d), y = make_data(ny * d);
+            float l2 = 0, ip = 0;
+            for (size_t i = 0; i < d; i++) {
+                l2 += (x[i] - y[i]) * (x[i] - y[i]);
+                ip += x[i] * y[i];
+            }
+            EXPECT_NEAR(l2, faiss::fvec_L2sqr(x.data(), y.data(), d), 1e-5);
+            EXPECT_NEAR(ip, faiss::fvec_inner_product(x.data(), y.data(), d),
+                        1e-5);
+
+            // the one-to-many kernels return exactly the same values as
+            // the one-to-one ones (the IVFFlat scanner relies on it)
+            std::vector<float> dis(ny), ips(ny);
+            faiss::fvec_L2sqr_ny(dis.data(), x.data(), y.data(), d, ny);
+            faiss::fvec_inner_products_ny(
+                ips.data(), x.data(), y.data(), d, ny);
+            for (size_t j = 0; j < ny; j++) {
+                const float *yj = y.data() + j * d;
+                EXPECT_EQ(faiss::fvec_L2sqr(x.data(), yj, d), dis[j]);
+                EXPECT_EQ(faiss::fvec_inner_product(x.data(), yj, d), ips[j]);
+            }
+
+            std::vector<int8_t> a(d), b(d);
+            int ip8 = 0, l28 = 0;
+            for (size_t i = 0; i < d; i++) {
+                a[i] = rand() % 256 - 128;
+                b[i] = rand() % 256 - 128;
+                ip8 += a[i] * b[i];
+                l28 += (a[i] - b[i]) * (a[i] - b[i]);
+            }
+            EXPECT_EQ(ip8, faiss::i8vec_inner_product(a.data(), b.data(), d));
+            EXPECT_EQ(l28, faiss::i8vec_L2sqr(a.data(), b.data(), d));
+        }
+
+        // the table and the argmin are exact
+        for (size_t n : {1, 4, 13, 64, 100}) {
+            std::vector<float> a = make_data(n), b = make_data(n);
+            std::vector<float> c(n), cref(n);
+            float bf = 0.7;
+            int imin_ref = -1;
+            for (size_t i = 0; i < n; i++) {
+                cref[i] = a[i] + bf * b[i];
+                if (imin_ref < 0 || cref[i] < cref[imin_ref]) {
+                    imin_ref = i;
+                }
+            }
+            int imin = faiss::fvec_madd_and_argmin(
+                n, a.data(), bf, b.data(), c.data());
+            EXPECT_EQ(cref, c);
+            EXPECT_EQ(imin_ref, imin);
+        }
+
+        // counts of the partitioning, with ties on the threshold
+        for (size_t n : {1, 7, 8, 33, 100}) {
+            std::vector<float> v(n);
+            for (size_t i = 0; i < n; i++) {
+                v[i] = (i * 7) % 5;
+            }
+            for (bool greater : {false, true}) {
+                size_t lt_ref = 0, eq_ref = 0;
+                for (size_t i = 0; i < n; i++) {
+                    lt_ref += greater ? v[i] > v[0] : v[i] < v[0];
+                    eq_ref += v[i] == v[0];
+                }
+                size_t n_lt, n_eq;
+                faiss::fvec_count_lt_and_eq(
+                    v.data(), n, v[0], greater, &n_lt, &n_eq);
+                EXPECT_EQ(lt_ref, n_lt);
+                EXPECT_EQ(eq_ref, n_eq);
+            }
+        }
+    }
+}
+
+/// the level can be changed while other threads call the kernels
+TEST(SIMDLevels, concurrent_set) {
+    SIMDLevelGuard guard;
+    size_t d = 100;
+    std::vector<float> x = make_data(d), y = make_data(d);
+    float ref = 0;
+    for (size_t i = 0; i < d; i++) {
+        ref += (x[i] - y[i]) * (x[i] - y[i]);
+    }
+
+    std::atomic<bool> stop(false);
+    std::thread setter([&] () {
+        int l = 0;
+        while (!stop) {
+            faiss::set_simd_level (faiss::SIMDLevel (l));
+            l = (l + 1) % (faiss::simd_level_supported () + 1);
+        }
+    });
+    for (int rep = 0; rep < 100000; rep++) {
+        EXPECT_NEAR(ref, faiss::fvec_L2sqr(x.data(), y.data(), d), 1e-4);
+    }
+    stop = true;
+    setter.join();
+}
+
+/// the 8-wide ScalarQuantizer code returns the same results as the
+/// scalar one
+TEST(SIMDLevels, scalar_quantizer) {
+    if (faiss::simd_level_supported () < faiss::SIMD_AVX2) {
+        return;
+    }
+    SIMDLevelGuard guard;
+    size_t d = 32, nb = 2000, nq = 10, k = 5;
+    std::vector<float> xb = make_data(nb * d), xq = make_data(nq * d);
+
+    for (auto qtype : {faiss::ScalarQuantizer::QT_8bit,
+                       faiss::ScalarQuantizer::QT_4bit,
+                       faiss::ScalarQuantizer::QT_6bit,
+                       faiss::ScalarQuantizer::QT_8bit_uniform,
+                       faiss::ScalarQuantizer::QT_fp16}) {
+        for (auto metric : {faiss::METRIC_L2, faiss::METRIC_INNER_PRODUCT}) {
+            faiss::IndexScalarQuantizer index(d, qtype, metric);
+            index.train(nb, xb.data());
+            index.add(nb, xb.data());
+
+            std::vector<float> D[2];
+            std::vector<idx_t> I[2];
+            for (int simd = 0; simd < 2; simd++) {
+                faiss::set_simd_level (
+                    simd ? faiss::SIMD_AVX2 : faiss::SIMD_GENERIC);
+                D[simd].resize(nq * k);
+                I[simd].resize(nq * k);
+                index.search(nq, xq.data(), k, D[simd].data(), I[simd].data());
+            }
+            for (size_t i = 0; i < nq * k; i++) {
+                EXPECT_NEAR(D[0][i], D[1][i], 1e-4);
+            }
+        }
+    }
+}
@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+
+#include <omp.h>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexShards.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/ThreadPool.h>
+
+
+namespace {
+
+typedef faiss::Index::idx_t idx_t;
+
+/// sets the OpenMP nb of threads of the calling thread for the scope
+struct OmpThreadsGuard {
+    int prev;
+    explicit OmpThreadsGuard(int nt): prev(omp_get_max_threads()) {
+        omp_set_num_threads(nt);
+    }
+    ~OmpThreadsGuard() {
+        omp_set_num_threads(prev);
+    }
+};
+
+} // namespace
+
+
+TEST(ThreadPool, parallel) {
+    OmpThreadsGuard guard(4);
+    faiss::ThreadPool pool(3);
+
+    size_t n = 10000;
+    std::vector<std::atomic<int>> count(n);
+    std::atomic<int> max_rank(0);
+    faiss::WorkRange range(0, n, 7);
+    pool.parallel(0, [&](int rank) {
+        int r = max_rank.load();
+        while (rank > r && !max_rank.compare_exchange_weak(r, rank)) {}
+        size_t i0, i1;
+        while (range.next(i0, i1)) {
+            for (size_t i = i0; i < i1; i++) {
+                count[i]++;
+            }
+        }
+    });
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(1, count[i]);
+    }
+    EXPECT_LT(max_rank, 4);
+}
+
+
+TEST(ThreadPool, nested_and_budget) {
+    OmpThreadsGuard guard(4);
+    faiss::ThreadPool pool(3);
+
+    // the nested calls run with a share of the budget
+    std::atomic<int> nleaf(0), max_budget(0);
+    pool.parallel(2, [&](int) {
+        int b = faiss::get_parallelism_budget();
+        int m = max_budget.load();
+        while (b > m && !max_budget.compare_exchange_weak(m, b)) {}
+        for (int rep = 0; rep < 10; rep++) {
+            faiss::WorkRange range(0, 100);
+            pool.parallel(0, [&](int) {
+                size_t i0, i1;
+                while (range.next(i0, i1)) {
+                    nleaf++;
+                }
+            });
+        }
+    });
+    EXPECT_EQ(2, max_budget);
+    EXPECT_EQ(4, faiss::get_parallelism_budget());
+
+    // the rank-0 call covers the whole range in each of the 2 calls
+    EXPECT_GE(nleaf, 10 * 100);
+    EXPECT_LE(nleaf, 2 * 10 * 100);
+
+    {
+        faiss::ParallelismBudget pb(2);
+        EXPECT_EQ(2, faiss::get_parallelism_budget());
+        // budgets can only decrease
+        faiss::ParallelismBudget pb2(3);
+        EXPECT_EQ(2, faiss::get_parallelism_budget());
+    }
+    EXPECT_EQ(4, faiss::get_parallelism_budget());
+}
+
+
+TEST(ThreadPool, exception) {
+    OmpThreadsGuard guard(4);
+    faiss::ThreadPool pool(3);
+    EXPECT_THROW(
+        pool.parallel(0, [](int rank) {
+            FAISS_THROW_IF_NOT_MSG(rank < 0, "error in task");
+        }),
+        faiss::FaissException);
+
+    // the pool is still usable
+    std::atomic<int> n(0);
+    faiss::parallel_for(0, 100, [&](size_t) { n++; });
+    EXPECT_EQ(100, n);
+}
+
+
+TEST(ThreadPool, shards_share_the_budget) {
+    OmpThreadsGuard guard(6);
+    int d = 8;
+    size_t nb = 1000, nq = 10;
+    idx_t k = 4;
+
+    std::vector<float> xb(nb * d);
+    for (size_t i = 0; i < xb.size(); i++) {
+        xb[i] = drand48();
+    }
+
+    faiss::IndexShards shards(d, true);
+    shards.own_fields = true;
+    for (int i = 0; i < 3; i++) {
+        shards.add_shard(new faiss::IndexFlatL2(d));
+    }
+    shards.add(nb, xb.data());
+
+    std::vector<int> budgets(3);
+    shards.runOnIndex([&](int i, faiss::Index*) {
+        budgets[i] = faiss::get_parallelism_budget();
+    });
+    for (int b : budgets) {
+        // less if the worker threads default to fewer threads
+        EXPECT_LE(b, 2);
+        EXPECT_GE(b, 1);
+    }
+
+    faiss::IndexFlatL2 ref(d);
+    ref.add(nb, xb.data());
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    shards.search(nq, xb.data(), k, D.data(), I.data());
+    ref.search(nq, xb.data(), k, Dref.data(), Iref.data());
+    EXPECT_EQ(Iref, I);
+    EXPECT_EQ(Dref, D);
+}
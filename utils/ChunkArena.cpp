@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/ChunkArena.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/hugepages.h>
+
+
+namespace faiss {
+
+namespace {
+
+const size_t hugepage_size = 2 << 20;
+
+}  // namespace
+
+
+ChunkArena::ChunkArena (size_t chunk_bytes_in, bool use_hugepages):
+    use_hugepages (use_hugepages),
+    nchunk_in_last_slab (0), nchunk_in_use (0)
+{
+    FAISS_THROW_IF_NOT (chunk_bytes_in > 0);
+    chunk_bytes = (chunk_bytes_in + 63) & ~size_t(63);
+    // small chunks are grouped in slabs of about one huge page
+    nchunk_per_slab = std::max (size_t(1), hugepage_size / chunk_bytes);
+    slab_bytes = nchunk_per_slab * chunk_bytes;
+    if (use_hugepages) {
+        slab_bytes = (slab_bytes + hugepage_size - 1) & ~(hugepage_size - 1);
+    }
+    nchunk_in_last_slab = nchunk_per_slab;
+}
+
+
+uint8_t *ChunkArena::alloc_chunk ()
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    nchunk_in_use++;
+    if (!free_chunks.empty()) {
+        uint8_t *chunk = free_chunks.back ();
+        free_chunks.pop_back ();
+        return chunk;
+    }
+    if (nchunk_in_last_slab == nchunk_per_slab) {
+        void *slab = nullptr;
+        bool on_hugepages = use_hugepages || hugepage_mode != HUGEPAGES_NONE;
+        try {
+            if (on_hugepages) {
+                // the slabs are too small for 1GB pages
+                HugePageMode mode =
+                    hugepage_mode == HUGEPAGES_NONE ? HUGEPAGES_THP :
+                    hugepage_mode == HUGEPAGES_1GB ? HUGEPAGES_2MB :
+                    hugepage_mode;
+                slab = hugepage_alloc (slab_bytes, mode);
+            } else {
+                int ret = posix_memalign (&slab, 64, slab_bytes);
+                FAISS_THROW_IF_NOT_FMT (
+                    ret == 0, "could not allocate slab of %zd bytes: %s",
+                    slab_bytes, strerror (ret));
+            }
+        } catch (...) {
+            nchunk_in_use--;
+            throw;
+        }
+        slabs.push_back ((uint8_t*)slab);
+        slab_from_hugepage_alloc.push_back (on_hugepages);
+        nchunk_in_last_slab = 0;
+    }
+    return slabs.back () + chunk_bytes * nchunk_in_last_slab++;
+}
+
+
+void ChunkArena::free_chunk (uint8_t *chunk)
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    nchunk_in_use--;
+    free_chunks.push_back (chunk);
+}
+
+
+size_t ChunkArena::nb_chunks_in_use () const
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    return nchunk_in_use;
+}
+
+
+size_t ChunkArena::nb_bytes_reserved () const
+{
+    std::lock_guard<std::mutex> lock (mutex);
+    return slabs.size () * slab_bytes;
+}
+
+
+ChunkArena::~ChunkArena ()
+{
+    for (size_t i = 0; i < slabs.size(); i++) {
+        if (slab_from_hugepage_alloc[i]) {
+            hugepage_free (slabs[i]);
+        } else {
+            free (slabs[i]);
+        }
+    }
+}
+
+
+} // namespace faiss
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#ifndef FAISS_CHUNK_ARENA_H
+#define FAISS_CHUNK_ARENA_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+
+namespace faiss {
+
+/** Allocator of fixed-size memory chunks, used by the storages that
+ * grow by appending chunks rather than by reallocating a contiguous
+ * array (IndexFlatChunked, ChunkedInvertedLists).
+ *
+ * The chunks are carved out of larger slabs, and freed chunks are
+ * kept in a free list for the next allocations. The memory of the
+ * slabs is returned to the system only when the arena is destroyed.
+ *
+ * alloc_chunk and free_chunk can be called concurrently.
+ */
+struct ChunkArena {
+
+    /// size of the chunks, rounded up to a multiple of 64 bytes
+    size_t chunk_bytes;
+
+    /// size of the slabs the chunks are carved from
+    size_t slab_bytes;
+
+    /// allocate the slabs on huge pages: those of hugepage_mode if it
+    /// is set, otherwise transparent huge pages
+    bool use_hugepages;
+
+    explicit ChunkArena (size_t chunk_bytes, bool use_hugepages = false);
+
+    /// @return a chunk of chunk_bytes bytes, 64-byte aligned,
+    ///         uninitialized
+    uint8_t *alloc_chunk ();
+
+    /// give back a chunk obtained from alloc_chunk
+    void free_chunk (uint8_t *chunk);
+
+    /// nb of chunks allocated and not freed
+    size_t nb_chunks_in_use () const;
+
+    /// total size of the slabs, in bytes
+    size_t nb_bytes_reserved () const;
+
+    ~ChunkArena ();
+
+  private:
+    mutable std::mutex mutex;
+    std::vector<uint8_t *> slabs;
+    std::vector<bool> slab_from_hugepage_alloc;
+    std::vector<uint8_t *> free_chunks;
+    size_t nchunk_per_slab;
+    size_t nchunk_in_last_slab;  ///< nb of chunks carved from slabs.back()
+    size_t nchunk_in_use;
+
+    ChunkArena (const ChunkArena &) = delete;
+    void operator = (const ChunkArena &) = delete;
+};
+
+
+} // namespace faiss
+
+#endif
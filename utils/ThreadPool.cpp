@@ -0,0 +1,328 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+
+#include <faiss/utils/ThreadPool.h>
+
+#include <algorithm>
+#include <exception>
+
+#include <omp.h>
+
+namespace faiss {
+
+namespace {
+
+// Pool and queue of the current thread, if it is a worker
+thread_local ThreadPool* currentPool = nullptr;
+thread_local int currentQueue = -1;
+
+// set by numa_bind_thread
+thread_local bool threadBound = false;
+
+} // namespace
+
+/// State of a parallel() call shared with the helper tasks
+struct ThreadPool::Job {
+  const std::function<void(int)>* f;
+  int nt;
+  int budget;
+
+  std::mutex mutex;
+  std::condition_variable monitor;
+  /// no helper may start anymore
+  bool closed;
+  int nextRank;
+  int nbActive;
+  std::exception_ptr exception;
+
+  void run(int rank) {
+    try {
+      ParallelismBudget pb(budget);
+      (*f)(rank);
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (!exception) {
+        exception = std::current_exception();
+      }
+    }
+  }
+
+  void runHelper() {
+    int rank;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (closed || nextRank == nt) {
+        return;
+      }
+      rank = nextRank++;
+      nbActive++;
+    }
+
+    run(rank);
+
+    std::lock_guard<std::mutex> guard(mutex);
+    nbActive--;
+    if (nbActive == 0) {
+      monitor.notify_all();
+    }
+  }
+};
+
+ThreadPool::ThreadPool(int nworker)
+    : nbPending_(0),
+      wantStop_(false),
+      nextQueue_(0) {
+  for (int i = 0; i < nworker; i++) {
+    queues_.emplace_back(new WorkerQueue);
+  }
+  for (int i = 0; i < nworker; i++) {
+    workers_.emplace_back([this, i](){ workerMain(i); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    wantStop_ = true;
+    monitor_.notify_all();
+  }
+  for (auto& t : workers_) {
+    t.join();
+  }
+}
+
+void
+ThreadPool::push(std::function<void()> task) {
+  size_t q = currentPool == this ?
+    currentQueue : nextQueue_.fetch_add(1) % queues_.size();
+  {
+    std::lock_guard<std::mutex> guard(queues_[q]->mutex);
+    queues_[q]->tasks.push_back(std::move(task));
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  nbPending_++;
+  monitor_.notify_one();
+}
+
+bool
+ThreadPool::getTask(int i, std::function<void()>& task) {
+  int n = queues_.size();
+  for (int j = 0; j < n; j++) {
+    auto& q = *queues_[(i + j) % n];
+    std::lock_guard<std::mutex> guard(q.mutex);
+    if (q.tasks.empty()) {
+      continue;
+    }
+    // most recent task of our own queue, the oldest one of the others
+    if (j == 0) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    } else {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+void
+ThreadPool::workerMain(int i) {
+  currentPool = this;
+  currentQueue = i;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!wantStop_ && nbPending_ == 0) {
+        monitor_.wait(lock);
+      }
+      if (wantStop_) {
+        return;
+      }
+      nbPending_--;
+    }
+
+    // the tasks are queued before they are counted, so there is one
+    // for us, possibly in another queue
+    std::function<void()> task;
+    if (getTask(i, task)) {
+      task();
+    }
+  }
+}
+
+void
+ThreadPool::parallel(int nt, const std::function<void(int rank)>& f) {
+  int budget = get_parallelism_budget();
+  if (nt <= 0 || nt > budget) {
+    nt = budget;
+  }
+  if (threadBound && nt > 1) {
+    parallelOnTeam(nt, budget, f);
+    return;
+  }
+  nt = std::min(nt, nworker() + 1);
+
+  if (nt <= 1) {
+    f(0);
+    return;
+  }
+
+  auto job = std::make_shared<Job>();
+  job->f = &f;
+  job->nt = nt;
+  job->budget = std::max(1, budget / nt);
+  job->closed = false;
+  job->nextRank = 1;
+  job->nbActive = 0;
+
+  for (int i = 1; i < nt; i++) {
+    push([job](){ job->runHelper(); });
+  }
+
+  job->run(0);
+
+  // the helpers that did not start are not waited for, and f is not
+  // called anymore once we return
+  std::unique_lock<std::mutex> lock(job->mutex);
+  job->closed = true;
+  while (job->nbActive > 0) {
+    job->monitor.wait(lock);
+  }
+  if (job->exception) {
+    std::rethrow_exception(job->exception);
+  }
+}
+
+void
+ThreadPool::parallelOnTeam(
+    int nt, int budget, const std::function<void(int rank)>& f) {
+  int rankBudget = std::max(1, budget / nt);
+  std::exception_ptr exception;
+
+#pragma omp parallel num_threads(nt)
+  {
+    try {
+      ParallelismBudget pb(rankBudget);
+      f(omp_get_thread_num());
+    } catch (...) {
+#pragma omp critical(faiss_thread_pool_exception)
+      {
+        if (!exception) {
+          exception = std::current_exception();
+        }
+      }
+    }
+  }
+
+  if (exception) {
+    std::rethrow_exception(exception);
+  }
+}
+
+WorkStealingRanges::WorkStealingRanges(
+    int nrank, const std::vector<uint64_t>& cumCost) {
+  size_t n = cumCost.size() - 1;
+  size_t begin = 0;
+  for (int r = 0; r < nrank; r++) {
+    // first item whose cumulative cost reaches the share of rank r
+    uint64_t target = cumCost[n] / nrank * (r + 1) +
+      cumCost[n] % nrank * (r + 1) / nrank;
+    size_t end = r + 1 == nrank ? n :
+      std::lower_bound(cumCost.begin() + begin, cumCost.end(), target) -
+      cumCost.begin();
+    end = std::max(std::min(end, n), begin);
+    ranges_.emplace_back(new Range);
+    ranges_.back()->begin = begin;
+    ranges_.back()->end = end;
+    begin = end;
+  }
+}
+
+bool
+WorkStealingRanges::next(int rank, size_t& i) {
+  Range& own = *ranges_[rank];
+  while (true) {
+    {
+      std::lock_guard<std::mutex> guard(own.mutex);
+      if (own.begin < own.end) {
+        i = own.begin++;
+        return true;
+      }
+    }
+
+    // steal from the largest range
+    int victim = -1;
+    size_t largest = 0;
+    for (int r = 0; r < ranges_.size(); r++) {
+      Range& range = *ranges_[r];
+      std::lock_guard<std::mutex> guard(range.mutex);
+      if (range.end - range.begin > largest) {
+        largest = range.end - range.begin;
+        victim = r;
+      }
+    }
+    if (victim < 0) {
+      return false;
+    }
+
+    size_t begin, end;
+    {
+      Range& range = *ranges_[victim];
+      std::lock_guard<std::mutex> guard(range.mutex);
+      if (range.begin == range.end) {
+        // taken in the meantime, look again
+        continue;
+      }
+      end = range.end;
+      begin = range.begin + (range.end - range.begin) / 2;
+      range.end = begin;
+    }
+
+    // nobody steals from our range while it is empty
+    std::lock_guard<std::mutex> guard(own.mutex);
+    own.begin = begin;
+    own.end = end;
+  }
+}
+
+ThreadPool& get_thread_pool() {
+  // never destroyed, so that it can be used until the very end of the
+  // program
+  static ThreadPool* pool =
+    new ThreadPool(std::max(omp_get_num_procs(), omp_get_max_threads()) - 1);
+  return *pool;
+}
+
+void set_thread_bound(bool bound) {
+  threadBound = bound;
+}
+
+bool is_thread_bound() {
+  return threadBound;
+}
+
+int get_parallelism_budget() {
+  if (omp_in_parallel() &&
+      omp_get_active_level() >= omp_get_max_active_levels()) {
+    return 1;
+  }
+  return omp_get_max_threads();
+}
+
+ParallelismBudget::ParallelismBudget(int nt)
+    : prev_(omp_get_max_threads()) {
+  omp_set_num_threads(std::max(1, std::min(nt, prev_)));
+}
+
+ParallelismBudget::~ParallelismBudget() {
+  omp_set_num_threads(prev_);
+}
+
+} // namespace
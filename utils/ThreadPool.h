@@ -0,0 +1,192 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace faiss {
+
+/**
+ * Work-stealing pool of threads shared by the library.
+ *
+ * Each worker has its own queue of tasks, where the tasks it submits
+ * are pushed; an idle worker steals the oldest tasks from the other
+ * queues. The calling thread of parallel() takes part in the work, so
+ * that the nested parallel() calls (eg. from the sub-indexes of an
+ * IndexShards) always progress, even when all the workers are busy.
+ *
+ * The nb of threads of a parallel() call is bounded by the
+ * parallelism budget of the calling thread, see ParallelismBudget.
+ */
+class ThreadPool {
+ public:
+  /// @param nworker   nb of threads in addition to the calling ones
+  explicit ThreadPool(int nworker);
+
+  /// Waits for the workers to exit; pending tasks are not run
+  ~ThreadPool();
+
+  int nworker() const { return workers_.size(); }
+
+  /**
+   * Calls f(rank) from at most nt threads, the calling thread being
+   * rank 0. Threads that are not available right away may join late or
+   * not at all, so f should take its work from a WorkRange shared by
+   * all the ranks rather than assume a fixed split. Each call of f runs
+   * with a budget of max(1, budget / nt) for its own parallel work.
+   *
+   * Blocks until all the calls to f have returned. The first exception
+   * thrown by f is rethrown.
+   *
+   * @param nt   max nb of threads, <= 0 for the budget of the caller
+   */
+  void parallel(int nt, const std::function<void(int rank)>& f);
+
+ private:
+  struct Job;
+
+  /// parallel() for a bound thread, on its OpenMP team
+  static void parallelOnTeam(
+      int nt, int budget, const std::function<void(int rank)>& f);
+
+  void workerMain(int i);
+
+  /// pops a task from queue i or steals one from the other queues
+  bool getTask(int i, std::function<void()>& task);
+
+  void push(std::function<void()> task);
+
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> workers_;
+
+  /// for the idle workers
+  std::mutex mutex_;
+  std::condition_variable monitor_;
+  size_t nbPending_;
+  bool wantStop_;
+
+  /// round-robin queue for the tasks submitted from outside the pool
+  std::atomic<size_t> nextQueue_;
+};
+
+/// Pool used by the library, with as many threads as there are cores
+ThreadPool& get_thread_pool();
+
+/**
+ * Marks the calling thread as bound to a subset of the CPUs (this is
+ * done by numa_bind_thread). The parallel() calls of a bound thread
+ * run on its OpenMP team, that is bound with it by
+ * numa_bind_thread_and_team, rather than on the pool workers that run
+ * on any CPU.
+ */
+void set_thread_bound(bool bound);
+
+bool is_thread_bound();
+
+/**
+ * Max nb of threads the calling thread may use for its parallel
+ * work. This is the OpenMP nb of threads of the thread (so that the
+ * OpenMP regions and the thread pool follow the same setting), or 1
+ * within an OpenMP region that cannot nest.
+ */
+int get_parallelism_budget();
+
+/**
+ * Caps the parallelism budget of the calling thread for the lifetime
+ * of the object. The budget can only decrease: nested budgets cannot
+ * exceed the enclosing one.
+ */
+struct ParallelismBudget {
+  explicit ParallelismBudget(int nt);
+  ~ParallelismBudget();
+
+ private:
+  int prev_;
+};
+
+/// Blocks of [begin, end) that are handed out to the threads of a
+/// parallel() call
+class WorkRange {
+ public:
+  WorkRange(size_t begin, size_t end, size_t blockSize = 1)
+      : next_(begin), end_(end), blockSize_(blockSize) {}
+
+  /// Gets the next block [ib, ie), false once the range is exhausted
+  bool next(size_t& ib, size_t& ie) {
+    ib = next_.fetch_add(blockSize_);
+    if (ib >= end_) {
+      return false;
+    }
+    ie = ib + blockSize_ < end_ ? ib + blockSize_ : end_;
+    return true;
+  }
+
+ private:
+  std::atomic<size_t> next_;
+  size_t end_;
+  size_t blockSize_;
+};
+
+/**
+ * Work-stealing distribution of the items [0, n) over the ranks of a
+ * parallel() call. The items are initially split into nrank contiguous
+ * ranges of about the same total cost. A rank whose range is exhausted
+ * (or that joins late) steals the second half of the largest remaining
+ * range, so the ranks stay busy until the end even when the costs are
+ * mis-estimated, and each rank mostly processes consecutive items.
+ */
+class WorkStealingRanges {
+ public:
+  /// @param cumCost   cumulative costs of the items, size n + 1
+  WorkStealingRanges(int nrank, const std::vector<uint64_t>& cumCost);
+
+  /// Gets the next item for rank, false once all the items are taken
+  bool next(int rank, size_t& i);
+
+ private:
+  struct Range {
+    std::mutex mutex;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<std::unique_ptr<Range>> ranges_;
+};
+
+/// Calls f(i) for i in [begin, end) with the library pool and the
+/// budget of the calling thread
+template <class F>
+void parallel_for(size_t begin, size_t end, F f) {
+  if (end <= begin) {
+    return;
+  }
+  WorkRange range(begin, end);
+  int nt = std::min(size_t(get_parallelism_budget()), end - begin);
+  get_thread_pool().parallel(nt, [&](int) {
+      size_t i, ie;
+      while (range.next(i, ie)) {
+        f(i);
+      }
+    });
+}
+
+} // namespace
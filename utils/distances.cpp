@@ -13,11 +13,16 @@
 #include <cassert>
 #include <cstring>
 #include <cmath>
+#include <vector>
 
 #include <omp.h>
+#include <unistd.h>
 
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/partitioning.h>
+#include <faiss/utils/ThreadPool.h>
+#include <faiss/MetricType.h>
 
 
 
@@ -57,35 +62,6 @@ namespace faiss {
 
 
 
-/* Compute the inner product between a vector x and
-   a set of ny vectors y.
-   These functions are not intended to replace BLAS matrix-matrix, as they
-   would be significantly less efficient in this case. */
-void fvec_inner_products_ny (float * ip,
-                             const float * x,
-                             const float * y,
-                             size_t d, size_t ny)
-{
-    // Not sure which one is fastest
-#if 0
-    {
-        FINTEGER di = d;
-        FINTEGER nyi = ny;
-        float one = 1.0, zero = 0.0;
-        FINTEGER onei = 1;
-        sgemv_ ("T", &di, &nyi, &one, y, &di, x, &onei, &zero, ip, &onei);
-    }
-#endif
-    for (size_t i = 0; i < ny; i++) {
-        ip[i] = fvec_inner_product (x, y, d);
-        y += d;
-    }
-}
-
-
-
-
-
 /* Compute the L2 norm of a set of nx vectors */
 void fvec_norms_L2 (float * __restrict nr,
                     const float * __restrict x,
@@ -109,6 +85,31 @@ void fvec_norms_L2sqr (float * __restrict nr,
 
 
 
+void hvec_norms_L2sqr (HalfType type, float * __restrict nr,
+                       const uint16_t * __restrict x,
+                       size_t d, size_t nx)
+{
+#pragma omp parallel
+    {
+        std::vector<float> buf (d);
+#pragma omp for
+        for (size_t i = 0; i < nx; i++) {
+            half_decode (type, x + i * d, buf.data(), d);
+            nr[i] = fvec_norm_L2sqr (buf.data(), d);
+        }
+    }
+}
+
+void i8vec_norms_L2sqr (int32_t * __restrict nr,
+                        const int8_t * __restrict x,
+                        size_t d, size_t nx)
+{
+#pragma omp parallel for
+    for (size_t i = 0; i < nx; i++)
+        nr[i] = i8vec_inner_product (x + i * d, x + i * d, d);
+}
+
+
 void fvec_renorm_L2 (size_t d, size_t nx, float * __restrict x)
 {
 #pragma omp parallel for
@@ -144,6 +145,10 @@ void fvec_renorm_L2 (size_t d, size_t nx, float * __restrict x)
 
 
 /* Find the nearest neighbors for nx queries in a set of ny vectors */
+// the distances of a query are computed by blocks with the one-to-many
+// kernels
+static const size_t knn_sse_block_size = 256;
+
 static void knn_inner_product_sse (const float * x,
                         const float * y,
                         size_t d, size_t nx, size_t ny,
@@ -152,71 +157,74 @@ static void knn_inner_product_sse (const float * x,
     size_t k = res->k;
     size_t check_period = InterruptCallback::get_period_hint (ny * d);
 
-    check_period *= omp_get_max_threads();
+    check_period *= get_parallelism_budget ();
 
     for (size_t i0 = 0; i0 < nx; i0 += check_period) {
         size_t i1 = std::min(i0 + check_period, nx);
 
-#pragma omp parallel for
-        for (size_t i = i0; i < i1; i++) {
+        parallel_for (i0, i1, [&] (size_t i) {
             const float * x_i = x + i * d;
-            const float * y_j = y;
 
             float * __restrict simi = res->get_val(i);
             int64_t * __restrict idxi = res->get_ids (i);
 
             minheap_heapify (k, simi, idxi);
 
-            for (size_t j = 0; j < ny; j++) {
-                float ip = fvec_inner_product (x_i, y_j, d);
-
-                if (ip > simi[0]) {
-                    minheap_pop (k, simi, idxi);
-                    minheap_push (k, simi, idxi, ip, j);
-                }
-                y_j += d;
+            HeapBlockCollector<CMin<float, int64_t> > coll (
+                res, distance_compute_min_k_reservoir);
+            coll.begin (i, i + 1);
+            float dis_block[knn_sse_block_size];
+            for (size_t j0 = 0; j0 < ny; j0 += knn_sse_block_size) {
+                size_t j1 = std::min (j0 + knn_sse_block_size, ny);
+                fvec_inner_products_ny (dis_block, x_i, y + j0 * d, d, j1 - j0);
+                coll.add_range (i, j0, j1, [&] (size_t j) {
+                    return dis_block[j - j0];
+                });
             }
+            coll.end ();
+
             minheap_reorder (k, simi, idxi);
-        }
+        });
         InterruptCallback::check ();
     }
 
 }
 
-static void knn_inner_product_sse (const int8_t * x,
-                                   const int8_t * y,
-                                   size_t d, size_t nx, size_t ny,
-                                   int_minheap_array_t * res)
+/* int8 one-to-one search, with a CMin heap for METRIC_INNER_PRODUCT
+ * and a CMax heap for METRIC_L2 */
+template<MetricType metric, class C>
+static void knn_int8_sse (const int8_t * x,
+                          const int8_t * y,
+                          size_t d, size_t nx, size_t ny,
+                          HeapArray<C> * res)
 {
     size_t k = res->k;
     size_t check_period = InterruptCallback::get_period_hint (ny * d);
 
-    check_period *= omp_get_max_threads();
+    check_period *= get_parallelism_budget ();
 
     for (size_t i0 = 0; i0 < nx; i0 += check_period) {
         size_t i1 = std::min(i0 + check_period, nx);
 
-#pragma omp parallel for default(none) shared(i0, i1, x, y, d, res, k, ny)
-        for (size_t i = i0; i < i1; i++) {
+        parallel_for (i0, i1, [&] (size_t i) {
             const int8_t * x_i = x + i * d;
-            const int8_t * y_j = y;
 
             int * __restrict simi = res->get_val(i);
             int64_t * __restrict idxi = res->get_ids (i);
 
-            minheap_heapify (k, simi, idxi);
+            heap_heapify<C> (k, simi, idxi);
 
-            for (size_t j = 0; j < ny; j++) {
-                int ip = i8vec_inner_product (x_i, y_j, d);
+            HeapBlockCollector<C> coll (res, distance_compute_min_k_reservoir);
+            coll.begin (i, i + 1);
+            coll.add_range (i, 0, ny, [&] (size_t j) {
+                return metric == METRIC_INNER_PRODUCT ?
+                    i8vec_inner_product (x_i, y + j * d, d) :
+                    i8vec_L2sqr (x_i, y + j * d, d);
+            });
+            coll.end ();
 
-                if (ip > simi[0]) {
-                    minheap_pop (k, simi, idxi);
-                    minheap_push (k, simi, idxi, ip, j);
-                }
-                y_j += d;
-            }
-            minheap_reorder (k, simi, idxi);
-        }
+            heap_reorder<C> (k, simi, idxi);
+        });
         InterruptCallback::check ();
     }
 
@@ -231,41 +239,79 @@ static void knn_L2sqr_sse (
     size_t k = res->k;
 
     size_t check_period = InterruptCallback::get_period_hint (ny * d);
-    check_period *= omp_get_max_threads();
+    check_period *= get_parallelism_budget ();
 
     for (size_t i0 = 0; i0 < nx; i0 += check_period) {
         size_t i1 = std::min(i0 + check_period, nx);
 
-#pragma omp parallel for
-        for (size_t i = i0; i < i1; i++) {
+        parallel_for (i0, i1, [&] (size_t i) {
             const float * x_i = x + i * d;
-            const float * y_j = y;
-            size_t j;
             float * simi = res->get_val(i);
             int64_t * idxi = res->get_ids (i);
 
             maxheap_heapify (k, simi, idxi);
-            for (j = 0; j < ny; j++) {
-                float disij = fvec_L2sqr (x_i, y_j, d);
 
-                if (disij < simi[0]) {
-                    maxheap_pop (k, simi, idxi);
-                    maxheap_push (k, simi, idxi, disij, j);
-                }
-                y_j += d;
+            HeapBlockCollector<CMax<float, int64_t> > coll (
+                res, distance_compute_min_k_reservoir);
+            coll.begin (i, i + 1);
+            float dis_block[knn_sse_block_size];
+            for (size_t j0 = 0; j0 < ny; j0 += knn_sse_block_size) {
+                size_t j1 = std::min (j0 + knn_sse_block_size, ny);
+                fvec_L2sqr_ny (dis_block, x_i, y + j0 * d, d, j1 - j0);
+                coll.add_range (i, j0, j1, [&] (size_t j) {
+                    return dis_block[j - j0];
+                });
             }
+            coll.end ();
+
             maxheap_reorder (k, simi, idxi);
-        }
+        });
         InterruptCallback::check ();
     }
 
 }
 
 
+/* The database vectors are read by tiles [j0, j1) of at most bs_y
+ * vectors. The float vectors are used in place, the half-precision
+ * ones are converted to a buffer of bs_y * d floats, so that the BLAS
+ * and fused paths work on both. */
+struct FloatTiles {
+    const float *y;
+    size_t d;
+    static const bool use_buffer = false;
+
+    const float *get (size_t j0, size_t /*j1*/, float * /*buf*/) const {
+        return y + j0 * d;
+    }
+
+    void norms_L2sqr (float *nr, size_t ny) const {
+        fvec_norms_L2sqr (nr, y, d, ny);
+    }
+};
+
+struct HalfTiles {
+    const uint16_t *y;
+    HalfType type;
+    size_t d;
+    static const bool use_buffer = true;
+
+    const float *get (size_t j0, size_t j1, float *buf) const {
+        half_decode (type, y + j0 * d, buf, (j1 - j0) * d);
+        return buf;
+    }
+
+    void norms_L2sqr (float *nr, size_t ny) const {
+        hvec_norms_L2sqr (type, nr, y, d, ny);
+    }
+};
+
+
 /** Find the nearest neighbors for nx queries in a set of ny vectors */
+template <class YTiles>
 static void knn_inner_product_blas (
         const float * x,
-        const float * y,
+        const YTiles & y_tiles,
         size_t d, size_t nx, size_t ny,
         float_minheap_array_t * res)
 {
@@ -275,89 +321,140 @@ static void knn_inner_product_blas (
     if (nx == 0 || ny == 0) return;
 
     /* block sizes */
-    const size_t bs_x = 4096, bs_y = 1024;
+    size_t bs_x = 4096, bs_y = 1024;
     // const size_t bs_x = 16, bs_y = 16;
+    HeapBlockCollector<CMin<float, int64_t> > coll (
+        res, distance_compute_min_k_reservoir);
+    if (coll.use_reservoir) {
+        // limit the size of the reservoirs
+        bs_x = std::max (size_t(64),
+                         std::min (bs_x, bs_x * bs_y / (8 * res->k)));
+    }
     std::unique_ptr<float[]> ip_block(new float[bs_x * bs_y]);
+    std::vector<float> y_buf (YTiles::use_buffer ? bs_y * d : 0);
 
     for (size_t i0 = 0; i0 < nx; i0 += bs_x) {
         size_t i1 = i0 + bs_x;
         if(i1 > nx) i1 = nx;
 
+        coll.begin (i0, i1);
+
         for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
             size_t j1 = j0 + bs_y;
             if (j1 > ny) j1 = ny;
+            const float *y_tile = y_tiles.get (j0, j1, y_buf.data());
             /* compute the actual dot products */
             {
                 float one = 1, zero = 0;
                 FINTEGER nyi = j1 - j0, nxi = i1 - i0, di = d;
                 sgemm_ ("Transpose", "Not transpose", &nyi, &nxi, &di, &one,
-                        y + j0 * d, &di,
+                        y_tile, &di,
                         x + i0 * d, &di, &zero,
                         ip_block.get(), &nyi);
             }
 
             /* collect maxima */
-            res->addn (j1 - j0, ip_block.get(), j0, i0, i1 - i0);
+            parallel_for (i0, i1, [&] (size_t i) {
+                const float *ip_line = ip_block.get() + (i - i0) * (j1 - j0);
+                coll.add_range (i, j0, j1, [&] (size_t j) {
+                    return ip_line[j - j0];
+                });
+            });
         }
+        coll.end ();
         InterruptCallback::check ();
     }
     res->reorder ();
 }
 
-#define BLK_SZ 2048
-
-// todo maximize cache utilization (https://dl.acm.org/doi/10.1145/1356052.1356053)
-static void knn_inner_product_blas (
+/** Find the nearest neighbors for nx int8 queries in a set of ny
+ * int8 vectors. The inner products are computed per (query block,
+ * database block) with the register-tiled i8vec_inner_products_block.
+ * The database block is sized to stay in L2 while all the queries of
+ * the block are scanned against it, so that the database is streamed
+ * from memory once per query block instead of once per query.
+ *
+ * ip_to_dis (ip, i, j) converts the inner product between x_i and y_j
+ * to the distance that is compared with C. */
+template<class C, class IPToDis>
+static void knn_int8_blas (
         const int8_t * x,
         const int8_t * y,
         size_t d, size_t nx, size_t ny,
-        int_minheap_array_t * res)
+        HeapArray<C> * res,
+        const IPToDis & ip_to_dis)
 {
     res->heapify ();
 
-    auto tmaxcnt = omp_get_max_threads();
-    if (nx < tmaxcnt) omp_set_num_threads(nx);
+    if (nx == 0 || ny == 0) return;
 
-#pragma omp parallel default(none) shared(x, y, nx, ny, d, res)
-    {
-        auto tcnt = omp_get_num_threads();
-        int task_per = std::ceil(nx / (float) tcnt);
-
-        auto tid = omp_get_thread_num();
-        for (size_t b = 0; b < ny; b += BLK_SZ) {
-            for (size_t i = tid * task_per; i < nx && i < (tid + 1) * task_per; ++i) {
-                const auto *xi = x + i * d;
-
-                auto *__restrict simi = res->get_val(i);
-                auto *__restrict idxi = res->get_ids(i);
-
-                for (size_t j = b; j < b + BLK_SZ && j < ny; ++j) {
-                    auto *yj = y + j * d;
-                    int dist = i8vec_inner_product(xi, yj, d);
-                    if (dist > simi[0]) {
-                        minheap_pop(res->k, simi, idxi);
-                        minheap_push(res->k, simi, idxi, dist, j);
+    /* block sizes */
+    const size_t bs_x = 32;
+    size_t bs_y = (256 * 1024) / (d > 0 ? d : 1);
+    bs_y = std::max(size_t(16), std::min(bs_y, size_t(4096))) & ~size_t(3);
+
+    size_t check_period = InterruptCallback::get_period_hint (ny * d);
+    check_period = std::max(check_period * get_parallelism_budget (), bs_x);
+    check_period -= check_period % bs_x;
+
+    for (size_t i0 = 0; i0 < nx; i0 += check_period) {
+        size_t i1 = std::min(i0 + check_period, nx);
+
+        WorkRange range (i0, i1, bs_x);
+        get_thread_pool().parallel (0, [&] (int) {
+            std::unique_ptr<int32_t[]> ip_block(new int32_t[bs_x * bs_y]);
+            HeapBlockCollector<C> coll (res, distance_compute_min_k_reservoir);
+
+            size_t ib, ie;
+            while (range.next (ib, ie)) {
+                coll.begin (ib, ie);
+
+                for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+                    size_t j1 = std::min(j0 + bs_y, ny);
+
+                    i8vec_inner_products_block (
+                        ip_block.get(), x + ib * d, y + j0 * d,
+                        d, ie - ib, j1 - j0);
+
+                    /* collect results */
+                    for (size_t i = ib; i < ie; i++) {
+                        const int32_t *ip_line =
+                            ip_block.get() + (i - ib) * (j1 - j0);
+                        coll.add_range (i, j0, j1, [&] (size_t j) {
+                            return ip_to_dis (ip_line[j - j0], i, j);
+                        });
                     }
                 }
+                coll.end ();
             }
-        }
-
-        for (size_t i = tid * task_per; i < nx && i < (tid+1)*task_per; ++i) {
-            auto *__restrict simi = res->get_val(i);
-            auto *__restrict idxi = res->get_ids(i);
-            minheap_reorder (res->k, simi, idxi);
-        }
+        });
+        InterruptCallback::check ();
     }
+    res->reorder ();
 }
 
+struct Int8IPToIP {
+    int operator () (int32_t ip, size_t /*i*/, size_t /*j*/) const {
+        return ip;
+    }
+};
+
+struct Int8IPToL2sqr {
+    const int32_t *x_norms, *y_norms;
+    int operator () (int32_t ip, size_t i, size_t j) const {
+        return x_norms[i] + y_norms[j] - 2 * ip;
+    }
+};
+
 // distance correction is an operator that can be applied to transform
-// the distances
-template<class DistanceCorrection>
+// the distances. The y norms are computed if y_norms_in is not provided
+template<class DistanceCorrection, class YTiles>
 static void knn_L2sqr_blas (const float * x,
-        const float * y,
+        const YTiles & y_tiles,
         size_t d, size_t nx, size_t ny,
         float_maxheap_array_t * res,
-        const DistanceCorrection &corr)
+        const DistanceCorrection &corr,
+        const float * y_norms_in = nullptr)
 {
     res->heapify ();
 
@@ -367,68 +464,222 @@ static void knn_L2sqr_blas (const float * x,
     size_t k = res->k;
 
     /* block sizes */
-    const size_t bs_x = 4096, bs_y = 1024;
+    size_t bs_x = 4096, bs_y = 1024;
     // const size_t bs_x = 16, bs_y = 16;
+    HeapBlockCollector<CMax<float, int64_t> > coll (
+        res, distance_compute_min_k_reservoir);
+    if (coll.use_reservoir) {
+        // limit the size of the reservoirs
+        bs_x = std::max (size_t(64), std::min (bs_x, bs_x * bs_y / (8 * k)));
+    }
     float *ip_block = new float[bs_x * bs_y];
     float *x_norms = new float[nx];
-    float *y_norms = new float[ny];
-    ScopeDeleter<float> del1(ip_block), del3(x_norms), del2(y_norms);
+    ScopeDeleter<float> del1(ip_block), del3(x_norms), del2;
+    std::vector<float> y_buf (YTiles::use_buffer ? bs_y * d : 0);
 
     fvec_norms_L2sqr (x_norms, x, d, nx);
-    fvec_norms_L2sqr (y_norms, y, d, ny);
 
+    const float *y_norms = y_norms_in;
+    if (!y_norms) {
+        float *y_norms_tmp = new float[ny];
+        del2.set (y_norms_tmp);
+        y_tiles.norms_L2sqr (y_norms_tmp, ny);
+        y_norms = y_norms_tmp;
+    }
 
     for (size_t i0 = 0; i0 < nx; i0 += bs_x) {
         size_t i1 = i0 + bs_x;
         if(i1 > nx) i1 = nx;
 
+        coll.begin (i0, i1);
+
         for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
             size_t j1 = j0 + bs_y;
             if (j1 > ny) j1 = ny;
+            const float *y_tile = y_tiles.get (j0, j1, y_buf.data());
             /* compute the actual dot products */
             {
                 float one = 1, zero = 0;
                 FINTEGER nyi = j1 - j0, nxi = i1 - i0, di = d;
                 sgemm_ ("Transpose", "Not transpose", &nyi, &nxi, &di, &one,
-                        y + j0 * d, &di,
+                        y_tile, &di,
                         x + i0 * d, &di, &zero,
                         ip_block, &nyi);
             }
 
             /* collect minima */
-#pragma omp parallel for
-            for (size_t i = i0; i < i1; i++) {
-                float * __restrict simi = res->get_val(i);
-                int64_t * __restrict idxi = res->get_ids (i);
+            parallel_for (i0, i1, [&] (size_t i) {
                 const float *ip_line = ip_block + (i - i0) * (j1 - j0);
 
-                for (size_t j = j0; j < j1; j++) {
-                    float ip = *ip_line++;
+                coll.add_range (i, j0, j1, [&] (size_t j) {
+                    float ip = ip_line[j - j0];
                     float dis = x_norms[i] + y_norms[j] - 2 * ip;
 
                     // negative values can occur for identical vectors
                     // due to roundoff errors
                     if (dis < 0) dis = 0;
 
-                    dis = corr (dis, i, j);
+                    return corr (dis, i, j);
+                });
+            });
+        }
+        coll.end ();
+        InterruptCallback::check ();
+    }
+    res->reorder ();
+
+}
 
-                    if (dis < simi[0]) {
-                        maxheap_pop (k, simi, idxi);
-                        maxheap_push (k, simi, idxi, dis, j);
+
+/*******************************************************
+ * Fused inner products + top-k for medium batches
+ *
+ * The blas functions above materialize a large ip_block and re-read it
+ * to update the heaps. For medium nx this round trip dominates. Here
+ * each thread computes a (query block, database block) tile of inner
+ * products with fvec_inner_products_block and feeds it to the heaps
+ * while it is still in cache.
+ *******************************************************/
+
+static size_t cache_size (int level)
+{
+    long sz = -1;
+#if defined(_SC_LEVEL1_DCACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+    sz = sysconf (level == 1 ? _SC_LEVEL1_DCACHE_SIZE : _SC_LEVEL2_CACHE_SIZE);
+#endif
+    if (sz <= 0) {
+        sz = level == 1 ? 32 * 1024 : 256 * 1024;
+    }
+    return sz;
+}
+
+/* The database block stays in L2 while all queries of the block are
+ * scanned against it, so the database is read from memory once per
+ * query block. bs_x is the reuse factor of the database block, it is
+ * reduced so that the heaps stay in L2 and all threads get a block.
+ * The database block and the tile of inner products then share half
+ * of L2, and the x micro-rows stay in L1. */
+static void fused_block_sizes (size_t d, size_t nx, size_t k,
+                               size_t & bs_x, size_t & bs_y)
+{
+    static const size_t l2_size = cache_size (2);
+    const size_t MR = 4;
+
+    bs_x = 64;
+    bs_x = std::min (bs_x, l2_size / (8 * k * (sizeof(float) + sizeof(int64_t))));
+    size_t nt = get_parallelism_budget ();
+    bs_x = std::min (bs_x, (nx + nt - 1) / nt);
+    bs_x = std::max ((bs_x + MR - 1) / MR * MR, MR);
+
+    bs_y = l2_size / 2 / (sizeof(float) * (d + bs_x));
+    bs_y = std::max (size_t(12), std::min (bs_y, size_t(4096)));
+    bs_y -= bs_y % 12;
+}
+
+/* ip_to_dis (ip, i, j) converts the inner product between x_i and y_j
+ * to the distance that is compared with C. */
+template<class C, class IPToDis, class YTiles>
+static void knn_float_fused (
+        const float * x,
+        const YTiles & y_tiles,
+        size_t d, size_t nx, size_t ny,
+        HeapArray<C> * res,
+        const IPToDis & ip_to_dis)
+{
+    res->heapify ();
+
+    // k = 0 would also make the block sizes divide by 0
+    if (nx == 0 || ny == 0 || res->k == 0) return;
+
+    size_t k = res->k;
+    size_t bs_x, bs_y;
+    fused_block_sizes (d, nx, k, bs_x, bs_y);
+
+    size_t check_period = InterruptCallback::get_period_hint (ny * d);
+    check_period = std::max(check_period * get_parallelism_budget (), bs_x);
+    check_period -= check_period % bs_x;
+
+    for (size_t i0 = 0; i0 < nx; i0 += check_period) {
+        size_t i1 = std::min(i0 + check_period, nx);
+
+        WorkRange range (i0, i1, bs_x);
+        get_thread_pool().parallel (0, [&] (int) {
+            std::unique_ptr<float[]> ip_block(new float[bs_x * bs_y]);
+            std::vector<float> y_buf (YTiles::use_buffer ? bs_y * d : 0);
+            HeapBlockCollector<C> coll (res, distance_compute_min_k_reservoir);
+
+            size_t ib, ie;
+            while (range.next (ib, ie)) {
+                coll.begin (ib, ie);
+
+                for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+                    size_t j1 = std::min(j0 + bs_y, ny);
+
+                    fvec_inner_products_block (
+                        ip_block.get(), x + ib * d,
+                        y_tiles.get (j0, j1, y_buf.data()),
+                        d, ie - ib, j1 - j0);
+
+                    /* collect results */
+                    for (size_t i = ib; i < ie; i++) {
+                        const float *ip_line =
+                            ip_block.get() + (i - ib) * (j1 - j0);
+                        coll.add_range (i, j0, j1, [&] (size_t j) {
+                            return ip_to_dis (ip_line[j - j0], i, j);
+                        });
                     }
                 }
+                coll.end ();
             }
-        }
+        });
         InterruptCallback::check ();
     }
     res->reorder ();
-
 }
 
+struct FloatIPToIP {
+    float operator () (float ip, size_t /*i*/, size_t /*j*/) const {
+        return ip;
+    }
+};
 
+template<class DistanceCorrection>
+struct FloatIPToL2sqr {
+    const float *x_norms, *y_norms;
+    const DistanceCorrection &corr;
+
+    float operator () (float ip, size_t i, size_t j) const {
+        float dis = x_norms[i] + y_norms[j] - 2 * ip;
+        // negative values can occur for identical vectors
+        // due to roundoff errors
+        if (dis < 0) dis = 0;
+        return corr (dis, i, j);
+    }
+};
 
+template<class DistanceCorrection, class YTiles>
+static void knn_L2sqr_fused (
+        const float * x,
+        const YTiles & y_tiles,
+        size_t d, size_t nx, size_t ny,
+        float_maxheap_array_t * res,
+        const DistanceCorrection &corr,
+        const float * y_norms_in = nullptr)
+{
+    std::vector<float> x_norms (nx), y_norms_tmp;
+    fvec_norms_L2sqr (x_norms.data(), x, d, nx);
+
+    const float *y_norms = y_norms_in;
+    if (!y_norms) {
+        y_norms_tmp.resize (ny);
+        y_tiles.norms_L2sqr (y_norms_tmp.data(), ny);
+        y_norms = y_norms_tmp.data();
+    }
 
-
+    FloatIPToL2sqr<DistanceCorrection> ip_to_dis = {
+        x_norms.data(), y_norms, corr};
+    knn_float_fused (x, y_tiles, d, nx, ny, res, ip_to_dis);
+}
 
 
 
@@ -438,6 +689,8 @@ static void knn_L2sqr_blas (const float * x,
  *******************************************************/
 
 int distance_compute_blas_threshold = 20;
+int distance_compute_fused_threshold = 512;
+int distance_compute_min_k_reservoir = 100;
 
 void knn_inner_product (const float * x,
         const float * y,
@@ -446,8 +699,10 @@ void knn_inner_product (const float * x,
 {
     if (nx < distance_compute_blas_threshold) {
         knn_inner_product_sse (x, y, d, nx, ny, res);
+    } else if (nx < distance_compute_fused_threshold) {
+        knn_float_fused (x, FloatTiles{y, d}, d, nx, ny, res, FloatIPToIP());
     } else {
-        knn_inner_product_blas (x, y, d, nx, ny, res);
+        knn_inner_product_blas (x, FloatTiles{y, d}, d, nx, ny, res);
     }
 }
 
@@ -457,9 +712,9 @@ void knn_inner_product (const int8_t * x,
                         int_minheap_array_t * res)
 {
     if (nx < distance_compute_blas_threshold) {
-        knn_inner_product_sse (x, y, d, nx, ny, res);
+        knn_int8_sse<METRIC_INNER_PRODUCT> (x, y, d, nx, ny, res);
     } else {
-        knn_inner_product_blas (x, y, d, nx, ny, res);
+        knn_int8_blas (x, y, d, nx, ny, res, Int8IPToIP());
     }
 }
 
@@ -474,16 +729,42 @@ struct NopDistanceCorrection {
 void knn_L2sqr (const float * x,
                 const float * y,
                 size_t d, size_t nx, size_t ny,
-                float_maxheap_array_t * res)
+                float_maxheap_array_t * res,
+                const float * y_norms)
 {
+    NopDistanceCorrection nop;
     if (nx < distance_compute_blas_threshold) {
         knn_L2sqr_sse (x, y, d, nx, ny, res);
+    } else if (nx < distance_compute_fused_threshold) {
+        knn_L2sqr_fused (x, FloatTiles{y, d}, d, nx, ny, res, nop, y_norms);
     } else {
-        NopDistanceCorrection nop;
-        knn_L2sqr_blas (x, y, d, nx, ny, res, nop);
+        knn_L2sqr_blas (x, FloatTiles{y, d}, d, nx, ny, res, nop, y_norms);
     }
 }
 
+void knn_L2sqr (const int8_t * x,
+                const int8_t * y,
+                size_t d, size_t nx, size_t ny,
+                int_maxheap_array_t * res,
+                const int32_t * y_norms)
+{
+    if (nx < distance_compute_blas_threshold) {
+        knn_int8_sse<METRIC_L2> (x, y, d, nx, ny, res);
+        return;
+    }
+
+    std::vector<int32_t> x_norms (nx), y_norms_tmp;
+    i8vec_norms_L2sqr (x_norms.data(), x, d, nx);
+    if (!y_norms) {
+        y_norms_tmp.resize (ny);
+        i8vec_norms_L2sqr (y_norms_tmp.data(), y, d, ny);
+        y_norms = y_norms_tmp.data();
+    }
+
+    Int8IPToL2sqr ip_to_dis = {x_norms.data(), y_norms};
+    knn_int8_blas (x, y, d, nx, ny, res, ip_to_dis);
+}
+
 struct BaseShiftDistanceCorrection {
     const float *base_shift;
     float operator()(float dis, size_t /*qno*/, size_t bno) const {
@@ -496,10 +777,103 @@ void knn_L2sqr_base_shift (
          const float * y,
          size_t d, size_t nx, size_t ny,
          float_maxheap_array_t * res,
-         const float *base_shift)
+         const float *base_shift,
+         const float *y_norms)
 {
     BaseShiftDistanceCorrection corr = {base_shift};
-    knn_L2sqr_blas (x, y, d, nx, ny, res, corr);
+    if (nx < distance_compute_fused_threshold) {
+        knn_L2sqr_fused (x, FloatTiles{y, d}, d, nx, ny, res, corr, y_norms);
+    } else {
+        knn_L2sqr_blas (x, FloatTiles{y, d}, d, nx, ny, res, corr, y_norms);
+    }
+}
+
+
+/*******************************************************
+ * KNN on half-precision vectors
+ *
+ * For few queries, the distances are computed with the one-to-many
+ * kernels that convert the database components in the registers.
+ * Otherwise the database is converted to float by tiles that are
+ * fed to the fused or BLAS paths.
+ *******************************************************/
+
+template<MetricType metric, class C>
+static void knn_half_sse (const float * x,
+                          const uint16_t * y, HalfType type,
+                          size_t d, size_t nx, size_t ny,
+                          HeapArray<C> * res)
+{
+    size_t k = res->k;
+    size_t check_period = InterruptCallback::get_period_hint (ny * d);
+
+    check_period *= get_parallelism_budget ();
+
+    for (size_t i0 = 0; i0 < nx; i0 += check_period) {
+        size_t i1 = std::min(i0 + check_period, nx);
+
+        parallel_for (i0, i1, [&] (size_t i) {
+            const float * x_i = x + i * d;
+
+            float * __restrict simi = res->get_val(i);
+            int64_t * __restrict idxi = res->get_ids (i);
+
+            heap_heapify<C> (k, simi, idxi);
+
+            HeapBlockCollector<C> coll (res, distance_compute_min_k_reservoir);
+            coll.begin (i, i + 1);
+            float dis_block[knn_sse_block_size];
+            for (size_t j0 = 0; j0 < ny; j0 += knn_sse_block_size) {
+                size_t j1 = std::min (j0 + knn_sse_block_size, ny);
+                if (metric == METRIC_INNER_PRODUCT) {
+                    hvec_inner_products_ny (
+                        type, dis_block, x_i, y + j0 * d, d, j1 - j0);
+                } else {
+                    hvec_L2sqr_ny (
+                        type, dis_block, x_i, y + j0 * d, d, j1 - j0);
+                }
+                coll.add_range (i, j0, j1, [&] (size_t j) {
+                    return dis_block[j - j0];
+                });
+            }
+            coll.end ();
+
+            heap_reorder<C> (k, simi, idxi);
+        });
+        InterruptCallback::check ();
+    }
+}
+
+void knn_inner_product (const float * x,
+                        const uint16_t * y, HalfType type,
+                        size_t d, size_t nx, size_t ny,
+                        float_minheap_array_t * res)
+{
+    HalfTiles y_tiles = {y, type, d};
+    if (nx < distance_compute_blas_threshold) {
+        knn_half_sse<METRIC_INNER_PRODUCT> (x, y, type, d, nx, ny, res);
+    } else if (nx < distance_compute_fused_threshold) {
+        knn_float_fused (x, y_tiles, d, nx, ny, res, FloatIPToIP());
+    } else {
+        knn_inner_product_blas (x, y_tiles, d, nx, ny, res);
+    }
+}
+
+void knn_L2sqr (const float * x,
+                const uint16_t * y, HalfType type,
+                size_t d, size_t nx, size_t ny,
+                float_maxheap_array_t * res,
+                const float * y_norms)
+{
+    HalfTiles y_tiles = {y, type, d};
+    NopDistanceCorrection nop;
+    if (nx < distance_compute_blas_threshold) {
+        knn_half_sse<METRIC_L2> (x, y, type, d, nx, ny, res);
+    } else if (nx < distance_compute_fused_threshold) {
+        knn_L2sqr_fused (x, y_tiles, d, nx, ny, res, nop, y_norms);
+    } else {
+        knn_L2sqr_blas (x, y_tiles, d, nx, ny, res, nop, y_norms);
+    }
 }
 
 
@@ -552,6 +926,65 @@ void fvec_L2sqr_by_idx (float * __restrict dis,
     }
 }
 
+/* The vectors selected by ids are scattered in y, so the next ones are
+ * prefetched while the current one is scored. */
+static inline void i8vec_prefetch (const int8_t * y, size_t d)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    for (size_t l = 0; l < d; l += 64) {
+        __builtin_prefetch (y + l);
+    }
+#endif
+}
+
+template <MetricType metric>
+static void i8vec_distances_by_idx (
+        int32_t * __restrict dis,
+        const int8_t * x,
+        const int8_t * y,
+        const int64_t * __restrict ids,
+        size_t d, size_t nx, size_t ny)
+{
+    const size_t pf_dist = 4;
+#pragma omp parallel for
+    for (size_t j = 0; j < nx; j++) {
+        const int64_t * __restrict idsj = ids + j * ny;
+        const int8_t * xj = x + j * d;
+        int32_t * __restrict disj = dis + j * ny;
+        for (size_t i = 0; i < std::min(pf_dist, ny); i++) {
+            if (idsj[i] >= 0)
+                i8vec_prefetch (y + d * idsj[i], d);
+        }
+        for (size_t i = 0; i < ny; i++) {
+            if (i + pf_dist < ny && idsj[i + pf_dist] >= 0)
+                i8vec_prefetch (y + d * idsj[i + pf_dist], d);
+            if (idsj[i] < 0)
+                continue;
+            const int8_t * yi = y + d * idsj[i];
+            disj[i] = metric == METRIC_INNER_PRODUCT ?
+                i8vec_inner_product (xj, yi, d) : i8vec_L2sqr (xj, yi, d);
+        }
+    }
+}
+
+void i8vec_inner_products_by_idx (int32_t * ip,
+                                  const int8_t * x,
+                                  const int8_t * y,
+                                  const int64_t * ids,
+                                  size_t d, size_t nx, size_t ny)
+{
+    i8vec_distances_by_idx<METRIC_INNER_PRODUCT> (ip, x, y, ids, d, nx, ny);
+}
+
+void i8vec_L2sqr_by_idx (int32_t * dis,
+                         const int8_t * x,
+                         const int8_t * y,
+                         const int64_t * ids,
+                         size_t d, size_t nx, size_t ny)
+{
+    i8vec_distances_by_idx<METRIC_L2> (dis, x, y, ids, d, nx, ny);
+}
+
 void pairwise_indexed_L2sqr (
         size_t d, size_t n,
         const float * x, const int64_t *ix,
@@ -653,13 +1086,14 @@ void knn_L2sqr_by_idx (const float * x,
 /** Find the nearest neighbors for nx queries in a set of ny vectors
  * compute_l2 = compute pairwise squared L2 distance rather than inner prod
  */
-template <bool compute_l2>
+template <bool compute_l2, class YTiles>
 static void range_search_blas (
         const float * x,
-        const float * y,
+        const YTiles & y_tiles,
         size_t d, size_t nx, size_t ny,
         float radius,
-        RangeSearchResult *result)
+        RangeSearchResult *result,
+        const float *y_norms_in = nullptr)
 {
 
     // BLAS does not like empty matrices
@@ -670,17 +1104,22 @@ static void range_search_blas (
     // const size_t bs_x = 16, bs_y = 16;
     float *ip_block = new float[bs_x * bs_y];
     ScopeDeleter<float> del0(ip_block);
+    std::vector<float> y_buf (YTiles::use_buffer ? bs_y * d : 0);
 
-    float *x_norms = nullptr, *y_norms = nullptr;
+    float *x_norms = nullptr;
+    const float *y_norms = y_norms_in;
     ScopeDeleter<float> del1, del2;
     if (compute_l2) {
         x_norms = new float[nx];
         del1.set (x_norms);
         fvec_norms_L2sqr (x_norms, x, d, nx);
 
-        y_norms = new float[ny];
-        del2.set (y_norms);
-        fvec_norms_L2sqr (y_norms, y, d, ny);
+        if (!y_norms) {
+            float *y_norms_tmp = new float[ny];
+            del2.set (y_norms_tmp);
+            y_tiles.norms_L2sqr (y_norms_tmp, ny);
+            y_norms = y_norms_tmp;
+        }
     }
 
     std::vector <RangeSearchPartialResult *> partial_results;
@@ -690,6 +1129,7 @@ static void range_search_blas (
         if (j1 > ny) j1 = ny;
         RangeSearchPartialResult * pres = new RangeSearchPartialResult (result);
         partial_results.push_back (pres);
+        const float *y_tile = y_tiles.get (j0, j1, y_buf.data());
 
         for (size_t i0 = 0; i0 < nx; i0 += bs_x) {
             size_t i1 = i0 + bs_x;
@@ -700,7 +1140,7 @@ static void range_search_blas (
                 float one = 1, zero = 0;
                 FINTEGER nyi = j1 - j0, nxi = i1 - i0, di = d;
                 sgemm_ ("Transpose", "Not transpose", &nyi, &nxi, &di, &one,
-                        y + j0 * d, &di,
+                        y_tile, &di,
                         x + i0 * d, &di, &zero,
                         ip_block, &nyi);
             }
@@ -786,13 +1226,15 @@ void range_search_L2sqr (
         const float * y,
         size_t d, size_t nx, size_t ny,
         float radius,
-        RangeSearchResult *res)
+        RangeSearchResult *res,
+        const float *y_norms)
 {
 
     if (nx < distance_compute_blas_threshold) {
         range_search_sse<true> (x, y, d, nx, ny, radius, res);
     } else {
-        range_search_blas<true> (x, y, d, nx, ny, radius, res);
+        range_search_blas<true> (
+            x, FloatTiles{y, d}, d, nx, ny, radius, res, y_norms);
     }
 }
 
@@ -807,11 +1249,250 @@ void range_search_inner_product (
     if (nx < distance_compute_blas_threshold) {
         range_search_sse<false> (x, y, d, nx, ny, radius, res);
     } else {
-        range_search_blas<false> (x, y, d, nx, ny, radius, res);
+        range_search_blas<false> (
+            x, FloatTiles{y, d}, d, nx, ny, radius, res);
     }
 }
 
 
+template <MetricType metric>
+static void range_search_half_sse (
+        const float * x,
+        const uint16_t * y, HalfType type,
+        size_t d, size_t nx, size_t ny,
+        float radius,
+        RangeSearchResult *res)
+{
+
+#pragma omp parallel
+    {
+        RangeSearchPartialResult pres (res);
+        float dis_block[knn_sse_block_size];
+
+#pragma omp for
+        for (size_t i = 0; i < nx; i++) {
+            const float * x_ = x + i * d;
+
+            RangeQueryResult & qres = pres.new_result (i);
+
+            for (size_t j0 = 0; j0 < ny; j0 += knn_sse_block_size) {
+                size_t j1 = std::min (j0 + knn_sse_block_size, ny);
+                if (metric == METRIC_INNER_PRODUCT) {
+                    hvec_inner_products_ny (
+                        type, dis_block, x_, y + j0 * d, d, j1 - j0);
+                    for (size_t j = j0; j < j1; j++) {
+                        if (dis_block[j - j0] > radius) {
+                            qres.add (dis_block[j - j0], j);
+                        }
+                    }
+                } else {
+                    hvec_L2sqr_ny (
+                        type, dis_block, x_, y + j0 * d, d, j1 - j0);
+                    for (size_t j = j0; j < j1; j++) {
+                        if (dis_block[j - j0] < radius) {
+                            qres.add (dis_block[j - j0], j);
+                        }
+                    }
+                }
+            }
+        }
+        pres.finalize ();
+    }
+
+    InterruptCallback::check();
+}
+
+void range_search_L2sqr (
+        const float * x,
+        const uint16_t * y, HalfType type,
+        size_t d, size_t nx, size_t ny,
+        float radius,
+        RangeSearchResult *res,
+        const float *y_norms)
+{
+    if (nx < distance_compute_blas_threshold) {
+        range_search_half_sse<METRIC_L2> (x, y, type, d, nx, ny, radius, res);
+    } else {
+        range_search_blas<true> (
+            x, HalfTiles{y, type, d}, d, nx, ny, radius, res, y_norms);
+    }
+}
+
+void range_search_inner_product (
+        const float * x,
+        const uint16_t * y, HalfType type,
+        size_t d, size_t nx, size_t ny,
+        float radius,
+        RangeSearchResult *res)
+{
+    if (nx < distance_compute_blas_threshold) {
+        range_search_half_sse<METRIC_INNER_PRODUCT> (
+            x, y, type, d, nx, ny, radius, res);
+    } else {
+        range_search_blas<false> (
+            x, HalfTiles{y, type, d}, d, nx, ny, radius, res);
+    }
+}
+
+
+/* int8 range search, one-to-one for METRIC_INNER_PRODUCT (ip > radius)
+ * or METRIC_L2 (dis < radius) */
+template <MetricType metric>
+static void range_search_int8_sse (
+        const int8_t * x,
+        const int8_t * y,
+        size_t d, size_t nx, size_t ny,
+        int radius,
+        RangeSearchResult *res)
+{
+
+#pragma omp parallel
+    {
+        RangeSearchPartialResult pres (res);
+
+#pragma omp for
+        for (size_t i = 0; i < nx; i++) {
+            const int8_t * x_ = x + i * d;
+            const int8_t * y_ = y;
+
+            RangeQueryResult & qres = pres.new_result (i);
+
+            for (size_t j = 0; j < ny; j++) {
+                if (metric == METRIC_INNER_PRODUCT) {
+                    int ip = i8vec_inner_product (x_, y_, d);
+                    if (ip > radius) {
+                        qres.add (ip, j);
+                    }
+                } else {
+                    int dis = i8vec_L2sqr (x_, y_, d);
+                    if (dis < radius) {
+                        qres.add (dis, j);
+                    }
+                }
+                y_ += d;
+            }
+        }
+        pres.finalize ();
+    }
+
+    InterruptCallback::check();
+}
+
+/* Blocked int8 range search, with the same blocking as knn_int8_blas.
+ * The results of a query must be contiguous in its partial result, so
+ * they are buffered per query while the database blocks are scanned
+ * and copied to the partial result when the query block is done. */
+template <MetricType metric, class IPToDis>
+static void range_search_int8_blas (
+        const int8_t * x,
+        const int8_t * y,
+        size_t d, size_t nx, size_t ny,
+        int radius,
+        RangeSearchResult *res,
+        const IPToDis & ip_to_dis)
+{
+    if (nx == 0 || ny == 0) return;
+
+    /* block sizes */
+    const size_t bs_x = 32;
+    size_t bs_y = (256 * 1024) / (d > 0 ? d : 1);
+    bs_y = std::max(size_t(16), std::min(bs_y, size_t(4096))) & ~size_t(3);
+
+#pragma omp parallel
+    {
+        RangeSearchPartialResult pres (res);
+        std::unique_ptr<int32_t[]> ip_block(new int32_t[bs_x * bs_y]);
+        std::vector<std::vector<int32_t> > buf_dis (bs_x);
+        std::vector<std::vector<int64_t> > buf_ids (bs_x);
+
+#pragma omp for schedule(dynamic)
+        for (size_t ib = 0; ib < nx; ib += bs_x) {
+            size_t ie = std::min(ib + bs_x, nx);
+
+            for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+                size_t j1 = std::min(j0 + bs_y, ny);
+
+                i8vec_inner_products_block (
+                    ip_block.get(), x + ib * d, y + j0 * d,
+                    d, ie - ib, j1 - j0);
+
+                for (size_t i = ib; i < ie; i++) {
+                    const int32_t *ip_line =
+                        ip_block.get() + (i - ib) * (j1 - j0);
+                    std::vector<int32_t> & bd = buf_dis[i - ib];
+                    std::vector<int64_t> & bi = buf_ids[i - ib];
+
+                    for (size_t j = j0; j < j1; j++) {
+                        int dis = ip_to_dis (*ip_line++, i, j);
+                        if (metric == METRIC_INNER_PRODUCT ?
+                                dis > radius : dis < radius) {
+                            bd.push_back (dis);
+                            bi.push_back (j);
+                        }
+                    }
+                }
+            }
+
+            for (size_t i = ib; i < ie; i++) {
+                RangeQueryResult & qres = pres.new_result (i);
+                std::vector<int32_t> & bd = buf_dis[i - ib];
+                std::vector<int64_t> & bi = buf_ids[i - ib];
+                for (size_t l = 0; l < bd.size(); l++) {
+                    qres.add (bd[l], bi[l]);
+                }
+                bd.clear ();
+                bi.clear ();
+            }
+        }
+        pres.finalize ();
+    }
+
+    InterruptCallback::check ();
+}
+
+void range_search_inner_product (
+        const int8_t * x,
+        const int8_t * y,
+        size_t d, size_t nx, size_t ny,
+        int radius,
+        RangeSearchResult *res)
+{
+    if (nx < distance_compute_blas_threshold) {
+        range_search_int8_sse<METRIC_INNER_PRODUCT> (
+            x, y, d, nx, ny, radius, res);
+    } else {
+        range_search_int8_blas<METRIC_INNER_PRODUCT> (
+            x, y, d, nx, ny, radius, res, Int8IPToIP());
+    }
+}
+
+void range_search_L2sqr (
+        const int8_t * x,
+        const int8_t * y,
+        size_t d, size_t nx, size_t ny,
+        int radius,
+        RangeSearchResult *res,
+        const int32_t * y_norms)
+{
+    if (nx < distance_compute_blas_threshold) {
+        range_search_int8_sse<METRIC_L2> (x, y, d, nx, ny, radius, res);
+        return;
+    }
+
+    std::vector<int32_t> x_norms (nx), y_norms_tmp;
+    i8vec_norms_L2sqr (x_norms.data(), x, d, nx);
+    if (!y_norms) {
+        y_norms_tmp.resize (ny);
+        i8vec_norms_L2sqr (y_norms_tmp.data(), y, d, ny);
+        y_norms = y_norms_tmp.data();
+    }
+
+    Int8IPToL2sqr ip_to_dis = {x_norms.data(), y_norms};
+    range_search_int8_blas<METRIC_L2> (
+        x, y, d, nx, ny, radius, res, ip_to_dis);
+}
+
+
 void pairwise_L2sqr (int64_t d,
                      int64_t nq, const float *xq,
                      int64_t nb, const float *xb,
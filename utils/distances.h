@@ -15,6 +15,7 @@
 #include <stdint.h>
 
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/half.h>
 
 
 namespace faiss {
@@ -36,9 +37,16 @@ float  fvec_inner_product (
         const float * y,
         size_t d);
 
+/** inner product of int8 vectors, accumulated in int32. The SIMD
+ * kernel (AVX-512 VNNI, AVX-VNNI, AVX2 or scalar) is selected at
+ * runtime from the CPU features */
 int
 i8vec_inner_product(const int8_t* a, const int8_t* b, int dim);
 
+/// squared L2 distance between int8 vectors, runtime-dispatched as well
+int
+i8vec_L2sqr(const int8_t* a, const int8_t* b, int dim);
+
 /// L1 distance
 float fvec_L1 (
         const float * x,
@@ -51,6 +59,34 @@ float fvec_Linf (
         size_t d);
 
 
+/** Instruction sets for which fvec_L2sqr, fvec_inner_product,
+ * fvec_L2sqr_ny, fvec_inner_products_ny, fvec_madd_and_argmin,
+ * fvec_count_lt_and_eq, the int8,
+ * block and half-precision kernels and the ScalarQuantizer distance
+ * computers are compiled. The level is selected when the library is loaded: the
+ * highest one supported by the CPU, or the one of the FAISS_SIMD_LEVEL
+ * environment variable ("generic", "avx2" or "avx512") if it is
+ * lower. */
+enum SIMDLevel {
+    SIMD_GENERIC = 0,  ///< kernels compiled with the build flags
+    SIMD_AVX2 = 1,     ///< AVX2 + FMA + F16C
+    SIMD_AVX512 = 2,   ///< AVX-512 F + BW
+};
+
+/// highest level supported by the CPU
+SIMDLevel simd_level_supported ();
+
+/// level of the kernels in use
+SIMDLevel get_simd_level ();
+
+/** force the level of the kernels, eg. for benchmarking. Throws if
+ * the CPU does not support it. Can be called while searches are
+ * running: each kernel call runs at the old or the new level. */
+void set_simd_level (SIMDLevel level);
+
+const char *simd_level_name (SIMDLevel level);
+
+
 /** Compute pairwise distances between sets of vectors
  *
  * @param d     dimension of the vectors
@@ -67,13 +103,40 @@ void pairwise_L2sqr (int64_t d,
                      float *dis,
                      int64_t ldq = -1, int64_t ldb = -1, int64_t ldd = -1);
 
-/* compute the inner product between nx vectors x and one y */
+/* compute the inner products between a vector x and a set of ny
+ * contiguous vectors y */
 void fvec_inner_products_ny (
         float * ip,         /* output inner product */
         const float * x,
         const float * y,
         size_t d, size_t ny);
 
+/** compute the nx * ny inner products between the int8 vectors x and
+ * the int8 vectors y, with register-tiled kernels.
+ *
+ * @param ip    output inner products, row-major, size nx * ny
+ * @param x     size nx * d
+ * @param y     size ny * d
+ */
+void i8vec_inner_products_block (
+        int32_t * ip,
+        const int8_t * x,
+        const int8_t * y,
+        size_t d, size_t nx, size_t ny);
+
+/// same as i8vec_inner_products_block for float vectors
+void fvec_inner_products_block (
+        float * ip,
+        const float * x,
+        const float * y,
+        size_t d, size_t nx, size_t ny);
+
+/** count the values that are strictly better than thresh (below it, or
+ * above it if greater is set) and equal to it, for the partitioning */
+void fvec_count_lt_and_eq (
+        const float * vals, size_t n, float thresh, bool greater,
+        size_t * n_lt, size_t * n_eq);
+
 /* compute ny square L2 distance bewteen x and a set of contiguous y vectors */
 void fvec_L2sqr_ny (
         float * dis,
@@ -81,6 +144,23 @@ void fvec_L2sqr_ny (
         const float * y,
         size_t d, size_t ny);
 
+/** same as fvec_L2sqr_ny for half-precision y vectors, which are
+ * converted to float in the kernel */
+void hvec_L2sqr_ny (
+        HalfType type,
+        float * dis,
+        const float * x,
+        const uint16_t * y,
+        size_t d, size_t ny);
+
+/// same as fvec_inner_products_ny for half-precision y vectors
+void hvec_inner_products_ny (
+        HalfType type,
+        float * ip,
+        const float * x,
+        const uint16_t * y,
+        size_t d, size_t ny);
+
 
 /** squared norm of a vector */
 float fvec_norm_L2sqr (const float * x,
@@ -96,6 +176,13 @@ void fvec_norms_L2 (float * ip, const float * x, size_t d, size_t nx);
 /// same as fvec_norms_L2, but computes square norms
 void fvec_norms_L2sqr (float * ip, const float * x, size_t d, size_t nx);
 
+/// squared norms of a set of int8 vectors
+void i8vec_norms_L2sqr (int32_t * nr, const int8_t * x, size_t d, size_t nx);
+
+/// squared norms of a set of half-precision vectors
+void hvec_norms_L2sqr (HalfType type, float * nr, const uint16_t * x,
+                       size_t d, size_t nx);
+
 /* L2-renormalize a set of vector. Nothing done if the vector is 0-normed */
 void fvec_renorm_L2 (size_t d, size_t nx, float * x);
 
@@ -130,6 +217,23 @@ void fvec_L2sqr_by_idx (
         size_t d, size_t nx, size_t ny);
 
 
+/** int8 versions of fvec_inner_products_by_idx and fvec_L2sqr_by_idx.
+ * The entries with a negative id are left untouched. */
+void i8vec_inner_products_by_idx (
+        int32_t * ip,
+        const int8_t * x,
+        const int8_t * y,
+        const int64_t *ids,
+        size_t d, size_t nx, size_t ny);
+
+void i8vec_L2sqr_by_idx (
+        int32_t * dis,
+        const int8_t * x,
+        const int8_t * y,
+        const int64_t *ids,
+        size_t d, size_t nx, size_t ny);
+
+
 /** compute dis[j] = L2sqr(x[ix[j]], y[iy[j]]) forall j=0..n-1
  *
  * @param x  size (max(ix) + 1, d)
@@ -158,6 +262,17 @@ void pairwise_indexed_inner_product (
 // threshold on nx above which we switch to BLAS to compute distances
 extern int distance_compute_blas_threshold;
 
+/* between distance_compute_blas_threshold and this threshold on nx, the
+ * float knn functions compute the distances by cache-sized tiles and
+ * update the heaps while the tiles are in cache, instead of going
+ * through BLAS. Set to 0 to always use BLAS. */
+extern int distance_compute_fused_threshold;
+
+/* from this k on, the knn functions collect the candidates in
+ * reservoirs that are partitioned when full (see partitioning.h)
+ * instead of updating a heap for each candidate. */
+extern int distance_compute_min_k_reservoir;
+
 /** Return the k nearest neighors of each of the nx vectors x among the ny
  *  vector y, w.r.t to max inner product
  *
@@ -177,12 +292,50 @@ void knn_inner_product (
         size_t d, size_t nx, size_t ny,
         int_minheap_array_t * res);
 
-/** Same as knn_inner_product, for the L2 distance */
+/** Same as knn_inner_product, for the L2 distance
+ *
+ * @param y_norms  squared norms of the y vectors (size ny), computed
+ *                 on the fly if not provided
+ */
 void knn_L2sqr (
         const float * x,
         const float * y,
         size_t d, size_t nx, size_t ny,
-        float_maxheap_array_t * res);
+        float_maxheap_array_t * res,
+        const float * y_norms = nullptr);
+
+/** int8 version. For large nx, the distances are computed as
+ * |x|^2 + |y|^2 - 2 <x, y> from blocked inner products.
+ *
+ * @param y_norms  squared norms of the y vectors (size ny), computed
+ *                 on the fly if not provided
+ */
+void knn_L2sqr (
+        const int8_t * x,
+        const int8_t * y,
+        size_t d, size_t nx, size_t ny,
+        int_maxheap_array_t * res,
+        const int32_t * y_norms = nullptr);
+
+/** knn_inner_product and knn_L2sqr with half-precision y vectors. For
+ * large nx, the y vectors are converted to float by tiles that go
+ * through the same code paths as the float functions.
+ *
+ * @param y_norms  squared norms of the y vectors (size ny), computed
+ *                 on the fly if not provided
+ */
+void knn_inner_product (
+        const float * x,
+        const uint16_t * y, HalfType type,
+        size_t d, size_t nx, size_t ny,
+        float_minheap_array_t * res);
+
+void knn_L2sqr (
+        const float * x,
+        const uint16_t * y, HalfType type,
+        size_t d, size_t nx, size_t ny,
+        float_maxheap_array_t * res,
+        const float * y_norms = nullptr);
 
 
 
@@ -196,7 +349,8 @@ void knn_L2sqr_base_shift (
          const float * y,
          size_t d, size_t nx, size_t ny,
          float_maxheap_array_t * res,
-         const float *base_shift);
+         const float *base_shift,
+         const float *y_norms = nullptr);
 
 /* Find the nearest neighbors for nx queries in a set of ny vectors
  * indexed by ids. May be useful for re-ranking a pre-selected vector list
@@ -236,7 +390,8 @@ void range_search_L2sqr (
         const float * y,
         size_t d, size_t nx, size_t ny,
         float radius,
-        RangeSearchResult *result);
+        RangeSearchResult *result,
+        const float *y_norms = nullptr);
 
 /// same as range_search_L2sqr for the inner product similarity
 void range_search_inner_product (
@@ -246,6 +401,45 @@ void range_search_inner_product (
         float radius,
         RangeSearchResult *result);
 
+/** int8 range search, returns the y with ip > radius. The queries are
+ * processed by blocks in parallel, each thread filling its own
+ * RangeSearchPartialResult. */
+void range_search_inner_product (
+        const int8_t * x,
+        const int8_t * y,
+        size_t d, size_t nx, size_t ny,
+        int radius,
+        RangeSearchResult *result);
+
+/** int8 range search, returns the y with L2sqr < radius.
+ *
+ * @param y_norms  squared norms of the y vectors (size ny), computed
+ *                 on the fly if not provided
+ */
+void range_search_L2sqr (
+        const int8_t * x,
+        const int8_t * y,
+        size_t d, size_t nx, size_t ny,
+        int radius,
+        RangeSearchResult *result,
+        const int32_t * y_norms = nullptr);
+
+/// range searches with half-precision y vectors
+void range_search_L2sqr (
+        const float * x,
+        const uint16_t * y, HalfType type,
+        size_t d, size_t nx, size_t ny,
+        float radius,
+        RangeSearchResult *result,
+        const float * y_norms = nullptr);
+
+void range_search_inner_product (
+        const float * x,
+        const uint16_t * y, HalfType type,
+        size_t d, size_t nx, size_t ny,
+        float radius,
+        RangeSearchResult *result);
+
 
 
 
@@ -8,12 +8,19 @@
 // -*- c++ -*-
 
 #include <faiss/utils/distances.h>
+#include <faiss/utils/half.h>
+#include <faiss/impl/FaissAssert.h>
 
 #include <cstdio>
+#include <cstdlib>
 #include <cassert>
 #include <cstring>
 #include <cmath>
 
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
 #ifdef __SSE__
 #include <immintrin.h>
 #endif
@@ -127,6 +134,17 @@ void fvec_L2sqr_ny_ref (float * dis,
     }
 }
 
+void fvec_inner_products_ny_ref (float * ip,
+                                 const float * x,
+                                 const float * y,
+                                 size_t d, size_t ny)
+{
+    for (size_t i = 0; i < ny; i++) {
+        ip[i] = fvec_inner_product (x, y, d);
+        y += d;
+    }
+}
+
 
 
 
@@ -286,8 +304,8 @@ void fvec_L2sqr_ny_D12 (float * dis, const float * x,
 
 } // anonymous namespace
 
-void fvec_L2sqr_ny (float * dis, const float * x,
-                        const float * y, size_t d, size_t ny) {
+static void fvec_L2sqr_ny_generic (float * dis, const float * x,
+                                   const float * y, size_t d, size_t ny) {
     // optimized for a few special cases
     switch(d) {
     case 1:
@@ -333,71 +351,9 @@ static inline __m256 masked_read_8 (int d, const float *x)
     }
 }
 
-int
-i8vec_inner_product(const int8_t* a, const int8_t* b, int dim)
-{
-    int d = 0;
-
-#if defined(__AVX512BW__) && defined(__AVX512DQ__)
-    __m512i S = _mm512_setzero_si512(), O = _mm512_setzero_si512();
-    while (dim >= 64) {
-        auto Ap = _mm512_loadu_si512(a); a += 64;
-        auto Bp = _mm512_loadu_si512(b); b += 64;
-        auto Ap1 = _mm512_srai_epi16(Ap, 8);
-        auto Ap2 = _mm512_srai_epi16(_mm512_slli_epi16(Ap, 8), 8);
-        auto Bp1 = _mm512_srai_epi16(Bp, 8);
-        auto Bp2 = _mm512_srai_epi16(_mm512_slli_epi16(Bp, 8), 8);
-        S += (_mm512_madd_epi16(Ap1, Bp1) + _mm512_madd_epi16(Ap2, Bp2));
-        dim -= 64;
-    }
-
-    auto S0 = _mm512_extracti32x8_epi32(S, 1);
-    S0 += _mm512_extracti32x8_epi32(S, 0);
-
-    if (dim >= 32) {
-#else
-    auto S0 = _mm256_setzero_si256();
-    while (dim >= 32) {
-#endif
-        auto Ap = _mm256_loadu_si256((const __m256i*)a); a += 32;
-        auto Bp = _mm256_loadu_si256((const __m256i*)b); b += 32;
-        auto Ap1 = _mm256_srai_epi16(Ap, 8);
-        auto Ap2 = _mm256_srai_epi16(_mm256_slli_epi16(Ap, 8), 8);
-        auto Bp1 = _mm256_srai_epi16(Bp, 8);
-        auto Bp2 = _mm256_srai_epi16(_mm256_slli_epi16(Bp, 8), 8);
-        S0 += (_mm256_madd_epi16(Ap1, Bp1) + _mm256_madd_epi16(Ap2, Bp2));
-        dim -= 32;
-    }
-
-    auto S1 = _mm256_extracti128_si256(S0, 1);
-    S1 += _mm256_extracti128_si256(S0, 0);
-
-    if (dim >= 16) {
-        auto Ap = _mm_loadu_si128((__m128i*)a); a += 16;
-        auto Bp = _mm_loadu_si128((__m128i*)b); b += 16;
-        auto Ap1 = _mm_srai_epi16(Ap, 8);
-        auto Ap2 = _mm_srai_epi16(_mm_slli_epi16(Ap, 8), 8);
-        auto Bp1 = _mm_srai_epi16(Bp, 8);
-        auto Bp2 = _mm_srai_epi16(_mm_slli_epi16(Bp, 8), 8);
-        S1 += (_mm_madd_epi16(Ap1, Bp1) + _mm_madd_epi16(Ap2, Bp2));
-        dim -= 16;
-    }
-    while (dim) {
-        d += ((int32_t)*a * (int32_t)*b);
-        dim -= 1; a += 1; b += 1;
-    }
-
-    S1 = _mm_hadd_epi32(S1, S1);
-    S1 = _mm_hadd_epi32(S1, S1);
-
-    d += _mm_cvtsi128_si32(S1);
-
-    return d;
-}
-
-float fvec_inner_product (const float * x,
-                          const float * y,
-                          size_t d)
+static float fvec_inner_product_generic (const float * x,
+                                         const float * y,
+                                         size_t d)
 {
 #if defined(__AVX512DQ__)
     __m512 S = _mm512_setzero_ps();
@@ -442,9 +398,9 @@ float fvec_inner_product (const float * x,
     return  _mm_cvtss_f32 (S1);
 }
 
-float fvec_L2sqr (const float * x,
-                 const float * y,
-                 size_t d)
+static float fvec_L2sqr_generic (const float * x,
+                                 const float * y,
+                                 size_t d)
 {
     __m256 msum1 = _mm256_setzero_ps();
 
@@ -566,9 +522,9 @@ float fvec_Linf (const float * x, const float * y, size_t d)
 }
 
 
-float fvec_L2sqr (const float * x,
-                 const float * y,
-                 size_t d)
+static float fvec_L2sqr_generic (const float * x,
+                                 const float * y,
+                                 size_t d)
 {
     __m128 msum1 = _mm_setzero_ps();
 
@@ -594,9 +550,9 @@ float fvec_L2sqr (const float * x,
 }
 
 
-float fvec_inner_product (const float * x,
-                         const float * y,
-                         size_t d)
+static float fvec_inner_product_generic (const float * x,
+                                         const float * y,
+                                         size_t d)
 {
     __m128 mx, my;
     __m128 msum1 = _mm_setzero_ps();
@@ -623,9 +579,9 @@ float fvec_inner_product (const float * x,
 #elif defined(__aarch64__)
 
 
-float fvec_L2sqr (const float * x,
-                  const float * y,
-                  size_t d)
+static float fvec_L2sqr_generic (const float * x,
+                                 const float * y,
+                                 size_t d)
 {
     if (d & 3) return fvec_L2sqr_ref (x, y, d);
     float32x4_t accu = vdupq_n_f32 (0);
@@ -639,9 +595,9 @@ float fvec_L2sqr (const float * x,
     return vdups_laneq_f32 (a2, 0) + vdups_laneq_f32 (a2, 1);
 }
 
-float fvec_inner_product (const float * x,
-                          const float * y,
-                          size_t d)
+static float fvec_inner_product_generic (const float * x,
+                                         const float * y,
+                                         size_t d)
 {
     if (d & 3) return fvec_inner_product_ref (x, y, d);
     float32x4_t accu = vdupq_n_f32 (0);
@@ -667,8 +623,8 @@ float fvec_norm_L2sqr (const float *x, size_t d)
 }
 
 // not optimized for ARM
-void fvec_L2sqr_ny (float * dis, const float * x,
-                        const float * y, size_t d, size_t ny) {
+static void fvec_L2sqr_ny_generic (float * dis, const float * x,
+                                   const float * y, size_t d, size_t ny) {
     fvec_L2sqr_ny_ref (dis, x, y, d, ny);
 }
 
@@ -686,9 +642,9 @@ float fvec_Linf (const float * x, const float * y, size_t d)
 #else
 // scalar implementation
 
-float fvec_L2sqr (const float * x,
-                  const float * y,
-                  size_t d)
+static float fvec_L2sqr_generic (const float * x,
+                                 const float * y,
+                                 size_t d)
 {
     return fvec_L2sqr_ref (x, y, d);
 }
@@ -703,9 +659,9 @@ float fvec_Linf (const float * x, const float * y, size_t d)
     return fvec_Linf_ref (x, y, d);
 }
 
-float fvec_inner_product (const float * x,
-                             const float * y,
-                             size_t d)
+static float fvec_inner_product_generic (const float * x,
+                                         const float * y,
+                                         size_t d)
 {
     return fvec_inner_product_ref (x, y, d);
 }
@@ -715,8 +671,8 @@ float fvec_norm_L2sqr (const float *x, size_t d)
     return fvec_norm_L2sqr_ref (x, d);
 }
 
-void fvec_L2sqr_ny (float * dis, const float * x,
-                        const float * y, size_t d, size_t ny) {
+static void fvec_L2sqr_ny_generic (float * dis, const float * x,
+                                   const float * y, size_t d, size_t ny) {
     fvec_L2sqr_ny_ref (dis, x, y, d, ny);
 }
 
@@ -742,6 +698,664 @@ void fvec_L2sqr_ny (float * dis, const float * x,
 
 
 
+/*********************************************************
+ * int8 inner product
+ *
+ * The kernel is selected at runtime from CPUID, so that a binary
+ * compiled for the lowest common denominator still uses VNNI
+ * (vpdpbusd) on the machines that support it.
+ */
+
+static int i8vec_inner_product_ref (const int8_t* a, const int8_t* b, int dim)
+{
+    int res = 0;
+    for (int i = 0; i < dim; i++) {
+        res += int32_t(a[i]) * int32_t(b[i]);
+    }
+    return res;
+}
+
+static int i8vec_L2sqr_ref (const int8_t* a, const int8_t* b, int dim)
+{
+    int res = 0;
+    for (int i = 0; i < dim; i++) {
+        int32_t tmp = int32_t(a[i]) - int32_t(b[i]);
+        res += tmp * tmp;
+    }
+    return res;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+
+#include <cpuid.h>
+
+#define SIMD_X86_DISPATCH
+
+// the compiler can generate AVX-VNNI code (VEX-encoded vpdpbusd)
+#if (defined(__clang__) && __clang_major__ >= 12) || \
+    (!defined(__clang__) && __GNUC__ >= 11)
+#define I8VEC_HAVE_AVXVNNI
+#endif
+
+// GCC (eg. 12) reports -Wuninitialized false positives on the
+// _mm256_undefined_* placeholders of the avx512fintrin.h reductions,
+// extractions and conversions once they are inlined, so they are
+// silenced around the AVX-512 kernels
+#if defined(__GNUC__) && !defined(__clang__)
+#define AVX512_WARNINGS_OFF \
+    _Pragma("GCC diagnostic push") \
+    _Pragma("GCC diagnostic ignored \"-Wuninitialized\"") \
+    _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+#define AVX512_WARNINGS_ON _Pragma("GCC diagnostic pop")
+#else
+#define AVX512_WARNINGS_OFF
+#define AVX512_WARNINGS_ON
+#endif
+
+__attribute__((target("avx2")))
+static int i8vec_inner_product_avx2 (const int8_t* a, const int8_t* b, int dim)
+{
+    int d = 0;
+
+    __m256i S0 = _mm256_setzero_si256();
+    while (dim >= 32) {
+        __m256i Ap = _mm256_loadu_si256((const __m256i*)a); a += 32;
+        __m256i Bp = _mm256_loadu_si256((const __m256i*)b); b += 32;
+        __m256i Ap1 = _mm256_srai_epi16(Ap, 8);
+        __m256i Ap2 = _mm256_srai_epi16(_mm256_slli_epi16(Ap, 8), 8);
+        __m256i Bp1 = _mm256_srai_epi16(Bp, 8);
+        __m256i Bp2 = _mm256_srai_epi16(_mm256_slli_epi16(Bp, 8), 8);
+        S0 = _mm256_add_epi32(S0, _mm256_add_epi32(_mm256_madd_epi16(Ap1, Bp1),
+                                                  _mm256_madd_epi16(Ap2, Bp2)));
+        dim -= 32;
+    }
+
+    // NB: the operators on __m256i / __m128i work on 64-bit lanes, so
+    // the 32-bit accumulations must use the explicit _epi32 intrinsics
+    __m128i S1 = _mm_add_epi32(_mm256_extracti128_si256(S0, 1),
+                               _mm256_extracti128_si256(S0, 0));
+
+    if (dim >= 16) {
+        __m128i Ap = _mm_loadu_si128((const __m128i*)a); a += 16;
+        __m128i Bp = _mm_loadu_si128((const __m128i*)b); b += 16;
+        __m128i Ap1 = _mm_srai_epi16(Ap, 8);
+        __m128i Ap2 = _mm_srai_epi16(_mm_slli_epi16(Ap, 8), 8);
+        __m128i Bp1 = _mm_srai_epi16(Bp, 8);
+        __m128i Bp2 = _mm_srai_epi16(_mm_slli_epi16(Bp, 8), 8);
+        S1 = _mm_add_epi32(S1, _mm_add_epi32(_mm_madd_epi16(Ap1, Bp1),
+                                            _mm_madd_epi16(Ap2, Bp2)));
+        dim -= 16;
+    }
+    while (dim) {
+        d += ((int32_t)*a * (int32_t)*b);
+        dim -= 1; a += 1; b += 1;
+    }
+
+    S1 = _mm_hadd_epi32(S1, S1);
+    S1 = _mm_hadd_epi32(S1, S1);
+
+    d += _mm_cvtsi128_si32(S1);
+
+    return d;
+}
+
+/* vpdpbusd multiplies unsigned by signed bytes. The signed x signed
+ * product is obtained with
+ *
+ *    sum_i a_i * b_i = sum_i (a_i + 128) * b_i - 128 * sum_i b_i
+ *
+ * where a_i + 128 = a_i ^ 0x80 as an unsigned byte, and sum_i b_i is
+ * accumulated with a second vpdpbusd against a vector of ones. */
+
+AVX512_WARNINGS_OFF
+
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static int i8vec_inner_product_avx512vnni (
+        const int8_t* a, const int8_t* b, int dim)
+{
+    const __m512i sign = _mm512_set1_epi8(-128);
+    const __m512i ones = _mm512_set1_epi8(1);
+    __m512i S = _mm512_setzero_si512();
+    __m512i Sb = _mm512_setzero_si512();
+
+    while (dim >= 64) {
+        __m512i Ap = _mm512_loadu_si512(a); a += 64;
+        __m512i Bp = _mm512_loadu_si512(b); b += 64;
+        S = _mm512_dpbusd_epi32(S, _mm512_xor_si512(Ap, sign), Bp);
+        Sb = _mm512_dpbusd_epi32(Sb, ones, Bp);
+        dim -= 64;
+    }
+
+    if (dim > 0) {
+        // masked-out bytes are 0 in b, so they do not contribute
+        __mmask64 mask = (~0ULL) >> (64 - dim);
+        __m512i Ap = _mm512_maskz_loadu_epi8(mask, a);
+        __m512i Bp = _mm512_maskz_loadu_epi8(mask, b);
+        S = _mm512_dpbusd_epi32(S, _mm512_xor_si512(Ap, sign), Bp);
+        Sb = _mm512_dpbusd_epi32(Sb, ones, Bp);
+    }
+
+    return _mm512_reduce_add_epi32(S) - 128 * _mm512_reduce_add_epi32(Sb);
+}
+
+AVX512_WARNINGS_ON
+
+#ifdef I8VEC_HAVE_AVXVNNI
+
+__attribute__((target("avx2,avxvnni")))
+static int i8vec_inner_product_avxvnni (
+        const int8_t* a, const int8_t* b, int dim)
+{
+    const __m256i sign = _mm256_set1_epi8(-128);
+    const __m256i ones = _mm256_set1_epi8(1);
+    __m256i S = _mm256_setzero_si256();
+    __m256i Sb = _mm256_setzero_si256();
+
+    while (dim >= 32) {
+        __m256i Ap = _mm256_loadu_si256((const __m256i*)a); a += 32;
+        __m256i Bp = _mm256_loadu_si256((const __m256i*)b); b += 32;
+        S = _mm256_dpbusd_avx_epi32(S, _mm256_xor_si256(Ap, sign), Bp);
+        Sb = _mm256_dpbusd_avx_epi32(Sb, ones, Bp);
+        dim -= 32;
+    }
+
+    __m128i S1 = _mm_sub_epi32(
+        _mm_add_epi32(_mm256_extracti128_si256(S, 1),
+                      _mm256_extracti128_si256(S, 0)),
+        _mm_slli_epi32(_mm_add_epi32(_mm256_extracti128_si256(Sb, 1),
+                                     _mm256_extracti128_si256(Sb, 0)), 7));
+
+    if (dim >= 16) {
+        __m128i Ap = _mm_loadu_si128((const __m128i*)a); a += 16;
+        __m128i Bp = _mm_loadu_si128((const __m128i*)b); b += 16;
+        __m128i Sa = _mm_dpbusd_avx_epi32(_mm_setzero_si128(),
+                _mm_xor_si128(Ap, _mm256_castsi256_si128(sign)), Bp);
+        __m128i Sc = _mm_dpbusd_avx_epi32(_mm_setzero_si128(),
+                _mm256_castsi256_si128(ones), Bp);
+        S1 = _mm_add_epi32(S1, _mm_sub_epi32(Sa, _mm_slli_epi32(Sc, 7)));
+        dim -= 16;
+    }
+
+    int d = 0;
+    while (dim) {
+        d += ((int32_t)*a * (int32_t)*b);
+        dim -= 1; a += 1; b += 1;
+    }
+
+    S1 = _mm_hadd_epi32(S1, S1);
+    S1 = _mm_hadd_epi32(S1, S1);
+
+    return d + _mm_cvtsi128_si32(S1);
+}
+
+#endif
+
+/* The differences of int8 components fit in int16, so the squared L2
+ * distance is computed by widening to int16, subtracting and
+ * accumulating the squares with madd. */
+
+__attribute__((target("avx2")))
+static int i8vec_L2sqr_avx2 (const int8_t* a, const int8_t* b, int dim)
+{
+    __m256i S = _mm256_setzero_si256();
+    while (dim >= 16) {
+        __m256i Ap = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)a));
+        __m256i Bp = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)b));
+        __m256i D = _mm256_sub_epi16(Ap, Bp);
+        S = _mm256_add_epi32(S, _mm256_madd_epi16(D, D));
+        a += 16; b += 16; dim -= 16;
+    }
+
+    __m128i S1 = _mm_add_epi32(_mm256_extracti128_si256(S, 1),
+                               _mm256_extracti128_si256(S, 0));
+    S1 = _mm_hadd_epi32(S1, S1);
+    S1 = _mm_hadd_epi32(S1, S1);
+
+    int d = _mm_cvtsi128_si32(S1);
+    while (dim) {
+        int32_t tmp = int32_t(*a) - int32_t(*b);
+        d += tmp * tmp;
+        dim -= 1; a += 1; b += 1;
+    }
+    return d;
+}
+
+AVX512_WARNINGS_OFF
+
+__attribute__((target("avx512f,avx512bw")))
+static int i8vec_L2sqr_avx512 (const int8_t* a, const int8_t* b, int dim)
+{
+    __m512i S = _mm512_setzero_si512();
+    while (dim >= 32) {
+        __m512i Ap = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)a));
+        __m512i Bp = _mm512_cvtepi8_epi16(_mm256_loadu_si256((const __m256i*)b));
+        __m512i D = _mm512_sub_epi16(Ap, Bp);
+        S = _mm512_add_epi32(S, _mm512_madd_epi16(D, D));
+        a += 32; b += 32; dim -= 32;
+    }
+    return _mm512_reduce_add_epi32(S) + i8vec_L2sqr_avx2(a, b, dim);
+}
+
+AVX512_WARNINGS_ON
+
+/* Register-tiled kernels computing the inner products between a block
+ * of nx vectors x and a block of ny vectors y. Each step of the inner
+ * loop computes a MR x NR tile of inner products in registers, so that
+ * every load of x or y is used NR (resp. MR) times. The tiles that do
+ * not fit in MR x NR are computed with the one-to-one kernel. */
+
+__attribute__((target("avx2")))
+static inline int32_t hsum_epi32_avx2 (__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_extracti128_si256(v, 1),
+                              _mm256_castsi256_si128(v));
+    s = _mm_hadd_epi32(s, s);
+    s = _mm_hadd_epi32(s, s);
+    return _mm_cvtsi128_si32(s);
+}
+
+// 4 x 2 tiles, components widened to int16 and multiplied with madd
+__attribute__((target("avx2")))
+static void i8vec_inner_products_block_avx2 (
+        int32_t *ip, const int8_t *x, const int8_t *y,
+        size_t d, size_t nx, size_t ny)
+{
+    const size_t MR = 4, NR = 2;
+    size_t d16 = d & ~size_t(15);
+    size_t nx_t = nx - nx % MR, ny_t = ny - ny % NR;
+
+    for (size_t i = 0; i < nx_t; i += MR) {
+        const int8_t *x0 = x + i * d;
+        for (size_t j = 0; j < ny_t; j += NR) {
+            const int8_t *y0 = y + j * d;
+            __m256i acc[MR][NR];
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    acc[a][b] = _mm256_setzero_si256();
+                }
+            }
+            for (size_t l = 0; l < d16; l += 16) {
+                __m256i yv[NR];
+                for (size_t b = 0; b < NR; b++) {
+                    yv[b] = _mm256_cvtepi8_epi16(
+                        _mm_loadu_si128((const __m128i*)(y0 + b * d + l)));
+                }
+                for (size_t a = 0; a < MR; a++) {
+                    __m256i xv = _mm256_cvtepi8_epi16(
+                        _mm_loadu_si128((const __m128i*)(x0 + a * d + l)));
+                    for (size_t b = 0; b < NR; b++) {
+                        acc[a][b] = _mm256_add_epi32(
+                            acc[a][b], _mm256_madd_epi16(xv, yv[b]));
+                    }
+                }
+            }
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    int32_t res = hsum_epi32_avx2(acc[a][b]);
+                    for (size_t l = d16; l < d; l++) {
+                        res += int32_t(x0[a * d + l]) * y0[b * d + l];
+                    }
+                    ip[(i + a) * ny + j + b] = res;
+                }
+            }
+        }
+    }
+
+    // borders
+    for (size_t i = 0; i < nx; i++) {
+        for (size_t j = i < nx_t ? ny_t : 0; j < ny; j++) {
+            ip[i * ny + j] = i8vec_inner_product_avx2(x + i * d, y + j * d, d);
+        }
+    }
+}
+
+/* the VNNI block kernels use the same (x ^ 0x80) * y - 128 * sum(y)
+ * identity as the one-to-one kernels, with sum(y) computed once per
+ * vector of the block */
+
+static void i8vec_sums (int32_t *sums, const int8_t *y, size_t d,
+                        size_t ny, size_t stride)
+{
+    // sum over the first d components of vectors stored every stride
+    for (size_t j = 0; j < ny; j++) {
+        int32_t s = 0;
+        for (size_t l = 0; l < d; l++) {
+            s += y[l];
+        }
+        sums[j] = s;
+        y += stride;
+    }
+}
+
+AVX512_WARNINGS_OFF
+
+// 4 x 4 tiles, 64 components per step
+__attribute__((target("avx512f,avx512bw,avx512vnni")))
+static void i8vec_inner_products_block_avx512vnni (
+        int32_t *ip, const int8_t *x, const int8_t *y,
+        size_t d, size_t nx, size_t ny)
+{
+    const size_t MR = 4, NR = 4;
+    size_t nx_t = nx - nx % MR, ny_t = ny - ny % NR;
+    const __m512i sign = _mm512_set1_epi8(-128);
+
+    std::vector<int32_t> ysums(ny_t);
+    i8vec_sums(ysums.data(), y, d, ny_t, d);
+
+    for (size_t i = 0; i < nx_t; i += MR) {
+        const int8_t *x0 = x + i * d;
+        for (size_t j = 0; j < ny_t; j += NR) {
+            const int8_t *y0 = y + j * d;
+            __m512i acc[MR][NR];
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    acc[a][b] = _mm512_setzero_si512();
+                }
+            }
+            for (size_t l = 0; l < d; l += 64) {
+                // masked-out bytes are 0 in y, so they do not contribute
+                __mmask64 mask = d - l >= 64 ? ~0ULL : (~0ULL) >> (64 - (d - l));
+                __m512i yv[NR];
+                for (size_t b = 0; b < NR; b++) {
+                    yv[b] = _mm512_maskz_loadu_epi8(mask, y0 + b * d + l);
+                }
+                for (size_t a = 0; a < MR; a++) {
+                    __m512i xv = _mm512_xor_si512(
+                        _mm512_maskz_loadu_epi8(mask, x0 + a * d + l), sign);
+                    for (size_t b = 0; b < NR; b++) {
+                        acc[a][b] = _mm512_dpbusd_epi32(acc[a][b], xv, yv[b]);
+                    }
+                }
+            }
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    ip[(i + a) * ny + j + b] =
+                        _mm512_reduce_add_epi32(acc[a][b]) -
+                        128 * ysums[j + b];
+                }
+            }
+        }
+    }
+
+    // borders
+    for (size_t i = 0; i < nx; i++) {
+        for (size_t j = i < nx_t ? ny_t : 0; j < ny; j++) {
+            ip[i * ny + j] = i8vec_inner_product_avx512vnni(
+                x + i * d, y + j * d, d);
+        }
+    }
+}
+
+AVX512_WARNINGS_ON
+
+#ifdef I8VEC_HAVE_AVXVNNI
+
+// 4 x 2 tiles, 32 components per step
+__attribute__((target("avx2,avxvnni")))
+static void i8vec_inner_products_block_avxvnni (
+        int32_t *ip, const int8_t *x, const int8_t *y,
+        size_t d, size_t nx, size_t ny)
+{
+    const size_t MR = 4, NR = 2;
+    size_t d32 = d & ~size_t(31);
+    size_t nx_t = nx - nx % MR, ny_t = ny - ny % NR;
+    const __m256i sign = _mm256_set1_epi8(-128);
+
+    std::vector<int32_t> ysums(ny_t);
+    i8vec_sums(ysums.data(), y, d32, ny_t, d);
+
+    for (size_t i = 0; i < nx_t; i += MR) {
+        const int8_t *x0 = x + i * d;
+        for (size_t j = 0; j < ny_t; j += NR) {
+            const int8_t *y0 = y + j * d;
+            __m256i acc[MR][NR];
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    acc[a][b] = _mm256_setzero_si256();
+                }
+            }
+            for (size_t l = 0; l < d32; l += 32) {
+                __m256i yv[NR];
+                for (size_t b = 0; b < NR; b++) {
+                    yv[b] = _mm256_loadu_si256((const __m256i*)(y0 + b * d + l));
+                }
+                for (size_t a = 0; a < MR; a++) {
+                    __m256i xv = _mm256_xor_si256(
+                        _mm256_loadu_si256((const __m256i*)(x0 + a * d + l)),
+                        sign);
+                    for (size_t b = 0; b < NR; b++) {
+                        acc[a][b] = _mm256_dpbusd_avx_epi32(acc[a][b], xv, yv[b]);
+                    }
+                }
+            }
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    int32_t res = hsum_epi32_avx2(acc[a][b]) -
+                        128 * ysums[j + b];
+                    for (size_t l = d32; l < d; l++) {
+                        res += int32_t(x0[a * d + l]) * y0[b * d + l];
+                    }
+                    ip[(i + a) * ny + j + b] = res;
+                }
+            }
+        }
+    }
+
+    // borders
+    for (size_t i = 0; i < nx; i++) {
+        for (size_t j = i < nx_t ? ny_t : 0; j < ny; j++) {
+            ip[i * ny + j] = i8vec_inner_product_avxvnni(
+                x + i * d, y + j * d, d);
+        }
+    }
+}
+
+#endif
+
+namespace {
+
+struct X86Features {
+    bool avx2 = false;
+    bool fma = false;
+    bool f16c = false;
+    bool avx512bw = false;     // with avx512f
+    bool avx512vnni = false;   // with avx512f and avx512bw
+    bool avxvnni = false;
+
+    X86Features () {
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid (1, &eax, &ebx, &ecx, &edx)) return;
+        bool osxsave = ecx & (1 << 27);
+        if (!osxsave) return;
+
+        // check that the OS saves the ymm and zmm registers
+        unsigned xcr0_lo, xcr0_hi;
+        __asm__ ("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        bool os_ymm = (xcr0_lo & 0x6) == 0x6;
+        bool os_zmm = (xcr0_lo & 0xe6) == 0xe6;
+        fma = os_ymm && (ecx & (1 << 12));
+        f16c = os_ymm && (ecx & (1 << 29));
+
+        if (__get_cpuid_max (0, nullptr) < 7) return;
+        __cpuid_count (7, 0, eax, ebx, ecx, edx);
+        avx2 = os_ymm && (ebx & (1 << 5));
+        avx512bw = os_zmm &&
+            (ebx & (1 << 16)) &&       // avx512f
+            (ebx & (1u << 30));        // avx512bw
+        avx512vnni = avx512bw && (ecx & (1 << 11));
+
+        __cpuid_count (7, 1, eax, ebx, ecx, edx);
+        avxvnni = avx2 && (eax & (1 << 4));
+    }
+};
+
+} // namespace
+
+static const X86Features & x86_features ()
+{
+    static const X86Features f;
+    return f;
+}
+
+#endif
+
+static void i8vec_inner_products_block_ref (
+        int32_t *ip, const int8_t *x, const int8_t *y,
+        size_t d, size_t nx, size_t ny)
+{
+    for (size_t i = 0; i < nx; i++) {
+        for (size_t j = 0; j < ny; j++) {
+            ip[i * ny + j] = i8vec_inner_product (x + i * d, y + j * d, d);
+        }
+    }
+}
+
+/*********************************************************
+ * float inner products by blocks
+ *
+ * Same register tiling as the int8 block kernels: each accumulator
+ * holds the partial sums of one (x, y) pair and is reduced at the end,
+ * so the vectors are read in place without packing.
+ */
+
+static void fvec_inner_products_block_ref (
+        float *ip, const float *x, const float *y,
+        size_t d, size_t nx, size_t ny)
+{
+    for (size_t i = 0; i < nx; i++) {
+        for (size_t j = 0; j < ny; j++) {
+            ip[i * ny + j] = fvec_inner_product (x + i * d, y + j * d, d);
+        }
+    }
+}
+
+#ifdef SIMD_X86_DISPATCH
+
+// sums of the 4 accumulators, in order
+__attribute__((target("avx2")))
+static inline __m128 hsum4_ps_avx2 (__m256 a0, __m256 a1, __m256 a2, __m256 a3)
+{
+    __m256 t = _mm256_hadd_ps (
+        _mm256_hadd_ps (a0, a1), _mm256_hadd_ps (a2, a3));
+    return _mm_add_ps (_mm256_castps256_ps128 (t),
+                       _mm256_extractf128_ps (t, 1));
+}
+
+// same summation order as hsum4_ps_avx2
+__attribute__((target("avx2")))
+static inline float hsum_ps_avx2 (__m256 v)
+{
+    return _mm_cvtss_f32 (hsum4_ps_avx2 (v, v, v, v));
+}
+
+// 4 x 3 tiles, 8 components per step
+__attribute__((target("avx2,fma")))
+static void fvec_inner_products_block_avx2 (
+        float *ip, const float *x, const float *y,
+        size_t d, size_t nx, size_t ny)
+{
+    const size_t MR = 4, NR = 3;
+    size_t d8 = d & ~size_t(7);
+    size_t nx_t = nx - nx % MR, ny_t = ny - ny % NR;
+
+    for (size_t i = 0; i < nx_t; i += MR) {
+        const float *x0 = x + i * d;
+        for (size_t j = 0; j < ny_t; j += NR) {
+            const float *y0 = y + j * d;
+            __m256 acc[MR][NR];
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    acc[a][b] = _mm256_setzero_ps();
+                }
+            }
+            for (size_t l = 0; l < d8; l += 8) {
+                __m256 yv[NR];
+                for (size_t b = 0; b < NR; b++) {
+                    yv[b] = _mm256_loadu_ps(y0 + b * d + l);
+                }
+                for (size_t a = 0; a < MR; a++) {
+                    __m256 xv = _mm256_loadu_ps(x0 + a * d + l);
+                    for (size_t b = 0; b < NR; b++) {
+                        acc[a][b] = _mm256_fmadd_ps(xv, yv[b], acc[a][b]);
+                    }
+                }
+            }
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    float res = hsum_ps_avx2(acc[a][b]);
+                    for (size_t l = d8; l < d; l++) {
+                        res += x0[a * d + l] * y0[b * d + l];
+                    }
+                    ip[(i + a) * ny + j + b] = res;
+                }
+            }
+        }
+    }
+
+    // borders
+    for (size_t i = 0; i < nx; i++) {
+        for (size_t j = i < nx_t ? ny_t : 0; j < ny; j++) {
+            ip[i * ny + j] = fvec_inner_product(x + i * d, y + j * d, d);
+        }
+    }
+}
+
+AVX512_WARNINGS_OFF
+
+// 4 x 4 tiles, 16 components per step, the tail is read with a mask
+__attribute__((target("avx512f")))
+static void fvec_inner_products_block_avx512 (
+        float *ip, const float *x, const float *y,
+        size_t d, size_t nx, size_t ny)
+{
+    const size_t MR = 4, NR = 4;
+    size_t d16 = d & ~size_t(15);
+    __mmask16 tail_mask = (1 << (d - d16)) - 1;
+    size_t nx_t = nx - nx % MR, ny_t = ny - ny % NR;
+
+    for (size_t i = 0; i < nx_t; i += MR) {
+        const float *x0 = x + i * d;
+        for (size_t j = 0; j < ny_t; j += NR) {
+            const float *y0 = y + j * d;
+            __m512 acc[MR][NR];
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    acc[a][b] = _mm512_setzero_ps();
+                }
+            }
+            for (size_t l = 0; l < d; l += 16) {
+                __mmask16 m = l < d16 ? __mmask16(0xffff) : tail_mask;
+                __m512 yv[NR];
+                for (size_t b = 0; b < NR; b++) {
+                    yv[b] = _mm512_maskz_loadu_ps(m, y0 + b * d + l);
+                }
+                for (size_t a = 0; a < MR; a++) {
+                    __m512 xv = _mm512_maskz_loadu_ps(m, x0 + a * d + l);
+                    for (size_t b = 0; b < NR; b++) {
+                        acc[a][b] = _mm512_fmadd_ps(xv, yv[b], acc[a][b]);
+                    }
+                }
+            }
+            for (size_t a = 0; a < MR; a++) {
+                for (size_t b = 0; b < NR; b++) {
+                    ip[(i + a) * ny + j + b] = _mm512_reduce_add_ps(acc[a][b]);
+                }
+            }
+        }
+    }
+
+    // borders
+    for (size_t i = 0; i < nx; i++) {
+        for (size_t j = i < nx_t ? ny_t : 0; j < ny; j++) {
+            ip[i * ny + j] = fvec_inner_product(x + i * d, y + j * d, d);
+        }
+    }
+}
+
+AVX512_WARNINGS_ON
+
+#endif
+
 /***************************************************************************
  * heavily optimized table computations
  ***************************************************************************/
@@ -858,8 +1472,8 @@ static inline int fvec_madd_and_argmin_sse (
 }
 
 
-int fvec_madd_and_argmin (size_t n, const float *a,
-                          float bf, const float *b, float *c)
+static int fvec_madd_and_argmin_generic (size_t n, const float *a,
+                                         float bf, const float *b, float *c)
 {
     if ((n & 3) == 0 &&
         ((((long)a) | ((long)b) | ((long)c)) & 15) == 0)
@@ -870,8 +1484,8 @@ int fvec_madd_and_argmin (size_t n, const float *a,
 
 #else
 
-int fvec_madd_and_argmin (size_t n, const float *a,
-                          float bf, const float *b, float *c)
+static int fvec_madd_and_argmin_generic (size_t n, const float *a,
+                                         float bf, const float *b, float *c)
 {
   return fvec_madd_and_argmin_ref (n, a, bf, b, c);
 }
@@ -879,6 +1493,1046 @@ int fvec_madd_and_argmin (size_t n, const float *a,
 #endif
 
 
+static void fvec_count_lt_and_eq_ref (
+        const float *vals, size_t n, float thresh, bool greater,
+        size_t *n_lt, size_t *n_eq)
+{
+    size_t lt = 0, eq = 0;
+    for (size_t i = 0; i < n; i++) {
+        lt += greater ? vals[i] > thresh : vals[i] < thresh;
+        eq += vals[i] == thresh;
+    }
+    *n_lt = lt;
+    *n_eq = eq;
+}
+
+
+
+/*********************************************************
+ * AVX2 and AVX-512 float kernels
+ *
+ * Compiled with target attributes whatever the build flags, and
+ * selected at runtime with set_simd_level. The tails are read with
+ * masked loads, so that any d is handled in the SIMD registers.
+ */
+
+#ifdef SIMD_X86_DISPATCH
+
+template <bool is_ip>
+__attribute__((target("avx2,fma")))
+static inline __m256 accu_avx2 (__m256 accu, __m256 xv, __m256 yv)
+{
+    if (is_ip) {
+        return _mm256_fmadd_ps (xv, yv, accu);
+    }
+    __m256 diff = _mm256_sub_ps (xv, yv);
+    return _mm256_fmadd_ps (diff, diff, accu);
+}
+
+/* Partial sums of the distances between x and the NY vectors y + l * d.
+ * Each block of 8 query components is loaded once for the NY vectors.
+ * There are two accumulators per vector for the latency of the FMAs:
+ * the even blocks and the last full block go to a, the odd blocks and
+ * the masked tail to b. The single-vector kernels are the NY = 1 case,
+ * so that fvec_L2sqr and fvec_L2sqr_ny return exactly the same values. */
+template <bool is_ip, int NY>
+__attribute__((target("avx2,fma")))
+static inline void accu_ny_avx2 (__m256 *sums, const float *x,
+                                 const float *y, size_t d)
+{
+    __m256 a[NY], b[NY];
+    for (int l = 0; l < NY; l++) {
+        a[l] = _mm256_setzero_ps ();
+        b[l] = _mm256_setzero_ps ();
+    }
+    size_t i = 0;
+    for (; i + 16 <= d; i += 16) {
+        __m256 x0 = _mm256_loadu_ps (x + i);
+        __m256 x1 = _mm256_loadu_ps (x + i + 8);
+        for (int l = 0; l < NY; l++) {
+            a[l] = accu_avx2<is_ip> (a[l], x0, _mm256_loadu_ps (y + l * d + i));
+            b[l] = accu_avx2<is_ip> (
+                b[l], x1, _mm256_loadu_ps (y + l * d + i + 8));
+        }
+    }
+    if (i + 8 <= d) {
+        __m256 x0 = _mm256_loadu_ps (x + i);
+        for (int l = 0; l < NY; l++) {
+            a[l] = accu_avx2<is_ip> (a[l], x0, _mm256_loadu_ps (y + l * d + i));
+        }
+        i += 8;
+    }
+    if (i < d) {
+        __m256i mask = _mm256_cmpgt_epi32 (
+            _mm256_set1_epi32 (d - i),
+            _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 x0 = _mm256_maskload_ps (x + i, mask);
+        for (int l = 0; l < NY; l++) {
+            b[l] = accu_avx2<is_ip> (
+                b[l], x0, _mm256_maskload_ps (y + l * d + i, mask));
+        }
+    }
+    for (int l = 0; l < NY; l++) {
+        sums[l] = _mm256_add_ps (a[l], b[l]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static float fvec_L2sqr_avx2 (const float *x, const float *y, size_t d)
+{
+    __m256 sum;
+    accu_ny_avx2<false, 1> (&sum, x, y, d);
+    return hsum_ps_avx2 (sum);
+}
+
+__attribute__((target("avx2,fma")))
+static float fvec_inner_product_avx2 (const float *x, const float *y, size_t d)
+{
+    __m256 sum;
+    accu_ny_avx2<true, 1> (&sum, x, y, d);
+    return hsum_ps_avx2 (sum);
+}
+
+// one query against ny contiguous vectors, 4 vectors per iteration
+template <bool is_ip>
+__attribute__((target("avx2,fma")))
+static void fvec_ny_avx2 (float *dis, const float *x,
+                          const float *y, size_t d, size_t ny)
+{
+    size_t j = 0;
+    for (; j + 4 <= ny; j += 4) {
+        __m256 sums[4];
+        accu_ny_avx2<is_ip, 4> (sums, x, y + j * d, d);
+        _mm_storeu_ps (dis + j,
+                       hsum4_ps_avx2 (sums[0], sums[1], sums[2], sums[3]));
+    }
+    for (; j < ny; j++) {
+        __m256 sum;
+        accu_ny_avx2<is_ip, 1> (&sum, x, y + j * d, d);
+        dis[j] = hsum_ps_avx2 (sum);
+    }
+}
+
+// the special cases of the generic version are faster for tiny d, and
+// return the same values
+__attribute__((target("avx2,fma")))
+static void fvec_L2sqr_ny_avx2 (float *dis, const float *x,
+                                const float *y, size_t d, size_t ny)
+{
+    if (d == 1 || d == 2 || d == 4) {
+        fvec_L2sqr_ny_generic (dis, x, y, d, ny);
+        return;
+    }
+    fvec_ny_avx2<false> (dis, x, y, d, ny);
+}
+
+__attribute__((target("avx2,fma")))
+static void fvec_inner_products_ny_avx2 (float *ip, const float *x,
+                                         const float *y, size_t d, size_t ny)
+{
+    fvec_ny_avx2<true> (ip, x, y, d, ny);
+}
+
+/* The c values are computed as a + bf * b without FMA, to get the same
+ * table as the generic version. Each lane keeps its first minimum, the
+ * lanes are merged by value then by index. */
+
+// GCC contracts the mul and add intrinsics to an FMA when the target
+// has one (eg. avx512f), so contraction is disabled explicitly
+#if defined(__GNUC__) && !defined(__clang__)
+#define MADD_NO_FP_CONTRACT __attribute__((optimize("fp-contract=off")))
+#else
+#define MADD_NO_FP_CONTRACT
+#endif
+
+__attribute__((target("avx2"))) MADD_NO_FP_CONTRACT
+static int fvec_madd_and_argmin_avx2 (size_t n, const float *a,
+                                      float bf, const float *b, float *c)
+{
+    __m256 bf8 = _mm256_set1_ps (bf);
+    __m256 vmin8 = _mm256_set1_ps (1e20);
+    __m256i imin8 = _mm256_set1_epi32 (-1);
+    __m256i idx8 = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i inc8 = _mm256_set1_epi32 (8);
+    size_t i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256 vc8 = _mm256_add_ps (
+            _mm256_loadu_ps (a + i),
+            _mm256_mul_ps (bf8, _mm256_loadu_ps (b + i)));
+        _mm256_storeu_ps (c + i, vc8);
+        __m256 mask = _mm256_cmp_ps (vc8, vmin8, _CMP_LT_OQ);
+        imin8 = _mm256_castps_si256 (_mm256_blendv_ps (
+            _mm256_castsi256_ps (imin8), _mm256_castsi256_ps (idx8), mask));
+        vmin8 = _mm256_min_ps (vmin8, vc8);
+        idx8 = _mm256_add_epi32 (idx8, inc8);
+    }
+
+    float vmin_tab[8];
+    int32_t imin_tab[8];
+    _mm256_storeu_ps (vmin_tab, vmin8);
+    _mm256_storeu_si256 ((__m256i*)imin_tab, imin8);
+    float vmin = 1e20;
+    int imin = -1;
+    for (int j = 0; j < 8; j++) {
+        if (vmin_tab[j] < vmin ||
+            (vmin_tab[j] == vmin && imin_tab[j] < imin)) {
+            vmin = vmin_tab[j];
+            imin = imin_tab[j];
+        }
+    }
+
+    for (; i < n; i++) {
+        c[i] = a[i] + bf * b[i];
+        if (c[i] < vmin) {
+            vmin = c[i];
+            imin = i;
+        }
+    }
+    return imin;
+}
+
+// the comparison results are all-ones masks, ie. -1 in int32
+template <int better_pred>
+__attribute__((target("avx2")))
+static void fvec_count_lt_and_eq_avx2 (
+        const float *vals, size_t n, float thresh,
+        size_t *n_lt, size_t *n_eq)
+{
+    __m256 t = _mm256_set1_ps (thresh);
+    __m256i lt = _mm256_setzero_si256 ();
+    __m256i eq = _mm256_setzero_si256 ();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_loadu_ps (vals + i);
+        lt = _mm256_sub_epi32 (
+            lt, _mm256_castps_si256 (_mm256_cmp_ps (v, t, better_pred)));
+        eq = _mm256_sub_epi32 (
+            eq, _mm256_castps_si256 (_mm256_cmp_ps (v, t, _CMP_EQ_OQ)));
+    }
+    uint32_t lt_tab[8], eq_tab[8];
+    _mm256_storeu_si256 ((__m256i*)lt_tab, lt);
+    _mm256_storeu_si256 ((__m256i*)eq_tab, eq);
+    size_t nl = 0, ne = 0;
+    for (int j = 0; j < 8; j++) {
+        nl += lt_tab[j];
+        ne += eq_tab[j];
+    }
+    for (; i < n; i++) {
+        nl += better_pred == _CMP_LT_OQ ? vals[i] < thresh : vals[i] > thresh;
+        ne += vals[i] == thresh;
+    }
+    *n_lt = nl;
+    *n_eq = ne;
+}
+
+__attribute__((target("avx2")))
+static void fvec_count_lt_and_eq_avx2 (
+        const float *vals, size_t n, float thresh, bool greater,
+        size_t *n_lt, size_t *n_eq)
+{
+    if (greater) {
+        fvec_count_lt_and_eq_avx2<_CMP_GT_OQ> (vals, n, thresh, n_lt, n_eq);
+    } else {
+        fvec_count_lt_and_eq_avx2<_CMP_LT_OQ> (vals, n, thresh, n_lt, n_eq);
+    }
+}
+
+AVX512_WARNINGS_OFF
+
+template <bool is_ip>
+__attribute__((target("avx512f")))
+static inline __m512 accu_avx512 (__m512 accu, __m512 xv, __m512 yv)
+{
+    if (is_ip) {
+        return _mm512_fmadd_ps (xv, yv, accu);
+    }
+    __m512 diff = _mm512_sub_ps (xv, yv);
+    return _mm512_fmadd_ps (diff, diff, accu);
+}
+
+/* same as accu_ny_avx2 with blocks of 16 components, folded to 8
+ * lanes. Below 16 components, all the AVX-512 kernels use the AVX2
+ * ones, which waste less of the registers. */
+template <bool is_ip, int NY>
+__attribute__((target("avx512f")))
+static inline void accu_ny_avx512 (__m256 *sums, const float *x,
+                                   const float *y, size_t d)
+{
+    __m512 a[NY], b[NY];
+    for (int l = 0; l < NY; l++) {
+        a[l] = _mm512_setzero_ps ();
+        b[l] = _mm512_setzero_ps ();
+    }
+    size_t i = 0;
+    for (; i + 32 <= d; i += 32) {
+        __m512 x0 = _mm512_loadu_ps (x + i);
+        __m512 x1 = _mm512_loadu_ps (x + i + 16);
+        for (int l = 0; l < NY; l++) {
+            a[l] = accu_avx512<is_ip> (
+                a[l], x0, _mm512_loadu_ps (y + l * d + i));
+            b[l] = accu_avx512<is_ip> (
+                b[l], x1, _mm512_loadu_ps (y + l * d + i + 16));
+        }
+    }
+    if (i + 16 <= d) {
+        __m512 x0 = _mm512_loadu_ps (x + i);
+        for (int l = 0; l < NY; l++) {
+            a[l] = accu_avx512<is_ip> (
+                a[l], x0, _mm512_loadu_ps (y + l * d + i));
+        }
+        i += 16;
+    }
+    if (i < d) {
+        __mmask16 mask = (1U << (d - i)) - 1;
+        __m512 x0 = _mm512_maskz_loadu_ps (mask, x + i);
+        for (int l = 0; l < NY; l++) {
+            b[l] = accu_avx512<is_ip> (
+                b[l], x0, _mm512_maskz_loadu_ps (mask, y + l * d + i));
+        }
+    }
+    for (int l = 0; l < NY; l++) {
+        __m512 sum = _mm512_add_ps (a[l], b[l]);
+        sums[l] = _mm256_add_ps (
+            _mm512_castps512_ps256 (sum),
+            _mm256_castpd_ps (_mm512_extractf64x4_pd (
+                _mm512_castps_pd (sum), 1)));
+    }
+}
+
+__attribute__((target("avx512f")))
+static float fvec_L2sqr_avx512 (const float *x, const float *y, size_t d)
+{
+    if (d < 16) {
+        return fvec_L2sqr_avx2 (x, y, d);
+    }
+    __m256 sum;
+    accu_ny_avx512<false, 1> (&sum, x, y, d);
+    return hsum_ps_avx2 (sum);
+}
+
+__attribute__((target("avx512f")))
+static float fvec_inner_product_avx512 (
+        const float *x, const float *y, size_t d)
+{
+    if (d < 16) {
+        return fvec_inner_product_avx2 (x, y, d);
+    }
+    __m256 sum;
+    accu_ny_avx512<true, 1> (&sum, x, y, d);
+    return hsum_ps_avx2 (sum);
+}
+
+// one query against ny contiguous vectors, 8 vectors per iteration
+template <bool is_ip>
+__attribute__((target("avx512f")))
+static void fvec_ny_avx512 (float *dis, const float *x,
+                            const float *y, size_t d, size_t ny)
+{
+    size_t j = 0;
+    for (; j + 8 <= ny; j += 8) {
+        __m256 sums[8];
+        accu_ny_avx512<is_ip, 8> (sums, x, y + j * d, d);
+        _mm_storeu_ps (dis + j,
+                       hsum4_ps_avx2 (sums[0], sums[1], sums[2], sums[3]));
+        _mm_storeu_ps (dis + j + 4,
+                       hsum4_ps_avx2 (sums[4], sums[5], sums[6], sums[7]));
+    }
+    for (; j < ny; j++) {
+        __m256 sum;
+        accu_ny_avx512<is_ip, 1> (&sum, x, y + j * d, d);
+        dis[j] = hsum_ps_avx2 (sum);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void fvec_L2sqr_ny_avx512 (float *dis, const float *x,
+                                  const float *y, size_t d, size_t ny)
+{
+    if (d < 16) {
+        fvec_L2sqr_ny_avx2 (dis, x, y, d, ny);
+        return;
+    }
+    fvec_ny_avx512<false> (dis, x, y, d, ny);
+}
+
+__attribute__((target("avx512f")))
+static void fvec_inner_products_ny_avx512 (
+        float *ip, const float *x, const float *y, size_t d, size_t ny)
+{
+    if (d < 16) {
+        fvec_inner_products_ny_avx2 (ip, x, y, d, ny);
+        return;
+    }
+    fvec_ny_avx512<true> (ip, x, y, d, ny);
+}
+
+__attribute__((target("avx512f"))) MADD_NO_FP_CONTRACT
+static int fvec_madd_and_argmin_avx512 (size_t n, const float *a,
+                                        float bf, const float *b, float *c)
+{
+    __m512 bf16 = _mm512_set1_ps (bf);
+    __m512 vmin16 = _mm512_set1_ps (1e20);
+    __m512i imin16 = _mm512_set1_epi32 (-1);
+    __m512i idx16 = _mm512_setr_epi32 (
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m512i inc16 = _mm512_set1_epi32 (16);
+
+    for (size_t i = 0; i < n; i += 16) {
+        __mmask16 valid = n - i >= 16 ? 0xffff : (1U << (n - i)) - 1;
+        __m512 vc16 = _mm512_add_ps (
+            _mm512_maskz_loadu_ps (valid, a + i),
+            _mm512_mul_ps (bf16, _mm512_maskz_loadu_ps (valid, b + i)));
+        _mm512_mask_storeu_ps (c + i, valid, vc16);
+        __mmask16 lt = _mm512_mask_cmp_ps_mask (
+            valid, vc16, vmin16, _CMP_LT_OQ);
+        imin16 = _mm512_mask_mov_epi32 (imin16, lt, idx16);
+        vmin16 = _mm512_mask_mov_ps (vmin16, lt, vc16);
+        idx16 = _mm512_add_epi32 (idx16, inc16);
+    }
+
+    float vmin_tab[16];
+    int32_t imin_tab[16];
+    _mm512_storeu_ps (vmin_tab, vmin16);
+    _mm512_storeu_si512 (imin_tab, imin16);
+    float vmin = 1e20;
+    int imin = -1;
+    for (int j = 0; j < 16; j++) {
+        if (vmin_tab[j] < vmin ||
+            (vmin_tab[j] == vmin && imin_tab[j] < imin)) {
+            vmin = vmin_tab[j];
+            imin = imin_tab[j];
+        }
+    }
+    return imin;
+}
+
+AVX512_WARNINGS_ON
+
+#endif
+
+
+/*********************************************************
+ * Half-precision vectors
+ *
+ * The database components are converted to float in the registers,
+ * so the kernels read 2 bytes per component. The fp16 components are
+ * converted with F16C, the bf16 ones with a 16-bit shift. The queries
+ * stay in float.
+ */
+
+static void half_decode_generic (HalfType type, const uint16_t *h,
+                                 float *x, size_t n)
+{
+    if (type == HALF_FP16) {
+        for (size_t i = 0; i < n; i++) {
+            x[i] = decode_fp16 (h[i]);
+        }
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            x[i] = decode_bf16 (h[i]);
+        }
+    }
+}
+
+template <bool is_ip, HalfType type>
+static void hvec_ny_ref (float *dis, const float *x,
+                         const uint16_t *y, size_t d, size_t ny)
+{
+    for (size_t j = 0; j < ny; j++) {
+        float accu = 0;
+        for (size_t i = 0; i < d; i++) {
+            float yi = decode_half (type, y[i]);
+            if (is_ip) {
+                accu += x[i] * yi;
+            } else {
+                accu += (x[i] - yi) * (x[i] - yi);
+            }
+        }
+        dis[j] = accu;
+        y += d;
+    }
+}
+
+static void hvec_L2sqr_ny_generic (HalfType type, float *dis, const float *x,
+                                   const uint16_t *y, size_t d, size_t ny)
+{
+    if (type == HALF_FP16) {
+        hvec_ny_ref<false, HALF_FP16> (dis, x, y, d, ny);
+    } else {
+        hvec_ny_ref<false, HALF_BF16> (dis, x, y, d, ny);
+    }
+}
+
+static void hvec_inner_products_ny_generic (
+        HalfType type, float *ip, const float *x,
+        const uint16_t *y, size_t d, size_t ny)
+{
+    if (type == HALF_FP16) {
+        hvec_ny_ref<true, HALF_FP16> (ip, x, y, d, ny);
+    } else {
+        hvec_ny_ref<true, HALF_BF16> (ip, x, y, d, ny);
+    }
+}
+
+#ifdef SIMD_X86_DISPATCH
+
+// 8 components converted to float
+template <HalfType type>
+__attribute__((target("avx2,f16c")))
+static inline __m256 half_load8 (const uint16_t *h)
+{
+    __m128i v = _mm_loadu_si128 ((const __m128i*)h);
+    if (type == HALF_FP16) {
+        return _mm256_cvtph_ps (v);
+    }
+    return _mm256_castsi256_ps (
+        _mm256_slli_epi32 (_mm256_cvtepu16_epi32 (v), 16));
+}
+
+// n < 8 components, the other lanes are 0
+template <HalfType type>
+__attribute__((target("avx2,f16c")))
+static inline __m256 half_load8_partial (const uint16_t *h, size_t n)
+{
+    uint16_t buf[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    memcpy (buf, h, n * sizeof(*h));
+    return half_load8<type> (buf);
+}
+
+template <HalfType type>
+__attribute__((target("avx2,f16c")))
+static void half_decode_avx2 (const uint16_t *h, float *x, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps (x + i, half_load8<type> (h + i));
+    }
+    if (i < n) {
+        float buf[8];
+        _mm256_storeu_ps (buf, half_load8_partial<type> (h + i, n - i));
+        memcpy (x + i, buf, (n - i) * sizeof(*x));
+    }
+}
+
+/* same accumulation scheme as accu_ny_avx2. The masked tail of x is
+ * zero, as are the padding lanes of y. */
+template <bool is_ip, HalfType type, int NY>
+__attribute__((target("avx2,fma,f16c")))
+static inline void accu_ny_half_avx2 (__m256 *sums, const float *x,
+                                      const uint16_t *y, size_t d)
+{
+    __m256 a[NY], b[NY];
+    for (int l = 0; l < NY; l++) {
+        a[l] = _mm256_setzero_ps ();
+        b[l] = _mm256_setzero_ps ();
+    }
+    size_t i = 0;
+    for (; i + 16 <= d; i += 16) {
+        __m256 x0 = _mm256_loadu_ps (x + i);
+        __m256 x1 = _mm256_loadu_ps (x + i + 8);
+        for (int l = 0; l < NY; l++) {
+            a[l] = accu_avx2<is_ip> (
+                a[l], x0, half_load8<type> (y + l * d + i));
+            b[l] = accu_avx2<is_ip> (
+                b[l], x1, half_load8<type> (y + l * d + i + 8));
+        }
+    }
+    if (i + 8 <= d) {
+        __m256 x0 = _mm256_loadu_ps (x + i);
+        for (int l = 0; l < NY; l++) {
+            a[l] = accu_avx2<is_ip> (
+                a[l], x0, half_load8<type> (y + l * d + i));
+        }
+        i += 8;
+    }
+    if (i < d) {
+        __m256i mask = _mm256_cmpgt_epi32 (
+            _mm256_set1_epi32 (d - i),
+            _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 x0 = _mm256_maskload_ps (x + i, mask);
+        for (int l = 0; l < NY; l++) {
+            b[l] = accu_avx2<is_ip> (
+                b[l], x0, half_load8_partial<type> (y + l * d + i, d - i));
+        }
+    }
+    for (int l = 0; l < NY; l++) {
+        sums[l] = _mm256_add_ps (a[l], b[l]);
+    }
+}
+
+template <bool is_ip, HalfType type>
+__attribute__((target("avx2,fma,f16c")))
+static void hvec_ny_avx2 (float *dis, const float *x,
+                          const uint16_t *y, size_t d, size_t ny)
+{
+    size_t j = 0;
+    for (; j + 4 <= ny; j += 4) {
+        __m256 sums[4];
+        accu_ny_half_avx2<is_ip, type, 4> (sums, x, y + j * d, d);
+        _mm_storeu_ps (dis + j,
+                       hsum4_ps_avx2 (sums[0], sums[1], sums[2], sums[3]));
+    }
+    for (; j < ny; j++) {
+        __m256 sum;
+        accu_ny_half_avx2<is_ip, type, 1> (&sum, x, y + j * d, d);
+        dis[j] = hsum_ps_avx2 (sum);
+    }
+}
+
+static void half_decode_avx2 (HalfType type, const uint16_t *h,
+                              float *x, size_t n)
+{
+    if (type == HALF_FP16) {
+        half_decode_avx2<HALF_FP16> (h, x, n);
+    } else {
+        half_decode_avx2<HALF_BF16> (h, x, n);
+    }
+}
+
+static void hvec_L2sqr_ny_avx2 (HalfType type, float *dis, const float *x,
+                                const uint16_t *y, size_t d, size_t ny)
+{
+    if (type == HALF_FP16) {
+        hvec_ny_avx2<false, HALF_FP16> (dis, x, y, d, ny);
+    } else {
+        hvec_ny_avx2<false, HALF_BF16> (dis, x, y, d, ny);
+    }
+}
+
+static void hvec_inner_products_ny_avx2 (
+        HalfType type, float *ip, const float *x,
+        const uint16_t *y, size_t d, size_t ny)
+{
+    if (type == HALF_FP16) {
+        hvec_ny_avx2<true, HALF_FP16> (ip, x, y, d, ny);
+    } else {
+        hvec_ny_avx2<true, HALF_BF16> (ip, x, y, d, ny);
+    }
+}
+
+/* AVX-512 versions, 16 components per load. The bf16 components are
+ * converted with a shift as well: the AVX512_BF16 dot products would
+ * need the queries rounded to bf16. */
+
+AVX512_WARNINGS_OFF
+
+template <HalfType type>
+__attribute__((target("avx512f")))
+static inline __m512 half_load16 (const uint16_t *h)
+{
+    __m256i v = _mm256_loadu_si256 ((const __m256i*)h);
+    if (type == HALF_FP16) {
+        return _mm512_cvtph_ps (v);
+    }
+    return _mm512_castsi512_ps (
+        _mm512_slli_epi32 (_mm512_cvtepu16_epi32 (v), 16));
+}
+
+template <HalfType type>
+__attribute__((target("avx512f")))
+static inline __m512 half_load16_partial (const uint16_t *h, size_t n)
+{
+    uint16_t buf[16];
+    memset (buf, 0, sizeof(buf));
+    memcpy (buf, h, n * sizeof(*h));
+    return half_load16<type> (buf);
+}
+
+template <HalfType type>
+__attribute__((target("avx512f")))
+static void half_decode_avx512 (const uint16_t *h, float *x, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        _mm512_storeu_ps (x + i, half_load16<type> (h + i));
+    }
+    if (i < n) {
+        __mmask16 mask = (1U << (n - i)) - 1;
+        _mm512_mask_storeu_ps (
+            x + i, mask, half_load16_partial<type> (h + i, n - i));
+    }
+}
+
+template <bool is_ip, HalfType type, int NY>
+__attribute__((target("avx512f")))
+static inline void accu_ny_half_avx512 (__m256 *sums, const float *x,
+                                        const uint16_t *y, size_t d)
+{
+    __m512 a[NY], b[NY];
+    for (int l = 0; l < NY; l++) {
+        a[l] = _mm512_setzero_ps ();
+        b[l] = _mm512_setzero_ps ();
+    }
+    size_t i = 0;
+    for (; i + 32 <= d; i += 32) {
+        __m512 x0 = _mm512_loadu_ps (x + i);
+        __m512 x1 = _mm512_loadu_ps (x + i + 16);
+        for (int l = 0; l < NY; l++) {
+            a[l] = accu_avx512<is_ip> (
+                a[l], x0, half_load16<type> (y + l * d + i));
+            b[l] = accu_avx512<is_ip> (
+                b[l], x1, half_load16<type> (y + l * d + i + 16));
+        }
+    }
+    if (i + 16 <= d) {
+        __m512 x0 = _mm512_loadu_ps (x + i);
+        for (int l = 0; l < NY; l++) {
+            a[l] = accu_avx512<is_ip> (
+                a[l], x0, half_load16<type> (y + l * d + i));
+        }
+        i += 16;
+    }
+    if (i < d) {
+        __mmask16 mask = (1U << (d - i)) - 1;
+        __m512 x0 = _mm512_maskz_loadu_ps (mask, x + i);
+        for (int l = 0; l < NY; l++) {
+            b[l] = accu_avx512<is_ip> (
+                b[l], x0, half_load16_partial<type> (y + l * d + i, d - i));
+        }
+    }
+    for (int l = 0; l < NY; l++) {
+        __m512 sum = _mm512_add_ps (a[l], b[l]);
+        sums[l] = _mm256_add_ps (
+            _mm512_castps512_ps256 (sum),
+            _mm256_castpd_ps (_mm512_extractf64x4_pd (
+                _mm512_castps_pd (sum), 1)));
+    }
+}
+
+template <bool is_ip, HalfType type>
+__attribute__((target("avx512f")))
+static void hvec_ny_avx512 (float *dis, const float *x,
+                            const uint16_t *y, size_t d, size_t ny)
+{
+    if (d < 16) {
+        hvec_ny_avx2<is_ip, type> (dis, x, y, d, ny);
+        return;
+    }
+    size_t j = 0;
+    for (; j + 8 <= ny; j += 8) {
+        __m256 sums[8];
+        accu_ny_half_avx512<is_ip, type, 8> (sums, x, y + j * d, d);
+        _mm_storeu_ps (dis + j,
+                       hsum4_ps_avx2 (sums[0], sums[1], sums[2], sums[3]));
+        _mm_storeu_ps (dis + j + 4,
+                       hsum4_ps_avx2 (sums[4], sums[5], sums[6], sums[7]));
+    }
+    for (; j < ny; j++) {
+        __m256 sum;
+        accu_ny_half_avx512<is_ip, type, 1> (&sum, x, y + j * d, d);
+        dis[j] = hsum_ps_avx2 (sum);
+    }
+}
+
+static void half_decode_avx512 (HalfType type, const uint16_t *h,
+                                float *x, size_t n)
+{
+    if (type == HALF_FP16) {
+        half_decode_avx512<HALF_FP16> (h, x, n);
+    } else {
+        half_decode_avx512<HALF_BF16> (h, x, n);
+    }
+}
+
+static void hvec_L2sqr_ny_avx512 (HalfType type, float *dis, const float *x,
+                                  const uint16_t *y, size_t d, size_t ny)
+{
+    if (type == HALF_FP16) {
+        hvec_ny_avx512<false, HALF_FP16> (dis, x, y, d, ny);
+    } else {
+        hvec_ny_avx512<false, HALF_BF16> (dis, x, y, d, ny);
+    }
+}
+
+static void hvec_inner_products_ny_avx512 (
+        HalfType type, float *ip, const float *x,
+        const uint16_t *y, size_t d, size_t ny)
+{
+    if (type == HALF_FP16) {
+        hvec_ny_avx512<true, HALF_FP16> (ip, x, y, d, ny);
+    } else {
+        hvec_ny_avx512<true, HALF_BF16> (ip, x, y, d, ny);
+    }
+}
+
+AVX512_WARNINGS_ON
+
+#endif
+
+
+/*********************************************************
+ * Runtime selection of the kernels
+ *
+ * The public functions call the kernels through a table of function
+ * pointers. There is one constant table per level, and the table in
+ * use is published through an atomic pointer, so that the level can
+ * be changed while other threads call the kernels. The pointer is
+ * statically initialized to the generic kernels, so that the functions
+ * can be called from the static initializers of other translation
+ * units, and upgraded when the library is loaded.
+ */
+
+namespace {
+
+struct SIMDKernels {
+    float (*fvec_L2sqr) (const float *, const float *, size_t);
+    float (*fvec_inner_product) (const float *, const float *, size_t);
+    void (*fvec_L2sqr_ny) (
+        float *, const float *, const float *, size_t, size_t);
+    void (*fvec_inner_products_ny) (
+        float *, const float *, const float *, size_t, size_t);
+    int (*fvec_madd_and_argmin) (
+        size_t, const float *, float, const float *, float *);
+    int (*i8vec_inner_product) (const int8_t *, const int8_t *, int);
+    int (*i8vec_L2sqr) (const int8_t *, const int8_t *, int);
+    void (*i8vec_inner_products_block) (
+        int32_t *, const int8_t *, const int8_t *, size_t, size_t, size_t);
+    void (*fvec_inner_products_block) (
+        float *, const float *, const float *, size_t, size_t, size_t);
+    void (*half_decode) (HalfType, const uint16_t *, float *, size_t);
+    void (*hvec_L2sqr_ny) (
+        HalfType, float *, const float *, const uint16_t *, size_t, size_t);
+    void (*hvec_inner_products_ny) (
+        HalfType, float *, const float *, const uint16_t *, size_t, size_t);
+    void (*fvec_count_lt_and_eq) (
+        const float *, size_t, float, bool, size_t *, size_t *);
+};
+
+const SIMDKernels generic_kernels = {
+    fvec_L2sqr_generic,
+    fvec_inner_product_generic,
+    fvec_L2sqr_ny_generic,
+    fvec_inner_products_ny_ref,
+    fvec_madd_and_argmin_generic,
+    i8vec_inner_product_ref,
+    i8vec_L2sqr_ref,
+    i8vec_inner_products_block_ref,
+    fvec_inner_products_block_ref,
+    half_decode_generic,
+    hvec_L2sqr_ny_generic,
+    hvec_inner_products_ny_generic,
+    fvec_count_lt_and_eq_ref
+};
+
+std::atomic<const SIMDKernels *> simd_kernels_ptr (&generic_kernels);
+
+std::atomic<SIMDLevel> simd_level (SIMD_GENERIC);
+
+inline const SIMDKernels & simd_kernels ()
+{
+    return *simd_kernels_ptr.load (std::memory_order_acquire);
+}
+
+} // namespace
+
+
+const char *simd_level_name (SIMDLevel level)
+{
+    switch (level) {
+    case SIMD_GENERIC: return "generic";
+    case SIMD_AVX2: return "avx2";
+    case SIMD_AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+SIMDLevel simd_level_supported ()
+{
+#ifdef SIMD_X86_DISPATCH
+    const X86Features & f = x86_features ();
+    if (f.avx2 && f.fma && f.f16c) {
+        return f.avx512bw ? SIMD_AVX512 : SIMD_AVX2;
+    }
+#endif
+    return SIMD_GENERIC;
+}
+
+SIMDLevel get_simd_level ()
+{
+    return simd_level;
+}
+
+namespace {
+
+// the table of a level, filled whether the CPU supports it or not
+SIMDKernels make_simd_kernels (SIMDLevel level)
+{
+    SIMDKernels k = generic_kernels;
+#ifdef SIMD_X86_DISPATCH
+    const X86Features & f = x86_features ();
+    if (level >= SIMD_AVX2) {
+        k.fvec_L2sqr = fvec_L2sqr_avx2;
+        k.fvec_inner_product = fvec_inner_product_avx2;
+        k.fvec_L2sqr_ny = fvec_L2sqr_ny_avx2;
+        k.fvec_inner_products_ny = fvec_inner_products_ny_avx2;
+        k.fvec_madd_and_argmin = fvec_madd_and_argmin_avx2;
+        k.i8vec_inner_product = i8vec_inner_product_avx2;
+        k.i8vec_L2sqr = i8vec_L2sqr_avx2;
+        k.i8vec_inner_products_block = i8vec_inner_products_block_avx2;
+        k.fvec_inner_products_block = fvec_inner_products_block_avx2;
+        k.half_decode = half_decode_avx2;
+        k.hvec_L2sqr_ny = hvec_L2sqr_ny_avx2;
+        k.hvec_inner_products_ny = hvec_inner_products_ny_avx2;
+        k.fvec_count_lt_and_eq = fvec_count_lt_and_eq_avx2;
+#ifdef I8VEC_HAVE_AVXVNNI
+        if (f.avxvnni) {
+            k.i8vec_inner_product = i8vec_inner_product_avxvnni;
+            k.i8vec_inner_products_block = i8vec_inner_products_block_avxvnni;
+        }
+#endif
+    }
+    if (level >= SIMD_AVX512) {
+        k.fvec_L2sqr = fvec_L2sqr_avx512;
+        k.fvec_inner_product = fvec_inner_product_avx512;
+        k.fvec_L2sqr_ny = fvec_L2sqr_ny_avx512;
+        k.fvec_inner_products_ny = fvec_inner_products_ny_avx512;
+        k.fvec_madd_and_argmin = fvec_madd_and_argmin_avx512;
+        k.i8vec_L2sqr = i8vec_L2sqr_avx512;
+        k.fvec_inner_products_block = fvec_inner_products_block_avx512;
+        k.half_decode = half_decode_avx512;
+        k.hvec_L2sqr_ny = hvec_L2sqr_ny_avx512;
+        k.hvec_inner_products_ny = hvec_inner_products_ny_avx512;
+        if (f.avx512vnni) {
+            k.i8vec_inner_product = i8vec_inner_product_avx512vnni;
+            k.i8vec_inner_products_block =
+                i8vec_inner_products_block_avx512vnni;
+        }
+    }
+#endif
+    return k;
+}
+
+} // namespace
+
+void set_simd_level (SIMDLevel level)
+{
+    FAISS_THROW_IF_NOT_FMT (
+        level >= SIMD_GENERIC && level <= simd_level_supported (),
+        "SIMD level %s not supported on this machine",
+        simd_level_name (level));
+
+    static const SIMDKernels tables[] = {
+        make_simd_kernels (SIMD_GENERIC),
+        make_simd_kernels (SIMD_AVX2),
+        make_simd_kernels (SIMD_AVX512)
+    };
+    simd_kernels_ptr.store (&tables[level], std::memory_order_release);
+    simd_level.store (level);
+}
+
+namespace {
+
+// the supported level, or the one of FAISS_SIMD_LEVEL if it is lower
+SIMDLevel initial_simd_level ()
+{
+    SIMDLevel supported = simd_level_supported ();
+    const char *env = getenv ("FAISS_SIMD_LEVEL");
+    if (!env) {
+        return supported;
+    }
+    for (int l = SIMD_GENERIC; l <= SIMD_AVX512; l++) {
+        if (!strcmp (env, simd_level_name (SIMDLevel (l)))) {
+            return std::min (SIMDLevel (l), supported);
+        }
+    }
+    fprintf (stderr, "WARN: unknown FAISS_SIMD_LEVEL=%s, using %s\n",
+             env, simd_level_name (supported));
+    return supported;
+}
+
+struct SIMDLevelInit {
+    SIMDLevelInit () {
+        set_simd_level (initial_simd_level ());
+    }
+};
+
+SIMDLevelInit simd_level_init;
+
+} // namespace
+
+
+float fvec_L2sqr (const float * x, const float * y, size_t d)
+{
+    return simd_kernels ().fvec_L2sqr (x, y, d);
+}
+
+float fvec_inner_product (const float * x, const float * y, size_t d)
+{
+    return simd_kernels ().fvec_inner_product (x, y, d);
+}
+
+void fvec_L2sqr_ny (float * dis, const float * x,
+                    const float * y, size_t d, size_t ny)
+{
+    simd_kernels ().fvec_L2sqr_ny (dis, x, y, d, ny);
+}
+
+void fvec_inner_products_ny (float * ip, const float * x,
+                             const float * y, size_t d, size_t ny)
+{
+    simd_kernels ().fvec_inner_products_ny (ip, x, y, d, ny);
+}
+
+int fvec_madd_and_argmin (size_t n, const float *a,
+                          float bf, const float *b, float *c)
+{
+    return simd_kernels ().fvec_madd_and_argmin (n, a, bf, b, c);
+}
+
+void fvec_count_lt_and_eq (const float *vals, size_t n, float thresh,
+                           bool greater, size_t *n_lt, size_t *n_eq)
+{
+    simd_kernels ().fvec_count_lt_and_eq (vals, n, thresh, greater, n_lt, n_eq);
+}
+
+int i8vec_inner_product (const int8_t* a, const int8_t* b, int dim)
+{
+    return simd_kernels ().i8vec_inner_product (a, b, dim);
+}
+
+int i8vec_L2sqr (const int8_t* a, const int8_t* b, int dim)
+{
+    return simd_kernels ().i8vec_L2sqr (a, b, dim);
+}
+
+void i8vec_inner_products_block (
+        int32_t *ip, const int8_t *x, const int8_t *y,
+        size_t d, size_t nx, size_t ny)
+{
+    simd_kernels ().i8vec_inner_products_block (ip, x, y, d, nx, ny);
+}
+
+void fvec_inner_products_block (
+        float *ip, const float *x, const float *y,
+        size_t d, size_t nx, size_t ny)
+{
+    simd_kernels ().fvec_inner_products_block (ip, x, y, d, nx, ny);
+}
+
+void half_encode (HalfType type, const float *x, uint16_t *h, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        h[i] = encode_half (type, x[i]);
+    }
+}
+
+void half_decode (HalfType type, const uint16_t *h, float *x, size_t n)
+{
+    simd_kernels ().half_decode (type, h, x, n);
+}
+
+void hvec_L2sqr_ny (HalfType type, float *dis, const float *x,
+                    const uint16_t *y, size_t d, size_t ny)
+{
+    simd_kernels ().hvec_L2sqr_ny (type, dis, x, y, d, ny);
+}
+
+void hvec_inner_products_ny (HalfType type, float *ip, const float *x,
+                             const uint16_t *y, size_t d, size_t ny)
+{
+    simd_kernels ().hvec_inner_products_ny (type, ip, x, y, d, ny);
+}
 
 
 } // namespace faiss
@@ -0,0 +1,174 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/*
+ * 16-bit floating-point formats for the storage of vectors:
+ *
+ * - fp16: IEEE half precision, 5 bits of exponent and 10 of mantissa
+ * - bf16: bfloat16, the 16 most significant bits of a float, ie. the
+ *   range of a float with 7 bits of mantissa
+ *
+ * The vectors are searched in float: the components are converted in
+ * the distance kernels, see distances.h.
+ */
+
+#ifndef FAISS_half_h
+#define FAISS_half_h
+
+#include <stdint.h>
+#include <cstring>
+#include <algorithm>
+
+
+namespace faiss {
+
+
+enum HalfType {
+    HALF_FP16 = 0,
+    HALF_BF16 = 1,
+};
+
+
+/*******************************************************************
+ * scalar conversions
+ *******************************************************************/
+
+inline float half_floatbits (uint32_t x) {
+    float f;
+    memcpy (&f, &x, sizeof(f));
+    return f;
+}
+
+inline uint32_t half_intbits (float f) {
+    uint32_t x;
+    memcpy (&x, &f, sizeof(x));
+    return x;
+}
+
+// non-intrinsic FP16 <-> FP32 code adapted from
+// https://github.com/ispc/ispc/blob/master/stdlib.ispc
+
+inline uint16_t encode_fp16 (float f) {
+
+    // via Fabian "ryg" Giesen.
+    // https://gist.github.com/2156668
+    uint32_t sign_mask = 0x80000000u;
+    int32_t o;
+
+    uint32_t fint = half_intbits(f);
+    uint32_t sign = fint & sign_mask;
+    fint ^= sign;
+
+    // NOTE all the integer compares in this function can be safely
+    // compiled into signed compares since all operands are below
+    // 0x80000000. Important if you want fast straight SSE2 code (since
+    // there's no unsigned PCMPGTD).
+
+    // Inf or NaN (all exponent bits set)
+    // NaN->qNaN and Inf->Inf
+    // unconditional assignment here, will override with right value for
+    // the regular case below.
+    uint32_t f32infty = 255u << 23;
+    o = (fint > f32infty) ? 0x7e00u : 0x7c00u;
+
+    // (De)normalized number or zero
+    // update fint unconditionally to save the blending; we don't need it
+    // anymore for the Inf/NaN case anyway.
+
+    const uint32_t round_mask = ~0xfffu;
+    const uint32_t magic = 15u << 23;
+
+    // Shift exponent down, denormalize if necessary.
+    // NOTE This represents half-float denormals using single
+    // precision denormals.  The main reason to do this is that
+    // there's no shift with per-lane variable shifts in SSE*, which
+    // we'd otherwise need. It has some funky side effects though:
+    // - This conversion will actually respect the FTZ (Flush To Zero)
+    //   flag in MXCSR - if it's set, no half-float denormals will be
+    //   generated. I'm honestly not sure whether this is good or
+    //   bad. It's definitely interesting.
+    // - If the underlying HW doesn't support denormals (not an issue
+    //   with Intel CPUs, but might be a problem on GPUs or PS3 SPUs),
+    //   you will always get flush-to-zero behavior. This is bad,
+    //   unless you're on a CPU where you don't care.
+    // - Denormals tend to be slow. FP32 denormals are rare in
+    //   practice outside of things like recursive filters in DSP -
+    //   not a typical half-float application. Whether FP16 denormals
+    //   are rare in practice, I don't know. Whatever slow path your
+    //   HW may or may not have for denormals, this may well hit it.
+    float fscale = half_floatbits(fint & round_mask) * half_floatbits(magic);
+    fscale = std::min(fscale, half_floatbits((31u << 23) - 0x1000u));
+    int32_t fint2 = half_intbits(fscale) - round_mask;
+
+    if (fint < f32infty)
+        o = fint2 >> 13; // Take the bits!
+
+    return (o | (sign >> 16));
+}
+
+inline float decode_fp16 (uint16_t h) {
+
+    // https://gist.github.com/2144712
+    // Fabian "ryg" Giesen.
+
+    const uint32_t shifted_exp = 0x7c00u << 13; // exponent mask after shift
+
+    int32_t o = ((int32_t)(h & 0x7fffu)) << 13;     // exponent/mantissa bits
+    int32_t exp = shifted_exp & o;   // just the exponent
+    o += (int32_t)(127 - 15) << 23;        // exponent adjust
+
+    int32_t infnan_val = o + ((int32_t)(128 - 16) << 23);
+    int32_t zerodenorm_val = half_intbits(
+                 half_floatbits(o + (1u<<23)) - half_floatbits(113u << 23));
+    int32_t reg_val = (exp == 0) ? zerodenorm_val : o;
+
+    int32_t sign_bit = ((int32_t)(h & 0x8000u)) << 16;
+    return half_floatbits(
+                 ((exp == shifted_exp) ? infnan_val : reg_val) | sign_bit);
+}
+
+/// round to nearest even, the NaNs stay quiet NaNs
+inline uint16_t encode_bf16 (float f) {
+    uint32_t x = half_intbits (f);
+    if ((x & 0x7fffffffu) > 0x7f800000u) {
+        return (x >> 16) | 0x40;
+    }
+    x += 0x7fff + ((x >> 16) & 1);
+    return x >> 16;
+}
+
+inline float decode_bf16 (uint16_t h) {
+    return half_floatbits (uint32_t(h) << 16);
+}
+
+inline uint16_t encode_half (HalfType type, float f) {
+    return type == HALF_FP16 ? encode_fp16 (f) : encode_bf16 (f);
+}
+
+inline float decode_half (HalfType type, uint16_t h) {
+    return type == HALF_FP16 ? decode_fp16 (h) : decode_bf16 (h);
+}
+
+
+/*******************************************************************
+ * vector conversions
+ *******************************************************************/
+
+/// convert n floats to half precision
+void half_encode (HalfType type, const float *x, uint16_t *h, size_t n);
+
+/// convert n half-precision values to float. Runtime-dispatched, see
+/// SIMDLevel
+void half_decode (HalfType type, const uint16_t *h, float *x, size_t n);
+
+
+} // namespace faiss
+
+
+#endif
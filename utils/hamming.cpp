@@ -32,6 +32,8 @@
 #include <math.h>
 
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/partitioning.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/utils.h>
 #include <faiss/impl/AuxIndexStructures.h>
@@ -276,26 +278,27 @@ void hammings_knn_hc (
     size_t k = ha->k;
     if (init_heap) ha->heapify ();
 
+    HeapBlockCollector<CMax<hamdis_t, int64_t> > coll (
+        ha, distance_compute_min_k_reservoir);
+    // bound the memory used by the reservoirs
+    size_t bs_q = coll.use_reservoir ?
+        std::max (size_t(64), size_t(1 << 20) / k) : ha->nh;
+
     const size_t block_size = hamming_batch_size;
-    for (size_t j0 = 0; j0 < n2; j0 += block_size) {
-      const size_t j1 = std::min(j0 + block_size, n2);
+    for (size_t i0 = 0; i0 < ha->nh; i0 += bs_q) {
+      const size_t i1 = std::min(i0 + bs_q, ha->nh);
+      coll.begin (i0, i1);
+      for (size_t j0 = 0; j0 < n2; j0 += block_size) {
+        const size_t j1 = std::min(j0 + block_size, n2);
 #pragma omp parallel for
-      for (size_t i = 0; i < ha->nh; i++) {
-        HammingComputer hc (bs1 + i * bytes_per_code, bytes_per_code);
-
-        const uint8_t * bs2_ = bs2 + j0 * bytes_per_code;
-        hamdis_t dis;
-        hamdis_t * __restrict bh_val_ = ha->val + i * k;
-        int64_t * __restrict bh_ids_ = ha->ids + i * k;
-        size_t j;
-        for (j = j0; j < j1; j++, bs2_+= bytes_per_code) {
-          dis = hc.hamming (bs2_);
-          if (dis < bh_val_[0]) {
-            faiss::maxheap_pop<hamdis_t> (k, bh_val_, bh_ids_);
-            faiss::maxheap_push<hamdis_t> (k, bh_val_, bh_ids_, dis, j);
-          }
+        for (size_t i = i0; i < i1; i++) {
+          HammingComputer hc (bs1 + i * bytes_per_code, bytes_per_code);
+          coll.add_range (i, j0, j1, [&] (size_t j) {
+            return hc.hamming (bs2 + j * bytes_per_code);
+          });
         }
       }
+      coll.end ();
     }
     if (order) ha->reorder ();
  }
@@ -378,6 +381,8 @@ void hammings_knn_hc_1 (
         ha->heapify ();
     }
 
+    bool use_reservoir = k >= distance_compute_min_k_reservoir;
+
 #pragma omp parallel for
     for (size_t i = 0; i < ha->nh; i++) {
         const uint64_t bs1_ = bs1 [i];
@@ -387,6 +392,15 @@ void hammings_knn_hc_1 (
         hamdis_t bh_val_0 = bh_val_[0];
         int64_t * bh_ids_ = ha->ids + i * k;
         size_t j;
+        if (use_reservoir) {
+            HeapBlockCollector<CMax<hamdis_t, int64_t> > coll (ha, k);
+            coll.begin (i, i + 1);
+            coll.add_range (i, 0, n2, [&] (size_t j) {
+                return popcount64 (bs1_ ^ bs2[j * nwords]);
+            });
+            coll.end ();
+            continue;
+        }
         for (j = 0; j < n2; j++, bs2_+= nwords) {
             dis = popcount64 (bs1_ ^ *bs2_);
             if (dis < bh_val_0) {
@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/hugepages.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+#include <faiss/impl/FaissAssert.h>
+
+
+namespace faiss {
+
+HugePageMode hugepage_mode = HUGEPAGES_NONE;
+
+size_t hugepage_min_bytes = 8 << 20;
+
+HugePageStats hugepage_stats;
+
+void HugePageStats::reset ()
+{
+    memset (this, 0, sizeof (*this));
+}
+
+
+namespace {
+
+const size_t size_2M = size_t(1) << 21;
+const size_t size_1G = size_t(1) << 30;
+
+// protects the stats and the mappings
+std::mutex hugepage_mutex;
+
+// mappings returned by hugepage_alloc -> their length
+std::unordered_map<void *, size_t> hugepage_mappings;
+
+size_t round_up (size_t x, size_t align)
+{
+    return (x + align - 1) / align * align;
+}
+
+/// anonymous mapping from the hugetlbfs pool, nullptr if the pool is
+/// empty or not supported
+void *map_hugetlb (size_t len, int log2_page_size)
+{
+#ifdef MAP_HUGETLB
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+    flags |= log2_page_size << MAP_HUGE_SHIFT;
+#endif
+    void *p = mmap (nullptr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+    return p == MAP_FAILED ? nullptr : p;
+#else
+    return nullptr;
+#endif
+}
+
+/// anonymous mapping aligned on 2MB, so that it can be fully backed
+/// by transparent huge pages
+void *map_aligned (size_t len)
+{
+    size_t total = len + size_2M;
+    void *p = mmap (nullptr, total, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    uint8_t *base = (uint8_t*)p;
+    uint8_t *aligned = (uint8_t*)round_up ((uintptr_t)base, size_2M);
+    // give back the unaligned head and the tail
+    if (aligned > base) {
+        munmap (base, aligned - base);
+    }
+    size_t tail = (base + total) - (aligned + len);
+    if (tail > 0) {
+        munmap (aligned + len, tail);
+    }
+    return aligned;
+}
+
+}  // namespace
+
+
+size_t hugepage_advise (void *ptr, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+    uintptr_t begin = round_up ((uintptr_t)ptr, size_2M);
+    uintptr_t end = ((uintptr_t)ptr + size) / size_2M * size_2M;
+    if (end <= begin) {
+        return 0;
+    }
+    if (madvise ((void*)begin, end - begin, MADV_HUGEPAGE) != 0) {
+        // THP disabled in the kernel
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock (hugepage_mutex);
+    hugepage_stats.nb_advised += end - begin;
+    return end - begin;
+#else
+    return 0;
+#endif
+}
+
+
+void hugepage_advise_mapping (void *ptr, size_t size, int fd)
+{
+    if (hugepage_mode == HUGEPAGES_NONE || size == 0) {
+        return;
+    }
+#ifdef __linux__
+    const long hugetlbfs_magic = 0x958458f6;
+    struct statfs buf;
+    if (fstatfs (fd, &buf) == 0 && buf.f_type == hugetlbfs_magic) {
+        std::lock_guard<std::mutex> lock (hugepage_mutex);
+        hugepage_stats.nb_hugetlb += size;
+        return;
+    }
+#endif
+    // only effective for the file systems that support huge pages
+    // in the page cache (eg. tmpfs mounted with huge=advise)
+    hugepage_advise (ptr, size);
+}
+
+
+void *hugepage_alloc (size_t size, HugePageMode mode)
+{
+    size = std::max (size, size_t(1));
+    void *p = nullptr;
+    size_t len = 0;
+
+    if (mode == HUGEPAGES_1GB) {
+        len = round_up (size, size_1G);
+        p = map_hugetlb (len, 30);
+    }
+    if (!p && mode >= HUGEPAGES_2MB) {
+        len = round_up (size, size_2M);
+        p = map_hugetlb (len, 21);
+    }
+    bool hugetlb = p != nullptr;
+
+    if (!p) {
+        if (mode == HUGEPAGES_NONE) {
+            len = round_up (size, sysconf (_SC_PAGESIZE));
+            p = mmap (nullptr, len, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            p = p == MAP_FAILED ? nullptr : p;
+        } else {
+            len = round_up (size, size_2M);
+            p = map_aligned (len);
+        }
+        FAISS_THROW_IF_NOT_FMT (p, "could not allocate %zd bytes: %s",
+                                size, strerror (errno));
+        if (mode != HUGEPAGES_NONE) {
+            hugepage_advise (p, len);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock (hugepage_mutex);
+    if (hugetlb) {
+        hugepage_stats.nb_hugetlb += len;
+    } else if (mode >= HUGEPAGES_2MB) {
+        hugepage_stats.nb_fallback += len;
+    }
+    hugepage_mappings[p] = len;
+    return p;
+}
+
+
+void hugepage_free (void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    size_t len;
+    {
+        std::lock_guard<std::mutex> lock (hugepage_mutex);
+        auto it = hugepage_mappings.find (ptr);
+        FAISS_THROW_IF_NOT_MSG (it != hugepage_mappings.end(),
+                                "pointer not allocated by hugepage_alloc");
+        len = it->second;
+        hugepage_mappings.erase (it);
+    }
+    munmap (ptr, len);
+}
+
+
+size_t get_hugepage_resident_bytes ()
+{
+    FILE *f = fopen ("/proc/self/smaps_rollup", "r");
+    if (!f) {
+        return 0;
+    }
+    const char *fields[] = {
+        "AnonHugePages:", "ShmemPmdMapped:", "FilePmdMapped:",
+        "Shared_Hugetlb:", "Private_Hugetlb:"
+    };
+    size_t total_kb = 0;
+    char line[256];
+    while (fgets (line, sizeof(line), f)) {
+        for (const char *field : fields) {
+            size_t l = strlen (field);
+            if (strncmp (line, field, l) == 0) {
+                total_kb += strtoull (line + l, nullptr, 10);
+            }
+        }
+    }
+    fclose (f);
+    return total_kb * 1024;
+}
+
+
+} // namespace faiss
@@ -0,0 +1,118 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/*
+ * Huge page backing of the large arrays of the indexes (database
+ * vectors, codes, inverted lists), to reduce the TLB misses when
+ * scanning them.
+ *
+ * The arrays stored in std::vector (IndexFlat::xb, IndexPQ::codes,
+ * ArrayInvertedLists, ...) can only use transparent huge pages: their
+ * buffer is advised with madvise(MADV_HUGEPAGE) when it is allocated,
+ * see hugepage_reserve. The memory allocated with hugepage_alloc (the
+ * slabs of ChunkArena) can also come from the hugetlbfs pool.
+ *
+ * Huge pages are a best-effort optimization: when they are not
+ * available, the normal pages are used.
+ */
+
+#ifndef FAISS_hugepages_h
+#define FAISS_hugepages_h
+
+#include <cstddef>
+#include <algorithm>
+#include <vector>
+
+
+namespace faiss {
+
+
+enum HugePageMode {
+    HUGEPAGES_NONE = 0,  ///< normal pages
+    HUGEPAGES_THP = 1,   ///< transparent huge pages, madvise(MADV_HUGEPAGE)
+    HUGEPAGES_2MB = 2,   ///< hugetlbfs 2MB pages, THP if not available
+    HUGEPAGES_1GB = 3,   ///< hugetlbfs 1GB pages, then 2MB, then THP
+};
+
+/// huge pages used for the large arrays (default HUGEPAGES_NONE)
+extern HugePageMode hugepage_mode;
+
+/// arrays smaller than this (in bytes) stay on normal pages
+extern size_t hugepage_min_bytes;
+
+
+/// cumulative statistics of the huge page allocations
+struct HugePageStats {
+    size_t nb_advised;   ///< bytes advised as transparent huge pages
+    size_t nb_hugetlb;   ///< bytes allocated or mapped from hugetlbfs
+    size_t nb_fallback;  ///< bytes for which the requested hugetlbfs
+                         ///< pages were not available
+
+    HugePageStats () {reset (); }
+    void reset ();
+};
+
+/// global var that collects them all
+extern HugePageStats hugepage_stats;
+
+/** @return the bytes of the process that currently are on huge pages,
+ * transparent or hugetlbfs, as reported by /proc/self/smaps_rollup
+ * (0 if not available). The kernel decides whether the advised
+ * memory actually gets huge pages, this is the number to check. */
+size_t get_hugepage_resident_bytes ();
+
+
+/** advise the 2MB-aligned pages within [ptr, ptr + size) to be
+ * backed by transparent huge pages. Pages that are already touched
+ * are collapsed asynchronously by the kernel.
+ *
+ * @return nb of bytes advised
+ */
+size_t hugepage_advise (void *ptr, size_t size);
+
+/** advise a mapping of the file fd, as done by the IO_FLAG_MMAP read
+ * path. A file on hugetlbfs is already mapped on huge pages. */
+void hugepage_advise_mapping (void *ptr, size_t size, int fd);
+
+/** allocate size bytes on the huge pages of the given mode, falling
+ * back to the next smaller kind of pages when they are not
+ * available. The memory is 2MB-aligned (except for HUGEPAGES_NONE)
+ * and must be freed with hugepage_free. */
+void *hugepage_alloc (size_t size, HugePageMode mode = hugepage_mode);
+
+/// free memory allocated with hugepage_alloc
+void hugepage_free (void *ptr);
+
+
+/** make sure that v can grow to n elements without reallocating. If
+ * hugepage_mode is set and the array is large enough, the buffer is
+ * reallocated and advised before the existing elements are copied
+ * into it. Otherwise this is a no-op, and v grows as usual.
+ */
+template <class T>
+void hugepage_reserve (std::vector<T> & v, size_t n)
+{
+    if (hugepage_mode == HUGEPAGES_NONE || n <= v.capacity() ||
+        n * sizeof(T) < hugepage_min_bytes) {
+        return;
+    }
+    // same amortized growth as std::vector
+    size_t capacity = std::max (n, 2 * v.capacity());
+    std::vector<T> v2;
+    v2.reserve (capacity);
+    hugepage_advise (v2.data(), capacity * sizeof(T));
+    v2.insert (v2.end(), v.begin(), v.end());
+    v.swap (v2);
+}
+
+
+} // namespace faiss
+
+
+#endif
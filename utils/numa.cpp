@@ -0,0 +1,219 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/numa.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <omp.h>
+
+#include <faiss/utils/ThreadPool.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+
+namespace faiss {
+
+namespace {
+
+/// parse a list in the kernel format, eg. "0-3,8-11,15"
+std::vector<int> parse_list (const char *s)
+{
+    std::vector<int> res;
+    while (*s) {
+        char *end;
+        long a = strtol (s, &end, 10);
+        if (end == s) {
+            break;
+        }
+        long b = a;
+        s = end;
+        if (*s == '-') {
+            b = strtol (s + 1, &end, 10);
+            s = end;
+        }
+        for (long i = a; i <= b; i++) {
+            res.push_back (i);
+        }
+        if (*s != ',') {
+            break;
+        }
+        s++;
+    }
+    return res;
+}
+
+/// @return false if the file cannot be read
+bool read_list (const char *fname, std::vector<int> & res)
+{
+    FILE *f = fopen (fname, "r");
+    if (!f) {
+        return false;
+    }
+    char buf[4096];
+    bool ok = fgets (buf, sizeof (buf), f) != nullptr;
+    fclose (f);
+    res = ok ? parse_list (buf) : std::vector<int>();
+    return ok;
+}
+
+/// CPUs the process may run on (all the online ones if unknown)
+std::vector<int> allowed_cpus ()
+{
+    std::vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    if (sched_getaffinity (0, sizeof (set), &set) == 0) {
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET (i, &set)) {
+                cpus.push_back (i);
+            }
+        }
+        return cpus;
+    }
+#endif
+    for (int i = 0; i < omp_get_num_procs(); i++) {
+        cpus.push_back (i);
+    }
+    return cpus;
+}
+
+bool has_node_info (int node, std::vector<int> & node_cpus)
+{
+    char fname[256];
+    snprintf (fname, sizeof (fname),
+              "/sys/devices/system/node/node%d/cpulist", node);
+    return read_list (fname, node_cpus);
+}
+
+}  // namespace
+
+
+std::vector<int> numa_get_nodes ()
+{
+    std::vector<int> online, nodes;
+    if (!read_list ("/sys/devices/system/node/online", online)) {
+        return {0};
+    }
+    for (int node : online) {
+        if (!numa_node_cpus (node).empty()) {
+            nodes.push_back (node);
+        }
+    }
+    if (nodes.empty()) {
+        nodes.push_back (0);
+    }
+    return nodes;
+}
+
+
+std::vector<int> numa_node_cpus (int node)
+{
+    std::vector<int> allowed = allowed_cpus ();
+    std::vector<int> node_cpus;
+    if (!has_node_info (node, node_cpus)) {
+        // no topology: a single node with all the CPUs
+        return node == 0 ? allowed : std::vector<int>();
+    }
+    std::vector<int> res;
+    for (int cpu : node_cpus) {
+        if (std::binary_search (allowed.begin(), allowed.end(), cpu)) {
+            res.push_back (cpu);
+        }
+    }
+    return res;
+}
+
+
+int numa_current_node ()
+{
+#ifdef __linux__
+    int cpu = sched_getcpu ();
+    if (cpu < 0) {
+        return -1;
+    }
+    std::vector<int> online, node_cpus;
+    if (!read_list ("/sys/devices/system/node/online", online)) {
+        return 0;
+    }
+    for (int node : online) {
+        if (has_node_info (node, node_cpus) &&
+            std::find (node_cpus.begin(), node_cpus.end(), cpu) !=
+            node_cpus.end()) {
+            return node;
+        }
+    }
+#endif
+    return -1;
+}
+
+
+bool numa_bind_thread (int node)
+{
+#ifdef __linux__
+    std::vector<int> cpus = numa_node_cpus (node);
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO (&set);
+    for (int cpu : cpus) {
+        CPU_SET (cpu, &set);
+    }
+    if (sched_setaffinity (0, sizeof (set), &set) != 0) {
+        return false;
+    }
+    // its parallel work must not go to the pool workers
+    set_thread_bound (true);
+#ifdef SYS_set_mempolicy
+    // MPOL_PREFERRED from linux/mempolicy.h: allocate on the node
+    // while it has free memory, elsewhere otherwise. Fails harmlessly
+    // on kernels without NUMA support.
+    const int mpol_preferred = 1;
+    const int nbits = 8 * sizeof (unsigned long);
+    std::vector<unsigned long> mask (node / nbits + 1);
+    mask[node / nbits] = 1UL << (node % nbits);
+    syscall (SYS_set_mempolicy, mpol_preferred, mask.data(),
+             (unsigned long)(mask.size() * nbits + 1));
+#endif
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+bool numa_bind_thread_and_team (int node)
+{
+    if (!numa_bind_thread (node)) {
+        return false;
+    }
+    int nt = numa_node_cpus (node).size();
+    omp_set_num_threads (nt);
+
+    // the threads of a team started before the binding do not inherit
+    // it, bind them explicitly
+    bool ok = true;
+#pragma omp parallel reduction(&&: ok)
+    {
+        ok = numa_bind_thread (node);
+    }
+    return ok;
+}
+
+
+} // namespace faiss
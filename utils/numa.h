@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/*
+ * Minimal NUMA support, used to place the shards of an IndexShards on
+ * the nodes of a multi-socket machine.
+ *
+ * The topology is read from /sys/devices/system/node and the binding
+ * is done with the sched_setaffinity and set_mempolicy system calls,
+ * so there is no dependency on libnuma. On machines (or kernels)
+ * without NUMA information, everything behaves as a single node that
+ * holds all the CPUs of the process.
+ */
+
+#ifndef FAISS_numa_h
+#define FAISS_numa_h
+
+#include <vector>
+
+
+namespace faiss {
+
+
+/// ids of the NUMA nodes that have CPUs usable by the process,
+/// {0} if the topology is not available
+std::vector<int> numa_get_nodes ();
+
+/// CPUs of a node that the process is allowed to run on
+std::vector<int> numa_node_cpus (int node);
+
+/// node of the CPU the calling thread runs on, -1 if unknown
+int numa_current_node ();
+
+/** restrict the calling thread to the CPUs of a node, and make its
+ * memory allocations go preferably to that node. Threads created
+ * afterwards by this thread inherit both settings. The library thread
+ * pool is not used by the thread anymore (see set_thread_bound).
+ *
+ * @return false if the binding is not supported
+ */
+bool numa_bind_thread (int node);
+
+/** bind the calling thread as numa_bind_thread, set the size of the
+ * OpenMP teams it starts to the nb of CPUs of the node, and bind the
+ * threads of its team as well. */
+bool numa_bind_thread_and_team (int node);
+
+
+} // namespace faiss
+
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/partitioning.h>
+
+#include <algorithm>
+
+#include <faiss/utils/distances.h>
+
+
+namespace faiss {
+
+namespace {
+
+/*********************************************************
+ * Counting, the inner loop of the partitioning
+ *********************************************************/
+
+// nb of values strictly better than thresh (n_lt) and equal (n_eq)
+template <class C>
+void count_lt_and_eq (const typename C::T *vals, size_t n,
+                      typename C::T thresh, size_t & n_lt, size_t & n_eq)
+{
+    n_lt = n_eq = 0;
+    for (size_t i = 0; i < n; i++) {
+        typename C::T v = vals[i];
+        n_lt += C::cmp (thresh, v);
+        n_eq += v == thresh;
+    }
+}
+
+// the float kernels follow the runtime SIMD level
+template <>
+void count_lt_and_eq<CMax<float, int64_t> > (
+        const float *vals, size_t n, float thresh,
+        size_t & n_lt, size_t & n_eq)
+{
+    fvec_count_lt_and_eq (vals, n, thresh, false, &n_lt, &n_eq);
+}
+
+template <>
+void count_lt_and_eq<CMin<float, int64_t> > (
+        const float *vals, size_t n, float thresh,
+        size_t & n_lt, size_t & n_eq)
+{
+    fvec_count_lt_and_eq (vals, n, thresh, true, &n_lt, &n_eq);
+}
+
+
+/*********************************************************
+ * Threshold selection
+ *********************************************************/
+
+template <typename T>
+T median3 (T a, T b, T c)
+{
+    if (a > b) std::swap (a, b);
+    if (b > c) std::swap (b, c);
+    return a > b ? a : b;
+}
+
+/* sample a threshold strictly between thresh_inf (the better bound) and
+ * thresh_sup. Returns false if there is no such value in the table. */
+template <class C>
+bool sample_threshold_median3 (
+        const typename C::T *vals, size_t n,
+        typename C::T thresh_inf, typename C::T thresh_sup,
+        typename C::T & thresh)
+{
+    typedef typename C::T T;
+    T found[3];
+    int nfound = 0;
+
+    auto in_range = [&] (T v) {
+        return C::cmp (v, thresh_inf) && C::cmp (thresh_sup, v);
+    };
+
+    // a few pseudo-random samples, then a linear scan if needed
+    uint64_t s = 1234;
+    for (int it = 0; it < 64 && nfound < 3; it++) {
+        s = s * 6364136223846793005ULL + 1442695040888963407ULL;
+        T v = vals[(s >> 33) % n];
+        if (in_range (v)) {
+            found[nfound++] = v;
+        }
+    }
+    for (size_t i = 0; i < n && nfound == 0; i++) {
+        if (in_range (vals[i])) {
+            found[nfound++] = vals[i];
+        }
+    }
+
+    if (nfound == 0) {
+        return false;
+    }
+    thresh = nfound == 3 ? median3 (found[0], found[1], found[2]) : found[0];
+    return true;
+}
+
+} // anonymous namespace
+
+
+template <class C>
+typename C::T partition_fuzzy (
+        typename C::T *vals, typename C::TI *ids, size_t n,
+        size_t q_min, size_t q_max, size_t *q_out)
+{
+    typedef typename C::T T;
+
+    if (q_min == 0) {
+        if (q_out) *q_out = 0;
+        return C::Crev::neutral ();
+    }
+    if (q_max >= n) {
+        T worst = C::Crev::neutral ();
+        for (size_t i = 0; i < n; i++) {
+            if (C::cmp (vals[i], worst)) worst = vals[i];
+        }
+        if (q_out) *q_out = n;
+        return worst;
+    }
+
+    // bisection on the threshold, with thresh_inf too strict and
+    // thresh_sup too loose. The nb of values strictly between the
+    // bounds decreases at each iteration, so the loop terminates
+    T thresh_inf = C::Crev::neutral ();
+    T thresh_sup = C::neutral ();
+    T thresh = thresh_sup;
+    size_t n_lt = 0, n_eq = 0;
+    bool found = false;
+
+    for (;;) {
+        if (!sample_threshold_median3<C> (
+                 vals, n, thresh_inf, thresh_sup, thresh)) {
+            break;
+        }
+        count_lt_and_eq<C> (vals, n, thresh, n_lt, n_eq);
+
+        if (n_lt <= q_max && n_lt + n_eq >= q_min) {
+            found = true;
+            break;
+        } else if (n_lt + n_eq < q_min) {
+            thresh_inf = thresh;
+        } else {
+            thresh_sup = thresh;
+        }
+    }
+
+    if (!found) {
+        // no values strictly between the bounds, so one of them is
+        // attained. This happens with values beyond the neutral ones.
+        thresh = thresh_sup;
+        count_lt_and_eq<C> (vals, n, thresh, n_lt, n_eq);
+        if (n_lt > q_max) {
+            thresh = thresh_inf;
+            count_lt_and_eq<C> (vals, n, thresh, n_lt, n_eq);
+        }
+    }
+
+    // keep the values strictly better than thresh, then as many ties as
+    // needed to reach q_min. The cap on q_max only applies when there
+    // are more than q_max values beyond the neutral value, which are
+    // all equal
+    size_t n_eq_keep = q_min > n_lt ? std::min (n_eq, q_min - n_lt) : 0;
+    size_t wp = 0;
+    for (size_t i = 0; i < n; i++) {
+        T v = vals[i];
+        bool keep = C::cmp (thresh, v);
+        if (!keep && v == thresh && n_eq_keep > 0) {
+            keep = true;
+            n_eq_keep--;
+        }
+        if (keep && wp < q_max) {
+            vals[wp] = v;
+            ids[wp] = ids[i];
+            wp++;
+        }
+    }
+
+    if (q_out) *q_out = wp;
+    return thresh;
+}
+
+
+template float partition_fuzzy<CMax<float, int64_t> > (
+        float *vals, int64_t *ids, size_t n,
+        size_t q_min, size_t q_max, size_t *q_out);
+
+template float partition_fuzzy<CMin<float, int64_t> > (
+        float *vals, int64_t *ids, size_t n,
+        size_t q_min, size_t q_max, size_t *q_out);
+
+template int partition_fuzzy<CMax<int, int64_t> > (
+        int *vals, int64_t *ids, size_t n,
+        size_t q_min, size_t q_max, size_t *q_out);
+
+template int partition_fuzzy<CMin<int, int64_t> > (
+        int *vals, int64_t *ids, size_t n,
+        size_t q_min, size_t q_max, size_t *q_out);
+
+
+} // namespace faiss
@@ -0,0 +1,182 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+/*
+ * Selection of the k best results out of many candidates without a
+ * heap. For large k, updating a heap for each candidate is the
+ * bottleneck of the searches. Here the candidates above a running
+ * threshold are appended to a reservoir, and the reservoir is
+ * partitioned when it is full, which costs O(capacity) every
+ * capacity - k additions.
+ */
+
+#ifndef FAISS_partitioning_h
+#define FAISS_partitioning_h
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+#include <faiss/utils/Heap.h>
+
+
+namespace faiss {
+
+
+/** Partition the table so that the q best values (w.r.t. C, ie. the
+ * ones that would stay in a C heap) are in vals[0:q], for some q in
+ * [q_min, q_max]. The elements in vals[q:n] are destroyed.
+ *
+ * @param vals   values to partition, size n
+ * @param ids    corresponding ids, size n
+ * @param q_out  nb of elements kept
+ * @return       partition threshold: the worst value in vals[0:q]
+ */
+template <class C>
+typename C::T partition_fuzzy (
+        typename C::T *vals, typename C::TI *ids, size_t n,
+        size_t q_min, size_t q_max, size_t *q_out);
+
+
+/** Keeps the n best results of a stream of candidates in a buffer of
+ * size capacity > n. The memory is not owned. */
+template <class C>
+struct ReservoirTopN {
+    typedef typename C::T T;
+    typedef typename C::TI TI;
+
+    T *vals;
+    TI *ids;
+
+    size_t i;         ///< nb of stored elements
+    size_t n;         ///< nb of requested results
+    size_t capacity;  ///< size of the buffers
+
+    /// candidates that are not better than this are dropped
+    T threshold;
+
+    ReservoirTopN (size_t n, size_t capacity, T *vals, TI *ids):
+        vals (vals), ids (ids), i (0), n (n), capacity (capacity),
+        threshold (C::neutral ())
+    {}
+
+    /// @return whether the candidate was kept
+    bool add (T val, TI id) {
+        if (C::cmp (threshold, val)) {
+            if (i == capacity) {
+                shrink_fuzzy ();
+            }
+            vals[i] = val;
+            ids[i] = id;
+            i++;
+            return true;
+        }
+        return false;
+    }
+
+    /// keep between n and (n + capacity) / 2 elements
+    void shrink_fuzzy () {
+        threshold = partition_fuzzy<C> (
+            vals, ids, capacity, n, (capacity + n) / 2, &i);
+    }
+
+    /// store the n best results as a C heap of size n
+    void to_heap (T *heap_dis, TI *heap_ids) {
+        if (i > n) {
+            threshold = partition_fuzzy<C> (vals, ids, i, n, n, &i);
+        }
+        heap_heapify<C> (n, heap_dis, heap_ids, vals, ids, i);
+    }
+};
+
+
+/** Collects the results of a block of queries [i0, i1) in the heaps of
+ * a HeapArray. For k < min_k_reservoir, the heaps are updated for each
+ * candidate. Otherwise the candidates go through reservoirs that start
+ * from the current heap contents and are stored back by end().
+ *
+ * add_range can be called concurrently for different queries. */
+template <class C>
+struct HeapBlockCollector {
+    typedef typename C::T T;
+    typedef typename C::TI TI;
+
+    HeapArray<C> *res;
+    size_t k;
+    bool use_reservoir;
+
+    size_t i0;
+    std::vector<T> rvals;
+    std::vector<TI> rids;
+    std::vector<ReservoirTopN<C> > reservoirs;
+
+    HeapBlockCollector (HeapArray<C> *res, size_t min_k_reservoir):
+        res (res), k (res->k), use_reservoir (res->k >= min_k_reservoir),
+        i0 (0)
+    {}
+
+    void begin (size_t i0, size_t i1) {
+        this->i0 = i0;
+        if (!use_reservoir) return;
+        size_t capacity = 2 * k;
+        rvals.resize ((i1 - i0) * capacity);
+        rids.resize ((i1 - i0) * capacity);
+        reservoirs.clear ();
+        for (size_t i = i0; i < i1; i++) {
+            reservoirs.emplace_back (
+                k, capacity,
+                rvals.data() + (i - i0) * capacity,
+                rids.data() + (i - i0) * capacity);
+            const T *simi = res->get_val (i);
+            const TI *idxi = res->get_ids (i);
+            for (size_t l = 0; l < k; l++) {
+                reservoirs.back().add (simi[l], idxi[l]);
+            }
+        }
+    }
+
+    /// candidates j0:j1 of query i, with distances dis_fn (j)
+    template <class DisFn>
+    void add_range (size_t i, size_t j0, size_t j1, DisFn dis_fn) {
+        if (k == 0) {
+            // the heap has no top to compare with
+            return;
+        }
+        if (use_reservoir) {
+            ReservoirTopN<C> & r = reservoirs[i - i0];
+            for (size_t j = j0; j < j1; j++) {
+                r.add (dis_fn (j), j);
+            }
+        } else {
+            T * __restrict simi = res->get_val (i);
+            TI * __restrict idxi = res->get_ids (i);
+            for (size_t j = j0; j < j1; j++) {
+                T dis = dis_fn (j);
+                if (C::cmp (simi[0], dis)) {
+                    heap_pop<C> (k, simi, idxi);
+                    heap_push<C> (k, simi, idxi, dis, j);
+                }
+            }
+        }
+    }
+
+    void end () {
+        for (size_t l = 0; l < reservoirs.size(); l++) {
+            reservoirs[l].to_heap (
+                res->get_val (i0 + l), res->get_ids (i0 + l));
+        }
+        reservoirs.clear ();
+    }
+};
+
+
+} // namespace faiss
+
+
+#endif